@@ -88,6 +88,28 @@ bool AsyncFetch::Write(const StringPiece& sp, MessageHandler* handler) {
   return ret;
 }
 
+bool AsyncFetch::WriteShared(const SharedString& storage,
+                             const StringPiece& content,
+                             MessageHandler* handler) {
+  bool ret = true;
+  if (!content.empty()) {
+    if (!headers_complete_) {
+      HeadersComplete();
+    }
+    if (request_headers()->method() == RequestHeaders::kHead) {
+      return ret;
+    }
+    ret = HandleWriteShared(storage, content, handler);
+  }
+  return ret;
+}
+
+bool AsyncFetch::HandleWriteShared(const SharedString& storage,
+                                   const StringPiece& content,
+                                   MessageHandler* handler) {
+  return HandleWrite(content, handler);
+}
+
 bool AsyncFetch::Flush(MessageHandler* handler) {
   if (!headers_complete_) {
     HeadersComplete();
@@ -30,11 +30,14 @@
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/base/trace_span_ring.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/util/gzip_inflater.h"
 #include "pagespeed/opt/logging/request_timing_info.h"
 
 namespace net_instaweb {
@@ -65,6 +68,8 @@ const char HTTPCache::kCacheDeletes[] = "cache_deletes";
 // This used for doing prefix match for etag in fetcher code.
 const char HTTPCache::kEtagPrefix[] = "W/\"PSA-";
 
+const char HTTPCache::kGzipVariantFragmentSuffix[] = ".gz";
+
 HTTPCache::HTTPCache(CacheInterface* cache, Timer* timer, Hasher* hasher,
                      Statistics* stats)
     : cache_(cache),
@@ -131,6 +136,10 @@ class HTTPCacheCallback : public CacheInterface::Callback {
         cache_level_(0) {
     start_us_ = http_cache_->timer()->NowUs();
     start_ms_ = start_us_ / 1000;
+    if (callback_->request_context().get() != NULL) {
+      callback_->request_context()->StartTraceSpan(
+          "http_cache", "HTTPCache::Find", &span_);
+    }
   }
 
   virtual bool ValidateCandidate(const GoogleString& key,
@@ -254,6 +263,7 @@ class HTTPCacheCallback : public CacheInterface::Callback {
   }
 
   virtual void Done(CacheInterface::KeyState backend_state) {
+    span_.End();
     callback_->Done(result_);
     delete this;
   }
@@ -269,6 +279,7 @@ class HTTPCacheCallback : public CacheInterface::Callback {
   int64 start_us_;
   int64 start_ms_;
   int cache_level_;
+  ScopedTraceSpan span_;
 
   DISALLOW_COPY_AND_ASSIGN(HTTPCacheCallback);
 };
@@ -457,6 +468,47 @@ void HTTPCache::Put(const GoogleString& key, const GoogleString& fragment,
   }
 }
 
+bool HTTPCache::PutGzipVariant(
+    const GoogleString& key, const GoogleString& fragment,
+    RequestHeaders::Properties req_properties,
+    ResponseHeaders::VaryOption respect_vary_on_resources,
+    const ResponseHeaders& headers, const StringPiece& content,
+    MessageHandler* handler) {
+  GoogleString compressed;
+  StringWriter writer(&compressed);
+  if (content.empty() || headers.Has(HttpAttributes::kContentEncoding) ||
+      !GzipInflater::Deflate(content, GzipInflater::kGzip,
+                             kGzipVariantCompressionLevel, &writer) ||
+      (compressed.size() >= content.size())) {
+    // Store the response as is, so that the next client that accepts gzip
+    // is served it from the variant, rather than missing and compressing it
+    // all over again.
+    ResponseHeaders plain_headers(headers);
+    Put(key, GzipVariantFragment(fragment), req_properties,
+        respect_vary_on_resources, &plain_headers, content, handler);
+    return false;
+  }
+
+  ResponseHeaders gzip_headers(headers);
+  gzip_headers.Add(HttpAttributes::kContentEncoding, HttpAttributes::kGzip);
+  if (!gzip_headers.HasValue(HttpAttributes::kVary,
+                             HttpAttributes::kAcceptEncoding)) {
+    gzip_headers.Add(HttpAttributes::kVary, HttpAttributes::kAcceptEncoding);
+  }
+  // The Etag, if any, identifies the uncompressed representation.  Let Put
+  // compute a fresh one from the compressed bytes.
+  gzip_headers.RemoveAll(HttpAttributes::kEtag);
+  gzip_headers.RemoveAll(HttpAttributes::kContentLength);
+  gzip_headers.ComputeCaching();
+  Put(key, GzipVariantFragment(fragment), req_properties,
+      respect_vary_on_resources, &gzip_headers, compressed, handler);
+  return true;
+}
+
+GoogleString HTTPCache::GzipVariantFragment(StringPiece fragment) {
+  return StrCat(fragment, kGzipVariantFragmentSuffix);
+}
+
 bool HTTPCache::IsCacheableContentLength(ResponseHeaders* headers) const {
   int64 content_length;
   bool content_length_found = headers->FindContentLength(&content_length);
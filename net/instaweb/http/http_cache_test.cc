@@ -32,6 +32,7 @@
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/cache/lru_cache.h"
@@ -39,6 +40,7 @@
 #include "pagespeed/kernel/http/content_type.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/util/gzip_inflater.h"
 #include "pagespeed/kernel/util/platform.h"
 #include "pagespeed/kernel/util/simple_stats.h"
 #include "pagespeed/opt/logging/request_timing_info.h"
@@ -754,6 +756,76 @@ TEST_F(HTTPCacheTest, UpdateVersion) {
             Find(kUrl, kFragment, &value, &meta_data_out, &message_handler_));
 }
 
+TEST_F(HTTPCacheTest, GzipVariant) {
+  GoogleString css;
+  for (int i = 0; i < 50; ++i) {
+    StrAppend(&css, ".a", IntegerToString(i), " { color: red; }\n");
+  }
+  ResponseHeaders meta_data_in, meta_data_out;
+  InitHeaders(&meta_data_in, "max-age=300");
+  meta_data_in.Replace(HttpAttributes::kContentType,
+                       kContentTypeCss.mime_type());
+  meta_data_in.ComputeCaching();
+  ASSERT_TRUE(http_cache_->PutGzipVariant(
+      kUrl, kFragment, RequestHeaders::Properties(),
+      ResponseHeaders::kRespectVaryOnResources, meta_data_in, css,
+      &message_handler_));
+
+  // The variant lives under its own fragment, leaving the plain entry alone.
+  HTTPValue value;
+  EXPECT_EQ(kNotFoundResult,
+            Find(kUrl, kFragment, &value, &meta_data_out, &message_handler_));
+  EXPECT_EQ(kFoundResult,
+            Find(kUrl, HTTPCache::GzipVariantFragment(kFragment), &value,
+                 &meta_data_out, &message_handler_));
+  EXPECT_TRUE(meta_data_out.HasValue(HttpAttributes::kContentEncoding,
+                                     HttpAttributes::kGzip));
+  EXPECT_TRUE(meta_data_out.HasValue(HttpAttributes::kVary,
+                                     HttpAttributes::kAcceptEncoding));
+  StringPiece contents;
+  ASSERT_TRUE(value.ExtractContents(&contents));
+  EXPECT_GT(css.size(), contents.size());
+  GoogleString inflated;
+  StringWriter writer(&inflated);
+  ASSERT_TRUE(GzipInflater::Inflate(contents, GzipInflater::kGzip, &writer));
+  EXPECT_EQ(css, inflated);
+}
+
+TEST_F(HTTPCacheTest, GzipVariantSkipped) {
+  ResponseHeaders meta_data_in, meta_data_out;
+  InitHeaders(&meta_data_in, "max-age=300");
+
+  // Too small to benefit from compression, so the variant is stored as is,
+  // and a gzip-accepting fetch won't try to compress it again.
+  EXPECT_FALSE(http_cache_->PutGzipVariant(
+      kUrl, kFragment, RequestHeaders::Properties(),
+      ResponseHeaders::kRespectVaryOnResources, meta_data_in, "x",
+      &message_handler_));
+  HTTPValue value;
+  EXPECT_EQ(kFoundResult,
+            Find(kUrl, HTTPCache::GzipVariantFragment(kFragment), &value,
+                 &meta_data_out, &message_handler_));
+  EXPECT_FALSE(meta_data_out.Has(HttpAttributes::kContentEncoding));
+  StringPiece contents;
+  ASSERT_TRUE(value.ExtractContents(&contents));
+  EXPECT_EQ("x", contents);
+
+  // Already encoded.
+  GoogleString big(1000, 'a');
+  meta_data_in.Add(HttpAttributes::kContentEncoding, HttpAttributes::kGzip);
+  EXPECT_FALSE(http_cache_->PutGzipVariant(
+      kUrl, kFragment, RequestHeaders::Properties(),
+      ResponseHeaders::kRespectVaryOnResources, meta_data_in, big,
+      &message_handler_));
+  value.Clear();
+  EXPECT_EQ(kFoundResult,
+            Find(kUrl, HTTPCache::GzipVariantFragment(kFragment), &value,
+                 &meta_data_out, &message_handler_));
+  ASSERT_TRUE(value.ExtractContents(&contents));
+  EXPECT_EQ(big, contents);
+  EXPECT_EQ(2, GetStat(HTTPCache::kCacheInserts));
+}
+
 class HTTPCacheWriteThroughTest : public HTTPCacheTest {
  protected:
   // Unlike HTTPCacheTest::Callback this can produce different validity for
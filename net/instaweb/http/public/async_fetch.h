@@ -36,6 +36,7 @@ namespace net_instaweb {
 
 class AbstractLogRecord;
 class MessageHandler;
+class SharedString;
 class Variable;
 
 // Abstract base class for encapsulating streaming, asynchronous HTTP fetches.
@@ -76,6 +77,13 @@ class AsyncFetch : public Writer {
   virtual bool Write(const StringPiece& content, MessageHandler* handler);
   virtual bool Flush(MessageHandler* handler);
 
+  // Like Write, but for content that points into 'storage', e.g. the body of
+  // an HTTPValue read from cache.  Fetches that can hold a reference to the
+  // storage instead of copying the bytes override HandleWriteShared; all
+  // others see an ordinary HandleWrite.
+  bool WriteShared(const SharedString& storage, const StringPiece& content,
+                   MessageHandler* handler);
+
   // Is the cache entry corresponding to headers valid? Default is that it is
   // valid. Sub-classes can provide specific implementations, e.g., based on
   // cache invalidation timestamp in domain specific options.
@@ -160,6 +168,13 @@ class AsyncFetch : public Writer {
   virtual void HandleDone(bool success) = 0;
   virtual void HandleHeadersComplete() = 0;
 
+  // Defaults to HandleWrite(content, handler).  Note that SharedAsyncFetch
+  // does not forward this to its base fetch by default, since its subclasses
+  // may transform the content in HandleWrite.
+  virtual bool HandleWriteShared(const SharedString& storage,
+                                 const StringPiece& content,
+                                 MessageHandler* handler);
+
  private:
   RequestHeaders* request_headers_;
   ResponseHeaders* response_headers_;
@@ -300,6 +315,15 @@ class SharedAsyncFetch : public AsyncFetch {
   // Propagates any set_content_length from this to the base fetch.
   void PropagateContentLength();
 
+  // Passes a shared write on to the base fetch.  Subclasses that don't
+  // transform content in HandleWrite can call this from HandleWriteShared,
+  // so the base fetch can hold on to the storage rather than copy it.
+  bool ForwardWriteShared(const SharedString& storage,
+                          const StringPiece& content,
+                          MessageHandler* handler) {
+    return base_fetch_->WriteShared(storage, content, handler);
+  }
+
  private:
   AsyncFetch* base_fetch_;
   DISALLOW_COPY_AND_ASSIGN(SharedAsyncFetch);
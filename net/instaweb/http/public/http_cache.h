@@ -64,6 +64,20 @@ class HTTPCache {
   // Function to format etags.
   static GoogleString FormatEtag(StringPiece hash);
 
+  // The gzip-compressed variant of a response is stored under the same key as
+  // the response itself, but with this suffix added to the fragment.  Since
+  // it contains a '.', which is not allowed in configured cache fragments, it
+  // cannot collide with them.
+  static const char kGzipVariantFragmentSuffix[];
+
+  // zlib compression level used for gzip variants.  They are compressed once
+  // and served many times, so it pays to compress as hard as possible.
+  static const int kGzipVariantCompressionLevel = 9;
+
+  // Returns the fragment under which to Find or Put the gzip variant of
+  // responses whose plain form is stored with fragment.
+  static GoogleString GzipVariantFragment(StringPiece fragment);
+
   // Does not take ownership of any inputs.
   HTTPCache(CacheInterface* cache, Timer* timer, Hasher* hasher,
             Statistics* stats);
@@ -264,6 +278,19 @@ class HTTPCache {
            ResponseHeaders* headers,
            const StringPiece& content, MessageHandler* handler);
 
+  // Compresses content with gzip and stores it, with headers adjusted to
+  // Content-Encoding:gzip and Vary:Accept-Encoding, as the gzip variant of
+  // key (see GzipVariantFragment).  If the response is already encoded, or
+  // does not shrink when compressed, it is stored as the variant unchanged,
+  // so that clients accepting gzip find it there without compressing it
+  // again.  Returns whether a compressed variant was stored.
+  bool PutGzipVariant(const GoogleString& key,
+                      const GoogleString& fragment,
+                      RequestHeaders::Properties req_properties,
+                      ResponseHeaders::VaryOption respect_vary_on_resources,
+                      const ResponseHeaders& headers,
+                      const StringPiece& content, MessageHandler* handler);
+
   // Deletes an element in the cache.
   void Delete(const GoogleString& key, const GoogleString& fragment);
 
@@ -1487,6 +1487,7 @@
       ],
       'sources': [
         'config/rewrite_options_manager.cc',
+        'rewriter/beacon_accumulator.cc',
         'rewriter/beacon_critical_images_finder.cc',
         'rewriter/beacon_critical_line_info_finder.cc',
         'rewriter/cache_html_info_finder.cc',
@@ -1749,6 +1750,7 @@
         'rewriter/critical_images_beacon_filter.cc',
         'rewriter/critical_selector_filter.cc',
         'rewriter/critical_selector_finder.cc',
+        'rewriter/critical_selector_matcher.cc',
         'rewriter/css_inline_filter.cc',
         'rewriter/css_move_to_head_filter.cc',
         'rewriter/css_outline_filter.cc',
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/instaweb/rewriter/public/beacon_accumulator.h"
+
+#include <utility>
+
+#include "base/logging.h"
+#include "net/instaweb/rewriter/rendered_image.pb.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+
+namespace net_instaweb {
+
+struct BeaconAccumulator::PendingPage {
+  PendingPage() {}
+  ~PendingPage() { STLDeleteElements(&beacons); }
+
+  BeaconVector beacons;
+  RequestContextPtr request_context;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PendingPage);
+};
+
+BeaconAccumulator::Beacon::Beacon() : arrival_ms(0) {
+}
+
+BeaconAccumulator::Beacon::~Beacon() {
+}
+
+BeaconAccumulator::PageKey::PageKey(
+    StringPiece url_in, StringPiece options_hash_in,
+    UserAgentMatcher::DeviceType device_type_in)
+    : url(url_in.data(), url_in.size()),
+      options_hash(options_hash_in.data(), options_hash_in.size()),
+      device_type(device_type_in) {
+}
+
+bool BeaconAccumulator::PageKey::operator<(const PageKey& that) const {
+  if (device_type != that.device_type) {
+    return device_type < that.device_type;
+  }
+  int cmp = url.compare(that.url);
+  if (cmp != 0) {
+    return cmp < 0;
+  }
+  return options_hash < that.options_hash;
+}
+
+BeaconAccumulator::BatchWriter::~BatchWriter() {
+}
+
+BeaconAccumulator::BeaconAccumulator(
+    int64 flush_interval_ms, int max_beacons_per_page, int max_pages,
+    Scheduler* scheduler, QueuedWorkerPool* workers, BatchWriter* writer)
+    : flush_interval_ms_(flush_interval_ms),
+      max_beacons_per_page_(max_beacons_per_page),
+      max_pages_(max_pages),
+      scheduler_(scheduler),
+      workers_(workers),
+      sequence_(workers->NewSequence()),
+      writer_(writer),
+      mutex_(scheduler->thread_system()->NewMutex()),
+      flush_done_(mutex_->NewCondvar()),
+      num_pending_beacons_(0),
+      flush_scheduled_(false),
+      num_outstanding_flushes_(0),
+      alarm_(NULL) {
+  scheduler_->RegisterWorker(sequence_);
+}
+
+BeaconAccumulator::~BeaconAccumulator() {
+  // If the alarm is cancelled, FlushAlarmCancelled accounts for the flush.
+  // The scheduler drops its mutex before running an alarm, so CancelAlarm
+  // fails if FlushAlarm is about to run.  In that case the flush stays
+  // outstanding until SequenceFlush or SequenceFlushCancelled has run, and we
+  // wait for it below rather than let it touch us after we are deleted.
+  {
+    ScopedMutex lock(scheduler_->mutex());
+    if (alarm_ != NULL) {
+      scheduler_->CancelAlarm(alarm_);
+      alarm_ = NULL;
+    }
+  }
+  sequence_->CancelPendingFunctions();
+  {
+    ScopedMutex lock(mutex_.get());
+    while (num_outstanding_flushes_ > 0) {
+      flush_done_->Wait();
+    }
+  }
+  scheduler_->UnregisterWorker(sequence_);
+  workers_->FreeSequence(sequence_);
+  STLDeleteValues(&pages_);
+}
+
+void BeaconAccumulator::Add(const PageKey& page,
+                            const RequestContextPtr& request_context,
+                            Beacon* beacon) {
+  BeaconVector to_write;
+  RequestContextPtr write_context;
+  {
+    ScopedMutex lock(mutex_.get());
+    PageMap::iterator iter = pages_.find(page);
+    if (iter == pages_.end() &&
+        static_cast<int>(pages_.size()) < max_pages_) {
+      iter = pages_.insert(std::make_pair(page, new PendingPage)).first;
+    }
+    if (iter == pages_.end()) {
+      // We are already holding as many pages as we are allowed to, so write
+      // this one through.
+      to_write.push_back(beacon);
+      write_context = request_context;
+    } else {
+      PendingPage* pending = iter->second;
+      pending->beacons.push_back(beacon);
+      pending->request_context = request_context;
+      ++num_pending_beacons_;
+      if (static_cast<int>(pending->beacons.size()) >= max_beacons_per_page_) {
+        to_write.swap(pending->beacons);
+        write_context = pending->request_context;
+        num_pending_beacons_ -= to_write.size();
+        delete pending;
+        pages_.erase(iter);
+      } else {
+        ScheduleFlushIfNeeded();
+      }
+    }
+  }
+  if (!to_write.empty()) {
+    writer_->WriteBeacons(page, write_context, &to_write);
+  }
+}
+
+void BeaconAccumulator::Flush() {
+  PageMap pages;
+  {
+    ScopedMutex lock(mutex_.get());
+    pages.swap(pages_);
+    num_pending_beacons_ = 0;
+  }
+  for (PageMap::iterator p = pages.begin(), e = pages.end(); p != e; ++p) {
+    PendingPage* pending = p->second;
+    writer_->WriteBeacons(p->first, pending->request_context,
+                          &pending->beacons);
+    pending->beacons.clear();
+    delete pending;
+  }
+}
+
+int BeaconAccumulator::num_pending_pages() const {
+  ScopedMutex lock(mutex_.get());
+  return pages_.size();
+}
+
+int BeaconAccumulator::num_pending_beacons() const {
+  ScopedMutex lock(mutex_.get());
+  return num_pending_beacons_;
+}
+
+void BeaconAccumulator::FlushAlarm() {
+  {
+    ScopedMutex lock(scheduler_->mutex());
+    alarm_ = NULL;
+  }
+  sequence_->Add(MakeFunction(this, &BeaconAccumulator::SequenceFlush,
+                              &BeaconAccumulator::SequenceFlushCancelled));
+}
+
+void BeaconAccumulator::FlushAlarmCancelled() {
+  {
+    ScopedMutex lock(scheduler_->mutex());
+    alarm_ = NULL;
+  }
+  SequenceFlushCancelled();
+}
+
+void BeaconAccumulator::SequenceFlush() {
+  {
+    ScopedMutex lock(mutex_.get());
+    flush_scheduled_ = false;
+  }
+  Flush();
+  ScopedMutex lock(mutex_.get());
+  --num_outstanding_flushes_;
+  flush_done_->Signal();
+}
+
+void BeaconAccumulator::SequenceFlushCancelled() {
+  ScopedMutex lock(mutex_.get());
+  flush_scheduled_ = false;
+  --num_outstanding_flushes_;
+  flush_done_->Signal();
+}
+
+void BeaconAccumulator::ScheduleFlushIfNeeded() {
+  if (!flush_scheduled_) {
+    flush_scheduled_ = true;
+    ++num_outstanding_flushes_;
+    int64 wakeup_time_us =
+        scheduler_->timer()->NowUs() + flush_interval_ms_ * Timer::kMsUs;
+    ScopedMutex lock(scheduler_->mutex());
+    alarm_ = scheduler_->AddAlarmAtUsMutexHeld(
+        wakeup_time_us,
+        MakeFunction(this, &BeaconAccumulator::FlushAlarm,
+                     &BeaconAccumulator::FlushAlarmCancelled));
+  }
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/instaweb/rewriter/public/beacon_accumulator.h"
+
+#include "net/instaweb/http/public/request_context.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/mock_timer.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/http/user_agent_matcher.h"
+#include "pagespeed/kernel/thread/mock_scheduler.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int64 kIntervalMs = 1000;
+const int kMaxBeaconsPerPage = 3;
+const int kMaxPages = 2;
+
+// Records each batch as "url:nonce,nonce,..." and deletes the beacons.
+class RecordingWriter : public BeaconAccumulator::BatchWriter {
+ public:
+  explicit RecordingWriter(StringVector* batches) : batches_(batches) {}
+  virtual ~RecordingWriter() {}
+
+  virtual void WriteBeacons(const BeaconAccumulator::PageKey& page,
+                            const RequestContextPtr& request_context,
+                            BeaconAccumulator::BeaconVector* beacons) {
+    EXPECT_TRUE(request_context.get() != NULL);
+    GoogleString batch = StrCat(page.url, ":");
+    for (int i = 0, n = beacons->size(); i < n; ++i) {
+      StrAppend(&batch, (i == 0) ? "" : ",", (*beacons)[i]->nonce);
+    }
+    batches_->push_back(batch);
+    STLDeleteElements(beacons);
+  }
+
+ private:
+  StringVector* batches_;
+  DISALLOW_COPY_AND_ASSIGN(RecordingWriter);
+};
+
+class BeaconAccumulatorTest : public testing::Test {
+ protected:
+  BeaconAccumulatorTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        timer_(thread_system_->NewMutex(), MockTimer::kApr_5_2010_ms),
+        scheduler_(thread_system_.get(), &timer_),
+        workers_(1, "beacon_accumulator_test", thread_system_.get()),
+        accumulator_(new BeaconAccumulator(
+            kIntervalMs, kMaxBeaconsPerPage, kMaxPages, &scheduler_,
+            &workers_, new RecordingWriter(&batches_))) {
+  }
+
+  // Timed flushes run in a worker, so wait for them after advancing time.
+  void AdvanceTimeMs(int64 delta_ms) {
+    scheduler_.AdvanceTimeMs(delta_ms);
+    scheduler_.AwaitQuiescence();
+  }
+
+  void Add(StringPiece url, StringPiece nonce) {
+    BeaconAccumulator::Beacon* beacon = new BeaconAccumulator::Beacon;
+    beacon->arrival_ms = timer_.NowMs();
+    nonce.CopyToString(&beacon->nonce);
+    accumulator_->Add(
+        BeaconAccumulator::PageKey(url, "hash", UserAgentMatcher::kDesktop),
+        RequestContext::NewTestRequestContext(thread_system_.get()), beacon);
+  }
+
+  GoogleString Batches() {
+    GoogleString batches = JoinCollection(batches_, " ");
+    batches_.clear();
+    return batches;
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  MockTimer timer_;
+  MockScheduler scheduler_;
+  QueuedWorkerPool workers_;
+  StringVector batches_;
+  scoped_ptr<BeaconAccumulator> accumulator_;
+};
+
+TEST_F(BeaconAccumulatorTest, FlushesOnInterval) {
+  Add("a", "1");
+  Add("b", "2");
+  AdvanceTimeMs(kIntervalMs / 2);
+  Add("a", "3");
+  EXPECT_EQ("", Batches());
+  EXPECT_EQ(2, accumulator_->num_pending_pages());
+  EXPECT_EQ(3, accumulator_->num_pending_beacons());
+
+  AdvanceTimeMs(kIntervalMs / 2);
+  EXPECT_EQ("a:1,3 b:2", Batches());
+  EXPECT_EQ(0, accumulator_->num_pending_pages());
+  EXPECT_EQ(0, accumulator_->num_pending_beacons());
+
+  // The next beacon starts a new interval.
+  Add("a", "4");
+  AdvanceTimeMs(kIntervalMs - 1);
+  EXPECT_EQ("", Batches());
+  AdvanceTimeMs(1);
+  EXPECT_EQ("a:4", Batches());
+}
+
+TEST_F(BeaconAccumulatorTest, FlushesPageAtMaxBeacons) {
+  Add("a", "1");
+  Add("b", "2");
+  Add("a", "3");
+  Add("a", "4");
+  EXPECT_EQ("a:1,3,4", Batches());
+  EXPECT_EQ(1, accumulator_->num_pending_pages());
+  AdvanceTimeMs(kIntervalMs);
+  EXPECT_EQ("b:2", Batches());
+}
+
+TEST_F(BeaconAccumulatorTest, WritesThroughBeyondMaxPages) {
+  Add("a", "1");
+  Add("b", "2");
+  Add("c", "3");
+  EXPECT_EQ("c:3", Batches());
+  Add("c", "4");
+  EXPECT_EQ("c:4", Batches());
+  EXPECT_EQ(2, accumulator_->num_pending_pages());
+  AdvanceTimeMs(kIntervalMs);
+  EXPECT_EQ("a:1 b:2", Batches());
+}
+
+TEST_F(BeaconAccumulatorTest, ExplicitFlush) {
+  Add("a", "1");
+  accumulator_->Flush();
+  EXPECT_EQ("a:1", Batches());
+  AdvanceTimeMs(kIntervalMs);
+  EXPECT_EQ("", Batches());
+}
+
+TEST_F(BeaconAccumulatorTest, DeleteDropsPendingBeacons) {
+  Add("a", "1");
+  accumulator_.reset(NULL);
+  AdvanceTimeMs(kIntervalMs);
+  EXPECT_EQ("", Batches());
+}
+
+TEST_F(BeaconAccumulatorTest, DeleteWaitsForTimedFlush) {
+  Add("a", "1");
+  // Fire the alarm but don't wait for the flush it queues: the destructor
+  // must either cancel it or wait for it to finish writing.
+  scheduler_.AdvanceTimeMs(kIntervalMs);
+  accumulator_.reset(NULL);
+  GoogleString batches = Batches();
+  EXPECT_TRUE(batches.empty() || (batches == "a:1")) << batches;
+  AdvanceTimeMs(kIntervalMs);
+  EXPECT_EQ("", Batches());
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
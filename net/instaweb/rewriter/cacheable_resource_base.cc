@@ -39,6 +39,7 @@
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/base/trace_span_ring.h"
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/request_headers.h"
@@ -106,6 +107,7 @@ class CacheableResourceBase::FetchCallbackBase : public AsyncFetchWithLock {
 
   // Overridden from AsyncFetch.
   virtual void HandleDone(bool success) {
+    fetch_span_.End();
     bool cached = false;
     // Do not store the response in cache if we are using the fallback.
     if (fallback_fetch_ != NULL && fallback_fetch_->serving_fallback()) {
@@ -210,6 +212,10 @@ class CacheableResourceBase::FetchCallbackBase : public AsyncFetchWithLock {
     }
     resource_->PrepareRequest(fetch->request_context(),
                               fetch->request_headers());
+    if (request_context().get() != NULL) {
+      request_context()->StartTraceSpan(
+          "fetch", "CacheableResourceBase::Fetch", &fetch_span_);
+    }
     fetcher_->Fetch(fetch_url_, message_handler_, fetch);
   }
 
@@ -276,6 +282,9 @@ class CacheableResourceBase::FetchCallbackBase : public AsyncFetchWithLock {
 
   FallbackSharedAsyncFetch* fallback_fetch_;
 
+  // Times the fetch from the origin.
+  ScopedTraceSpan fetch_span_;
+
   DISALLOW_COPY_AND_ASSIGN(FetchCallbackBase);
 };
 
@@ -23,6 +23,7 @@
 
 #include "net/instaweb/rewriter/public/critical_finder_support_util.h"
 #include "net/instaweb/rewriter/public/critical_selector_finder.h"
+#include "net/instaweb/rewriter/public/critical_selector_matcher.h"
 #include "net/instaweb/rewriter/public/css_tag_scanner.h"
 #include "net/instaweb/rewriter/public/css_util.h"
 #include "net/instaweb/rewriter/public/request_properties.h"
@@ -31,7 +32,9 @@
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/static_asset_manager.h"
+#include "net/instaweb/util/public/property_cache.h"
 #include "pagespeed/kernel/base/escaping.h"
+#include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/hasher.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
@@ -59,6 +62,56 @@ const char CriticalCssBeaconFilter::kCriticalCssNoBeaconDueToMissingData[] =
     "critical_css_no_beacon_due_to_missing_data";
 const char CriticalCssBeaconFilter::kCriticalCssSkippedDueToCharset[] =
     "critical_css_skipped_due_to_charset";
+const char CriticalCssBeaconFilter::kCriticalCssServerComputedCount[] =
+    "critical_css_server_computed_count";
+
+const int CriticalCssBeaconFilter::kMaxDomSummaryElements = 5000;
+
+// Matches the candidate selectors against the page's elements and records the
+// matches as critical, off the HTML thread.  Holds an async event on the driver
+// so it outlives neither the driver nor its property page.
+class CriticalCssBeaconFilter::ComputeCriticalSelectorsTask : public Function {
+ public:
+  ComputeCriticalSelectorsTask(RewriteDriver* driver,
+                               const StringSet& selectors,
+                               DomSummary* dom_summary,
+                               Variable* computed_count)
+      : driver_(driver),
+        selectors_(selectors),
+        dom_summary_(dom_summary),
+        computed_count_(computed_count) {
+    driver_->IncrementAsyncEventsCount();
+  }
+
+  virtual ~ComputeCriticalSelectorsTask() {}
+
+  virtual void Run() {
+    StringSet critical_selectors;
+    CriticalSelectorMatcher matcher(selectors_);
+    matcher.FindMatches(*dom_summary_, &critical_selectors);
+    ServerContext* server_context = driver_->server_context();
+    server_context->critical_selector_finder()->
+        WriteComputedCriticalSelectorsToPropertyCache(critical_selectors,
+                                                      driver_);
+    driver_->property_page()->WriteCohort(server_context->beacon_cohort());
+    if (computed_count_ != NULL) {
+      computed_count_->Add(1);
+    }
+    driver_->DecrementAsyncEventsCount();
+  }
+
+  virtual void Cancel() {
+    driver_->DecrementAsyncEventsCount();
+  }
+
+ private:
+  RewriteDriver* driver_;
+  StringSet selectors_;
+  scoped_ptr<DomSummary> dom_summary_;
+  Variable* computed_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(ComputeCriticalSelectorsTask);
+};
 
 CriticalCssBeaconFilter::CriticalCssBeaconFilter(RewriteDriver* driver)
     : CssSummarizerBase(driver) {
@@ -69,6 +122,8 @@ CriticalCssBeaconFilter::CriticalCssBeaconFilter(RewriteDriver* driver)
       kCriticalCssNoBeaconDueToMissingData);
   critical_css_skipped_due_to_charset_ = stats->GetVariable(
       kCriticalCssSkippedDueToCharset);
+  critical_css_server_computed_count_ = stats->GetVariable(
+      kCriticalCssServerComputedCount);
 }
 
 CriticalCssBeaconFilter::~CriticalCssBeaconFilter() {}
@@ -77,6 +132,30 @@ void CriticalCssBeaconFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kCriticalCssBeaconAddedCount);
   statistics->AddVariable(kCriticalCssNoBeaconDueToMissingData);
   statistics->AddVariable(kCriticalCssSkippedDueToCharset);
+  statistics->AddVariable(kCriticalCssServerComputedCount);
+}
+
+void CriticalCssBeaconFilter::StartDocumentImpl() {
+  CssSummarizerBase::StartDocumentImpl();
+  if (driver()->options()->compute_critical_selectors_on_server()) {
+    dom_summary_.reset(new DomSummary(kMaxDomSummaryElements));
+  } else {
+    dom_summary_.reset(NULL);
+  }
+}
+
+void CriticalCssBeaconFilter::StartElementImpl(HtmlElement* element) {
+  CssSummarizerBase::StartElementImpl(element);
+  if (dom_summary_.get() != NULL) {
+    dom_summary_->StartElement(*element);
+  }
+}
+
+void CriticalCssBeaconFilter::EndElementImpl(HtmlElement* element) {
+  CssSummarizerBase::EndElementImpl(element);
+  if (dom_summary_.get() != NULL) {
+    dom_summary_->EndElement();
+  }
 }
 
 bool CriticalCssBeaconFilter::MustSummarize(HtmlElement* element) const {
@@ -187,6 +266,7 @@ void CriticalCssBeaconFilter::SummariesDone() {
   BeaconMetadata metadata =
       driver()->server_context()->critical_selector_finder()->
           PrepareForBeaconInsertion(selectors, driver());
+  MaybeComputeCriticalSelectors(selectors);
   if (metadata.status == kDoNotBeacon) {
     // No beaconing required according to current pcache state and computed
     // selector set.
@@ -216,6 +296,23 @@ void CriticalCssBeaconFilter::SummariesDone() {
   }
 }
 
+void CriticalCssBeaconFilter::MaybeComputeCriticalSelectors(
+    const StringSet& selectors) {
+  scoped_ptr<DomSummary> dom_summary(dom_summary_.release());
+  // Once a beacon result (or an earlier computation, which counts as one) has
+  // been recorded for the current candidates, leave it to the beacons.  A new
+  // candidate set resets the count, so we compute again when the CSS changes.
+  CriticalSelectorInfo* info = driver()->critical_selector_info();
+  if (dom_summary.get() == NULL || dom_summary->truncated() ||
+      selectors.empty() || driver()->property_page() == NULL ||
+      info == NULL || IsBeaconDataAvailable(info->proto)) {
+    return;
+  }
+  driver()->AddLowPriorityRewriteTask(new ComputeCriticalSelectorsTask(
+      driver(), selectors, dom_summary.release(),
+      critical_css_server_computed_count_));
+}
+
 void CriticalCssBeaconFilter::DetermineEnabled(GoogleString* disabled_reason) {
   set_is_enabled(driver()->request_properties()->SupportsCriticalCssBeacon());
 }
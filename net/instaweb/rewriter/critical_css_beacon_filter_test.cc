@@ -386,6 +386,29 @@ TEST_F(CriticalCssBeaconOnlyTest, ExtantPCache) {
   ValidateExpectedUrl(kTestDomain, input_html, expected_html);
 }
 
+class CriticalCssServerComputedTest : public CriticalCssBeaconOnlyTest {
+ protected:
+  virtual void SetUp() {
+    options()->set_compute_critical_selectors_on_server(true);
+    CriticalCssBeaconOnlyTest::SetUp();
+  }
+};
+
+TEST_F(CriticalCssServerComputedTest, MatchedSelectorsAreCritical) {
+  // The beacon still goes out, but "p" is critical before it comes back, as
+  // it's the only candidate with a matching element on the page.
+  ValidateExpectedUrl(kTestDomain, InputHtml(kInlineStyle),
+                      BeaconHtml(kInlineStyle, kSelectorsInline));
+  rewrite_driver()->WaitForShutDown();
+  EXPECT_EQ(1, statistics()->GetVariable(
+      CriticalCssBeaconFilter::kCriticalCssServerComputedCount)->Get());
+
+  rewrite_driver()->set_critical_selector_info(NULL);
+  CriticalSelectorFinder* finder = server_context()->critical_selector_finder();
+  const StringSet& critical = finder->GetCriticalSelectors(rewrite_driver());
+  EXPECT_EQ("p", JoinCollection(critical, ","));
+}
+
 class CriticalCssBeaconWithCombinerFilterTest
     : public CriticalCssBeaconFilterTest {
  public:
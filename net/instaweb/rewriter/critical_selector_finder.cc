@@ -92,6 +92,23 @@ void CriticalSelectorFinder::WriteCriticalSelectorsToPropertyCache(
       driver->property_page(), driver->message_handler(), driver->timer());
 }
 
+void CriticalSelectorFinder::WriteComputedCriticalSelectorsToPropertyCache(
+    const StringSet& selector_set, RewriteDriver* driver) {
+  DCHECK(cohort_ != NULL);
+  CriticalKeysWriteFlags flags;
+  if (ShouldReplacePriorResult()) {
+    flags = kReplacePriorResult;
+  } else {
+    flags = static_cast<CriticalKeysWriteFlags>(
+        kRequirePriorSupport | kSkipNonceCheck);
+  }
+  WriteCriticalKeysToPropertyCache(
+      selector_set, NULL /* no nonce to check */, SupportInterval(), flags,
+      kCriticalSelectorsPropertyName,
+      driver->server_context()->page_property_cache(), cohort_,
+      driver->property_page(), driver->message_handler(), driver->timer());
+}
+
 void CriticalSelectorFinder::WriteCriticalSelectorsToPropertyCacheStatic(
     const StringSet& selector_set, StringPiece nonce, int support_interval,
     bool should_replace_prior_result, const PropertyCache* cache,
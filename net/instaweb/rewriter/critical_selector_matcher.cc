@@ -0,0 +1,276 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/instaweb/rewriter/public/critical_selector_matcher.h"
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_name.h"
+#include "util/utf8/public/unicodetext.h"
+#include "webutil/css/parser.h"
+#include "webutil/css/selector.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Whitespace that separates class names in a class attribute.
+const char kClassSeparators[] = " \t\n\r\f";
+
+GoogleString UnicodeTextToString(const UnicodeText& text) {
+  return GoogleString(text.utf8_data(), text.utf8_length());
+}
+
+}  // namespace
+
+DomSummary::DomSummary(int max_elements)
+    : max_elements_(max_elements),
+      truncated_(false) {
+}
+
+DomSummary::~DomSummary() {
+}
+
+void DomSummary::StartElement(const HtmlElement& element) {
+  int index = -1;
+  if (num_elements() < max_elements_) {
+    index = num_elements();
+    elements_.push_back(Element());
+    Element& summary = elements_.back();
+    element.name_str().CopyToString(&summary.tag);
+    LowerString(&summary.tag);
+    const char* id = element.AttributeValue(HtmlName::kId);
+    if (id != NULL) {
+      summary.id = id;
+    }
+    const char* classes = element.AttributeValue(HtmlName::kClass);
+    if (classes != NULL) {
+      StringPieceVector names;
+      SplitStringPieceToVector(classes, kClassSeparators, &names,
+                               true /* omit_empty_strings */);
+      for (int i = 0, n = names.size(); i < n; ++i) {
+        names[i].CopyToString(StringVectorAdd(&summary.classes));
+      }
+    }
+    summary.parent = open_elements_.empty() ? -1 : open_elements_.back();
+    summary.previous_sibling = last_child_.empty() ? -1 : last_child_.back();
+    if (!last_child_.empty()) {
+      last_child_.back() = index;
+    }
+  } else {
+    truncated_ = true;
+  }
+  open_elements_.push_back(index);
+  last_child_.push_back(-1);
+}
+
+void DomSummary::EndElement() {
+  DCHECK(!open_elements_.empty());
+  if (!open_elements_.empty()) {
+    open_elements_.pop_back();
+    last_child_.pop_back();
+  }
+}
+
+struct CriticalSelectorMatcher::IndexedSelector {
+  int id;  // Position in selectors_.
+  GoogleString text;
+  scoped_ptr<Css::Selectors> parsed;
+  const Css::Selector* selector;  // Owned by parsed of its group's first.
+};
+
+CriticalSelectorMatcher::CriticalSelectorMatcher(const StringSet& selectors) {
+  for (StringSet::const_iterator i = selectors.begin(), e = selectors.end();
+       i != e; ++i) {
+    Css::Parser parser(*i);
+    scoped_ptr<Css::Selectors> parsed(parser.ParseSelectors());
+    if (parsed == NULL || parsed->empty() ||
+        parser.errors_seen_mask() != 0) {
+      unparsed_.push_back(*i);
+      continue;
+    }
+    // Selector text can be a group, in which case matching any member is
+    // enough; index each member, with the first holding the parse tree.
+    Css::Selectors* group = parsed.get();
+    for (int j = 0, n = group->size(); j < n; ++j) {
+      if (group->get(j)->empty()) {
+        continue;
+      }
+      IndexedSelector* indexed = new IndexedSelector;
+      indexed->id = selectors_.size();
+      indexed->text = *i;
+      indexed->selector = group->get(j);
+      if (parsed != NULL) {
+        indexed->parsed.reset(parsed.release());
+      }
+      selectors_.push_back(indexed);
+      AddToIndex(indexed);
+    }
+  }
+}
+
+CriticalSelectorMatcher::~CriticalSelectorMatcher() {
+  STLDeleteElements(&selectors_);
+}
+
+void CriticalSelectorMatcher::AddToIndex(const IndexedSelector* indexed) {
+  // Bucket by the most specific thing the rightmost compound selector needs
+  // of an element: an id, then a class, then a tag.
+  const Css::SimpleSelectors* compound = indexed->selector->back();
+  const Css::SimpleSelector* class_selector = NULL;
+  const Css::SimpleSelector* tag_selector = NULL;
+  for (int i = 0, n = compound->size(); i < n; ++i) {
+    const Css::SimpleSelector* simple = compound->get(i);
+    switch (simple->type()) {
+      case Css::SimpleSelector::ID:
+        by_id_[UnicodeTextToString(simple->value())].push_back(indexed);
+        return;
+      case Css::SimpleSelector::CLASS:
+        if (class_selector == NULL) {
+          class_selector = simple;
+        }
+        break;
+      case Css::SimpleSelector::ELEMENT_TYPE:
+        tag_selector = simple;
+        break;
+      default:
+        break;
+    }
+  }
+  if (class_selector != NULL) {
+    by_class_[UnicodeTextToString(class_selector->value())].push_back(indexed);
+  } else if (tag_selector != NULL) {
+    GoogleString tag = UnicodeTextToString(tag_selector->element_text());
+    LowerString(&tag);
+    by_tag_[tag].push_back(indexed);
+  } else {
+    universal_.push_back(indexed);
+  }
+}
+
+void CriticalSelectorMatcher::AddCandidates(const SelectorIndex& index,
+                                            const GoogleString& key,
+                                            SelectorList* candidates) {
+  SelectorIndex::const_iterator p = index.find(key);
+  if (p != index.end()) {
+    candidates->insert(candidates->end(), p->second.begin(), p->second.end());
+  }
+}
+
+void CriticalSelectorMatcher::FindMatches(const DomSummary& dom,
+                                          StringSet* matches) const {
+  matches->insert(unparsed_.begin(), unparsed_.end());
+  std::vector<bool> matched(selectors_.size(), false);
+  int num_unmatched = selectors_.size();
+  SelectorList candidates;
+  for (int i = 0, n = dom.num_elements(); i < n && num_unmatched > 0; ++i) {
+    const DomSummary::Element& element = dom.element(i);
+    candidates.clear();
+    if (!element.id.empty()) {
+      AddCandidates(by_id_, element.id, &candidates);
+    }
+    for (int j = 0, m = element.classes.size(); j < m; ++j) {
+      AddCandidates(by_class_, element.classes[j], &candidates);
+    }
+    AddCandidates(by_tag_, element.tag, &candidates);
+    candidates.insert(candidates.end(), universal_.begin(), universal_.end());
+
+    for (int j = 0, m = candidates.size(); j < m; ++j) {
+      const IndexedSelector* candidate = candidates[j];
+      if (!matched[candidate->id] &&
+          MatchesAt(*candidate->selector, candidate->selector->size() - 1,
+                    dom, i)) {
+        matched[candidate->id] = true;
+        --num_unmatched;
+        matches->insert(candidate->text);
+      }
+    }
+  }
+}
+
+bool CriticalSelectorMatcher::MatchesAt(const Css::Selector& selector,
+                                        int pos, const DomSummary& dom,
+                                        int element_index) {
+  const Css::SimpleSelectors& compound = *selector.get(pos);
+  const DomSummary::Element& element = dom.element(element_index);
+  if (!CompoundMatches(compound, element)) {
+    return false;
+  }
+  if (pos == 0) {
+    return true;
+  }
+  switch (compound.combinator()) {
+    case Css::SimpleSelectors::CHILD:
+      return (element.parent >= 0 &&
+              MatchesAt(selector, pos - 1, dom, element.parent));
+    case Css::SimpleSelectors::DESCENDANT:
+      for (int ancestor = element.parent; ancestor >= 0;
+           ancestor = dom.element(ancestor).parent) {
+        if (MatchesAt(selector, pos - 1, dom, ancestor)) {
+          return true;
+        }
+      }
+      return false;
+    case Css::SimpleSelectors::SIBLING:
+      return (element.previous_sibling >= 0 &&
+              MatchesAt(selector, pos - 1, dom, element.previous_sibling));
+    case Css::SimpleSelectors::NONE:
+      break;
+  }
+  // Only the first compound selector should lack a combinator.
+  return true;
+}
+
+bool CriticalSelectorMatcher::CompoundMatches(
+    const Css::SimpleSelectors& compound, const DomSummary::Element& element) {
+  for (int i = 0, n = compound.size(); i < n; ++i) {
+    const Css::SimpleSelector* simple = compound.get(i);
+    switch (simple->type()) {
+      case Css::SimpleSelector::ELEMENT_TYPE: {
+        GoogleString tag = UnicodeTextToString(simple->element_text());
+        if (!StringCaseEqual(tag, element.tag)) {
+          return false;
+        }
+        break;
+      }
+      case Css::SimpleSelector::ID:
+        if (UnicodeTextToString(simple->value()) != element.id) {
+          return false;
+        }
+        break;
+      case Css::SimpleSelector::CLASS: {
+        GoogleString name = UnicodeTextToString(simple->value());
+        bool found = false;
+        for (int j = 0, m = element.classes.size(); j < m && !found; ++j) {
+          found = (element.classes[j] == name);
+        }
+        if (!found) {
+          return false;
+        }
+        break;
+      }
+      default:
+        // Universal, attribute and pseudo-class conditions: the summary
+        // doesn't keep enough to check these, so assume they match.
+        break;
+    }
+  }
+  return true;
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/instaweb/rewriter/public/critical_selector_matcher.h"
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/html/empty_html_filter.h"
+#include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_parse_test_base.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Feeds every element of the parsed page to a DomSummary.
+class DomSummaryFilter : public EmptyHtmlFilter {
+ public:
+  DomSummaryFilter() {}
+  virtual ~DomSummaryFilter() {}
+
+  virtual void StartDocument() {
+    summary_.reset(new DomSummary(max_elements_));
+  }
+  virtual void StartElement(HtmlElement* element) {
+    summary_->StartElement(*element);
+  }
+  virtual void EndElement(HtmlElement* element) {
+    summary_->EndElement();
+  }
+  virtual const char* Name() const { return "DomSummaryFilter"; }
+
+  void set_max_elements(int max_elements) { max_elements_ = max_elements; }
+  const DomSummary& summary() const { return *summary_; }
+
+ private:
+  int max_elements_;
+  scoped_ptr<DomSummary> summary_;
+
+  DISALLOW_COPY_AND_ASSIGN(DomSummaryFilter);
+};
+
+class CriticalSelectorMatcherTest : public HtmlParseTestBase {
+ protected:
+  CriticalSelectorMatcherTest() {
+    filter_.set_max_elements(100);
+    html_parse_.AddFilter(&filter_);
+  }
+
+  virtual bool AddBody() const { return true; }
+
+  // Returns the comma-separated selectors from the given list that match
+  // some element of html.
+  GoogleString Matches(StringPiece html, StringPiece selectors) {
+    Parse("matcher", html);
+    StringPieceVector pieces;
+    SplitStringPieceToVector(selectors, ",", &pieces,
+                             true /* omit_empty_strings */);
+    StringSet candidates;
+    for (int i = 0, n = pieces.size(); i < n; ++i) {
+      candidates.insert(pieces[i].as_string());
+    }
+    StringSet matches;
+    CriticalSelectorMatcher matcher(candidates);
+    matcher.FindMatches(filter_.summary(), &matches);
+    return JoinCollection(matches, ",");
+  }
+
+  DomSummaryFilter filter_;
+};
+
+TEST_F(CriticalSelectorMatcherTest, SimpleSelectors) {
+  const char kHtml[] =
+      "<div id=main class='a  b'><p>text</p></div><SPAN class=c></SPAN>";
+  EXPECT_EQ("#main,.a,.b,div,p,span",
+            Matches(kHtml, "#main,#other,.a,.b,.d,div,p,span,table"));
+  EXPECT_EQ(".a.b,div#main,span.c",
+            Matches(kHtml, "div#main,p#main,.a.b,.a.c,span.c,DIV.c"));
+}
+
+TEST_F(CriticalSelectorMatcherTest, Universal) {
+  EXPECT_EQ("*", Matches("<p></p>", "*"));
+}
+
+TEST_F(CriticalSelectorMatcherTest, Combinators) {
+  const char kHtml[] =
+      "<div class=outer><ul><li class=first></li><li class=second></li></ul>"
+      "</div><p class=after></p>";
+  EXPECT_EQ(".outer li,.outer>ul,ul>li",
+            Matches(kHtml, ".outer li,.outer>li,.outer>ul,ul>li,p li"));
+  EXPECT_EQ(".first+.second,.outer+p",
+            Matches(kHtml, ".first+.second,.second+.first,.outer+p,ul+p"));
+}
+
+TEST_F(CriticalSelectorMatcherTest, AttributesAndUnparsedAssumedToMatch) {
+  EXPECT_EQ("[not valid,p[title]",
+            Matches("<p></p>", "p[title],div[title],[not valid"));
+}
+
+TEST_F(CriticalSelectorMatcherTest, Truncated) {
+  filter_.set_max_elements(4);  // html, body, div, p.
+  Matches("<div><p></p></div>", "p");
+  EXPECT_FALSE(filter_.summary().truncated());
+  EXPECT_EQ("", Matches("<div><p></p><span></span></div>", "span"));
+  EXPECT_TRUE(filter_.summary().truncated());
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
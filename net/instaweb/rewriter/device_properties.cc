@@ -99,6 +99,8 @@ DeviceProperties::DeviceProperties(UserAgentMatcher* matcher)
       screen_height_(0),
       preferred_webp_qualities_(NULL),
       preferred_jpeg_qualities_(NULL),
+      capabilities_set_(kNotSet),
+      capabilities_(0),
       device_type_set_(kNotSet),
       device_type_(UserAgentMatcher::kDesktop) {
 #ifndef NDEBUG
@@ -126,6 +128,8 @@ void DeviceProperties::SetUserAgent(const StringPiece& user_agent_string) {
   screen_dimensions_set_ = kNotSet;
   screen_width_ = 0;
   screen_height_ = 0;
+  capabilities_set_ = kNotSet;
+  capabilities_ = 0;
 }
 
 void DeviceProperties::ParseRequestHeaders(
@@ -137,19 +141,46 @@ void DeviceProperties::ParseRequestHeaders(
       kTrue : kFalse;
 }
 
+bool DeviceProperties::GetCapabilities(uint32* capabilities) const {
+  if (capabilities_set_ == kNotSet) {
+    capabilities_set_ =
+        ua_matcher_->LookupCapabilities(user_agent_, &capabilities_) ?
+        kTrue : kFalse;
+  }
+  *capabilities = capabilities_;
+  return (capabilities_set_ == kTrue);
+}
+
+bool DeviceProperties::CachedCapability(uint32 capability,
+                                        bool* has_capability) const {
+  uint32 capabilities;
+  if (!GetCapabilities(&capabilities)) {
+    return false;
+  }
+  *has_capability = ((capabilities & capability) != 0);
+  return true;
+}
+
 bool DeviceProperties::SupportsImageInlining() const {
   if (supports_image_inlining_ == kNotSet) {
-    supports_image_inlining_ =
-        ua_matcher_->SupportsImageInlining(user_agent_) ? kTrue : kFalse;
+    bool supported;
+    if (!CachedCapability(UserAgentMatcher::kCapabilityImageInlining,
+                          &supported)) {
+      supported = ua_matcher_->SupportsImageInlining(user_agent_);
+    }
+    supports_image_inlining_ = supported ? kTrue : kFalse;
   }
   return (supports_image_inlining_ == kTrue);
 }
 
 bool DeviceProperties::SupportsLazyloadImages() const {
   if (supports_lazyload_images_ == kNotSet) {
-    supports_lazyload_images_ =
-        (!IsBot() && ua_matcher_->SupportsLazyloadImages(user_agent_)) ?
-        kTrue : kFalse;
+    bool supported;
+    if (!CachedCapability(UserAgentMatcher::kCapabilityLazyloadImages,
+                          &supported)) {
+      supported = ua_matcher_->SupportsLazyloadImages(user_agent_);
+    }
+    supports_lazyload_images_ = (!IsBot() && supported) ? kTrue : kFalse;
   }
   return (supports_lazyload_images_ == kTrue);
 }
@@ -162,7 +193,11 @@ bool DeviceProperties::SupportsCriticalCss() const {
   // X-UA-Compatible, which can come in both meta and header flavors. Once we
   // have a good way of detecting this case, we can enable us for strict IE10.
   if (supports_critical_css_ == kNotSet) {
-    supports_critical_css_ = !ua_matcher_->IsIe(user_agent_) ? kTrue : kFalse;
+    bool is_ie;
+    if (!CachedCapability(UserAgentMatcher::kCapabilityIsIe, &is_ie)) {
+      is_ie = ua_matcher_->IsIe(user_agent_);
+    }
+    supports_critical_css_ = !is_ie ? kTrue : kFalse;
   }
   return (supports_critical_css_ == kTrue);
 }
@@ -180,9 +215,14 @@ bool DeviceProperties::SupportsCriticalImagesBeacon() const {
 // value for allow_mobile.
 bool DeviceProperties::SupportsJsDefer(bool allow_mobile) const {
   if (supports_js_defer_ == kNotSet) {
-    supports_js_defer_ =
-        ua_matcher_->SupportsJsDefer(user_agent_, allow_mobile) ?
-        kTrue : kFalse;
+    bool supported;
+    if (!CachedCapability(
+            allow_mobile ? UserAgentMatcher::kCapabilityJsDeferAllowMobile :
+                           UserAgentMatcher::kCapabilityJsDefer,
+            &supported)) {
+      supported = ua_matcher_->SupportsJsDefer(user_agent_, allow_mobile);
+    }
+    supports_js_defer_ = supported ? kTrue : kFalse;
   }
   return (supports_js_defer_ == kTrue);
 }
@@ -208,9 +248,13 @@ bool DeviceProperties::PossiblyMasqueradingAsChrome() const {
 
 bool DeviceProperties::SupportsWebpRewrittenUrls() const {
   if (supports_webp_rewritten_urls_ == kNotSet) {
+    bool supports_webp;
+    if (!CachedCapability(UserAgentMatcher::kCapabilityWebp,
+                          &supports_webp)) {
+      supports_webp = ua_matcher_->SupportsWebp(user_agent_);
+    }
     if (SupportsWebpInPlace() ||
-        (ua_matcher_->SupportsWebp(user_agent_) &&
-         !PossiblyMasqueradingAsChrome())) {
+        (supports_webp && !PossiblyMasqueradingAsChrome())) {
       supports_webp_rewritten_urls_ = kTrue;
     } else {
       supports_webp_rewritten_urls_ = kFalse;
@@ -221,8 +265,12 @@ bool DeviceProperties::SupportsWebpRewrittenUrls() const {
 
 bool DeviceProperties::SupportsWebpLosslessAlpha() const {
   if (supports_webp_lossless_alpha_ == kNotSet) {
-    if (ua_matcher_->SupportsWebpLosslessAlpha(user_agent_) &&
-        !PossiblyMasqueradingAsChrome()) {
+    bool supported;
+    if (!CachedCapability(UserAgentMatcher::kCapabilityWebpLosslessAlpha,
+                          &supported)) {
+      supported = ua_matcher_->SupportsWebpLosslessAlpha(user_agent_);
+    }
+    if (supported && !PossiblyMasqueradingAsChrome()) {
       supports_webp_lossless_alpha_ = kTrue;
     } else {
       supports_webp_lossless_alpha_ = kFalse;
@@ -248,6 +296,12 @@ bool DeviceProperties::SupportsSplitHtml(bool allow_mobile) const {
 }
 
 bool DeviceProperties::CanPreloadResources() const {
+  uint32 capabilities;
+  if (GetCapabilities(&capabilities)) {
+    return ((capabilities & UserAgentMatcher::kPrefetchMechanismMask) >>
+            UserAgentMatcher::kPrefetchMechanismShift) !=
+        UserAgentMatcher::kPrefetchNotSupported;
+  }
   return ua_matcher_->GetPrefetchMechanism(user_agent_) !=
       UserAgentMatcher::kPrefetchNotSupported;
 }
@@ -273,7 +327,13 @@ void DeviceProperties::SetScreenResolution(int width, int height) const {
 
 UserAgentMatcher::DeviceType DeviceProperties::GetDeviceType() const {
   if (device_type_set_ == kNotSet) {
-    device_type_ = ua_matcher_->GetDeviceTypeForUA(user_agent_);
+    uint32 capabilities;
+    if (GetCapabilities(&capabilities)) {
+      device_type_ = static_cast<UserAgentMatcher::DeviceType>(
+          capabilities & UserAgentMatcher::kDeviceTypeMask);
+    } else {
+      device_type_ = ua_matcher_->GetDeviceTypeForUA(user_agent_);
+    }
     device_type_set_ = kTrue;
   }
   return device_type_;
@@ -14,10 +14,13 @@
 
 #include "net/instaweb/rewriter/public/device_properties.h"
 
+#include <map>
 #include <vector>
 
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/request_headers.h"
 #include "pagespeed/kernel/http/user_agent_matcher.h"
@@ -36,6 +39,33 @@ const char* kMediumUserAgent =
 const char* kLargeUserAgent =
     UserAgentMatcherTestBase::kNexus10ChromeUserAgent;
 
+// Single-threaded CapabilityCache that counts lookups.
+class CountingCapabilityCache : public UserAgentMatcher::CapabilityCache {
+ public:
+  CountingCapabilityCache() : lookups_(0) {}
+
+  virtual bool Lookup(StringPiece user_agent, uint32* capabilities) {
+    ++lookups_;
+    std::map<GoogleString, uint32>::const_iterator p =
+        map_.find(user_agent.as_string());
+    if (p == map_.end()) {
+      return false;
+    }
+    *capabilities = p->second;
+    return true;
+  }
+
+  virtual void Insert(StringPiece user_agent, uint32 capabilities) {
+    map_[user_agent.as_string()] = capabilities;
+  }
+
+  int lookups() const { return lookups_; }
+
+ private:
+  std::map<GoogleString, uint32> map_;
+  int lookups_;
+};
+
 }  // namespace
 
 class DevicePropertiesTest: public testing::Test {
@@ -231,4 +261,26 @@ TEST_F(DevicePropertiesTest, WebpUserAgentIdentificationAccept) {
   EXPECT_TRUE(device_properties_.SupportsWebpLosslessAlpha());
 }
 
+TEST_F(DevicePropertiesTest, CapabilityCacheLookedUpOncePerUserAgent) {
+  CountingCapabilityCache cache;
+  user_agent_matcher_.set_capability_cache(&cache);
+
+  device_properties_.SetUserAgent(UserAgentMatcherTestBase::kIe7UserAgent);
+  EXPECT_FALSE(device_properties_.SupportsCriticalCss());
+  EXPECT_FALSE(device_properties_.SupportsImageInlining());
+  EXPECT_FALSE(device_properties_.SupportsWebpRewrittenUrls());
+  EXPECT_FALSE(device_properties_.SupportsWebpLosslessAlpha());
+  EXPECT_EQ(UserAgentMatcher::kDesktop, device_properties_.GetDeviceType());
+  device_properties_.CanPreloadResources();
+  EXPECT_EQ(1, cache.lookups());
+
+  device_properties_.SetUserAgent(
+      UserAgentMatcherTestBase::kTestingWebpLosslessAlpha);
+  EXPECT_TRUE(device_properties_.SupportsCriticalCss());
+  EXPECT_TRUE(device_properties_.SupportsWebpLosslessAlpha());
+  EXPECT_EQ(2, cache.lookups());
+
+  user_agent_matcher_.set_capability_cache(NULL);
+}
+
 }  // namespace net_instaweb
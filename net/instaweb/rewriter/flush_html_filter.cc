@@ -22,6 +22,10 @@
 #include "net/instaweb/rewriter/public/flush_html_filter.h"
 #include "net/instaweb/rewriter/public/resource_tag_scanner.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_name.h"
 #include "pagespeed/kernel/http/semantic_type.h"
 
 namespace {
@@ -30,8 +34,6 @@ namespace {
 // Flush is issued.
 //
 // TODO(jmarantz): Make these configurable via RewriteOptions.
-// TODO(jmarantz): Consider gaps in realtime as justification to induce flushes
-// as well.  That might be beyond the scope of this filter.
 const int kFlushScoreThreshold = 80;
 const int kFlushCssScore = 10;     // 8 CSS files induces a flush.
 const int kFlushScriptScore = 10;  // 8 Scripts files induces a flush.
@@ -41,26 +43,50 @@ const int kFlushImageScore = 2;    // 40 images induces a flush.
 
 namespace net_instaweb {
 
-class HtmlElement;
-
 FlushHtmlFilter::FlushHtmlFilter(RewriteDriver* driver)
     : CommonFilter(driver),
-      score_(0) {
+      score_(0),
+      bytes_at_mark_(0),
+      elements_since_mark_(0),
+      window_start_ms_(0),
+      in_head_(false) {
 }
 
 FlushHtmlFilter::~FlushHtmlFilter() {}
 
 void FlushHtmlFilter::StartDocumentImpl() {
   score_ = 0;
+  in_head_ = false;
+  ResetBudget();
+  window_start_ms_ = driver()->timer()->NowMs();
 }
 
 void FlushHtmlFilter::Flush() {
   score_ = 0;
+  ResetBudget();
+  window_start_ms_ = driver()->timer()->NowMs();
+}
+
+void FlushHtmlFilter::ResetBudget() {
+  bytes_at_mark_ = driver()->num_bytes_in();
+  elements_since_mark_ = 0;
 }
 
 void FlushHtmlFilter::StartElementImpl(HtmlElement* element) {
+  if (element->keyword() == HtmlName::kHead) {
+    in_head_ = true;
+  } else if (element->keyword() == HtmlName::kBody) {
+    in_head_ = false;
+  }
   resource_tag_scanner::UrlCategoryVector attributes;
   resource_tag_scanner::ScanElement(element, driver()->options(), &attributes);
+  if (attributes.empty()) {
+    ++elements_since_mark_;
+  } else {
+    // Rewrites of this element's resources are about to start; give them
+    // the whole budget before flushing cuts them short.
+    ResetBudget();
+  }
   for (int i = 0, n = attributes.size(); i < n; ++i) {
     switch (attributes[i].category) {
       case semantic_type::kStylesheet:
@@ -85,6 +111,40 @@ void FlushHtmlFilter::EndElementImpl(HtmlElement* element) {
     score_ = 0;
     driver()->RequestFlush();
   }
+  if (element->keyword() == HtmlName::kHead) {
+    in_head_ = false;
+  }
+
+  const char* reason;
+  if (!driver()->flush_requested() && BudgetExceeded(&reason) &&
+      !(in_head_ && driver()->FiltersNeedCompleteHead())) {
+    driver()->ShowProgress(reason);
+    driver()->RequestFlush();
+  }
+}
+
+bool FlushHtmlFilter::BudgetExceeded(const char** reason) const {
+  // num_bytes_in counts each ParseText call in full as it starts, so the
+  // byte budget is only as fine-grained as the chunks we're given.
+  const RewriteOptions* options = driver()->options();
+  if (options->flush_budget_bytes() > 0 &&
+      driver()->num_bytes_in() - bytes_at_mark_ >=
+      options->flush_budget_bytes()) {
+    *reason = "- Flush injected due to byte budget -";
+    return true;
+  }
+  if (options->flush_budget_elements() > 0 &&
+      elements_since_mark_ >= options->flush_budget_elements()) {
+    *reason = "- Flush injected due to element budget -";
+    return true;
+  }
+  if (options->flush_budget_ms() > 0 &&
+      driver()->timer()->NowMs() - window_start_ms_ >=
+      options->flush_budget_ms()) {
+    *reason = "- Flush injected due to time budget -";
+    return true;
+  }
+  return false;
 }
 
 }  // namespace net_instaweb
@@ -85,6 +85,77 @@ TEST_F(FlushFilterTest, NotEnoughToInduceFlushes) {
   EXPECT_EQ(0, server_context()->rewrite_stats()->num_flushes()->Get());
 }
 
+TEST_F(FlushFilterTest, ElementBudget) {
+  options()->ClearSignatureForTesting();
+  options()->set_flush_budget_elements(5);
+  html_parse()->ParseText("<body><p>1</p><p>2</p><p>3</p>");
+  html_parse()->ExecuteFlushIfRequested();
+  EXPECT_EQ(0, server_context()->rewrite_stats()->num_flushes()->Get());
+  html_parse()->ParseText("<p>4</p>");
+  html_parse()->ExecuteFlushIfRequested();
+  EXPECT_EQ(1, server_context()->rewrite_stats()->num_flushes()->Get());
+}
+
+TEST_F(FlushFilterTest, ResourcesRestartElementBudget) {
+  options()->ClearSignatureForTesting();
+  options()->set_flush_budget_elements(2);
+  html_parse()->ParseText(StrCat(
+      "<body>", StringPrintf(kImgFormat, "a.png"), "<p>1</p>",
+      StringPrintf(kImgFormat, "b.png"), "<p>2</p>"));
+  html_parse()->ExecuteFlushIfRequested();
+  EXPECT_EQ(0, server_context()->rewrite_stats()->num_flushes()->Get());
+}
+
+TEST_F(FlushFilterTest, ByteBudget) {
+  options()->ClearSignatureForTesting();
+  options()->set_flush_budget_bytes(50);
+  html_parse()->ParseText("<body><p>short</p>");
+  html_parse()->ExecuteFlushIfRequested();
+  EXPECT_EQ(0, server_context()->rewrite_stats()->num_flushes()->Get());
+  html_parse()->ParseText(StrCat("<p>", GoogleString(50, 'x'), "</p>"));
+  html_parse()->ExecuteFlushIfRequested();
+  EXPECT_EQ(1, server_context()->rewrite_stats()->num_flushes()->Get());
+}
+
+TEST_F(FlushFilterTest, TimeBudget) {
+  options()->ClearSignatureForTesting();
+  options()->set_flush_budget_ms(100);
+  html_parse()->ParseText("<body><p>1</p>");
+  html_parse()->ExecuteFlushIfRequested();
+  EXPECT_EQ(0, server_context()->rewrite_stats()->num_flushes()->Get());
+  AdvanceTimeMs(100);
+  html_parse()->ParseText("<p>2</p>");
+  html_parse()->ExecuteFlushIfRequested();
+  EXPECT_EQ(1, server_context()->rewrite_stats()->num_flushes()->Get());
+}
+
+TEST_F(FlushFilterTest, BudgetFlushesInHead) {
+  options()->ClearSignatureForTesting();
+  options()->set_flush_budget_elements(2);
+  html_parse()->ParseText("<head><meta><meta><meta>");
+  html_parse()->ExecuteFlushIfRequested();
+  EXPECT_EQ(1, server_context()->rewrite_stats()->num_flushes()->Get());
+}
+
+class FlushFilterWithCombinerTest : public FlushFilterTest {
+ protected:
+  virtual void SetUp() {
+    options()->EnableFilter(RewriteOptions::kCombineCss);
+    FlushFilterTest::SetUp();
+  }
+};
+
+TEST_F(FlushFilterWithCombinerTest, BudgetWaitsForEndOfHead) {
+  options()->ClearSignatureForTesting();
+  options()->set_flush_budget_elements(2);
+  html_parse()->ParseText("<head><meta><meta><meta>");
+  html_parse()->ExecuteFlushIfRequested();
+  EXPECT_EQ(0, server_context()->rewrite_stats()->num_flushes()->Get());
+  html_parse()->ParseText("</head>");
+  html_parse()->ExecuteFlushIfRequested();
+  EXPECT_EQ(1, server_context()->rewrite_stats()->num_flushes()->Get());
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
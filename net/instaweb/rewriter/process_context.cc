@@ -19,6 +19,7 @@
 #include "base/logging.h"
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/html/html_keywords.h"
+#include "pagespeed/kernel/html/shared_name_table.h"
 #include "pagespeed/kernel/http/domain_registry.h"
 #include "pagespeed/kernel/js/js_tokenizer.h"
 #include "pagespeed/kernel/util/gflags.h"
@@ -46,6 +47,7 @@ ProcessContext::ProcessContext()
 
   domain_registry::Init();
   HtmlKeywords::Init();
+  SharedNameTable::Init();
 
   // url/url_util.cc lazily initializes its "standard_schemes" table in a
   // thread-unsafe way and so it must be explicitly initialized prior to thread
@@ -69,6 +71,7 @@ ProcessContext::~ProcessContext() {
 
   url::Shutdown();
   HtmlKeywords::ShutDown();
+  SharedNameTable::ShutDown();
 }
 
 }  // namespace net_instaweb
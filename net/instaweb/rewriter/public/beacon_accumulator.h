@@ -0,0 +1,168 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NET_INSTAWEB_REWRITER_PUBLIC_BEACON_ACCUMULATOR_H_
+#define NET_INSTAWEB_REWRITER_PUBLIC_BEACON_ACCUMULATOR_H_
+
+#include <map>
+#include <vector>
+
+#include "net/instaweb/http/public/request_context.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/http/user_agent_matcher.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+#include "pagespeed/kernel/thread/scheduler.h"
+
+namespace net_instaweb {
+
+class RenderedImages;
+
+// Holds beacon results in memory so that the beacons received for a page
+// over a short interval can be applied to its property-cache entry with one
+// read and one write, rather than a read-modify-write per beacon.  Beacons
+// for a page are handed to the BatchWriter, oldest first, when the flush
+// interval expires or when the page has max_beacons_per_page of them,
+// whichever comes first.
+//
+// Memory is bounded: at most max_pages pages are held, each with at most
+// max_beacons_per_page beacons.  Beacons for further pages are written
+// through immediately.
+//
+// Each process has its own accumulator, so a page beaconed from several
+// processes still gets a write per process per interval.
+class BeaconAccumulator {
+ public:
+  // The results carried by one beacon.  Any of the sets may be NULL if the
+  // beacon didn't report them.
+  struct Beacon {
+    Beacon();
+    ~Beacon();
+
+    // When the beacon arrived.  Nonces are checked as of this time, so that
+    // holding a beacon doesn't expire the nonce it was sent with.
+    int64 arrival_ms;
+    GoogleString nonce;
+    scoped_ptr<StringSet> html_critical_images;
+    scoped_ptr<StringSet> css_critical_images;
+    scoped_ptr<StringSet> critical_css_selectors;
+    scoped_ptr<RenderedImages> rendered_images;
+    scoped_ptr<StringSet> xpaths;
+
+   private:
+    DISALLOW_COPY_AND_ASSIGN(Beacon);
+  };
+  typedef std::vector<Beacon*> BeaconVector;
+
+  // Identifies the property page that a beacon updates.
+  struct PageKey {
+    PageKey(StringPiece url_in, StringPiece options_hash_in,
+            UserAgentMatcher::DeviceType device_type_in);
+
+    bool operator<(const PageKey& that) const;
+
+    GoogleString url;
+    GoogleString options_hash;
+    UserAgentMatcher::DeviceType device_type;
+  };
+
+  class BatchWriter {
+   public:
+    BatchWriter() {}
+    virtual ~BatchWriter();
+
+    // Applies beacons, oldest first, to page, and takes ownership of the
+    // elements of *beacons.  request_context is that of the newest beacon.
+    // This is called without any of the accumulator's locks held.
+    virtual void WriteBeacons(const PageKey& page,
+                              const RequestContextPtr& request_context,
+                              BeaconVector* beacons) = 0;
+
+   private:
+    DISALLOW_COPY_AND_ASSIGN(BatchWriter);
+  };
+
+  // Takes ownership of writer.  Flushes are timed by scheduler, and run in a
+  // sequence from workers, which should be a low-priority pool since beacon
+  // writes are never urgent.  workers must outlive the accumulator.
+  BeaconAccumulator(int64 flush_interval_ms, int max_beacons_per_page,
+                    int max_pages, Scheduler* scheduler,
+                    QueuedWorkerPool* workers, BatchWriter* writer);
+
+  // Any beacons still held are dropped: beacon results are advisory, and the
+  // property cache may already be gone at this point.  If a timed flush has
+  // already started, this blocks until it has finished.
+  ~BeaconAccumulator();
+
+  // Takes ownership of beacon, and writes it with the other beacons for page
+  // once the flush interval or per-page limit is reached.
+  void Add(const PageKey& page, const RequestContextPtr& request_context,
+           Beacon* beacon) LOCKS_EXCLUDED(mutex_);
+
+  // Writes all held beacons now.
+  void Flush() LOCKS_EXCLUDED(mutex_);
+
+  int num_pending_pages() const LOCKS_EXCLUDED(mutex_);
+  int num_pending_beacons() const LOCKS_EXCLUDED(mutex_);
+
+ private:
+  struct PendingPage;
+  typedef std::map<PageKey, PendingPage*> PageMap;
+
+  // Called from the scheduler when the flush interval expires.  Queues
+  // SequenceFlush on sequence_, so that the writes don't hold up other
+  // alarms.  FlushAlarmCancelled is called instead if the alarm is
+  // cancelled, and retires the flush so the destructor doesn't wait for it.
+  void FlushAlarm();
+  void FlushAlarmCancelled();
+
+  // Runs in sequence_.  SequenceFlushCancelled is called instead if the
+  // sequence is shut down or the accumulator is deleted first.
+  void SequenceFlush();
+  void SequenceFlushCancelled();
+
+  void ScheduleFlushIfNeeded() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const int64 flush_interval_ms_;
+  const int max_beacons_per_page_;
+  const int max_pages_;
+  Scheduler* scheduler_;
+  QueuedWorkerPool* workers_;
+  QueuedWorkerPool::Sequence* sequence_;
+  scoped_ptr<BatchWriter> writer_;
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  // Signalled as each timed flush finishes, for the destructor.
+  scoped_ptr<ThreadSystem::Condvar> flush_done_;
+  PageMap pages_ GUARDED_BY(mutex_);
+  int num_pending_beacons_ GUARDED_BY(mutex_);
+  // Whether a timed flush is due that hasn't yet taken the pending pages.
+  bool flush_scheduled_ GUARDED_BY(mutex_);
+  // Timed flushes whose alarm has been added but which haven't yet finished
+  // or been cancelled.  There can be two while a flush is writing, since a
+  // beacon arriving then schedules the next one.
+  int num_outstanding_flushes_ GUARDED_BY(mutex_);
+  Scheduler::Alarm* alarm_ GUARDED_BY(scheduler_->mutex());
+
+  DISALLOW_COPY_AND_ASSIGN(BeaconAccumulator);
+};
+
+}  // namespace net_instaweb
+
+#endif  // NET_INSTAWEB_REWRITER_PUBLIC_BEACON_ACCUMULATOR_H_
@@ -51,6 +51,11 @@ class CacheHtmlFilter : public HtmlWriterFilter {
   virtual void EndDocument();
   void WriteString(StringPiece str);
   virtual void Flush();
+  // Reads the ids of ancestors, which later filters in a shared pass might
+  // already have changed.
+  virtual bool CanShareFlushPass() const { return false; }
+  // Writes out only the non-cacheable panels.
+  virtual bool AcceptsRawMarkup() const { return false; }
   virtual const char* Name() const { return "CacheHtmlFilter"; }
 
  private:
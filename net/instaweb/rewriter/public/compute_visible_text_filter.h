@@ -57,6 +57,8 @@ class ComputeVisibleTextFilter : public HtmlWriterFilter {
   virtual void IEDirective(HtmlIEDirectiveNode* directive);
   virtual void Directive(HtmlDirectiveNode* directive);
   virtual void EndDocument();
+  // Writes out only the visible text.
+  virtual bool AcceptsRawMarkup() const { return false; }
   virtual const char* Name() const { return "ComputeVisibleTextFilter"; }
 
  private:
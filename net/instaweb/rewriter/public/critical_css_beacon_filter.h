@@ -23,6 +23,7 @@
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/http/semantic_type.h"
@@ -37,6 +38,7 @@ class Stylesheet;
 namespace net_instaweb {
 
 struct BeaconMetadata;
+class DomSummary;
 class HtmlElement;
 class Statistics;
 class Variable;
@@ -54,6 +56,11 @@ class CriticalCssBeaconFilter : public CssSummarizerBase {
   static const char kCriticalCssBeaconAddedCount[];
   static const char kCriticalCssNoBeaconDueToMissingData[];
   static const char kCriticalCssSkippedDueToCharset[];
+  static const char kCriticalCssServerComputedCount[];
+
+  // The most elements we'll summarize when computing critical selectors on
+  // the server; pages with more than this are left to the beacon.
+  static const int kMaxDomSummaryElements;
 
   explicit CriticalCssBeaconFilter(RewriteDriver* driver);
   virtual ~CriticalCssBeaconFilter();
@@ -84,9 +91,20 @@ class CriticalCssBeaconFilter : public CssSummarizerBase {
                          GoogleString* out) const;
   virtual void SummariesDone();
 
+  virtual void StartDocumentImpl();
+  virtual void StartElementImpl(HtmlElement* element);
+  virtual void EndElementImpl(HtmlElement* element);
+
   virtual void DetermineEnabled(GoogleString* disabled_reason);
 
  private:
+  class ComputeCriticalSelectorsTask;
+
+  // If there's no beacon data for the page yet, starts a low-priority task
+  // matching selectors against dom_summary_ and recording the ones that match
+  // as critical.  Takes ownership of dom_summary_.
+  void MaybeComputeCriticalSelectors(const StringSet& selectors);
+
   static void FindSelectorsFromRuleset(const Css::Ruleset& ruleset,
                                        StringSet* selectors);
   // The following adds the selectors to the given StringSet.
@@ -107,6 +125,11 @@ class CriticalCssBeaconFilter : public CssSummarizerBase {
   // The number of CSS files we ignore due to charset incompatibility.
   // Should these block critical CSS insertion?
   Variable* critical_css_skipped_due_to_charset_;
+  // The number of times critical selectors were computed on the server.
+  Variable* critical_css_server_computed_count_;
+
+  // The elements seen so far, when compute_critical_selectors_on_server is on.
+  scoped_ptr<DomSummary> dom_summary_;
 
   DISALLOW_COPY_AND_ASSIGN(CriticalCssBeaconFilter);
 };
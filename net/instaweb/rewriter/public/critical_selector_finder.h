@@ -78,6 +78,12 @@ class CriticalSelectorFinder {
       const StringSet& selector_set, StringPiece nonce,
       RewriteDriver* driver);
 
+  // Like WriteCriticalSelectorsToPropertyCache, but for selectors computed on
+  // the server rather than reported by a beacon, so there is no nonce to
+  // check.  Support is only added to known candidate selectors.
+  void WriteComputedCriticalSelectorsToPropertyCache(
+      const StringSet& selector_set, RewriteDriver* driver);
+
   // As above, but suitable for use in a beacon context where no RewriteDriver
   // is available.
   static void WriteCriticalSelectorsToPropertyCacheStatic(
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NET_INSTAWEB_REWRITER_PUBLIC_CRITICAL_SELECTOR_MATCHER_H_
+#define NET_INSTAWEB_REWRITER_PUBLIC_CRITICAL_SELECTOR_MATCHER_H_
+
+#include <map>
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace Css {
+
+class Selector;
+class SimpleSelectors;
+
+}  // namespace Css
+
+namespace net_instaweb {
+
+class HtmlElement;
+
+// A compact record of the elements on a page: just enough (tag, id, classes
+// and position in the tree) to decide which CSS selectors match something.
+// It is filled in from the parser's StartElement/EndElement events.
+class DomSummary {
+ public:
+  struct Element {
+    GoogleString tag;  // Lower case.
+    GoogleString id;
+    StringVector classes;
+    int parent;            // Index of the parent element, or -1.
+    int previous_sibling;  // Index of the previous sibling element, or -1.
+  };
+
+  // Stops recording after max_elements elements, and marks itself truncated.
+  explicit DomSummary(int max_elements);
+  ~DomSummary();
+
+  void StartElement(const HtmlElement& element);
+  void EndElement();
+
+  // True if the page had more than max_elements elements, in which case the
+  // summary doesn't describe the whole page.
+  bool truncated() const { return truncated_; }
+
+  int num_elements() const { return static_cast<int>(elements_.size()); }
+  const Element& element(int i) const { return elements_[i]; }
+
+ private:
+  const int max_elements_;
+  bool truncated_;
+  std::vector<Element> elements_;
+
+  // For each open element, its index in elements_ (-1 if it wasn't recorded)
+  // and the index of the last child element seen so far.
+  std::vector<int> open_elements_;
+  std::vector<int> last_child_;
+
+  DISALLOW_COPY_AND_ASSIGN(DomSummary);
+};
+
+// Finds which of a set of CSS selectors, in the form produced by
+// css_util::JsDetectableSelector, match at least one element of a DomSummary.
+// The selectors are bucketed by the id, class or tag required by their
+// rightmost compound selector, so each element is only checked against the
+// selectors that could possibly match it.
+//
+// Matching errs towards calling a selector critical: attribute conditions
+// are assumed to match, as is any selector that doesn't parse.
+class CriticalSelectorMatcher {
+ public:
+  explicit CriticalSelectorMatcher(const StringSet& selectors);
+  ~CriticalSelectorMatcher();
+
+  // Adds the selectors matching some element of dom to *matches.
+  void FindMatches(const DomSummary& dom, StringSet* matches) const;
+
+ private:
+  struct IndexedSelector;
+  typedef std::vector<const IndexedSelector*> SelectorList;
+  typedef std::map<GoogleString, SelectorList> SelectorIndex;
+
+  void AddToIndex(const IndexedSelector* indexed);
+  static void AddCandidates(const SelectorIndex& index, const GoogleString& key,
+                            SelectorList* candidates);
+  static bool MatchesAt(const Css::Selector& selector, int pos,
+                        const DomSummary& dom, int element_index);
+  static bool CompoundMatches(const Css::SimpleSelectors& compound,
+                              const DomSummary::Element& element);
+
+  std::vector<IndexedSelector*> selectors_;
+  // Selectors that didn't parse, which we treat as always matching.
+  StringVector unparsed_;
+
+  SelectorIndex by_id_;
+  SelectorIndex by_class_;
+  SelectorIndex by_tag_;
+  SelectorList universal_;
+
+  DISALLOW_COPY_AND_ASSIGN(CriticalSelectorMatcher);
+};
+
+}  // namespace net_instaweb
+
+#endif  // NET_INSTAWEB_REWRITER_PUBLIC_CRITICAL_SELECTOR_MATCHER_H_
@@ -58,6 +58,8 @@ class CssCombineFilter : public RewriteFilter {
   virtual void DetermineEnabled(GoogleString* disabled_reason);
   virtual void IEDirective(HtmlIEDirectiveNode* directive);
   virtual const char* Name() const { return "CssCombine"; }
+  // A flush ends every combination, so keep the <head>'s CSS together.
+  virtual bool NeedsCompleteHead() const { return true; }
   virtual const UrlSegmentEncoder* encoder() const {
     return &multipart_encoder_;
   }
@@ -103,6 +103,13 @@ class DeviceProperties {
   // Returns true if there are valid preferred image qualities.
   bool HasPreferredImageQualities() const;
   bool PossiblyMasqueradingAsChrome() const;
+  // Fills in the user agent's UserAgentMatcher::Capability bits, looking
+  // them up in the matcher's capability cache at most once per user agent.
+  // Returns false if the matcher has no capability cache.
+  bool GetCapabilities(uint32* capabilities) const;
+  // Sets *has_capability from the cached Capability bits, returning false
+  // if there are none, in which case the caller must ask ua_matcher_.
+  bool CachedCapability(uint32 capability, bool* has_capability) const;
 
   GoogleString user_agent_;
   GoogleString accept_header_;
@@ -124,6 +131,10 @@ class DeviceProperties {
   mutable int screen_height_;
   const std::vector<int>* preferred_webp_qualities_;
   const std::vector<int>* preferred_jpeg_qualities_;
+  // Used to lazily set capabilities_; kFalse if there is no capability
+  // cache.
+  mutable LazyBool capabilities_set_;
+  mutable uint32 capabilities_;
   // Used to lazily set device_type_.
   mutable LazyBool device_type_set_;
   mutable UserAgentMatcher::DeviceType device_type_;
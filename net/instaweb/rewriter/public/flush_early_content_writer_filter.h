@@ -67,6 +67,11 @@ class FlushEarlyContentWriterFilter : public HtmlWriterFilter {
 
   virtual void Characters(HtmlCharactersNode* characters_node);
 
+  // Looks at attributes in EndElement.
+  virtual bool CanShareFlushPass() const { return false; }
+  // Writes out only the resources it finds.
+  virtual bool AcceptsRawMarkup() const { return false; }
+
  protected:
   virtual void Clear();
 
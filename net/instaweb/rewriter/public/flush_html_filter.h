@@ -30,6 +30,13 @@ class RewriteDriver;
 // This filter is run immediately after lexing when streaming HTML into
 // the system.  It is used to monitor the HTML and try to figure out good
 // times to flush, based on document structure and timing.
+//
+// Besides flushing after enough resource references, it flushes once the
+// flush_budget_bytes or flush_budget_elements options' worth of HTML has
+// been parsed past the last resource reference, or the flush window has
+// been open for flush_budget_ms, so that a slow origin that doesn't flush
+// doesn't hold back output that's ready.  These budgets wait for the end of
+// the <head> if a filter needs all of it; see HtmlFilter::NeedsCompleteHead.
 class FlushHtmlFilter : public CommonFilter {
  public:
   explicit FlushHtmlFilter(RewriteDriver* driver);
@@ -43,8 +50,20 @@ class FlushHtmlFilter : public CommonFilter {
   virtual const char* Name() const { return "FlushHtmlFilter"; }
 
  private:
+  // Starts counting the flush budgets again from the current position.
+  void ResetBudget();
+  // Sets *reason and returns true if a budget has run out.
+  bool BudgetExceeded(const char** reason) const;
+
   int score_;
 
+  // Where the byte and element budgets are counted from: the last flush or
+  // resource reference, whichever is later.
+  int bytes_at_mark_;
+  int elements_since_mark_;
+  int64 window_start_ms_;
+  bool in_head_;
+
   DISALLOW_COPY_AND_ASSIGN(FlushHtmlFilter);
 };
 
@@ -93,6 +93,8 @@ class JsCombineFilter : public RewriteFilter {
   virtual void DetermineEnabled(GoogleString* disabled_reason);
   virtual void IEDirective(HtmlIEDirectiveNode* directive);
   virtual const char* Name() const { return "JsCombine"; }
+  // A flush ends every combination, so keep the <head>'s scripts together.
+  virtual bool NeedsCompleteHead() const { return true; }
   virtual RewriteContext* MakeRewriteContext();
   virtual const UrlSegmentEncoder* encoder() const {
     return &encoder_;
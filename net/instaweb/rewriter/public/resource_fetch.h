@@ -26,6 +26,7 @@
 #include "net/instaweb/http/public/async_fetch.h"
 #include "net/instaweb/http/public/request_context.h"
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/http/google_url.h"
 
 namespace net_instaweb {
@@ -34,6 +35,7 @@ class MessageHandler;
 class ServerContext;
 class RewriteDriver;
 class RewriteOptions;
+class SharedString;
 class SyncFetcherAdapterCallback;
 class Timer;
 
@@ -104,6 +106,11 @@ class ResourceFetch : public SharedAsyncFetch {
   // Protected interface from AsyncFetch.
   virtual void HandleHeadersComplete();
   virtual void HandleDone(bool success);
+  virtual bool HandleWriteShared(const SharedString& storage,
+                                 const StringPiece& content,
+                                 MessageHandler* handler) {
+    return ForwardWriteShared(storage, content, handler);
+  }
 
  private:
   ResourceFetch(const GoogleUrl& url, CleanupMode cleanup_mode,
@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_name.h"
 #include "pagespeed/kernel/http/semantic_type.h"
 
 namespace net_instaweb {
@@ -116,6 +117,11 @@ semantic_type::Category CategorizeAttribute(
     const HtmlElement::Attribute* attribute,
     const RewriteOptions* options);
 
+// Returns the keywords of the elements that have spec-defined url-valued
+// attributes, setting *num_keywords.  Options with UrlValuedAttributes can
+// add any element to these.
+const HtmlName::Keyword* ResourceElementKeywords(int* num_keywords);
+
 // Examines an HTML element to determine if it's a link to any sort of resource,
 // extracting out the HREF, SRC, or other URL attributes and identifying their
 // categories.  Because, for example, a LINK tag can be an image, stylesheet, or
@@ -127,6 +133,9 @@ semantic_type::Category CategorizeAttribute(
 // Attributes that we can't decode, such as non-ascii urls, will be skipped.
 //
 // Attributes are returned in left-to-right order.
+//
+// The result is cached on the element, so scanning it again from another
+// filter is cheap until its name or attribute list changes.
 void ScanElement(HtmlElement* element, const RewriteOptions* options,
                  UrlCategoryVector* attributes);
 
@@ -33,6 +33,7 @@
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/trace_span_ring.h"
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/response_headers.h"
 #include "pagespeed/kernel/util/url_segment_encoder.h"
@@ -145,6 +146,7 @@ class RewriteContext {
  public:
   typedef std::vector<InputInfo*> InputInfoStarVector;
   static const char kNumRewritesAbandonedForLockContention[];
+  static const char kNumRewritesReusedAfterLockContention[];
   static const char kNumDeadlineAlarmInvocations[];
   static const char kNumDistributedRewriteSuccesses[];
   static const char kNumDistributedRewriteFailures[];
@@ -231,6 +233,7 @@ class RewriteContext {
 
   void CallFetchInputs();
   void CallLockFailed();
+  void CallRecheckAfterLockWait();
   void CallStartFetchImpl();
 
   // Starts a resource rewrite.  Once Inititated, the Rewrite object
@@ -704,9 +707,17 @@ class RewriteContext {
   // avoid having multiple concurrent processes attempt the same rewrite.
   void FetchInputs();
 
-  // Called when we fail to acquire the lock for the output resource.
+  // Called when we fail to acquire the lock for the output resource.  If
+  // wait_for_contended_rewrites is on, waits for the lock once, so that the
+  // result of the rewrite holding it can be reused.
   void LockFailed();
 
+  // Called once we have waited for and obtained the lock that another rewrite
+  // of the same partition held.  Looks the partition up in the metadata cache
+  // again, rewriting it ourselves only if the other rewrite left no result.
+  void RecheckAfterLockWait();
+  void RecheckAfterLockWaitDone(CacheLookupResult* cache_result);
+
   // Callback to a distributed rewrite fetch. Queued to run in the high-priority
   // thread. Fetch path: If the fetch succeeded then the rest of the flow is
   // skipped and that result is used, otherwise the original resource is fetched
@@ -1028,6 +1039,10 @@ class RewriteContext {
   // is stale.
   bool stale_rewrite_;
 
+  // Set once we have waited for a creation lock held by another rewrite, so
+  // that we wait at most once.
+  bool waited_for_creation_lock_;
+
   // Indicates whether we have a metadata miss (or an unsuccessful revalidation
   // attempt) on the html path.
   bool is_metadata_cache_miss_;
@@ -1040,6 +1055,11 @@ class RewriteContext {
   // Always owned externally.
   RequestTrace* dependent_request_trace_;
 
+  // Span-trace timers for the whole rewrite, from Start to Finalize, and for
+  // its metadata cache lookup.
+  ScopedTraceSpan rewrite_span_;
+  ScopedTraceSpan metadata_lookup_span_;
+
   // Set true if this rewrite context should be blocked from distributing its
   // rewrite.
   bool block_distribute_rewrite_;
@@ -1051,6 +1071,7 @@ class RewriteContext {
   StringIntMap other_dependency_map_;
 
   Variable* const num_rewrites_abandoned_for_lock_contention_;
+  Variable* const num_rewrites_reused_after_lock_contention_;
   Variable* const num_distributed_rewrite_failures_;
   Variable* const num_distributed_rewrite_successes_;
   Variable* const num_distributed_metadata_failures_;
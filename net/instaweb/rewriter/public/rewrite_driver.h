@@ -54,6 +54,7 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_annotations.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/trace_span_ring.h"
 #include "pagespeed/kernel/base/writer.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_filter.h"
@@ -878,6 +879,13 @@ class RewriteDriver : public HtmlParse {
   // (If a flush is not needed, the callback will be invoked immediately).
   void ExecuteFlushIfRequestedAsync(Function* callback);
 
+  // Returns true if any enabled filter wants the whole <head> in one flush
+  // window; see HtmlFilter::NeedsCompleteHead.
+  bool FiltersNeedCompleteHead() const;
+
+  // The number of bytes passed to ParseText so far.
+  int num_bytes_in() const { return num_bytes_in_; }
+
   // Overrides HtmlParse::Flush so that it can happen in two phases:
   //    1. Pre-render chain runs, resulting in async rewrite activity
   //    2. async rewrite activity ends, calling callback, and post-render
@@ -888,6 +896,15 @@ class RewriteDriver : public HtmlParse {
   // FlushAsync is prefered for event-driven servers.
   virtual void Flush();
 
+  // Overrides HtmlParse::ApplyFilter to charge the thread CPU time spent in
+  // the filter to its histogram in RewriteStats, when
+  // RewriteOptions::account_filter_cpu_time is on.
+  virtual void ApplyFilter(HtmlFilter* filter);
+
+  // Runs the filters separately, through ApplyFilter, when
+  // account_filter_cpu_time is on.
+  virtual void ApplyFusedFilters(const FilterVector& filters);
+
   // Initiates an asynchronous Flush.  done->Run() will be called when
   // the flush is complete.  Further calls to ParseText should be deferred until
   // the callback is called. Scheduler mutex is not held while done is called.
@@ -1324,6 +1341,10 @@ class RewriteDriver : public HtmlParse {
   // Parses an arbitrary block of an html file
   virtual void ParseTextInternal(const char* content, int size);
 
+  // Returns the id a filter's CPU time is accounted under: its id() for
+  // RewriteFilters, and RewriteStats::kOtherFilterId for other HtmlFilters.
+  StringPiece FilterCpuAccountingId(const HtmlFilter* filter) const;
+
   // Indicates whether we should skip parsing for the given request.
   bool ShouldSkipParsing();
 
@@ -1738,6 +1759,9 @@ class RewriteDriver : public HtmlParse {
   // the context is reference counted.)
   RequestContextPtr request_context_;
 
+  // Times how long each flush waits for its rewrites to complete.
+  ScopedTraceSpan flush_wait_span_;
+
   // Start time for HTML requests. Used for statistics reporting.
   int64 start_time_ms_;
 
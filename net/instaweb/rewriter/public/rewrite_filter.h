@@ -43,6 +43,10 @@ class RewriteFilter : public CommonFilter {
 
   virtual const char* id() const = 0;
 
+  // RewriteContext labels its rewrites with the id, so we label the filter's
+  // HTML pass the same way, and a profile shows all of its work together.
+  virtual const char* ProfileLabel() const { return id(); }
+
   // Override DetermineEnabled so that filters that use the DOM cohort of the
   // property cache can enable writing of it in the RewriterDriver. Filters
   // inheriting from RewriteDriver that use the DOM cohort should override
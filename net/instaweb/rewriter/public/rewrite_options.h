@@ -219,6 +219,7 @@ class RewriteOptions {
   // css_filter.cc.
   static const char kAcceptInvalidSignatures[];
   static const char kAccessControlAllowOrigins[];
+  static const char kAccountFilterCpuTime[];
   static const char kAddOptionsToUrls[];
   static const char kAllowLoggingUrlsInLogRecord[];
   static const char kAllowOptionsToBeSetByCookies[];
@@ -227,6 +228,8 @@ class RewriteOptions {
   static const char kAnalyticsID[];
   static const char kAvoidRenamingIntrospectiveJavascript[];
   static const char kAwaitPcacheLookup[];
+  static const char kBeaconBatchIntervalMs[];
+  static const char kBeaconBatchMaxBeacons[];
   static const char kBeaconReinstrumentTimeSec[];
   static const char kBeaconUrl[];
   static const char kBlinkMaxHtmlSizeRewritable[];
@@ -234,6 +237,7 @@ class RewriteOptions {
   static const char kCacheSmallImagesUnrewritten[];
   static const char kClientDomainRewrite[];
   static const char kCombineAcrossPaths[];
+  static const char kComputeCriticalSelectorsOnServer[];
   static const char kCriticalImagesBeaconEnabled[];
   static const char kCriticalLineConfig[];
   static const char kCssFlattenMaxBytes[];
@@ -270,6 +274,9 @@ class RewriteOptions {
   static const char kFetcherTimeOutMs[];
   static const char kFinderPropertiesCacheExpirationTimeMs[];
   static const char kFinderPropertiesCacheRefreshTimeMs[];
+  static const char kFlushBudgetBytes[];
+  static const char kFlushBudgetElements[];
+  static const char kFlushBudgetMs[];
   static const char kFlushBufferLimitBytes[];
   static const char kFlushHtml[];
   static const char kFlushMoreResourcesEarlyIfTimePermits[];
@@ -324,6 +331,7 @@ class RewriteOptions {
   static const char kMaxLowResImageSizeBytes[];
   static const char kMaxLowResToHighResImageSizePercentage[];
   static const char kMaxPrefetchJsElements[];
+  static const char kMaxRetainedHtmlParseBytes[];
   static const char kMaxRewriteInfoLogSize[];
   static const char kMaxUrlSegmentSize[];
   static const char kMaxUrlSize[];
@@ -355,6 +363,8 @@ class RewriteOptions {
   static const char kObliviousPagespeedUrls[];
   static const char kOptionCookiesDurationMs[];
   static const char kOverrideCachingTtlMs[];
+  static const char kPrecompressResources[];
+  static const char kPrescanUninterestingHtml[];
   static const char kPreserveUrlRelativity[];
   static const char kPrivateNotVaryForIE[];
   static const char kProactiveResourceFreshening[];
@@ -390,6 +400,7 @@ class RewriteOptions {
   static const char kUseImageScanlineApi[];
   static const char kUseSelectorsForCriticalCss[];
   static const char kUseSmartDiffInBlink[];
+  static const char kWaitForContendedRewrites[];
   static const char kXModPagespeedHeaderValue[];
   static const char kXPsaBlockingRewrite[];
   // Options that require special handling, e.g. non-scalar values
@@ -676,6 +687,7 @@ class RewriteOptions {
   static const int64 kDefaultMaxCacheableResponseContentLength;
   static const int64 kDefaultMaxHtmlCacheTimeMs;
   static const int64 kDefaultMaxHtmlParseBytes;
+  static const int64 kDefaultMaxRetainedHtmlParseBytes;
   static const int64 kDefaultMaxImageBytesForWebpInCss;
   static const int64 kDefaultMaxLowResImageSizeBytes;
   static const int kDefaultMaxLowResToFullResImageSizePercentage;
@@ -1448,6 +1460,18 @@ class RewriteOptions {
   void set_max_html_parse_bytes(int64 x) {
     set_option(x, &max_html_parse_bytes_);
   }
+  int64 max_retained_html_parse_bytes() const {
+    return max_retained_html_parse_bytes_.value();
+  }
+  void set_max_retained_html_parse_bytes(int64 x) {
+    set_option(x, &max_retained_html_parse_bytes_);
+  }
+  bool prescan_uninteresting_html() const {
+    return prescan_uninteresting_html_.value();
+  }
+  void set_prescan_uninteresting_html(bool x) {
+    set_option(x, &prescan_uninteresting_html_);
+  }
   int64 max_image_bytes_for_webp_in_css() const {
     return max_image_bytes_for_webp_in_css_.value();
   }
@@ -1602,6 +1626,35 @@ class RewriteOptions {
     set_option(x, &flush_buffer_limit_bytes_);
   }
 
+  // With flush_html on, how much HTML, in bytes or in elements, can be parsed
+  // past the last resource reference before PSA introduces a flush, so that
+  // output doesn't wait on a slow origin's next flush.  Values <= 0 disable
+  // each limit.
+  int64 flush_budget_bytes() const {
+    return flush_budget_bytes_.value();
+  }
+  void set_flush_budget_bytes(int64 x) {
+    set_option(x, &flush_budget_bytes_);
+  }
+  int flush_budget_elements() const {
+    return flush_budget_elements_.value();
+  }
+  void set_flush_budget_elements(int x) {
+    set_option(x, &flush_budget_elements_);
+  }
+
+  // With flush_html on, how long a flush window can stay open while HTML
+  // keeps arriving before PSA introduces a flush.  Values <= 0 disable it.
+  // Like the other budgets it is only checked in
+  // FlushHtmlFilter::EndElementImpl, so it can be overshot by however long it
+  // takes to parse up to the next closing tag.
+  int64 flush_budget_ms() const {
+    return flush_budget_ms_.value();
+  }
+  void set_flush_budget_ms(int64 x) {
+    set_option(x, &flush_budget_ms_);
+  }
+
   // The maximum length of a URL segment.
   // for http://a/b/c.d, this is == strlen("c.d")
   int max_url_segment_size() const { return max_url_segment_size_.value(); }
@@ -1877,6 +1930,27 @@ class RewriteOptions {
     return critical_images_beacon_enabled_.value();
   }
 
+  void set_compute_critical_selectors_on_server(bool x) {
+    set_option(x, &compute_critical_selectors_on_server_);
+  }
+  bool compute_critical_selectors_on_server() const {
+    return compute_critical_selectors_on_server_.value();
+  }
+
+  void set_beacon_batch_interval_ms(int64 x) {
+    set_option(x, &beacon_batch_interval_ms_);
+  }
+  int64 beacon_batch_interval_ms() const {
+    return beacon_batch_interval_ms_.value();
+  }
+
+  void set_beacon_batch_max_beacons(int x) {
+    set_option(x, &beacon_batch_max_beacons_);
+  }
+  int beacon_batch_max_beacons() const {
+    return beacon_batch_max_beacons_.value();
+  }
+
   void set_beacon_reinstrument_time_sec(int x) {
     set_option(x, &beacon_reinstrument_time_sec_);
   }
@@ -2574,6 +2648,27 @@ class RewriteOptions {
     return serve_rewritten_webp_urls_to_any_agent_.value();
   }
 
+  void set_precompress_resources(bool x) {
+    set_option(x, &precompress_resources_);
+  }
+  bool precompress_resources() const {
+    return precompress_resources_.value();
+  }
+
+  void set_account_filter_cpu_time(bool x) {
+    set_option(x, &account_filter_cpu_time_);
+  }
+  bool account_filter_cpu_time() const {
+    return account_filter_cpu_time_.value();
+  }
+
+  void set_wait_for_contended_rewrites(bool x) {
+    set_option(x, &wait_for_contended_rewrites_);
+  }
+  bool wait_for_contended_rewrites() const {
+    return wait_for_contended_rewrites_.value();
+  }
+
   void set_cache_fragment(StringPiece p) {
     set_option(p.as_string(), &cache_fragment_);
   }
@@ -3680,12 +3775,23 @@ class RewriteOptions {
   // The maximum number of bytes of HTML that we parse, before redirecting to
   // ?ModPagespeed=off.
   Option<int64> max_html_parse_bytes_;
+  // The most memory a pooled driver's parser keeps between documents, so the
+  // next one it parses needn't allocate it again.
+  Option<int64> max_retained_html_parse_bytes_;
+  // Whether the parser may pass markup that no enabled filter is interested
+  // in straight through to the output as raw text, without parsing it.  Any
+  // CommonFilter, which includes all the resource rewriters, wants every
+  // element, so this only helps pass-through configurations.
+  Option<bool> prescan_uninteresting_html_;
   // The maximum size of an image in CSS, which we convert to webp.
   Option<int64> max_image_bytes_for_webp_in_css_;
   // Resources with Cache-Control TTL less than this will not be rewritten.
   Option<int64> min_resource_cache_time_to_rewrite_ms_;
   Option<int64> idle_flush_time_ms_;
   Option<int64> flush_buffer_limit_bytes_;
+  Option<int64> flush_budget_bytes_;
+  Option<int> flush_budget_elements_;
+  Option<int64> flush_budget_ms_;
 
   // How long to wait in blocking fetches before timing out.
   // Applies to ResourceFetch::BlockingFetch() and class SyncFetcherAdapter.
@@ -3818,6 +3924,10 @@ class RewriteOptions {
   // Indicates whether image rewriting filters should insert the critical images
   // beacon code.
   Option<bool> critical_images_beacon_enabled_;
+  // Indicates whether the critical CSS beacon filter should also work out
+  // critical selectors itself, by matching them against the page's elements,
+  // until beacon results arrive.
+  Option<bool> compute_critical_selectors_on_server_;
   // Indicates whether the DomainRewriteFilter should also do client side
   // rewriting.
   Option<bool> client_domain_rewrite_;
@@ -3848,6 +3958,19 @@ class RewriteOptions {
 
   Option<bool> serve_rewritten_webp_urls_to_any_agent_;
 
+  // Store a gzipped copy of compressible rewritten resources in the HTTP
+  // cache, and serve it to clients that accept gzip.
+  Option<bool> precompress_resources_;
+
+  // Record the thread CPU time spent in each filter's parse callbacks and in
+  // each RewriteContext::Rewrite in per-filter histograms.
+  Option<bool> account_filter_cpu_time_;
+
+  // When another process or thread holds the creation lock for a rewrite,
+  // wait for it (up to the rewrite deadline) and reuse its result instead of
+  // serving the original resource.
+  Option<bool> wait_for_contended_rewrites_;
+
   // Flush more resources if origin is slow to respond.
   Option<bool> flush_more_resources_early_if_time_permits_;
 
@@ -3913,6 +4036,15 @@ class RewriteOptions {
   // beacon response.
   Option<int> beacon_reinstrument_time_sec_;
 
+  // How long beacon results for a page are held in memory before they are
+  // written to the property cache together.  0 writes each beacon as it
+  // arrives.
+  Option<int64> beacon_batch_interval_ms_;
+
+  // The most beacons held for a page before they are written, regardless of
+  // beacon_batch_interval_ms_.
+  Option<int> beacon_batch_max_beacons_;
+
   // Number of first N images for which low res image is generated. Negative
   // values will bypass image index check.
   Option<int> max_inlined_preview_images_index_;
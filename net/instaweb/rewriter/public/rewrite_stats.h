@@ -19,10 +19,12 @@
 #ifndef NET_INSTAWEB_REWRITER_PUBLIC_REWRITE_STATS_H_
 #define NET_INSTAWEB_REWRITER_PUBLIC_REWRITE_STATS_H_
 
+#include <map>
 #include <vector>
 
 #include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string_util.h"
 
 namespace net_instaweb {
 
@@ -50,6 +52,26 @@ class RewriteStats {
   // successful (200s).
   static const char kSuccessfulDownstreamCachePurges[];
 
+  // Prefix of the per-filter CPU time histograms, which are suffixed with the
+  // filter id, or with kOtherFilterId for filters without a histogram.
+  static const char kFilterCpuUsHistogramPrefix[];
+  static const char kOtherFilterId[];
+
+  // Adds the CPU time the calling thread uses between construction and
+  // destruction to a histogram, in microseconds.  Does nothing if the
+  // histogram is NULL.
+  class ScopedCpuTimer {
+   public:
+    explicit ScopedCpuTimer(Histogram* histogram);
+    ~ScopedCpuTimer();
+
+   private:
+    Histogram* histogram_;
+    int64 start_us_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedCpuTimer);
+  };
+
   RewriteStats(Statistics* stats, ThreadSystem* thread_system, Timer* timer);
   ~RewriteStats();
 
@@ -71,6 +93,8 @@ class RewriteStats {
     return num_cache_control_not_rewritable_resources_;
   }
   Variable* num_flushes() { return num_flushes_; }
+  Variable* html_name_intern_hits() { return html_name_intern_hits_; }
+  Variable* html_name_intern_misses() { return html_name_intern_misses_; }
   Variable* resource_404_count() { return resource_404_count_; }
   Variable* resource_url_domain_acceptances() {
     return resource_url_domain_acceptances_;
@@ -119,6 +143,9 @@ class RewriteStats {
   // HTML rewrite latency in ms.
   Histogram* rewrite_latency_histogram() { return rewrite_latency_histogram_; }
   Histogram* backend_latency_histogram() { return backend_latency_histogram_; }
+  // CPU time in us spent in the filter or RewriteContext with the given id,
+  // when RewriteOptions::account_filter_cpu_time is on.
+  Histogram* filter_cpu_us_histogram(StringPiece id) const;
 
   // Number of .pagespeed. resources fetched.
   TimedVariable* total_fetch_count() { return total_fetch_count_; }
@@ -141,6 +168,8 @@ class RewriteStats {
   Variable* num_cache_control_rewritable_resources_;
   Variable* num_cache_control_not_rewritable_resources_;
   Variable* num_flushes_;
+  Variable* html_name_intern_hits_;
+  Variable* html_name_intern_misses_;
   Variable* page_load_count_;
   Variable* resource_404_count_;
   Variable* resource_url_domain_acceptances_;
@@ -163,6 +192,12 @@ class RewriteStats {
   Histogram* rewrite_latency_histogram_;
   Histogram* backend_latency_histogram_;
 
+  // Keyed by filter id.  The keys point at the static ids from
+  // RewriteOptions::FilterId.
+  typedef std::map<StringPiece, Histogram*> FilterHistogramMap;
+  FilterHistogramMap filter_cpu_us_histograms_;
+  Histogram* other_filter_cpu_us_histogram_;
+
   TimedVariable* total_fetch_count_;
   TimedVariable* total_rewrite_count_;
   TimedVariable* num_rewrites_executed_;
@@ -19,7 +19,10 @@
 #ifndef NET_INSTAWEB_REWRITER_PUBLIC_SCAN_FILTER_H_
 #define NET_INSTAWEB_REWRITER_PUBLIC_SCAN_FILTER_H_
 
+#include <vector>
+
 #include "pagespeed/kernel/html/empty_html_filter.h"
+#include "pagespeed/kernel/html/html_name.h"
 
 namespace net_instaweb {
 
@@ -52,10 +55,19 @@ class ScanFilter : public EmptyHtmlFilter {
   virtual void Directive(HtmlDirectiveNode* directive);
   virtual void Flush();
 
+  // Only <base>, <meta> and elements with url-valued attributes matter to
+  // us, unless options have UrlValuedAttributes, which can be on any element.
+  // Markup between them will do as raw Characters.
+  virtual const HtmlName::Keyword* ElementKeywords(int* num_keywords) const;
+  virtual bool AcceptsRawMarkup() const;
+
   virtual const char* Name() const { return "Scan"; }
 
  private:
+  bool ScansAllElements() const;
+
   RewriteDriver* driver_;
+  std::vector<HtmlName::Keyword> keywords_;
   bool seen_any_nodes_;
   bool seen_refs_;
   bool seen_base_;
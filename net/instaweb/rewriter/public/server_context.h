@@ -55,6 +55,7 @@ namespace pagespeed { namespace js { struct JsTokenizerPatterns; } }
 namespace net_instaweb {
 
 class AsyncFetch;
+class BeaconAccumulator;
 class CacheHtmlInfoFinder;
 class CachePropertyStore;
 class CriticalCssFinder;
@@ -85,6 +86,7 @@ class StaticAssetManager;
 class Statistics;
 class ThreadSynchronizer;
 class Timer;
+class TraceSpanRing;
 class UrlNamer;
 class UsageDataReporter;
 class UserAgentMatcher;
@@ -340,6 +342,13 @@ class ServerContext {
   void LockForCreation(NamedLock* creation_lock,
                        QueuedWorkerPool::Sequence* worker, Function* callback);
 
+  // Wait up to wait_ms for a named lock held by another rewrite of the same
+  // resource, so that its result can be reused once it is written.  Runs
+  // callback once the lock is obtained, or cancels it on timeout.  Like
+  // TryLockForCreation, steals locks held for too long.
+  void WaitForCreation(NamedLock* creation_lock, int64 wait_ms,
+                       Function* callback);
+
   // Setters should probably only be used in testing.
   void set_hasher(Hasher* hasher) { hasher_ = hasher; }
   void set_signature(SHA1Signature* signature) { signature_ = signature; }
@@ -360,6 +369,15 @@ class ServerContext {
                     StringPiece user_agent,
                     const RequestContextPtr& request_context);
 
+  // If global_options()->beacon_batch_interval_ms() is positive, makes
+  // HandleBeacon hold beacon results in memory and write those for each page
+  // to the property cache together, every beacon_batch_interval_ms().  This
+  // is called from PostInitHook.
+  void InitBeaconAccumulator();
+  BeaconAccumulator* beacon_accumulator() {
+    return beacon_accumulator_.get();
+  }
+
   // Returns a pointer to the master global_options.  These are not used
   // directly in RewriteDrivers, but are Cloned into the drivers as they
   // are created.  We generally do not expect global_options() to change once
@@ -607,6 +625,11 @@ class ServerContext {
     hostname_ = x;
   }
 
+  // Ring that request spans are traced into, or NULL if span tracing is
+  // off.  set_trace_spans takes ownership.
+  TraceSpanRing* trace_spans() const { return trace_spans_.get(); }
+  void set_trace_spans(TraceSpanRing* x);
+
   // Adds an X-Original-Content-Length header to the response headers
   // based on the size of the input resources.
   void AddOriginalContentLengthHeader(const ResourceVector& inputs,
@@ -668,6 +691,12 @@ class ServerContext {
   // Returns NULL if non-CachePropertyStore is used.
   const CacheInterface* pcache_cache_backend();
 
+  // Returns the CachePropertyStore created by CreatePropertyStore, or NULL if
+  // a different PropertyStore is used.
+  CachePropertyStore* cache_property_store() {
+    return cache_property_store_.get();
+  }
+
   const pagespeed::js::JsTokenizerPatterns* js_tokenizer_patterns() const {
     return js_tokenizer_patterns_;
   }
@@ -844,6 +873,11 @@ class ServerContext {
 
   scoped_ptr<CachePropertyStore> cache_property_store_;
 
+  scoped_ptr<TraceSpanRing> trace_spans_;
+
+  // NULL unless beacon results are batched; see InitBeaconAccumulator.
+  scoped_ptr<BeaconAccumulator> beacon_accumulator_;
+
   DISALLOW_COPY_AND_ASSIGN(ServerContext);
 };
 
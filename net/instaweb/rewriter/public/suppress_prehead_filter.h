@@ -50,6 +50,11 @@ class SuppressPreheadFilter : public HtmlWriterFilter {
 
   virtual void EndDocument();
 
+  // Inserts a script into the head.
+  virtual bool CanShareFlushPass() const { return false; }
+  // Holds back the pre-head markup.
+  virtual bool AcceptsRawMarkup() const { return false; }
+
  protected:
   virtual void Clear();
   RewriteDriver* driver() const { return driver_; }
@@ -20,14 +20,17 @@
 
 #include "net/instaweb/rewriter/public/resource_fetch.h"
 
+#include "net/instaweb/http/public/async_fetch.h"
 #include "net/instaweb/http/public/sync_fetcher_adapter_callback.h"
 #include "net/instaweb/http/public/wait_url_async_fetcher.h"
+#include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_test_base.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/test_rewrite_driver_factory.h"
 #include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/string_writer.h"
@@ -47,6 +50,31 @@ const char kMinimizedCssContent[] = "*{display:none}";
 class ResourceFetchTest : public RewriteTestBase {
 };
 
+// Counts the bytes that arrive through WriteShared rather than Write.
+class SharedWriteCountingFetch : public StringAsyncFetch {
+ public:
+  SharedWriteCountingFetch(const RequestContextPtr& request_context,
+                           GoogleString* buffer)
+      : StringAsyncFetch(request_context, buffer),
+        shared_bytes_(0) {
+  }
+
+  size_t shared_bytes() const { return shared_bytes_; }
+
+ protected:
+  virtual bool HandleWriteShared(const SharedString& storage,
+                                 const StringPiece& content,
+                                 MessageHandler* handler) {
+    shared_bytes_ += content.size();
+    return StringAsyncFetch::HandleWrite(content, handler);
+  }
+
+ private:
+  size_t shared_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedWriteCountingFetch);
+};
+
 TEST_F(ResourceFetchTest, BlockingFetch) {
   SetResponseWithDefaultHeaders("a.css", kContentTypeCss, kCssContent, 100);
 
@@ -82,6 +110,35 @@ TEST_F(ResourceFetchTest, BlockingFetch) {
   EXPECT_EQ(kMinimizedCssContent, buffer);
 }
 
+TEST_F(ResourceFetchTest, CachedResourceWrittenShared) {
+  SetResponseWithDefaultHeaders("a.css", kContentTypeCss, kCssContent, 100);
+  GoogleString url = Encode(kTestDomain, "cf", "0", "a.css", "css");
+
+  // The first fetch rewrites the resource and puts it into the HTTP cache.
+  GoogleString content;
+  ASSERT_TRUE(FetchResourceUrl(url, &content));
+  EXPECT_EQ(kMinimizedCssContent, content);
+
+  // The second is served from cache, and ResourceFetch should pass the
+  // cached bytes through to its base fetch by reference.
+  GoogleString buffer;
+  SharedWriteCountingFetch fetch(CreateRequestContext(), &buffer);
+  RewriteDriver* custom_driver =
+      server_context()->NewCustomRewriteDriver(
+          server_context()->global_options()->Clone(),
+          CreateRequestContext());
+  ResourceFetch::StartWithDriver(
+      GoogleUrl(url), ResourceFetch::kDontAutoCleanupDriver, server_context(),
+      custom_driver, &fetch);
+  custom_driver->WaitForShutDown();
+  custom_driver->Cleanup();
+
+  EXPECT_TRUE(fetch.done());
+  EXPECT_TRUE(fetch.success());
+  EXPECT_EQ(kMinimizedCssContent, buffer);
+  EXPECT_EQ(STATIC_STRLEN(kMinimizedCssContent), fetch.shared_bytes());
+}
+
 TEST_F(ResourceFetchTest, BlockingFetchOfInvalidUrl) {
   // Fetch stuff.
   GoogleString buffer;
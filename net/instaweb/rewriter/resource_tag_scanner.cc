@@ -19,8 +19,11 @@
 
 #include "net/instaweb/rewriter/public/resource_tag_scanner.h"
 
+#include <vector>
+
 #include "net/instaweb/rewriter/public/css_tag_scanner.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_name.h"
@@ -47,6 +50,38 @@ const char kAttrValImage[] = "image";  // <input type="image" src=...>
 
 namespace {
 
+// The elements CategorizeAttributeBySpec knows url-valued attributes of.
+const HtmlName::Keyword kResourceElements[] = {
+  HtmlName::kA,
+  HtmlName::kArea,
+  HtmlName::kAudio,
+  HtmlName::kBlockquote,
+  HtmlName::kBody,
+  HtmlName::kButton,
+  HtmlName::kCommand,
+  HtmlName::kDel,
+  HtmlName::kEmbed,
+  HtmlName::kForm,
+  HtmlName::kFrame,
+  HtmlName::kHtml,
+  HtmlName::kIframe,
+  HtmlName::kImg,
+  HtmlName::kInput,
+  HtmlName::kIns,
+  HtmlName::kLink,
+  HtmlName::kQ,
+  HtmlName::kScript,
+  HtmlName::kSource,
+  HtmlName::kTable,
+  HtmlName::kTbody,
+  HtmlName::kTd,
+  HtmlName::kTfoot,
+  HtmlName::kTh,
+  HtmlName::kThead,
+  HtmlName::kTrack,
+  HtmlName::kVideo,
+};
+
 bool IsAttributeValid(HtmlElement::Attribute* attr) {
   return attr != NULL && !attr->decoding_error();
 }
@@ -178,6 +213,56 @@ semantic_type::Category CategorizeAttributeBySpec(
   return semantic_type::kUndefined;
 }
 
+// ScanElement's results for one element, cached on the element so that the
+// filters that scan it after the first one needn't classify its attributes
+// again.  The element drops the cache when its name or attribute list
+// changes; renaming one of the url-valued attributes in place is caught by
+// remembering the names they had.
+class ScanCache : public HtmlElement::AttributeCache {
+ public:
+  ScanCache(const RewriteOptions* options, const UrlCategoryVector& attributes)
+      : options_(options),
+        attributes_(attributes) {
+    names_.reserve(attributes.size());
+    for (int i = 0, n = attributes.size(); i < n; ++i) {
+      names_.push_back(attributes[i].url->name_str().data());
+    }
+  }
+  virtual ~ScanCache() {}
+
+  // Appends the cached attributes and returns true if they still describe
+  // the element as scanned with options.
+  bool Lookup(const RewriteOptions* options,
+              UrlCategoryVector* attributes) const {
+    if (options != options_) {
+      return false;
+    }
+    for (int i = 0, n = attributes_.size(); i < n; ++i) {
+      if (attributes_[i].url->name_str().data() != names_[i]) {
+        return false;
+      }
+    }
+    attributes->insert(attributes->end(), attributes_.begin(),
+                       attributes_.end());
+    return true;
+  }
+
+ private:
+  const RewriteOptions* options_;
+  UrlCategoryVector attributes_;
+  std::vector<const char*> names_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScanCache);
+};
+
+// The categories of a link's href and of an input's src depend on the values
+// of rel and type, which can change without the element noticing, so we
+// don't cache those.
+bool IsCacheable(const HtmlElement* element) {
+  return (element->keyword() != HtmlName::kLink) &&
+      (element->keyword() != HtmlName::kInput);
+}
+
 }  // namespace
 
 semantic_type::Category CategorizeAttribute(
@@ -212,14 +297,32 @@ semantic_type::Category CategorizeAttribute(
   return semantic_type::kUndefined;
 }
 
+const HtmlName::Keyword* ResourceElementKeywords(int* num_keywords) {
+  *num_keywords = arraysize(kResourceElements);
+  return kResourceElements;
+}
+
 void ScanElement(HtmlElement* element,
                  const RewriteOptions* options,
                  UrlCategoryVector* attributes) {
-  HtmlElement::AttributeList* attrs = element->mutable_attributes();
-  for (HtmlElement::AttributeIterator i = attrs->begin();
-       i != attrs->end(); ++i) {
+  bool cacheable = IsCacheable(element);
+  if (cacheable) {
+    const ScanCache* cache =
+        static_cast<const ScanCache*>(element->attribute_cache());
+    if ((cache != NULL) && cache->Lookup(options, attributes)) {
+      return;
+    }
+  }
+
+  // Walk the attributes without calling mutable_attributes(), which would
+  // drop the cache we're about to fill.  We hand out mutable attributes of
+  // an element our caller was given as mutable, so this is safe.
+  int first = attributes->size();
+  const HtmlElement::AttributeList& attrs = element->attributes();
+  for (HtmlElement::AttributeConstIterator i = attrs.begin();
+       i != attrs.end(); ++i) {
     UrlCategoryPair url_category_pair;
-    url_category_pair.url = i.Get();
+    url_category_pair.url = const_cast<HtmlElement::Attribute*>(i.Get());
     if (IsAttributeValid(url_category_pair.url)) {
       url_category_pair.category = CategorizeAttribute(
           element, url_category_pair.url, options);
@@ -228,6 +331,12 @@ void ScanElement(HtmlElement* element,
       }
     }
   }
+
+  if (cacheable) {
+    element->set_attribute_cache(new ScanCache(
+        options, UrlCategoryVector(attributes->begin() + first,
+                                   attributes->end())));
+  }
 }
 
 }  // namespace resource_tag_scanner
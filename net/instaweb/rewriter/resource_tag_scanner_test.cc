@@ -690,6 +690,107 @@ TEST_F(ResourceTagScannerTest, THeadBackgroundImage) {
   EXPECT_EQ(semantic_type::kImage, resource_category_[0]);
 }
 
+// Scans each element, so that its classification is cached, then edits it
+// before ResourceCollector scans it again.
+class ScanThenEditFilter : public EmptyHtmlFilter {
+ public:
+  enum Edit {
+    kSetSrc,
+    kDeleteSrc,
+    kRenameSrc,
+    kSetRelToIcon,
+  };
+
+  ScanThenEditFilter(Edit edit, RewriteDriver* driver)
+      : edit_(edit),
+        driver_(driver) {}
+
+  virtual void StartElement(HtmlElement* element) {
+    resource_tag_scanner::UrlCategoryVector attributes;
+    resource_tag_scanner::ScanElement(element, driver_->options(), &attributes);
+    switch (edit_) {
+      case kSetSrc:
+        if (element->FindAttribute(HtmlName::kSrc) != NULL) {
+          element->FindAttribute(HtmlName::kSrc)->SetValue("edited.jpg");
+        }
+        break;
+      case kDeleteSrc:
+        element->DeleteAttribute(HtmlName::kSrc);
+        break;
+      case kRenameSrc:
+        if (element->FindAttribute(HtmlName::kSrc) != NULL) {
+          element->FindAttribute(HtmlName::kSrc)->set_name(
+              driver_->MakeName("data-src"));
+        }
+        break;
+      case kSetRelToIcon:
+        if (element->FindAttribute(HtmlName::kRel) != NULL) {
+          element->FindAttribute(HtmlName::kRel)->SetValue("icon");
+        }
+        break;
+    }
+  }
+
+  virtual const char* Name() const { return "ScanThenEdit"; }
+
+ private:
+  Edit edit_;
+  RewriteDriver* driver_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScanThenEditFilter);
+};
+
+class ResourceTagScannerCacheTest : public RewriteTestBase {
+ protected:
+  virtual bool AddBody() const { return true; }
+
+  void AddFilters(ScanThenEditFilter::Edit edit) {
+    editor_.reset(new ScanThenEditFilter(edit, rewrite_driver()));
+    collector_.reset(
+        new ResourceCollector(
+            &resources_, &resource_category_, rewrite_driver()));
+    rewrite_driver()->AddFilter(editor_.get());
+    rewrite_driver()->AddFilter(collector_.get());
+  }
+
+  StringVector resources_;
+  CategoryVector resource_category_;
+  scoped_ptr<ScanThenEditFilter> editor_;
+  scoped_ptr<ResourceCollector> collector_;
+};
+
+TEST_F(ResourceTagScannerCacheTest, SeesNewValue) {
+  AddFilters(ScanThenEditFilter::kSetSrc);
+  ValidateExpected("SeesNewValue",
+                   "<img src=a.jpg>", "<img src=edited.jpg>");
+  ASSERT_EQ(static_cast<size_t>(1), resources_.size());
+  EXPECT_STREQ("edited.jpg", resources_[0]);
+  EXPECT_EQ(semantic_type::kImage, resource_category_[0]);
+}
+
+TEST_F(ResourceTagScannerCacheTest, SeesDeletedAttribute) {
+  AddFilters(ScanThenEditFilter::kDeleteSrc);
+  ValidateExpected("SeesDeletedAttribute", "<img src=a.jpg>", "<img>");
+  EXPECT_TRUE(resources_.empty());
+}
+
+TEST_F(ResourceTagScannerCacheTest, SeesRenamedAttribute) {
+  AddFilters(ScanThenEditFilter::kRenameSrc);
+  ValidateExpected("SeesRenamedAttribute",
+                   "<img src=a.jpg>", "<img data-src=a.jpg>");
+  EXPECT_TRUE(resources_.empty());
+}
+
+TEST_F(ResourceTagScannerCacheTest, SeesNewLinkRel) {
+  AddFilters(ScanThenEditFilter::kSetRelToIcon);
+  ValidateExpected("SeesNewLinkRel",
+                   "<link rel=stylesheet href=a.png>",
+                   "<link rel=icon href=a.png>");
+  ASSERT_EQ(static_cast<size_t>(1), resources_.size());
+  EXPECT_STREQ("a.png", resources_[0]);
+  EXPECT_EQ(semantic_type::kImage, resource_category_[0]);
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
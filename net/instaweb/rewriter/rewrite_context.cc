@@ -62,6 +62,7 @@
 #include "pagespeed/kernel/base/named_lock_manager.h"
 #include "pagespeed/kernel/base/proto_util.h"
 #include "pagespeed/kernel/base/request_trace.h"
+#include "pagespeed/kernel/base/sampling_profiler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/statistics.h"
@@ -91,6 +92,8 @@ const char kRewriteContextLockPrefix[] = "rc:";
 // There is no partition index for other dependency fields. Use a constant
 // to denote that.
 const int kOtherDependencyPartitionIndex = -1;
+// How long to wait for a contended rewrite when there's no rewrite deadline.
+const int64 kMaxContendedRewriteWaitMs = 5 * Timer::kSecondMs;
 
 }  // namespace
 
@@ -1202,8 +1205,14 @@ class RewriteContext::InvokeRewriteFunction : public Function {
   virtual ~InvokeRewriteFunction() {}
 
   virtual void Run() {
-    context_->FindServerContext()->rewrite_stats()->num_rewrites_executed()
-        ->IncBy(1);
+    RewriteStats* stats = context_->FindServerContext()->rewrite_stats();
+    stats->num_rewrites_executed()->IncBy(1);
+    SamplingProfiler::ScopedLabel profiler_label(context_->id());
+    // Only the synchronous part of Rewrite is charged to the filter; work it
+    // hands to other threads or callbacks is not.
+    RewriteStats::ScopedCpuTimer cpu_timer(
+        context_->Options()->account_filter_cpu_time() ?
+        stats->filter_cpu_us_histogram(context_->id()) : NULL);
     context_->Rewrite(partition_,
                       context_->partitions_->mutable_partition(partition_),
                       output_);
@@ -1226,6 +1235,7 @@ RewriteContext::CacheLookupResultCallback::~CacheLookupResultCallback() {
 
 void RewriteContext::InitStats(Statistics* stats) {
   stats->AddVariable(kNumRewritesAbandonedForLockContention);
+  stats->AddVariable(kNumRewritesReusedAfterLockContention);
   stats->AddVariable(kNumDistributedRewriteSuccesses);
   stats->AddVariable(kNumDistributedRewriteFailures);
   stats->AddVariable(kNumDistributedMetadataFailures);
@@ -1234,6 +1244,8 @@ void RewriteContext::InitStats(Statistics* stats) {
 
 const char RewriteContext::kNumRewritesAbandonedForLockContention[] =
     "num_rewrites_abandoned_for_lock_contention";
+const char RewriteContext::kNumRewritesReusedAfterLockContention[] =
+    "num_rewrites_reused_after_lock_contention";
 const char RewriteContext::kNumDeadlineAlarmInvocations[] =
     "num_deadline_alarm_invocations";
 const char RewriteContext::kNumDistributedRewriteFailures[] =
@@ -1270,6 +1282,7 @@ RewriteContext::RewriteContext(RewriteDriver* driver,
     notify_driver_on_fetch_done_(false),
     force_rewrite_(false),
     stale_rewrite_(false),
+    waited_for_creation_lock_(false),
     is_metadata_cache_miss_(false),
     rewrite_uncacheable_(false),
     dependent_request_trace_(NULL),
@@ -1277,6 +1290,9 @@ RewriteContext::RewriteContext(RewriteDriver* driver,
     num_rewrites_abandoned_for_lock_contention_(
         Driver()->statistics()->GetVariable(
             kNumRewritesAbandonedForLockContention)),
+    num_rewrites_reused_after_lock_contention_(
+        Driver()->statistics()->GetVariable(
+            kNumRewritesReusedAfterLockContention)),
     num_distributed_rewrite_failures_(
         Driver()->statistics()->GetVariable(kNumDistributedRewriteFailures)),
     num_distributed_rewrite_successes_(
@@ -1355,6 +1371,10 @@ void RewriteContext::Start() {
   DCHECK(!started_);
   DCHECK_EQ(0, num_predecessors_);
   started_ = true;
+  const RequestContextPtr& request_context = Driver()->request_context();
+  if (request_context.get() != NULL) {
+    request_context->StartTraceSpan("rewrite_context", id(), &rewrite_span_);
+  }
 
   // See if any of the input slots are marked as unsafe for use,
   // and if so bail out quickly.
@@ -1402,6 +1422,11 @@ void RewriteContext::Start() {
           this, &RewriteContext::OutputCacheDone))->Done(
               CacheInterface::kNotFound);
     } else {
+      if (request_context.get() != NULL) {
+        request_context->StartTraceSpan("rewrite_context",
+                                        "RewriteContext::MetadataLookup",
+                                        &metadata_lookup_span_);
+      }
       metadata_cache->Get(
           partition_key_, new OutputCacheCallback(
               this, &RewriteContext::OutputCacheDone));
@@ -1568,12 +1593,17 @@ void RewriteContext::AddRecheckDependency() {
 
 void RewriteContext::OutputCacheDone(CacheLookupResult* cache_result) {
   DCHECK_LE(0, outstanding_fetches_);
+  metadata_lookup_span_.End();
 
   scoped_ptr<CacheLookupResult> owned_cache_result(cache_result);
 
   partitions_.reset(owned_cache_result->partitions.release());
-  LogMetadataCacheInfo(owned_cache_result->cache_ok,
-                       owned_cache_result->can_revalidate);
+  // A lookup repeated after waiting for a contended lock was already logged
+  // the first time round.
+  if (!waited_for_creation_lock_) {
+    LogMetadataCacheInfo(owned_cache_result->cache_ok,
+                         owned_cache_result->can_revalidate);
+  }
 
   // If something already created output resources (like DistributedRewriteDone)
   // then don't append new ones here.
@@ -1649,6 +1679,10 @@ void RewriteContext::OutputCacheMiss() {
         "server_context->shutting_down(); leaking the context.");
   } else if (ShouldDistributeRewrite()) {
     DistributeRewrite();
+  } else if (waited_for_creation_lock_ && Lock()->Held()) {
+    // We waited for another rewrite of this partition, but it did not leave
+    // a usable result behind, so do it ourselves under the lock we now hold.
+    CallFetchInputs();
   } else {
     server_context->TryLockForCreation(Lock(), MakeFunction(
         this,
@@ -1665,12 +1699,49 @@ void RewriteContext::CallLockFailed() {
   Driver()->AddRewriteTask(MakeFunction(this, &RewriteContext::LockFailed));
 }
 
+void RewriteContext::CallRecheckAfterLockWait() {
+  Driver()->AddRewriteTask(
+      MakeFunction(this, &RewriteContext::RecheckAfterLockWait));
+}
+
 void RewriteContext::LockFailed() {
+  ServerContext* server_context = FindServerContext();
+  if (!waited_for_creation_lock_ && Options()->wait_for_contended_rewrites() &&
+      !server_context->shutting_down()) {
+    // Someone else is doing this rewrite.  The lock is released only after
+    // the result has been written to the metadata cache, so once we get it we
+    // can most likely just read their result.  There is no point waiting past
+    // the deadline, when the HTML will have moved on without us.
+    waited_for_creation_lock_ = true;
+    int64 wait_ms = GetRewriteDeadlineAlarmMs();
+    if (wait_ms <= 0) {
+      wait_ms = kMaxContendedRewriteWaitMs;
+    }
+    server_context->WaitForCreation(Lock(), wait_ms, MakeFunction(
+        this,
+        &RewriteContext::CallRecheckAfterLockWait,
+        &RewriteContext::CallLockFailed));
+    return;
+  }
   num_rewrites_abandoned_for_lock_contention_->Add(1);
   MarkTooBusy();
   Activate();
 }
 
+void RewriteContext::RecheckAfterLockWait() {
+  FindServerContext()->metadata_cache()->Get(
+      partition_key_, new OutputCacheCallback(
+          this, &RewriteContext::RecheckAfterLockWaitDone));
+}
+
+void RewriteContext::RecheckAfterLockWaitDone(
+    CacheLookupResult* cache_result) {
+  if (cache_result->cache_ok) {
+    num_rewrites_reused_after_lock_contention_->Add(1);
+  }
+  OutputCacheDone(cache_result);
+}
+
 bool RewriteContext::IsDistributedRewriteForHtml() const {
   const RequestHeaders* request_headers = Driver()->request_headers();
   if (request_headers != NULL &&
@@ -2440,6 +2511,7 @@ void RewriteContext::Propagate(bool render_slots) {
 
 void RewriteContext::Finalize() {
   rewrite_done_ = true;
+  rewrite_span_.End();
   DCHECK_EQ(0, num_pending_nested_);
   if (IsFetchRewrite()) {
     fetch_->FetchDone();
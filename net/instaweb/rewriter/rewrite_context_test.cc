@@ -49,6 +49,7 @@
 #include "net/instaweb/rewriter/public/test_rewrite_driver_factory.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/charset_util.h"
+#include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/gtest.h"
 #include "pagespeed/kernel/base/mem_file_system.h"
 #include "pagespeed/kernel/base/mock_message_handler.h"
@@ -71,6 +72,7 @@
 #include "pagespeed/kernel/http/response_headers.h"
 #include "pagespeed/kernel/http/semantic_type.h"
 #include "pagespeed/kernel/http/user_agent_matcher_test_base.h"
+#include "pagespeed/kernel/thread/mock_scheduler.h"
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/thread/worker_test_base.h"
 
@@ -4911,6 +4913,136 @@ TEST_F(RewriteContextTest, AbandonRedundantFetchInHTML) {
   EXPECT_EQ(0, counting_url_async_fetcher()->fetch_count());
 }
 
+TEST_F(RewriteContextTest, ReuseContendedRewriteInHTML) {
+  // As in AbandonRedundantFetchInHTML, the first rewrite takes the creation
+  // lock and finishes just after its deadline.  This time the second driver
+  // waits for the lock rather than abandoning, and then renders the first
+  // rewrite's result without rewriting again.
+  RewriteOptions* new_options_ = other_options_->Clone();
+  new_options_->set_wait_for_contended_rewrites(true);
+  delete other_rewrite_driver_;
+  other_rewrite_driver_ = MakeDriver(server_context_, new_options_);
+  InitResources();
+
+  FakeFilter* fake1 =
+      new FakeFilter(TrimWhitespaceRewriter::kFilterId, rewrite_driver_,
+                     semantic_type::kStylesheet);
+  fake1->set_exceed_deadline(true);
+  rewrite_driver_->AppendRewriteFilter(fake1);
+  rewrite_driver_->AddFilters();
+  FakeFilter* fake2 =
+      new FakeFilter(TrimWhitespaceRewriter::kFilterId, other_rewrite_driver_,
+                     semantic_type::kStylesheet);
+  other_rewrite_driver_->AppendRewriteFilter(fake2);
+  other_rewrite_driver_->AddFilters();
+
+  const GoogleString encoded =
+      Encode("", TrimWhitespaceRewriter::kFilterId, "0", "a.css", "css");
+  ValidateNoChanges("trimmable", CssLinkHref("a.css"));
+  EXPECT_EQ(0, fake1->num_rewrites());
+
+  // The second driver's wait ends when the first rewrite finishes, 1us past
+  // its deadline but well inside the second driver's.
+  SetActiveServer(kSecondary);
+  ValidateExpected("trimmable2", CssLinkHref("a.css"), CssLinkHref(encoded));
+  SetActiveServer(kPrimary);
+  EXPECT_EQ(1, fake1->num_rewrites());
+  EXPECT_EQ(0, fake2->num_rewrites());
+  EXPECT_EQ(1, counting_url_async_fetcher()->fetch_count());
+  EXPECT_EQ(1, statistics()->GetVariable(
+      RewriteContext::kNumRewritesReusedAfterLockContention)->Get());
+  EXPECT_EQ(0, statistics()->GetVariable(
+      RewriteContext::kNumRewritesAbandonedForLockContention)->Get());
+}
+
+namespace {
+
+// Stands in for another process rewriting the same partition.  While
+// installed, the first creation lock made is taken by a second lock object
+// before the RewriteContext gets to try it, and held until Release().
+class ContendedCreationLockManager : public NamedLockManager {
+ public:
+  explicit ContendedCreationLockManager(ServerContext* server_context)
+      : server_context_(server_context),
+        lock_manager_(server_context->lock_manager()),
+        lock_tester_(server_context->thread_system()) {
+    server_context_->set_lock_manager(this);
+  }
+
+  virtual ~ContendedCreationLockManager() {
+    server_context_->set_lock_manager(lock_manager_);
+  }
+
+  virtual NamedLock* CreateNamedLock(const StringPiece& name) {
+    if ((other_lock_.get() == NULL) && name.ends_with(".outputlock")) {
+      other_lock_.reset(lock_manager_->CreateNamedLock(name));
+      CHECK(lock_tester_.TryLock(other_lock_.get()));
+    }
+    return lock_manager_->CreateNamedLock(name);
+  }
+
+  // Releases the lock without writing a result, as though the other process
+  // had died.
+  void Release() { other_lock_->Unlock(); }
+
+ private:
+  ServerContext* server_context_;
+  NamedLockManager* lock_manager_;
+  NamedLockTester lock_tester_;
+  scoped_ptr<NamedLock> other_lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(ContendedCreationLockManager);
+};
+
+}  // namespace
+
+TEST_F(RewriteContextTest, RewriteAfterWaitingForContendedLock) {
+  options()->ClearSignatureForTesting();
+  options()->set_wait_for_contended_rewrites(true);
+  options()->ComputeSignature();
+  InitTrimFilters(kRewrittenResource);
+  InitResources();
+
+  // The lock is released with nothing in the metadata cache, so once we have
+  // it we do the rewrite ourselves, without trying to lock again.
+  ContendedCreationLockManager lock_manager(server_context());
+  mock_scheduler()->AddAlarmAtUs(
+      timer()->NowUs() + Timer::kMsUs,
+      MakeFunction(&lock_manager, &ContendedCreationLockManager::Release));
+  EXPECT_EQ(0, RewriteAndCountUnrewrittenCss("contended",
+                                             CssLinkHref("a.css")));
+  EXPECT_EQ(1, trim_filter_->num_rewrites());
+  EXPECT_EQ(1, counting_url_async_fetcher()->fetch_count());
+  EXPECT_EQ(0, statistics()->GetVariable(
+      RewriteContext::kNumRewritesReusedAfterLockContention)->Get());
+  EXPECT_EQ(0, statistics()->GetVariable(
+      RewriteContext::kNumRewritesAbandonedForLockContention)->Get());
+  // The second lookup, after the wait, isn't logged as another miss.
+  EXPECT_EQ(1, metadata_cache_info().num_misses());
+  EXPECT_EQ(0, metadata_cache_info().num_hits());
+}
+
+TEST_F(RewriteContextTest, AbandonAfterWaitingForContendedLock) {
+  options()->ClearSignatureForTesting();
+  options()->set_wait_for_contended_rewrites(true);
+  options()->ComputeSignature();
+  InitTrimFilters(kRewrittenResource);
+  InitResources();
+
+  // The lock is never released, so the wait times out at the deadline and
+  // the rewrite is abandoned, just as if we had not waited.
+  ContendedCreationLockManager lock_manager(server_context());
+  EXPECT_EQ(1, RewriteAndCountUnrewrittenCss("contended",
+                                             CssLinkHref("a.css")));
+  rewrite_driver()->WaitForShutDown();
+  EXPECT_EQ(0, trim_filter_->num_rewrites());
+  EXPECT_EQ(0, counting_url_async_fetcher()->fetch_count());
+  EXPECT_EQ(0, statistics()->GetVariable(
+      RewriteContext::kNumRewritesReusedAfterLockContention)->Get());
+  EXPECT_EQ(1, statistics()->GetVariable(
+      RewriteContext::kNumRewritesAbandonedForLockContention)->Get());
+}
+
 TEST_F(RewriteContextTest, WaitForRedundantRewriteInFetchAfterHtml) {
   // Test that an HTML request with a resource followed by a reconstruction
   // request for the same resource only rewrites and fetches once. We simulate
@@ -356,6 +356,12 @@ void RewriteDriver::set_request_context(const RequestContextPtr& x) {
         options()->allow_logging_urls_in_log_record());
     request_context_->log_record()->SetLogUrlIndices(
         options()->log_url_indices());
+    // Servers that trace spans normally attach the ring when they create the
+    // request context; pick up any context that got here without one.
+    if ((request_context_->trace_spans() == NULL) &&
+        (server_context_->trace_spans() != NULL)) {
+      request_context_->set_trace_spans(server_context_->trace_spans());
+    }
     PopulateRequestContext();
   }
 }
@@ -639,6 +645,20 @@ void RewriteDriver::ExecuteFlushIfRequestedAsync(Function* callback) {
   }
 }
 
+bool RewriteDriver::FiltersNeedCompleteHead() const {
+  const FilterList* lists[] = {&early_pre_render_filters_,
+                               &pre_render_filters_};
+  for (int i = 0, n = arraysize(lists); i < n; ++i) {
+    for (FilterList::const_iterator it = lists[i]->begin();
+         it != lists[i]->end(); ++it) {
+      if ((*it)->is_enabled() && (*it)->NeedsCompleteHead()) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 void RewriteDriver::Flush() {
   SchedulerBlockingFunction wait(scheduler_);
   FlushAsync(&wait);
@@ -656,20 +676,8 @@ void RewriteDriver::FlushAsync(Function* callback) {
 
   DetermineEnabledFilters();
 
-  for (FilterList::iterator it = early_pre_render_filters_.begin();
-      it != early_pre_render_filters_.end(); ++it) {
-    HtmlFilter* filter = *it;
-    if (filter->is_enabled()) {
-      ApplyFilter(filter);
-    }
-  }
-  for (FilterList::iterator it = pre_render_filters_.begin();
-      it != pre_render_filters_.end(); ++it) {
-    HtmlFilter* filter = *it;
-    if (filter->is_enabled()) {
-      ApplyFilter(filter);
-    }
-  }
+  ApplyFilters(early_pre_render_filters_);
+  ApplyFilters(pre_render_filters_);
 
   int num_rewrites = rewrites_.size();
 
@@ -713,6 +721,9 @@ void RewriteDriver::FlushAsync(Function* callback) {
     Function* flush_async_done =
         MakeFunction(this, &RewriteDriver::QueueFlushAsyncDone,
                      num_rewrites, callback);
+    request_context_->StartTraceSpan("rewrite_driver",
+                                     "RewriteDriver::WaitForRewrites",
+                                     &flush_wait_span_);
     if (fully_rewrite_on_flush_) {
       CheckForCompletionAsync(kWaitForCompletion, -1, flush_async_done);
     } else {
@@ -751,6 +762,7 @@ void RewriteDriver::QueueFlushAsyncDone(int num_rewrites, Function* callback) {
 void RewriteDriver::FlushAsyncDone(int num_rewrites, Function* callback) {
   DCHECK(request_context_.get() != NULL);
   TraceLiteral("RewriteDriver::FlushAsyncDone()");
+  flush_wait_span_.End();
 
   {
     ScopedMutex lock(rewrite_mutex());
@@ -1356,6 +1368,7 @@ void RewriteDriver::AddPostRenderFilters() {
     AddOwnedPostRenderFilter(new RedirectOnSizeLimitFilter(this));
     set_size_limit(rewrite_options->max_html_parse_bytes());
   }
+  set_max_retained_bytes(rewrite_options->max_retained_html_parse_bytes());
 
   if (rewrite_options->Enabled(RewriteOptions::kStripNonCacheable)) {
     StripNonCacheableFilter* filter = new StripNonCacheableFilter(this);
@@ -1762,20 +1775,33 @@ class FilterFetch : public SharedAsyncFetch {
   RewriteDriver* driver_;
 };
 
+// Returns whether a fetch of a rewritten resource should be served the
+// precompressed variant, if we have it.
+bool ShouldServeGzipVariant(const RewriteOptions* options,
+                            AsyncFetch* async_fetch) {
+  const RequestHeaders* request_headers = async_fetch->request_headers();
+  return (options->precompress_resources() && (request_headers != NULL) &&
+          request_headers->AcceptsGzip());
+}
+
 class CacheCallback : public OptionsAwareHTTPCacheCallback {
  public:
+  // If gzip_variant is set, we look for the precompressed variant of the
+  // resource, falling back to the plain one if it is not in cache.
   CacheCallback(RewriteDriver* driver,
                 RewriteFilter* filter,
                 const OutputResourcePtr& output_resource,
                 AsyncFetch* async_fetch,
-                MessageHandler* handler)
+                MessageHandler* handler,
+                bool gzip_variant)
       : OptionsAwareHTTPCacheCallback(driver->options(),
                                       async_fetch->request_context()),
         driver_(driver),
         filter_(filter),
         output_resource_(output_resource),
         async_fetch_(async_fetch),
-        handler_(handler) {
+        handler_(handler),
+        gzip_variant_(gzip_variant) {
     // Canonicalize the URL before looking it up.  Applies
     // rewrite-domain mappings, and reverses any sharding.  E.g.
     // if you have
@@ -1794,7 +1820,11 @@ class CacheCallback : public OptionsAwareHTTPCacheCallback {
   void Find() {
     ServerContext* server_context = driver_->server_context();
     HTTPCache* http_cache = server_context->http_cache();
-    http_cache->Find(canonical_url_, driver_->CacheFragment(), handler_, this);
+    GoogleString fragment = driver_->CacheFragment();
+    if (gzip_variant_) {
+      fragment = HTTPCache::GzipVariantFragment(fragment);
+    }
+    http_cache->Find(canonical_url_, fragment, handler_, this);
   }
 
   bool IsCacheValid(const GoogleString& key, const ResponseHeaders& headers) {
@@ -1811,6 +1841,14 @@ class CacheCallback : public OptionsAwareHTTPCacheCallback {
   virtual void Done(HTTPCache::FindResult find_result) {
     StringPiece content;
     ResponseHeaders* response_headers = async_fetch_->response_headers();
+    if (gzip_variant_ && (find_result.status != HTTPCache::kFound)) {
+      // No precompressed copy; look for the plain resource instead.
+      CacheCallback* plain_callback = new CacheCallback(
+          driver_, filter_, output_resource_, async_fetch_, handler_, false);
+      plain_callback->Find();
+      delete this;
+      return;
+    }
     if (find_result.status == HTTPCache::kFound) {
       RewriteStats* stats = driver_->server_context()->rewrite_stats();
       stats->cached_resource_fetches()->Add(1);
@@ -1818,12 +1856,22 @@ class CacheCallback : public OptionsAwareHTTPCacheCallback {
       HTTPValue* value = http_value();
       bool success = (value->ExtractContents(&content) &&
                       value->ExtractHeaders(response_headers, handler_));
+      if (success && !gzip_variant_) {
+        MaybePutGzipVariant(*response_headers, content);
+      }
       if (success) {
-        output_resource_->Link(value, handler_);
-        output_resource_->SetWritten(true);
+        // The output resource holds the plain contents, as used by
+        // rewriters, so don't give it the compressed bytes.
+        if (!gzip_variant_) {
+          output_resource_->Link(value, handler_);
+          output_resource_->SetWritten(true);
+        }
         async_fetch_->set_content_length(content.size());
         async_fetch_->HeadersComplete();
-        success = async_fetch_->Write(content, handler_);
+        // The content points into the cached value's storage, which the
+        // fetch may hold on to rather than copy.
+        success = async_fetch_->WriteShared(*value->share(), content,
+                                            handler_);
       }
       async_fetch_->Done(success);
       driver_->FetchComplete();
@@ -1859,12 +1907,31 @@ class CacheCallback : public OptionsAwareHTTPCacheCallback {
   }
 
  private:
+  // Called when the plain resource is found.  If the client would have been
+  // served a precompressed variant had there been one, compress it now, so
+  // that the next such client will be.
+  void MaybePutGzipVariant(const ResponseHeaders& headers,
+                           StringPiece content) {
+    const RewriteOptions* options = driver_->options();
+    const ContentType* type = headers.DetermineContentType();
+    if (ShouldServeGzipVariant(options, async_fetch_) &&
+        (type != NULL) && type->IsCompressible()) {
+      HTTPCache* http_cache = driver_->server_context()->http_cache();
+      http_cache->PutGzipVariant(
+          canonical_url_, driver_->CacheFragment(),
+          RequestHeaders::Properties(),
+          ResponseHeaders::GetVaryOption(options->respect_vary()),
+          headers, content, handler_);
+    }
+  }
+
   RewriteDriver* driver_;
   RewriteFilter* filter_;
   OutputResourcePtr output_resource_;
   AsyncFetch* async_fetch_;
   MessageHandler* handler_;
   GoogleString canonical_url_;
+  bool gzip_variant_;
 };
 
 // A fetch that writes back to the base fetch, takes care of a few stats,
@@ -2164,7 +2231,8 @@ bool RewriteDriver::FetchOutputResource(
       }
     } else {
       CacheCallback* cache_callback = new CacheCallback(
-          this, filter, output_resource, async_fetch, message_handler());
+          this, filter, output_resource, async_fetch, message_handler(),
+          ShouldServeGzipVariant(options(), async_fetch));
       cache_callback->Find();
       queued = true;
     }
@@ -2372,6 +2440,7 @@ bool RewriteDriver::StartParseId(const StringPiece& url, const StringPiece& id,
   }
   start_time_ms_ = server_context_->timer()->NowMs();
   set_log_rewrite_timing(options()->log_rewrite_timing());
+  set_prescan_uninteresting_markup(options()->prescan_uninteresting_html());
 
   if (debug_filter_ != NULL) {
     debug_filter_->InitParse();
@@ -2396,8 +2465,49 @@ bool RewriteDriver::StartParseId(const StringPiece& url, const StringPiece& id,
   return ret;
 }
 
+void RewriteDriver::ApplyFilter(HtmlFilter* filter) {
+  Histogram* histogram = NULL;
+  if (options()->account_filter_cpu_time()) {
+    histogram = server_context_->rewrite_stats()->filter_cpu_us_histogram(
+        FilterCpuAccountingId(filter));
+  }
+  RewriteStats::ScopedCpuTimer cpu_timer(histogram);
+  HtmlParse::ApplyFilter(filter);
+}
+
+void RewriteDriver::ApplyFusedFilters(const FilterVector& filters) {
+  if (options()->account_filter_cpu_time()) {
+    // A shared pass can't be split between the filters' histograms, so run
+    // them one at a time, which gives the same result.
+    for (int i = 0, n = filters.size(); i < n; ++i) {
+      ApplyFilter(filters[i]);
+    }
+  } else {
+    HtmlParse::ApplyFusedFilters(filters);
+  }
+}
+
+StringPiece RewriteDriver::FilterCpuAccountingId(
+    const HtmlFilter* filter) const {
+  // HtmlFilters don't know their ids, so look for the filter among the
+  // registered RewriteFilters.  There are few enough of them that a scan is
+  // cheap next to running the filter.
+  for (StringFilterMap::const_iterator p = resource_filter_map_.begin(),
+           e = resource_filter_map_.end(); p != e; ++p) {
+    if (p->second == filter) {
+      return p->first;
+    }
+  }
+  return RewriteStats::kOtherFilterId;
+}
+
 void RewriteDriver::ParseTextInternal(const char* content, int size) {
   num_bytes_in_ += size;
+  ScopedTraceSpan span;
+  if (request_context_.get() != NULL) {
+    request_context_->StartTraceSpan("rewrite_driver",
+                                     "RewriteDriver::ParseText", &span);
+  }
   if (ShouldSkipParsing()) {
     writer()->Write(content, message_handler());
   } else if (debug_filter_ != NULL) {
@@ -2749,6 +2859,8 @@ void RewriteDriver::FinishParseAfterFlush(Function* user_callback) {
   stats->rewrite_latency_histogram()->Add(
       server_context_->timer()->NowMs() - start_time_ms_);
   stats->total_rewrite_count()->IncBy(1);
+  stats->html_name_intern_hits()->Add(num_shared_name_hits());
+  stats->html_name_intern_misses()->Add(num_shared_name_misses());
 
   // Update statistics log.
   StatisticsLogger* stats_logger =
@@ -3559,6 +3671,17 @@ bool RewriteDriver::Write(const ResourceVector& inputs,
                       RequestHeaders::Properties(),
                       options()->ComputeHttpOptions(),
                       &output->value_, handler);
+
+      // Compress the resource once now, rather than having the server gzip
+      // it again on every request.
+      if (options()->precompress_resources() && (type != NULL) &&
+          type->IsCompressible()) {
+        http_cache->PutGzipVariant(
+            output->HttpCacheKey(), CacheFragment(),
+            RequestHeaders::Properties(),
+            ResponseHeaders::GetVaryOption(options()->respect_vary()),
+            *meta_data, contents, handler);
+      }
     }
 
     // If we're asked to, also save a debug dump
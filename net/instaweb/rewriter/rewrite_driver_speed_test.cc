@@ -28,11 +28,22 @@
 #include "net/instaweb/http/public/mock_url_fetcher.h"
 #include "net/instaweb/http/public/request_context.h"
 #include "net/instaweb/rewriter/public/process_context.h"
+#include "net/instaweb/rewriter/public/resource_tag_scanner.h"
 #include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/test_rewrite_driver_factory.h"
 #include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/null_writer.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_name.h"
+#include "pagespeed/kernel/html/html_parse.h"
+#include "pagespeed/kernel/util/platform.h"
 
 using net_instaweb::RequestContext;
 
@@ -59,3 +70,103 @@ static void BM_RewriteDriverConstruction(int iters) {
   net_instaweb::RewriteDriverFactory::Terminate();
 }
 BENCHMARK(BM_RewriteDriverConstruction);
+
+// Scans one element once per filter in a typical chain that looks at urls,
+// either keeping the cached classification between scans or dropping it as
+// an edit to the attribute list would.
+static void ScanElementPerFilter(int iters, bool keep_cache) {
+  StopBenchmarkTiming();
+  static const int kNumFilters = 10;
+  net_instaweb::NullMessageHandler handler;
+  net_instaweb::HtmlParse parse(&handler);
+  net_instaweb::scoped_ptr<net_instaweb::ThreadSystem> thread_system(
+      net_instaweb::Platform::CreateThreadSystem());
+  net_instaweb::RewriteOptions options(thread_system.get());
+  parse.StartParse("http://example.com/index.html");
+  net_instaweb::HtmlElement* img =
+      parse.NewElement(NULL, net_instaweb::HtmlName::kImg);
+  parse.AddAttribute(img, net_instaweb::HtmlName::kId, "hero");
+  parse.AddAttribute(img, net_instaweb::HtmlName::kClass, "wide framed");
+  parse.AddAttribute(img, net_instaweb::HtmlName::kSrc, "images/hero.jpg");
+  parse.AddAttribute(img, net_instaweb::HtmlName::kAlt, "A hero");
+  parse.AddAttribute(img, net_instaweb::HtmlName::kWidth, "640");
+  parse.AddAttribute(img, net_instaweb::HtmlName::kHeight, "480");
+  parse.AddAttribute(img, net_instaweb::HtmlName::kLongdesc, "hero.html");
+  net_instaweb::resource_tag_scanner::UrlCategoryVector attributes;
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < kNumFilters; ++j) {
+      attributes.clear();
+      net_instaweb::resource_tag_scanner::ScanElement(img, &options,
+                                                      &attributes);
+      if (!keep_cache) {
+        img->mutable_attributes();
+      }
+    }
+  }
+
+  StopBenchmarkTiming();
+  parse.FinishParse();
+}
+
+static void BM_ScanElementPerFilterUncached(int iters) {
+  ScanElementPerFilter(iters, false);
+}
+BENCHMARK(BM_ScanElementPerFilterUncached);
+
+static void BM_ScanElementPerFilterCached(int iters) {
+  ScanElementPerFilter(iters, true);
+}
+BENCHMARK(BM_ScanElementPerFilterCached);
+
+// Rewrites a page of 5000 url-bearing elements with filters that scan every
+// element's urls but fetch nothing.
+static void BM_RewriteDriverScanningFilters(int iters) {
+  StopBenchmarkTiming();
+  net_instaweb::ProcessContext process_context;
+  net_instaweb::MockUrlFetcher fetcher;
+  net_instaweb::RewriteDriverFactory::Initialize();
+  net_instaweb::TestRewriteDriverFactory factory(
+      process_context, "/tmp", &fetcher, NULL);
+  net_instaweb::RewriteDriverFactory::InitStats(factory.statistics());
+  net_instaweb::ServerContext* server_context = factory.CreateServerContext();
+
+  GoogleString html = "<html><head></head><body>";
+  for (int i = 0; i < 1000; ++i) {
+    net_instaweb::StrAppend(
+        &html, "<div id=d", net_instaweb::IntegerToString(i), ">",
+        "<a href=\"http://example.com/page.html\">",
+        "<img src=\"http://cdn.example.com/a.jpg\" alt=x></a>");
+    net_instaweb::StrAppend(
+        &html, "<script src=\"http://example.com/a.js\"></script>",
+        "<iframe src=\"http://example.com/frame.html\"></iframe>",
+        "</div>");
+  }
+  html += "</body></html>";
+  net_instaweb::NullWriter writer;
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    net_instaweb::RewriteOptions* options = new net_instaweb::RewriteOptions(
+        factory.thread_system());
+    options->EnableFilter(net_instaweb::RewriteOptions::kRewriteDomains);
+    options->EnableFilter(net_instaweb::RewriteOptions::kLeftTrimUrls);
+    options->EnableFilter(net_instaweb::RewriteOptions::kInsertDnsPrefetch);
+    net_instaweb::RewriteDriver* driver =
+        server_context->NewCustomRewriteDriver(
+            options, RequestContext::NewTestRequestContext(
+                         factory.thread_system()));
+    driver->SetWriter(&writer);
+    if (driver->StartParse("http://example.com/index.html")) {
+      driver->ParseText(html);
+      driver->FinishParse();
+    } else {
+      driver->Cleanup();
+    }
+  }
+
+  StopBenchmarkTiming();
+  net_instaweb::RewriteDriverFactory::Terminate();
+}
+BENCHMARK(BM_RewriteDriverScanningFilters);
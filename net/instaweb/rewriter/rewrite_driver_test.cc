@@ -191,6 +191,47 @@ TEST_F(RewriteDriverTest, NoChanges) {
                     "</form></body>");
 }
 
+TEST_F(RewriteDriverTest, AccountFilterCpuTime) {
+  RewriteStats* stats = server_context()->rewrite_stats();
+  Histogram* css_cpu_us =
+      stats->filter_cpu_us_histogram(RewriteOptions::kCssFilterId);
+  Histogram* other_cpu_us =
+      stats->filter_cpu_us_histogram(RewriteStats::kOtherFilterId);
+  EXPECT_EQ(other_cpu_us, stats->filter_cpu_us_histogram("no-such-id"));
+
+  SetResponseWithDefaultHeaders("a.css", kContentTypeCss,
+                                "* { display: none; }", 100);
+  options()->set_account_filter_cpu_time(true);
+  options()->EnableFilter(RewriteOptions::kCollapseWhitespace);
+  AddFilter(RewriteOptions::kRewriteCss);
+  Parse("account_cpu", CssLinkHref("a.css"));
+
+  // The css filter is charged for its parse callbacks and its Rewrite, and
+  // collapse_whitespace, which is not a RewriteFilter, goes under "other".
+  EXPECT_LE(2, css_cpu_us->Count());
+  EXPECT_LE(1, other_cpu_us->Count());
+}
+
+TEST_F(RewriteDriverTest, FilterCpuTimeNotAccountedByDefault) {
+  SetResponseWithDefaultHeaders("a.css", kContentTypeCss,
+                                "* { display: none; }", 100);
+  AddFilter(RewriteOptions::kRewriteCss);
+  Parse("no_cpu_accounting", CssLinkHref("a.css"));
+  EXPECT_EQ(0, server_context()->rewrite_stats()->filter_cpu_us_histogram(
+      RewriteOptions::kCssFilterId)->Count());
+}
+
+TEST_F(RewriteDriverTest, HtmlNameInternStats) {
+  RewriteStats* stats = server_context()->rewrite_stats();
+  static const char kHtml[] = "<x-intern-stats x-intern-stats-attr=1>";
+  Parse("intern_first", kHtml);
+  EXPECT_EQ(0, stats->html_name_intern_hits()->Get());
+  EXPECT_EQ(2, stats->html_name_intern_misses()->Get());
+  Parse("intern_second", kHtml);
+  EXPECT_EQ(2, stats->html_name_intern_hits()->Get());
+  EXPECT_EQ(2, stats->html_name_intern_misses()->Get());
+}
+
 TEST_F(RewriteDriverTest, CloneMarksNested) {
   RewriteDriver* clone1 = rewrite_driver()->Clone();
   EXPECT_TRUE(clone1->is_nested());
@@ -248,6 +248,18 @@ DEFINE_int32(psa_flush_buffer_limit_bytes,
              RewriteOptions::kDefaultFlushBufferLimitBytes,
              "Whenever more than this much HTML gets buffered, a flush"
              "will be injected.");
+DEFINE_int64(psa_flush_budget_bytes, 0,
+             "Once this much HTML has been parsed past the last resource "
+             "reference without a flush, a flush will be injected. Use a "
+             "value <= 0 to disable.");
+DEFINE_int32(psa_flush_budget_elements, 0,
+             "Once this many HTML elements have been parsed past the last "
+             "resource reference without a flush, a flush will be injected. "
+             "Use a value <= 0 to disable.");
+DEFINE_int64(psa_flush_budget_ms, 0,
+             "If HTML keeps coming in for this many ms without a flush, a "
+             "flush will be injected. This is only checked as elements "
+             "close. Use a value <= 0 to disable.");
 DEFINE_int32(psa_idle_flush_time_ms,
              RewriteOptions::kDefaultIdleFlushTimeMs,
              "If the input HTML stops coming in for this many ms, a flush"
@@ -482,6 +494,15 @@ DEFINE_int64(max_html_parse_bytes,
              RewriteOptions::kDefaultMaxHtmlParseBytes,
              "The maximum number of bytes in a html that we parse before "
              "redirecting to a page with no rewriting.");
+DEFINE_int64(max_retained_html_parse_bytes,
+             RewriteOptions::kDefaultMaxRetainedHtmlParseBytes,
+             "The maximum number of bytes of parser memory a pooled driver "
+             "keeps between documents, for reuse by the next one.");
+DEFINE_bool(prescan_uninteresting_html, false,
+            "If enabled, HTML that none of the enabled filters looks at is "
+            "passed through to the output without being parsed.  Only helps "
+            "pass-through configurations, since the resource rewriters look "
+            "at every element.");
 
 DEFINE_int64(
     metadata_input_errors_cache_ttl_ms,
@@ -669,6 +690,15 @@ bool RewriteGflags::SetupOptionsOnly(
   if (WasExplicitlySet("psa_flush_buffer_limit_bytes")) {
     options->set_flush_buffer_limit_bytes(FLAGS_psa_flush_buffer_limit_bytes);
   }
+  if (WasExplicitlySet("psa_flush_budget_bytes")) {
+    options->set_flush_budget_bytes(FLAGS_psa_flush_budget_bytes);
+  }
+  if (WasExplicitlySet("psa_flush_budget_elements")) {
+    options->set_flush_budget_elements(FLAGS_psa_flush_budget_elements);
+  }
+  if (WasExplicitlySet("psa_flush_budget_ms")) {
+    options->set_flush_budget_ms(FLAGS_psa_flush_budget_ms);
+  }
   if (WasExplicitlySet("image_recompress_quality")) {
     options->set_image_recompress_quality(
         FLAGS_image_recompress_quality);
@@ -896,6 +926,13 @@ bool RewriteGflags::SetupOptionsOnly(
   if (WasExplicitlySet("max_html_parse_bytes")) {
     options->set_max_html_parse_bytes(FLAGS_max_html_parse_bytes);
   }
+  if (WasExplicitlySet("max_retained_html_parse_bytes")) {
+    options->set_max_retained_html_parse_bytes(
+        FLAGS_max_retained_html_parse_bytes);
+  }
+  if (WasExplicitlySet("prescan_uninteresting_html")) {
+    options->set_prescan_uninteresting_html(FLAGS_prescan_uninteresting_html);
+  }
   if (WasExplicitlySet("enable_aggressive_rewriters_for_mobile")) {
     options->set_enable_aggressive_rewriters_for_mobile(
         FLAGS_enable_aggressive_rewriters_for_mobile);
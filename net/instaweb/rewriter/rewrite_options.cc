@@ -55,6 +55,7 @@ const char RewriteOptions::kAcceptInvalidSignatures[] =
     "AcceptInvalidSignatures";
 const char RewriteOptions::kAccessControlAllowOrigins[] =
     "AccessControlAllowOrigins";
+const char RewriteOptions::kAccountFilterCpuTime[] = "AccountFilterCpuTime";
 const char RewriteOptions::kAllowLoggingUrlsInLogRecord[] =
     "AllowLoggingUrlsInLogRecord";
 const char RewriteOptions::kAllowOptionsToBeSetByCookies[] =
@@ -65,6 +66,8 @@ const char RewriteOptions::kAnalyticsID[] = "AnalyticsID";
 const char RewriteOptions::kAvoidRenamingIntrospectiveJavascript[] =
     "AvoidRenamingIntrospectiveJavascript";
 const char RewriteOptions::kAwaitPcacheLookup[] = "AwaitPcacheLookup";
+const char RewriteOptions::kBeaconBatchIntervalMs[] = "BeaconBatchIntervalMs";
+const char RewriteOptions::kBeaconBatchMaxBeacons[] = "BeaconBatchMaxBeacons";
 const char RewriteOptions::kBeaconReinstrumentTimeSec[] =
     "BeaconReinstrumentTimeSec";
 const char RewriteOptions::kBeaconUrl[] = "BeaconUrl";
@@ -76,6 +79,8 @@ const char RewriteOptions::kCacheSmallImagesUnrewritten[] =
 const char RewriteOptions::kClientDomainRewrite[] = "ClientDomainRewrite";
 const char RewriteOptions::kCombineAcrossPaths[] = "CombineAcrossPaths";
 const char RewriteOptions::kCompressMetadataCache[] = "CompressMetadataCache";
+const char RewriteOptions::kComputeCriticalSelectorsOnServer[] =
+    "ComputeCriticalSelectorsOnServer";
 const char RewriteOptions::kCriticalImagesBeaconEnabled[] =
     "CriticalImagesBeaconEnabled";
 const char RewriteOptions::kCriticalLineConfig[] = "CriticalLineConfig";
@@ -133,6 +138,9 @@ const char RewriteOptions::kFinderPropertiesCacheExpirationTimeMs[] =
     "FinderPropertiesCacheExpirationTimeMs";
 const char RewriteOptions::kFinderPropertiesCacheRefreshTimeMs[] =
     "FinderPropertiesCacheRefreshTimeMs";
+const char RewriteOptions::kFlushBudgetBytes[] = "FlushBudgetBytes";
+const char RewriteOptions::kFlushBudgetElements[] = "FlushBudgetElements";
+const char RewriteOptions::kFlushBudgetMs[] = "FlushBudgetMs";
 const char RewriteOptions::kFlushBufferLimitBytes[] = "FlushBufferLimitBytes";
 const char RewriteOptions::kFlushHtml[] = "FlushHtml";
 const char RewriteOptions::kFlushMoreResourcesEarlyIfTimePermits[] =
@@ -216,6 +224,8 @@ const char RewriteOptions::kMaxLowResImageSizeBytes[] =
 const char RewriteOptions::kMaxLowResToHighResImageSizePercentage[] =
     "MaxLowResToHighResImageSizePercentage";
 const char RewriteOptions::kMaxPrefetchJsElements[] = "MaxPrefetchJsElements";
+const char RewriteOptions::kMaxRetainedHtmlParseBytes[] =
+    "MaxRetainedHtmlParseBytes";
 const char RewriteOptions::kMaxRewriteInfoLogSize[] = "MaxRewriteInfoLogSize";
 const char RewriteOptions::kMaxUrlSegmentSize[] = "MaxSegmentLength";
 const char RewriteOptions::kMaxUrlSize[] = "MaxUrlSize";
@@ -255,6 +265,9 @@ const char RewriteOptions::kObliviousPagespeedUrls[] = "ObliviousPagespeedUrls";
 const char RewriteOptions::kOptionCookiesDurationMs[] =
     "OptionCookiesDurationMs";
 const char RewriteOptions::kOverrideCachingTtlMs[] = "OverrideCachingTtlMs";
+const char RewriteOptions::kPrecompressResources[] = "PrecompressResources";
+const char RewriteOptions::kPrescanUninterestingHtml[] =
+    "PrescanUninterestingHtml";
 const char RewriteOptions::kPreserveUrlRelativity[] = "PreserveUrlRelativity";
 const char RewriteOptions::kPrivateNotVaryForIE[] = "PrivateNotVaryForIE";
 const char RewriteOptions::kPubliclyCacheMismatchedHashesExperimental[] =
@@ -302,6 +315,8 @@ const char RewriteOptions::kUseFallbackPropertyCacheValues[] =
     "UseFallbackPropertyCacheValues";
 const char RewriteOptions::kUseImageScanlineApi[] = "UseImageScanlineApi";
 const char RewriteOptions::kUseSmartDiffInBlink[] = "UseSmartDiffInBlink";
+const char RewriteOptions::kWaitForContendedRewrites[] =
+    "WaitForContendedRewrites";
 const char RewriteOptions::kXModPagespeedHeaderValue[] =
     "XHeaderValue";
 const char RewriteOptions::kXPsaBlockingRewrite[] = "BlockingRewriteKey";
@@ -444,6 +459,7 @@ const int64 RewriteOptions::kDefaultProgressiveJpegMinBytes = 10240;
 
 const int64 RewriteOptions::kDefaultMaxHtmlCacheTimeMs = 0;
 const int64 RewriteOptions::kDefaultMaxHtmlParseBytes = -1;
+const int64 RewriteOptions::kDefaultMaxRetainedHtmlParseBytes = 64 * 1024;
 const int64 RewriteOptions::kDefaultMaxImageBytesForWebpInCss = kint64max;
 
 const int64 RewriteOptions::kDefaultMinResourceCacheTimeToRewriteMs = 0;
@@ -1319,6 +1335,22 @@ void RewriteOptions::AddProperties() {
       kDirectoryScope,  // TODO(jmarantz): switch to kProcessScope?
       "Maximum number of bytes of HTML that we parse, before "
       "redirecting to ?ModPagespeed=off", true);
+  AddBaseProperty(
+      kDefaultMaxRetainedHtmlParseBytes,
+      &RewriteOptions::max_retained_html_parse_bytes_, "rhpb",
+      kMaxRetainedHtmlParseBytes,
+      kServerScope,
+      "Maximum number of bytes of parser memory a pooled driver keeps "
+      "between documents, for reuse by the next one", true);
+  AddBaseProperty(
+      false, &RewriteOptions::prescan_uninteresting_html_, "puh",
+      kPrescanUninterestingHtml,
+      kDirectoryScope,
+      "Pass HTML that none of the enabled filters looks at straight "
+      "through to the output, without parsing it. This only helps "
+      "pass-through configurations: the resource rewriters (images, CSS, "
+      "JavaScript and the combiners) look at every element, so with any of "
+      "them enabled nothing is skipped", true);
   AddBaseProperty(
       kDefaultMaxImageBytesForWebpInCss,
       &RewriteOptions::max_image_bytes_for_webp_in_css_, "miwc",
@@ -1357,6 +1389,25 @@ void RewriteOptions::AddProperties() {
       kFlushBufferLimitBytes,
       kDirectoryScope,
       NULL, true);  // TODO(jmarantz): implement for mod_pagespeed.
+  AddBaseProperty(
+      0, &RewriteOptions::flush_budget_bytes_, "fbb",
+      kFlushBudgetBytes,
+      kDirectoryScope,
+      "With flush_html, inject a flush once this many bytes of HTML have "
+      "been parsed past the last resource reference.  0 disables.", true);
+  AddBaseProperty(
+      0, &RewriteOptions::flush_budget_elements_, "fbe",
+      kFlushBudgetElements,
+      kDirectoryScope,
+      "With flush_html, inject a flush once this many HTML elements have "
+      "been parsed past the last resource reference.  0 disables.", true);
+  AddBaseProperty(
+      0, &RewriteOptions::flush_budget_ms_, "fbm",
+      kFlushBudgetMs,
+      kDirectoryScope,
+      "With flush_html, inject a flush once this many ms have passed since "
+      "the last one.  Only checked as elements close, so a long run of text "
+      "can overshoot it.  0 disables.", true);
   AddBaseProperty(
       kDefaultImplicitCacheTtlMs,
       &RewriteOptions::implicit_cache_ttl_ms_, "ict",
@@ -1481,6 +1532,12 @@ void RewriteOptions::AddProperties() {
       kCriticalImagesBeaconEnabled,
       kDirectoryScope, "Enable insertion of client-side critical "
       "image detection js for image optimization filters.", true);
+  AddBaseProperty(
+      false, &RewriteOptions::compute_critical_selectors_on_server_, "ccss",
+      kComputeCriticalSelectorsOnServer,
+      kDirectoryScope, "Until critical CSS beacon results arrive for a page, "
+      "treat the CSS selectors that match any of its elements as critical.",
+      true);
   AddBaseProperty(
       false, &RewriteOptions::
                  test_only_prioritize_critical_css_dont_apply_original_css_,
@@ -1495,6 +1552,17 @@ void RewriteOptions::AddProperties() {
                   "How often (in seconds) to reinstrument pages with beacons. "
                   "This is used for both critical image beaconing, and for the "
                   "prioritize_critical_css filter.", true);
+  AddBaseProperty(
+      0, &RewriteOptions::beacon_batch_interval_ms_, "bbim",
+      kBeaconBatchIntervalMs, kServerScope,
+      "How long (in milliseconds) to hold beacon results for a page so they "
+      "can be written to the property cache together.  0 writes each beacon "
+      "as it arrives.", true);
+  AddBaseProperty(
+      20, &RewriteOptions::beacon_batch_max_beacons_, "bbmb",
+      kBeaconBatchMaxBeacons, kServerScope,
+      "The most beacon results to hold for a page before writing them to "
+      "the property cache.", true);
   AddBaseProperty(
       false, &RewriteOptions::log_background_rewrites_, "lbr",
       kLogBackgroundRewrite,
@@ -2225,6 +2293,34 @@ void RewriteOptions::AddProperties() {
       kDirectoryScope,
       "Serve rewritten .webp images to any user-agent", true);
 
+  AddBaseProperty(
+      false,
+      &RewriteOptions::precompress_resources_,
+      "pcr",
+      kPrecompressResources,
+      kDirectoryScope,
+      "Store gzipped copies of compressible rewritten resources, and serve "
+      "them to clients that accept gzip", true);
+
+  AddBaseProperty(
+      false,
+      &RewriteOptions::account_filter_cpu_time_,
+      "afct",
+      kAccountFilterCpuTime,
+      kDirectoryScope,
+      "Record the CPU time spent in each filter in per-filter histograms",
+      true);
+
+  AddBaseProperty(
+      false,
+      &RewriteOptions::wait_for_contended_rewrites_,
+      "wfcr",
+      kWaitForContendedRewrites,
+      kDirectoryScope,
+      "When another server process is already rewriting a resource, wait "
+      "for its result up to the rewrite deadline rather than giving up",
+      true);
+
   AddBaseProperty(
       "", &RewriteOptions::cache_fragment_, "ckp", kCacheFragment,
       kDirectoryScope,
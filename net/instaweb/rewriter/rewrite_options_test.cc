@@ -867,6 +867,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
   const char* const option_names[] = {
     RewriteOptions::kAcceptInvalidSignatures,
     RewriteOptions::kAccessControlAllowOrigins,
+    RewriteOptions::kAccountFilterCpuTime,
     RewriteOptions::kAddOptionsToUrls,
     RewriteOptions::kAllowLoggingUrlsInLogRecord,
     RewriteOptions::kAllowOptionsToBeSetByCookies,
@@ -875,6 +876,8 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kAnalyticsID,
     RewriteOptions::kAvoidRenamingIntrospectiveJavascript,
     RewriteOptions::kAwaitPcacheLookup,
+    RewriteOptions::kBeaconBatchIntervalMs,
+    RewriteOptions::kBeaconBatchMaxBeacons,
     RewriteOptions::kBeaconReinstrumentTimeSec,
     RewriteOptions::kBeaconUrl,
     RewriteOptions::kBlinkMaxHtmlSizeRewritable,
@@ -882,6 +885,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kCacheSmallImagesUnrewritten,
     RewriteOptions::kClientDomainRewrite,
     RewriteOptions::kCombineAcrossPaths,
+    RewriteOptions::kComputeCriticalSelectorsOnServer,
     RewriteOptions::kCriticalImagesBeaconEnabled,
     RewriteOptions::kCriticalLineConfig,
     RewriteOptions::kCssFlattenMaxBytes,
@@ -918,6 +922,9 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kFetcherTimeOutMs,
     RewriteOptions::kFinderPropertiesCacheExpirationTimeMs,
     RewriteOptions::kFinderPropertiesCacheRefreshTimeMs,
+    RewriteOptions::kFlushBudgetBytes,
+    RewriteOptions::kFlushBudgetElements,
+    RewriteOptions::kFlushBudgetMs,
     RewriteOptions::kFlushBufferLimitBytes,
     RewriteOptions::kFlushHtml,
     RewriteOptions::kFlushMoreResourcesEarlyIfTimePermits,
@@ -973,6 +980,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kMaxLowResImageSizeBytes,
     RewriteOptions::kMaxLowResToHighResImageSizePercentage,
     RewriteOptions::kMaxPrefetchJsElements,
+    RewriteOptions::kMaxRetainedHtmlParseBytes,
     RewriteOptions::kMaxRewriteInfoLogSize,
     RewriteOptions::kMaxUrlSegmentSize,
     RewriteOptions::kMaxUrlSize,
@@ -1004,6 +1012,8 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kObliviousPagespeedUrls,
     RewriteOptions::kOptionCookiesDurationMs,
     RewriteOptions::kOverrideCachingTtlMs,
+    RewriteOptions::kPrecompressResources,
+    RewriteOptions::kPrescanUninterestingHtml,
     RewriteOptions::kPreserveUrlRelativity,
     RewriteOptions::kPrivateNotVaryForIE,
     RewriteOptions::kProactiveResourceFreshening,
@@ -1039,6 +1049,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kUseFallbackPropertyCacheValues,
     RewriteOptions::kUseSelectorsForCriticalCss,
     RewriteOptions::kUseSmartDiffInBlink,
+    RewriteOptions::kWaitForContendedRewrites,
     RewriteOptions::kXModPagespeedHeaderValue,
     RewriteOptions::kXPsaBlockingRewrite,
   };
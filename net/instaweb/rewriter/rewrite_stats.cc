@@ -18,9 +18,14 @@
 
 #include "net/instaweb/rewriter/public/rewrite_stats.h"
 
+#include <time.h>
+
+#include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/base/waveform.h"
 
 namespace net_instaweb {
@@ -39,6 +44,10 @@ const char kResourceFetchConstructSuccesses[] =
 const char kResourceFetchConstructFailures[] =
     "resource_fetch_construct_failures";
 const char kNumFlushes[] = "num_flushes";
+// How often HtmlParse found a non-keyword tag or attribute name already in
+// the SharedNameTable.
+const char kHtmlNameInternHits[] = "html_name_intern_hits";
+const char kHtmlNameInternMisses[] = "html_name_intern_misses";
 const char kFallbackResponsesServed[] = "num_fallback_responses_served";
 const char kProactivelyFreshenUserFacingRequest[] =
     "num_proactively_freshen_user_facing_request";
@@ -74,12 +83,33 @@ const char kRewriteLatencyHistogram[] = "Rewrite Latency Histogram";
 const char kBackendLatencyHistogram[] =
     "Backend Fetch First Byte Latency Histogram";
 
+// There is one CPU time histogram per filter, so keep them small: most of the
+// interest is in their counts and averages.
+const int kFilterCpuUsHistogramNumBuckets = 50;
+const int kFilterCpuUsHistogramMaxValue = 20 * Timer::kMsUs;
+
 // TimedVariable names.
 const char kTotalFetchCount[] = "total_fetch_count";
 const char kTotalRewriteCount[] = "total_rewrite_count";
 const char kRewritesExecuted[] = "num_rewrites_executed";
 const char kRewritesDropped[] = "num_rewrites_dropped";
 
+int64 ThreadCpuTimeUs() {
+  struct timespec now;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+    return 0;
+  }
+  return static_cast<int64>(now.tv_sec) * Timer::kSecondUs +
+      now.tv_nsec / 1000;
+}
+
+void AddFilterCpuUsHistogram(StringPiece id, Statistics* statistics) {
+  Histogram* histogram = statistics->AddHistogram(
+      StrCat(RewriteStats::kFilterCpuUsHistogramPrefix, id));
+  histogram->SetSuggestedNumBuckets(kFilterCpuUsHistogramNumBuckets);
+  histogram->SetMaxValue(kFilterCpuUsHistogramMaxValue);
+}
+
 }  // namespace
 
 const char RewriteStats::kNumCacheControlRewritableResources[] =
@@ -103,6 +133,20 @@ const char RewriteStats::kDownstreamCachePurgeAttempts[] =
 const char RewriteStats::kSuccessfulDownstreamCachePurges[] =
     "successful_downstream_cache_purges";
 
+const char RewriteStats::kFilterCpuUsHistogramPrefix[] = "Filter CPU (us) ";
+const char RewriteStats::kOtherFilterId[] = "other";
+
+RewriteStats::ScopedCpuTimer::ScopedCpuTimer(Histogram* histogram)
+    : histogram_(histogram),
+      start_us_((histogram == NULL) ? 0 : ThreadCpuTimeUs()) {
+}
+
+RewriteStats::ScopedCpuTimer::~ScopedCpuTimer() {
+  if (histogram_ != NULL) {
+    histogram_->Add(ThreadCpuTimeUs() - start_us_);
+  }
+}
+
 // In Apache, this is called in the root process to establish shared memory
 // boundaries prior to the primary initialization of RewriteDriverFactories.
 //
@@ -124,6 +168,8 @@ void RewriteStats::InitStats(Statistics* statistics) {
   statistics->AddVariable(kNumCacheControlRewritableResources);
   statistics->AddVariable(kNumCacheControlNotRewritableResources);
   statistics->AddVariable(kNumFlushes);
+  statistics->AddVariable(kHtmlNameInternHits);
+  statistics->AddVariable(kHtmlNameInternMisses);
   statistics->AddHistogram(kBeaconTimingsMsHistogram);
   statistics->AddHistogram(kFetchLatencyHistogram);
   statistics->AddHistogram(kRewriteLatencyHistogram);
@@ -151,6 +197,14 @@ void RewriteStats::InitStats(Statistics* statistics) {
   for (int i = 0; i < RewriteDriverFactory::kNumWorkerPools; ++i) {
     statistics->AddUpDownCounter(kWaveFormCounters[i]);
   }
+
+  for (int i = RewriteOptions::kFirstFilter;
+       i != RewriteOptions::kEndOfFilters; ++i) {
+    AddFilterCpuUsHistogram(
+        RewriteOptions::FilterId(static_cast<RewriteOptions::Filter>(i)),
+        statistics);
+  }
+  AddFilterCpuUsHistogram(kOtherFilterId, statistics);
 }
 
 // This is called when a RewriteDriverFactory is created, and adds
@@ -177,6 +231,10 @@ RewriteStats::RewriteStats(Statistics* stats,
           stats->GetVariable(kNumCacheControlNotRewritableResources)),
       num_flushes_(
           stats->GetVariable(kNumFlushes)),
+      html_name_intern_hits_(
+          stats->GetVariable(kHtmlNameInternHits)),
+      html_name_intern_misses_(
+          stats->GetVariable(kHtmlNameInternMisses)),
       page_load_count_(
           stats->GetVariable(kPageLoadCount)),
       resource_404_count_(
@@ -214,6 +272,8 @@ RewriteStats::RewriteStats(Statistics* stats,
           stats->GetHistogram(kRewriteLatencyHistogram)),
       backend_latency_histogram_(
           stats->GetHistogram(kBackendLatencyHistogram)),
+      other_filter_cpu_us_histogram_(stats->GetHistogram(
+          StrCat(kFilterCpuUsHistogramPrefix, kOtherFilterId))),
       total_fetch_count_(stats->GetTimedVariable(kTotalFetchCount)),
       total_rewrite_count_(stats->GetTimedVariable(kTotalRewriteCount)),
       num_rewrites_executed_(stats->GetTimedVariable(kRewritesExecuted)),
@@ -228,6 +288,17 @@ RewriteStats::RewriteStats(Statistics* stats,
   rewrite_latency_histogram_->EnableNegativeBuckets();
   backend_latency_histogram_->EnableNegativeBuckets();
 
+  for (int i = RewriteOptions::kFirstFilter;
+       i != RewriteOptions::kEndOfFilters; ++i) {
+    const char* id =
+        RewriteOptions::FilterId(static_cast<RewriteOptions::Filter>(i));
+    Histogram* histogram =
+        stats->GetHistogram(StrCat(kFilterCpuUsHistogramPrefix, id));
+    histogram->SetMaxValue(kFilterCpuUsHistogramMaxValue);
+    filter_cpu_us_histograms_[id] = histogram;
+  }
+  other_filter_cpu_us_histogram_->SetMaxValue(kFilterCpuUsHistogramMaxValue);
+
   for (int i = 0; i < RewriteDriverFactory::kNumWorkerPools; ++i) {
     thread_queue_depths_.push_back(
         new Waveform(thread_system, timer, kNumWaveformSamples,
@@ -239,4 +310,12 @@ RewriteStats::~RewriteStats() {
   STLDeleteElements(&thread_queue_depths_);
 }
 
+Histogram* RewriteStats::filter_cpu_us_histogram(StringPiece id) const {
+  FilterHistogramMap::const_iterator p = filter_cpu_us_histograms_.find(id);
+  if (p == filter_cpu_us_histograms_.end()) {
+    return other_filter_cpu_us_histogram_;
+  }
+  return p->second;
+}
+
 }  // namespace net_instaweb
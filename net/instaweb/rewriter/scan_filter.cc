@@ -41,6 +41,12 @@ namespace net_instaweb {
 
 ScanFilter::ScanFilter(RewriteDriver* driver)
     : driver_(driver) {
+  int num_keywords = 0;
+  const HtmlName::Keyword* keywords =
+      resource_tag_scanner::ResourceElementKeywords(&num_keywords);
+  keywords_.assign(keywords, keywords + num_keywords);
+  keywords_.push_back(HtmlName::kBase);
+  keywords_.push_back(HtmlName::kMeta);
 }
 
 ScanFilter::~ScanFilter() {
@@ -80,8 +86,10 @@ void ScanFilter::Directive(HtmlDirectiveNode* directive) {
 void ScanFilter::Characters(HtmlCharactersNode* characters) {
   // Check for a BOM at the start of the document. All other event handlers
   // set the flag to false without using it, so if it's true on entry then
-  // this must be the first event.
-  if (!seen_any_nodes_ && driver_->containing_charset().empty()) {
+  // this must be the first event we've seen.  We aren't called for elements
+  // outside keywords_, so also check that we aren't inside one.
+  if (!seen_any_nodes_ && (characters->parent() == NULL) &&
+      driver_->containing_charset().empty()) {
     StringPiece charset = GetCharsetForBom(characters->contents());
     if (!charset.empty()) {
       driver_->set_containing_charset(charset);
@@ -166,6 +174,23 @@ void ScanFilter::EndElement(HtmlElement* element) {
   }
 }
 
+const HtmlName::Keyword* ScanFilter::ElementKeywords(
+    int* num_keywords) const {
+  if (ScansAllElements()) {
+    return NULL;
+  }
+  *num_keywords = keywords_.size();
+  return &keywords_[0];
+}
+
+bool ScanFilter::AcceptsRawMarkup() const {
+  return !ScansAllElements();
+}
+
+bool ScanFilter::ScansAllElements() const {
+  return driver_->options()->num_url_valued_attributes() != 0;
+}
+
 void ScanFilter::Flush() {
   driver_->server_context()->rewrite_stats()->num_flushes()->Add(1);
 }
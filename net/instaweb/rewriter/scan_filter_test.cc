@@ -21,6 +21,7 @@
 #include "net/instaweb/rewriter/public/scan_filter.h"
 
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_test_base.h"
 #include "pagespeed/kernel/base/charset_util.h"
 #include "pagespeed/kernel/base/gtest.h"
@@ -28,6 +29,7 @@
 #include "pagespeed/kernel/html/html_parse_test_base.h"
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/http/semantic_type.h"
 
 namespace net_instaweb {
 
@@ -187,4 +189,54 @@ TEST_F(ScanFilterTest, CharsetFromMetaTagMissingQuotes) {
   EXPECT_STREQ("us-ascii", rewrite_driver()->containing_charset());
 }
 
+TEST_F(ScanFilterTest, PrescanStopsForRefsAndBase) {
+  // With the prescan on, the oddly spaced div comes out exactly as it went
+  // in, but the link and base are still seen.
+  const char kTestName[] = "prescan_stops_for_refs_and_base";
+  const char kNewBase[] = "http://example.com/index.html";
+  options()->set_prescan_uninteresting_html(true);
+  ValidateNoChanges(kTestName,
+                    StrCat("<head>"
+                           "<div  class = x>text</div >"
+                           "<a href=\"help.html\">link</a>"
+                           "<base href=\"", kNewBase, "\">"
+                           "</head>"));
+  EXPECT_STREQ(kNewBase, rewrite_driver()->base_url().Spec());
+  EXPECT_TRUE(rewrite_driver()->refs_before_base());
+}
+
+TEST_F(ScanFilterTest, PrescanStopsForMetaTag) {
+  const char kTestName[] = "prescan_stops_for_meta_tag";
+  options()->set_prescan_uninteresting_html(true);
+  ValidateNoChanges(kTestName,
+                    "<head>"
+                    "<p  id = x>text</p >"
+                    "<meta charset=\"UTF-8\">"
+                    "</head>");
+  EXPECT_STREQ("UTF-8", rewrite_driver()->containing_charset());
+}
+
+TEST_F(ScanFilterTest, PrescanKeepsBom) {
+  const char kTestName[] = "prescan_keeps_bom";
+  options()->set_prescan_uninteresting_html(true);
+  SetDoctype(kUtf8Bom);
+  ValidateNoChanges(kTestName, "<head><p  id = x>text</p ></head>");
+  EXPECT_STREQ(kUtf8Charset, rewrite_driver()->containing_charset());
+}
+
+TEST_F(ScanFilterTest, PrescanSeesUrlValuedAttributes) {
+  // A user-defined url-valued attribute can be on any element, so the
+  // prescan can't skip any.
+  const char kTestName[] = "prescan_sees_url_valued_attributes";
+  const char kNewBase[] = "http://example.com/index.html";
+  options()->set_prescan_uninteresting_html(true);
+  options()->AddUrlValuedAttribute("span", "data-src", semantic_type::kImage);
+  ValidateNoChanges(kTestName,
+                    StrCat("<head>"
+                           "<span data-src=\"a.png\"></span>"
+                           "<base href=\"", kNewBase, "\">"
+                           "</head>"));
+  EXPECT_TRUE(rewrite_driver()->refs_before_base());
+}
+
 }  // namespace net_instaweb
@@ -29,6 +29,7 @@
 #include "net/instaweb/http/public/sync_fetcher_adapter_callback.h"
 #include "net/instaweb/http/public/url_async_fetcher.h"
 #include "net/instaweb/rewriter/cached_result.pb.h"
+#include "net/instaweb/rewriter/public/beacon_accumulator.h"
 #include "net/instaweb/rewriter/public/beacon_critical_images_finder.h"
 #include "net/instaweb/rewriter/public/beacon_critical_line_info_finder.h"
 #include "net/instaweb/rewriter/public/cache_html_info_finder.h"
@@ -70,6 +71,7 @@
 #include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/base/trace_span_ring.h"
 #include "pagespeed/kernel/html/html_keywords.h"
 #include "pagespeed/kernel/http/content_type.h"
 #include "pagespeed/kernel/http/google_url.h"
@@ -98,6 +100,10 @@ const char kBeaconCriticalCssQueryParam[] = "cs";
 const char kBeaconXPathsQueryParam[] = "xp";
 const char kBeaconNonceQueryParam[] = "n";
 
+// The most pages for which beacon results are held when they are being
+// batched; beacons for any more pages are written through.
+const int kBeaconBatchMaxPages = 1000;
+
 // Attributes that should not be automatically copied from inputs to outputs
 const char* kExcludedAttributes[] = {
   HttpAttributes::kCacheControl,
@@ -130,37 +136,42 @@ StringSet* CommaSeparatedStringToSet(StringPiece str) {
   return set;
 }
 
-// Track a property cache lookup triggered from a beacon response. When
-// complete, Done will update and and writeback the beacon cohort with the
-// critical image set.
+// Reports the time a beacon arrived, so that its nonce is checked as of then
+// even if the beacon was held in a BeaconAccumulator before being written.
+class BeaconArrivalTimer : public Timer {
+ public:
+  explicit BeaconArrivalTimer(int64 arrival_ms)
+      : arrival_us_(arrival_ms * Timer::kMsUs) {}
+  virtual ~BeaconArrivalTimer() {}
+
+  virtual int64 NowUs() const { return arrival_us_; }
+  virtual void SleepUs(int64 us) {}
+
+ private:
+  const int64 arrival_us_;
+  DISALLOW_COPY_AND_ASSIGN(BeaconArrivalTimer);
+};
+
+// Track a property cache lookup triggered from beacon responses. When
+// complete, Done will apply the beacons, oldest first, to the beacon cohort
+// and write it back once.
 class BeaconPropertyCallback : public PropertyPage {
  public:
+  // Takes ownership of the elements of *beacons.
   BeaconPropertyCallback(
       ServerContext* server_context,
-      StringPiece url,
-      StringPiece options_signature_hash,
-      UserAgentMatcher::DeviceType device_type,
+      const BeaconAccumulator::PageKey& page,
       const RequestContextPtr& request_context,
-      StringSet* html_critical_images_set,
-      StringSet* css_critical_images_set,
-      StringSet* critical_css_selector_set,
-      RenderedImages* rendered_images_set,
-      StringSet* xpaths_set,
-      StringPiece nonce)
+      BeaconAccumulator::BeaconVector* beacons)
       : PropertyPage(kPropertyCachePage,
-                     url,
-                     options_signature_hash,
-                     UserAgentMatcher::DeviceTypeSuffix(device_type),
+                     page.url,
+                     page.options_hash,
+                     UserAgentMatcher::DeviceTypeSuffix(page.device_type),
                      request_context,
                      server_context->thread_system()->NewMutex(),
                      server_context->page_property_cache()),
-        server_context_(server_context),
-        html_critical_images_set_(html_critical_images_set),
-        css_critical_images_set_(css_critical_images_set),
-        critical_css_selector_set_(critical_css_selector_set),
-        rendered_images_set_(rendered_images_set),
-        xpaths_set_(xpaths_set) {
-    nonce.CopyToString(&nonce_);
+        server_context_(server_context) {
+    beacons_.swap(*beacons);
   }
 
   const PropertyCache::CohortVector CohortList() {
@@ -171,44 +182,68 @@ class BeaconPropertyCallback : public PropertyPage {
     return cohort_list;
   }
 
-  virtual ~BeaconPropertyCallback() {}
+  virtual ~BeaconPropertyCallback() {
+    STLDeleteElements(&beacons_);
+  }
 
   virtual void Done(bool success) {
+    for (int i = 0, n = beacons_.size(); i < n; ++i) {
+      ApplyBeacon(*beacons_[i]);
+    }
+    WriteCohort(server_context_->beacon_cohort());
+    delete this;
+  }
+
+ private:
+  void ApplyBeacon(const BeaconAccumulator::Beacon& beacon) {
+    BeaconArrivalTimer timer(beacon.arrival_ms);
     // TODO(jud): Clean up the call to UpdateCriticalImagesCacheEntry with a
     // struct to nicely package up all of the pcache arguments.
     BeaconCriticalImagesFinder::UpdateCriticalImagesCacheEntry(
-        html_critical_images_set_.get(), css_critical_images_set_.get(),
-        rendered_images_set_.get(), nonce_, server_context_->beacon_cohort(),
-        this, server_context_->timer());
-    if (critical_css_selector_set_ != NULL) {
+        beacon.html_critical_images.get(), beacon.css_critical_images.get(),
+        beacon.rendered_images.get(), beacon.nonce,
+        server_context_->beacon_cohort(), this, &timer);
+    if (beacon.critical_css_selectors != NULL) {
       BeaconCriticalSelectorFinder::
           WriteCriticalSelectorsToPropertyCacheFromBeacon(
-              *critical_css_selector_set_, nonce_,
+              *beacon.critical_css_selectors, beacon.nonce,
               server_context_->page_property_cache(),
               server_context_->beacon_cohort(), this,
-              server_context_->message_handler(), server_context_->timer());
+              server_context_->message_handler(), &timer);
     }
 
-    if (xpaths_set_ != NULL) {
+    if (beacon.xpaths != NULL) {
       BeaconCriticalLineInfoFinder::WriteXPathsToPropertyCacheFromBeacon(
-          *xpaths_set_, nonce_, server_context_->page_property_cache(),
+          *beacon.xpaths, beacon.nonce, server_context_->page_property_cache(),
           server_context_->beacon_cohort(), this,
-          server_context_->message_handler(), server_context_->timer());
+          server_context_->message_handler(), &timer);
     }
+  }
 
-    WriteCohort(server_context_->beacon_cohort());
-    delete this;
+  ServerContext* server_context_;
+  BeaconAccumulator::BeaconVector beacons_;
+  DISALLOW_COPY_AND_ASSIGN(BeaconPropertyCallback);
+};
+
+// Writes batches of beacons from a BeaconAccumulator to the property cache.
+class BeaconPropertyWriter : public BeaconAccumulator::BatchWriter {
+ public:
+  explicit BeaconPropertyWriter(ServerContext* server_context)
+      : server_context_(server_context) {}
+  virtual ~BeaconPropertyWriter() {}
+
+  virtual void WriteBeacons(const BeaconAccumulator::PageKey& page,
+                            const RequestContextPtr& request_context,
+                            BeaconAccumulator::BeaconVector* beacons) {
+    BeaconPropertyCallback* beacon_property_cb = new BeaconPropertyCallback(
+        server_context_, page, request_context, beacons);
+    server_context_->page_property_cache()->ReadWithCohorts(
+        beacon_property_cb->CohortList(), beacon_property_cb);
   }
 
  private:
   ServerContext* server_context_;
-  scoped_ptr<StringSet> html_critical_images_set_;
-  scoped_ptr<StringSet> css_critical_images_set_;
-  scoped_ptr<StringSet> critical_css_selector_set_;
-  scoped_ptr<RenderedImages> rendered_images_set_;
-  scoped_ptr<StringSet> xpaths_set_;
-  GoogleString nonce_;
-  DISALLOW_COPY_AND_ASSIGN(BeaconPropertyCallback);
+  DISALLOW_COPY_AND_ASSIGN(BeaconPropertyWriter);
 };
 
 }  // namespace
@@ -314,6 +349,8 @@ ServerContext::ServerContext(RewriteDriverFactory* factory)
 }
 
 ServerContext::~ServerContext() {
+  // Stop any pending beacon flush before the things it writes through go.
+  beacon_accumulator_.reset(NULL);
   {
     ScopedMutex lock(rewrite_drivers_mutex_.get());
 
@@ -361,6 +398,20 @@ void ServerContext::InitWorkers() {
 
 void ServerContext::PostInitHook() {
   InitWorkers();
+  InitBeaconAccumulator();
+}
+
+void ServerContext::InitBeaconAccumulator() {
+  const RewriteOptions* options = global_options();
+  if (options->beacon_batch_interval_ms() > 0) {
+    beacon_accumulator_.reset(new BeaconAccumulator(
+        options->beacon_batch_interval_ms(),
+        options->beacon_batch_max_beacons(), kBeaconBatchMaxPages,
+        scheduler_, low_priority_rewrite_workers_,
+        new BeaconPropertyWriter(this)));
+  } else {
+    beacon_accumulator_.reset(NULL);
+  }
 }
 
 void ServerContext::SetDefaultLongCacheHeaders(
@@ -564,6 +615,11 @@ void ServerContext::LockForCreation(NamedLock* creation_lock,
       new QueuedWorkerPool::Sequence::AddFunction(worker, callback));
 }
 
+void ServerContext::WaitForCreation(NamedLock* creation_lock, int64 wait_ms,
+                                    Function* callback) {
+  creation_lock->LockTimedWaitStealOld(wait_ms, kBreakLockMs, callback);
+}
+
 bool ServerContext::HandleBeacon(StringPiece params,
                                  StringPiece user_agent,
                                  const RequestContextPtr& request_context) {
@@ -637,67 +693,59 @@ bool ServerContext::HandleBeacon(StringPiece params,
 
   // Extract critical image URLs
   // TODO(jud): Add css critical image detection to the beacon.
-  // Beacon property callback takes ownership of both critical images sets.
-  scoped_ptr<StringSet> html_critical_images_set;
-  scoped_ptr<StringSet> css_critical_images_set;
+  scoped_ptr<BeaconAccumulator::Beacon> beacon(new BeaconAccumulator::Beacon);
+  beacon->arrival_ms = timer()->NowMs();
   if (query_params.Lookup1Unescaped(kBeaconCriticalImagesQueryParam,
                                     &query_param_str)) {
-    html_critical_images_set.reset(
+    beacon->html_critical_images.reset(
         CommaSeparatedStringToSet(query_param_str));
   }
 
-  scoped_ptr<StringSet> critical_css_selector_set;
   if (query_params.Lookup1Unescaped(kBeaconCriticalCssQueryParam,
                                     &query_param_str)) {
-    critical_css_selector_set.reset(
+    beacon->critical_css_selectors.reset(
         CommaSeparatedStringToSet(query_param_str));
   }
 
-  scoped_ptr<RenderedImages> rendered_images;
   if (query_params.Lookup1Unescaped(kBeaconRenderedDimensionsQueryParam,
                                     &query_param_str)) {
-    rendered_images.reset(
+    beacon->rendered_images.reset(
         critical_images_finder_->JsonMapToRenderedImagesMap(
             query_param_str, global_options()));
   }
 
-  scoped_ptr<StringSet> xpaths_set;
   if (query_params.Lookup1Unescaped(kBeaconXPathsQueryParam,
                                     &query_param_str)) {
-    xpaths_set.reset(CommaSeparatedStringToSet(query_param_str));
+    beacon->xpaths.reset(CommaSeparatedStringToSet(query_param_str));
   }
 
-  StringPiece nonce;
   if (query_params.Lookup1Unescaped(kBeaconNonceQueryParam, &query_param_str)) {
-    nonce.set(query_param_str.data(), query_param_str.size());
+    beacon->nonce = query_param_str;
   }
 
   // Store the critical information in the property cache. This is done by
   // looking up the property page for the URL specified in the beacon, and
   // performing the page update and cohort write in
   // BeaconPropertyCallback::Done(). Done() is called when the read completes.
-  if (html_critical_images_set != NULL ||
-      css_critical_images_set != NULL ||
-      critical_css_selector_set != NULL ||
-      rendered_images != NULL ||
-      xpaths_set != NULL) {
+  // If beacons are being batched, the accumulator does this later, for all
+  // the beacons it has received for the page.
+  if (beacon->html_critical_images != NULL ||
+      beacon->css_critical_images != NULL ||
+      beacon->critical_css_selectors != NULL ||
+      beacon->rendered_images != NULL ||
+      beacon->xpaths != NULL) {
     UserAgentMatcher::DeviceType device_type =
         user_agent_matcher()->GetDeviceTypeForUA(user_agent);
-
-    BeaconPropertyCallback* beacon_property_cb = new BeaconPropertyCallback(
-        this,
-        url_query_param.Spec(),
-        options_hash_param,
-        device_type,
-        request_context,
-        html_critical_images_set.release(),
-        css_critical_images_set.release(),
-        critical_css_selector_set.release(),
-        rendered_images.release(),
-        xpaths_set.release(),
-        nonce);
-    page_property_cache()->ReadWithCohorts(beacon_property_cb->CohortList(),
-                                           beacon_property_cb);
+    BeaconAccumulator::PageKey page(url_query_param.Spec(), options_hash_param,
+                                    device_type);
+    if (beacon_accumulator_.get() != NULL) {
+      beacon_accumulator_->Add(page, request_context, beacon.release());
+    } else {
+      BeaconAccumulator::BeaconVector beacons;
+      beacons.push_back(beacon.release());
+      BeaconPropertyWriter writer(this);
+      writer.WriteBeacons(page, request_context, &beacons);
+    }
   }
 
   return status;
@@ -1086,6 +1134,10 @@ void ServerContext::set_mobilize_cached_finder(MobilizeCachedFinder* finder) {
   mobilize_cached_finder_.reset(finder);
 }
 
+void ServerContext::set_trace_spans(TraceSpanRing* x) {
+  trace_spans_.reset(x);
+}
+
 RewriteDriverPool* ServerContext::SelectDriverPool(bool using_spdy) {
   return standard_rewrite_driver_pool();
 }
@@ -30,6 +30,7 @@
 #include "net/instaweb/http/public/http_value.h"
 #include "net/instaweb/http/public/mock_url_fetcher.h"
 #include "net/instaweb/rewriter/cached_result.pb.h"
+#include "net/instaweb/rewriter/public/beacon_accumulator.h"
 #include "net/instaweb/rewriter/public/beacon_critical_images_finder.h"
 #include "net/instaweb/rewriter/public/critical_finder_support_util.h"
 #include "net/instaweb/rewriter/public/critical_images_finder.h"
@@ -1421,6 +1422,55 @@ TEST_F(BeaconTest, EmptyCriticalCss) {
   EXPECT_TRUE(critical_css_selectors_.empty());
 }
 
+TEST_F(BeaconTest, BatchedCriticalCss) {
+  // Hold beacons for longer than their nonces are valid, to check that each
+  // nonce is validated as of when its beacon arrived.
+  RewriteOptions* global_options = server_context()->global_options();
+  global_options->ClearSignatureForTesting();
+  global_options->set_beacon_batch_interval_ms(2 * Timer::kMinuteMs);
+  server_context()->ComputeSignature(global_options);
+  server_context()->InitBeaconAccumulator();
+  BeaconAccumulator* accumulator = server_context()->beacon_accumulator();
+  ASSERT_TRUE(accumulator != NULL);
+
+  InsertCssBeacon(UserAgentMatcherTestBase::kChromeUserAgent);
+  GoogleString first_nonce = last_beacon_metadata_.nonce;
+  InsertCssBeacon(UserAgentMatcherTestBase::kChromeUserAgent);
+  GoogleString second_nonce = last_beacon_metadata_.nonce;
+  GoogleString beacon_prefix = StrCat(
+      "url=http%3A%2F%2Fwww.example.com&oh=", kOptionsHash);
+  EXPECT_TRUE(server_context()->HandleBeacon(
+      StrCat(beacon_prefix, "&n=", first_nonce,
+             "&cs=%23foo,.bar,%23noncandidate"),
+      UserAgentMatcherTestBase::kChromeUserAgent, CreateRequestContext()));
+  EXPECT_TRUE(server_context()->HandleBeacon(
+      StrCat(beacon_prefix, "&n=", second_nonce,
+             "&cs=.bar,img,%23noncandidate"),
+      UserAgentMatcherTestBase::kChromeUserAgent, CreateRequestContext()));
+  // A beacon whose nonce was never issued is held, but not applied.
+  EXPECT_TRUE(server_context()->HandleBeacon(
+      StrCat(beacon_prefix, "&n=bogus&cs=%23noncandidate"),
+      UserAgentMatcherTestBase::kChromeUserAgent, CreateRequestContext()));
+  EXPECT_EQ(1, accumulator->num_pending_pages());
+  EXPECT_EQ(3, accumulator->num_pending_beacons());
+
+  size_t inserts = lru_cache()->num_inserts();
+  AdvanceTimeMs(2 * Timer::kMinuteMs);
+  // The flush runs in a low-priority worker.
+  mock_scheduler()->AwaitQuiescence();
+  EXPECT_EQ(0, accumulator->num_pending_beacons());
+  // All three beacons went out in one write of the beacon cohort.
+  EXPECT_EQ(inserts + 1, lru_cache()->num_inserts());
+
+  ResetDriver();
+  rewrite_driver()->set_property_page(
+      MockPageForUA(UserAgentMatcherTestBase::kChromeUserAgent));
+  critical_css_selectors_ = server_context()->critical_selector_finder()->
+      GetCriticalSelectors(rewrite_driver());
+  EXPECT_STREQ("#foo,.bar,img",
+               JoinCollection(critical_css_selectors_, ","));
+}
+
 class ResourceFreshenTest : public ServerContextTest {
  protected:
   virtual void SetUp() {
@@ -39,6 +39,7 @@
       'type': 'executable',
       'dependencies': [
         'test_util',
+        'instaweb.gyp:automatic_util',
         'instaweb.gyp:instaweb_automatic',
         'instaweb.gyp:instaweb_javascript',
         'instaweb.gyp:instaweb_spriter_test',
@@ -72,6 +73,8 @@
         '<(DEPTH)/pagespeed/automatic/proxy_fetch_test.cc',
         '<(DEPTH)/pagespeed/automatic/proxy_interface_test.cc',
         '<(DEPTH)/pagespeed/automatic/proxy_interface_test_base.cc',
+        '<(DEPTH)/pagespeed/automatic/proxy_replayer.cc',
+        '<(DEPTH)/pagespeed/automatic/proxy_replayer_test.cc',
         # TODO(jefftk): get this test to build.
         # '<(DEPTH)/pagespeed/automatic/rewriter_speed_test.cc',
         'config/rewrite_options_manager_test.cc',
@@ -101,6 +104,7 @@
         'rewriter/add_instrumentation_filter_test.cc',
         'rewriter/association_transformer_test.cc',
         'rewriter/base_tag_filter_test.cc',
+        'rewriter/beacon_accumulator_test.cc',
         'rewriter/beacon_critical_images_finder_test.cc',
         'rewriter/beacon_critical_line_info_finder_test.cc',
         'rewriter/blink_util_test.cc',
@@ -120,6 +124,7 @@
         'rewriter/critical_line_info_finder_test.cc',
         'rewriter/critical_selector_filter_test.cc',
         'rewriter/critical_selector_finder_test.cc',
+        'rewriter/critical_selector_matcher_test.cc',
         'rewriter/css_combine_filter_test.cc',
         'rewriter/css_embedded_config_test.cc',
         'rewriter/css_filter_test.cc',
@@ -258,6 +263,7 @@
         '<(DEPTH)/pagespeed/kernel/base/null_statistics_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/pool_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/ref_counted_ptr_test.cc',
+        '<(DEPTH)/pagespeed/kernel/base/sampling_profiler_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/sha1_signature_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/shared_string_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/source_map_test.cc',
@@ -268,6 +274,7 @@
         '<(DEPTH)/pagespeed/kernel/base/string_util_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/symbol_table_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/time_util_test.cc',
+        '<(DEPTH)/pagespeed/kernel/base/trace_span_ring_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/vector_deque_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/waveform_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/wildcard_group.cc',
@@ -296,12 +303,14 @@
         '<(DEPTH)/pagespeed/kernel/html/html_name_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/html_parse_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/remove_comments_filter_test.cc',
+        '<(DEPTH)/pagespeed/kernel/html/shared_name_table_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/bot_checker_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/caching_headers_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/content_type_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/data_url_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/domain_registry_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/google_url_test.cc',
+        '<(DEPTH)/pagespeed/kernel/http/known_headers_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/query_params_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/request_headers_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/response_headers_test.cc',
@@ -350,6 +359,7 @@
         '<(DEPTH)/pagespeed/kernel/util/re2_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/simple_stats_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/statistics_logger_test.cc',
+        '<(DEPTH)/pagespeed/kernel/util/statistics_time_series_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/statistics_work_bound_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/threadsafe_lock_manager_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/url_escaper_test.cc',
@@ -423,6 +433,7 @@
         '<(DEPTH)/pagespeed/apache/header_util.cc',
         '<(DEPTH)/pagespeed/apache/header_util_test.cc',
         '<(DEPTH)/pagespeed/apache/mock_apache.cc',
+        '<(DEPTH)/pagespeed/apache/shared_string_bucket.cc',
         '<(DEPTH)/pagespeed/apache/speed_test.cc',
         '<(DEPTH)/pagespeed/system/add_headers_fetcher_test.cc',
         '<(DEPTH)/pagespeed/system/in_place_resource_recorder_test.cc',
@@ -505,7 +516,10 @@
         '<(DEPTH)/pagespeed/kernel/base/wildcard_group.cc',
         '<(DEPTH)/pagespeed/kernel/cache/compressed_cache_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/lru_cache_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/html/html_keywords_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/html_parse_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/http/response_headers_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/sharedmem/shared_mem_lock_manager_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/deque_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/url_escaper_speed_test.cc',
       ],
@@ -531,5 +545,25 @@
         '<(DEPTH)/third_party/css_parser/src',
       ],
     },
+    {
+      'target_name': 'proxy_replay',
+      'type': 'executable',
+      'sources': [
+        '<(DEPTH)/pagespeed/automatic/proxy_replay_main.cc',
+        '<(DEPTH)/pagespeed/automatic/proxy_replayer.cc',
+      ],
+      'dependencies': [
+        'instaweb.gyp:automatic_util',
+        'instaweb.gyp:instaweb_automatic',
+        'instaweb.gyp:process_context',
+        '<(DEPTH)/base/base.gyp:base',
+        '<(DEPTH)/pagespeed/kernel.gyp:pagespeed_base_test_infrastructure',
+        '<(DEPTH)/pagespeed/kernel.gyp:pthread_system',
+        '<(DEPTH)/pagespeed/kernel.gyp:util_gflags',
+      ],
+      'include_dirs': [
+        '<(DEPTH)',
+      ],
+    },
   ],
 }
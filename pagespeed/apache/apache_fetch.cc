@@ -48,6 +48,7 @@ ApacheFetch::ApacheFetch(const GoogleString& mapped_url, StringPiece debug_info,
       status_ok_(false),
       is_proxy_(false),
       buffered_(true),
+      last_chunk_owned_(false),
       blocking_fetch_timeout_ms_(options_->blocking_fetch_timeout_ms()),
       max_wait_ms_(kDefaultMaxWaitMs) {
   // We are proxying content, and the caching in the http configuration
@@ -132,7 +133,7 @@ void ApacheFetch::SendOutHeaders() {
     apache_writer_->OutputHeaders(response_headers());
     if (!error_message.empty()) {
       if (buffered_) {
-        error_message.CopyToString(&output_bytes_);
+        BufferCopy(error_message);
       } else {
         apache_writer_->Write(error_message, message_handler_);
       }
@@ -184,7 +185,7 @@ bool ApacheFetch::HandleWrite(const StringPiece& sp, MessageHandler* handler) {
       if (squelch_output_) {
         return true;  // Suppressing further output after writing error message.
       } else if (buffered_) {
-        sp.AppendToString(&output_bytes_);
+        BufferCopy(sp);
         return true;
       } else {
         return apache_writer_->Write(sp, handler);
@@ -198,6 +199,45 @@ bool ApacheFetch::HandleWrite(const StringPiece& sp, MessageHandler* handler) {
   return false;  // Drop the write.
 }
 
+// Called by other threads, unless buffered=false.
+bool ApacheFetch::HandleWriteShared(const SharedString& storage,
+                                    const StringPiece& sp,
+                                    MessageHandler* handler) {
+  {
+    ScopedMutex lock(mutex_.get());
+    if (!abandoned_) {
+      if (squelch_output_) {
+        return true;  // Suppressing further output after writing error message.
+      } else if (buffered_) {
+        // Hold on to the storage rather than copying it.  The SharedString
+        // reference count is thread-safe, so the chunk can be released on
+        // the apache request thread.
+        SharedString chunk(storage);
+        chunk.RemovePrefix(sp.data() - storage.data());
+        chunk.RemoveSuffix(chunk.size() - sp.size());
+        output_chunks_.push_back(chunk);
+        last_chunk_owned_ = false;
+        return true;
+      } else {
+        return apache_writer_->WriteShared(storage, sp, handler);
+      }
+    }
+  }
+  handler->Message(kWarning,
+                   "Write of %zu bytes for url %s received after "
+                   "being abandoned for timing out.",
+                   sp.size(), mapped_url_.c_str());
+  return false;  // Drop the write.
+}
+
+void ApacheFetch::BufferCopy(const StringPiece& sp) {
+  if (!last_chunk_owned_) {
+    output_chunks_.push_back(SharedString());
+    last_chunk_owned_ = true;
+  }
+  output_chunks_.back().Append(sp);
+}
+
 // Called by other threads, unless buffered=false.
 bool ApacheFetch::HandleFlush(MessageHandler* handler) {
   if (buffered_) {
@@ -257,9 +297,11 @@ bool ApacheFetch::Wait(const RewriteDriver* rewrite_driver) {
     }
   }
   SendOutHeaders();
-  if (!output_bytes_.empty()) {
-    apache_writer_->Write(output_bytes_, message_handler_);
+  for (int i = 0, n = output_chunks_.size(); i < n; ++i) {
+    const SharedString& chunk = output_chunks_[i];
+    apache_writer_->WriteShared(chunk, chunk.Value(), message_handler_);
   }
+  output_chunks_.clear();
   mutex_->Unlock();
   return true;  // handled
 }
@@ -18,12 +18,15 @@
 #ifndef PAGESPEED_APACHE_FETCH_H_
 #define PAGESPEED_APACHE_FETCH_H_
 
+#include <vector>
+
 #include "net/instaweb/http/public/async_fetch.h"
 #include "net/instaweb/http/public/request_context.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "pagespeed/apache/apache_writer.h"
 #include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/http/response_headers.h"
@@ -108,10 +111,17 @@ class ApacheFetch : public AsyncFetch {
   virtual bool HandleFlush(MessageHandler* handler) LOCKS_EXCLUDED(mutex_);
   virtual bool HandleWrite(const StringPiece& sp, MessageHandler* handler)
       LOCKS_EXCLUDED(mutex_);
+  virtual bool HandleWriteShared(const SharedString& storage,
+                                 const StringPiece& sp,
+                                 MessageHandler* handler)
+      LOCKS_EXCLUDED(mutex_);
 
  private:
   void SendOutHeaders() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Buffers a copy of sp, to be written out in Wait().
+  void BufferCopy(const StringPiece& sp) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   GoogleString mapped_url_;
 
   // All uses of apache_writer_ and options_ must be protected with a check
@@ -140,7 +150,13 @@ class ApacheFetch : public AsyncFetch {
   int64 blocking_fetch_timeout_ms_;  // Need in Wait()
   int max_wait_ms_;                  // Need in Wait()
   GoogleString debug_info_;
-  GoogleString output_bytes_;
+
+  // Output buffered until Wait().  Shared writes are kept as references to
+  // their storage, and written out without copying; other writes are copied
+  // into chunks of our own, and last_chunk_owned_ says whether more can be
+  // appended to the last one.
+  std::vector<SharedString> output_chunks_;
+  bool last_chunk_owned_;
 
   DISALLOW_COPY_AND_ASSIGN(ApacheFetch);
 };
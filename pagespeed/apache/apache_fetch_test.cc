@@ -23,6 +23,8 @@
 #include "pagespeed/kernel/base/mock_message_handler.h"
 #include "pagespeed/kernel/base/null_mutex.h"
 #include "pagespeed/kernel/base/null_thread_system.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/string_writer.h"
 
 #include "httpd.h"  // NOLINT
@@ -222,6 +224,34 @@ TEST_F(ApacheFetchTest, SuccessBuffered) {
             HeadersOutToString(&request_));
 }
 
+TEST_F(ApacheFetchTest, SharedWritesBuffered) {
+  GoogleString body(10000, 'x');
+  SharedString storage(body);
+  EXPECT_TRUE(apache_fetch_->Write("hello ", &message_handler_));
+  EXPECT_TRUE(apache_fetch_->WriteShared(storage, storage.Value(),
+                                         &message_handler_));
+  EXPECT_TRUE(apache_fetch_->Write("world", &message_handler_));
+  EXPECT_TRUE(apache_fetch_->Write(".", &message_handler_));
+  EXPECT_EQ("", MockApache::ActionsSinceLastCall());
+  // The fetch holds a reference to the storage rather than a copy.
+  EXPECT_FALSE(storage.unique());
+
+  WaitExpectSuccess();
+
+  // Writes stay in order; the shared one is passed through without copying
+  // and the copied ones around it are still combined.
+  EXPECT_EQ(
+      StrCat("ap_set_content_type(text/plain) "
+             "ap_remove_output_filter(MOD_EXPIRES) "
+             "ap_remove_output_filter(FIXUP_HEADERS_OUT) "
+             "ap_set_content_type(text/plain) "
+             "ap_rwrite(hello ) "
+             "ap_pass_brigade(", body, ") "
+             "ap_rwrite(world.)"),
+      MockApache::ActionsSinceLastCall());
+  EXPECT_TRUE(storage.unique());
+}
+
 TEST_F(ApacheFetchTest, SuccessUnbuffered) {
   apache_fetch_->set_buffered(false);
   EXPECT_TRUE(apache_fetch_->Write("hello ", &message_handler_));
@@ -201,10 +201,12 @@ void ApacheServerContext::InitProxyFetchFactory() {
 
 ApacheRequestContext* ApacheServerContext::NewApacheRequestContext(
     request_rec* request) {
-  return new ApacheRequestContext(
+  ApacheRequestContext* request_context = new ApacheRequestContext(
       thread_system()->NewMutex(),
       timer(),
       request);
+  request_context->set_trace_spans(trace_spans());
+  return request_context;
 }
 
 void ApacheServerContext::ReportNotFoundHelper(MessageType message_type,
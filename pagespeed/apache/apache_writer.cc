@@ -17,18 +17,32 @@
 #include "base/logging.h"
 #include "pagespeed/apache/apache_writer.h"
 #include "pagespeed/apache/header_util.h"
+#include "pagespeed/apache/shared_string_bucket.h"
 #include "net/instaweb/http/public/async_fetch.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/response_headers.h"
 
+#include "apr_buckets.h"                        // NOLINT
 #include "apr_strings.h"  // for apr_pstrdup    // NOLINT
 #include "http_protocol.h"                      // NOLINT
+#include "util_filter.h"                        // NOLINT
 
 namespace net_instaweb {
 
+namespace {
+
+// Writes shorter than this are copied into Apache's output buffer, which
+// coalesces them into fewer network writes.  ap_rwrite uses the same
+// threshold to decide whether to buffer.
+const size_t kMinSharedWriteBytes = AP_MIN_BYTES_TO_WRITE;
+
+}  // namespace
+
 ApacheWriter::ApacheWriter(request_rec* r, ThreadSystem* thread_system)
     : request_(r),
+      brigade_(NULL),
       headers_out_(false),
       disable_downstream_header_filters_(false),
       strip_cookies_(false),
@@ -47,6 +61,27 @@ bool ApacheWriter::Write(const StringPiece& str, MessageHandler* handler) {
   return true;
 }
 
+bool ApacheWriter::WriteShared(const SharedString& storage,
+                               const StringPiece& str,
+                               MessageHandler* handler) {
+  if (str.size() < kMinSharedWriteBytes) {
+    return Write(str, handler);
+  }
+  DCHECK(apache_request_thread_->IsCurrentThread());
+  DCHECK(headers_out_);
+  apr_bucket_alloc_t* bucket_alloc = request_->connection->bucket_alloc;
+  if (brigade_ == NULL) {
+    brigade_ = apr_brigade_create(request_->pool, bucket_alloc);
+  }
+  APR_BRIGADE_INSERT_TAIL(
+      brigade_, NewSharedStringBucket(storage, str, bucket_alloc));
+  // Any bytes ap_rwrite has buffered are sent ahead of the brigade by the
+  // OLD_WRITE filter at the top of the chain, so ordering is preserved.
+  apr_status_t status = ap_pass_brigade(request_->output_filters, brigade_);
+  apr_brigade_cleanup(brigade_);
+  return (status == APR_SUCCESS);
+}
+
 bool ApacheWriter::Flush(MessageHandler* handler) {
   DCHECK(apache_request_thread_->IsCurrentThread());
   DCHECK(headers_out_);
@@ -23,12 +23,14 @@
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/writer.h"
 
+struct apr_bucket_brigade;
 struct request_rec;
 
 namespace net_instaweb {
 
 class MessageHandler;
 class ResponseHeaders;
+class SharedString;
 
 // Writer object that writes to an Apache Request stream.  Should only be used
 // from a single apache request thread, not from a rewrite thread or anything
@@ -41,6 +43,14 @@ class ApacheWriter : public Writer {
   virtual bool Write(const StringPiece& str, MessageHandler* handler);
   virtual bool Flush(MessageHandler* handler);
 
+  // Like Write, but 'str' points into 'storage', which we may hold a
+  // reference to instead of copying.  Large writes are passed down the
+  // filter chain as a bucket sharing the storage, so Apache sends them
+  // without any copy in user space.  Small writes are cheaper to copy into
+  // Apache's output buffer, and go through Write.
+  bool WriteShared(const SharedString& storage, const StringPiece& str,
+                   MessageHandler* handler);
+
   // Copies the contents of the specified response_headers to the Apache
   // headers_out structure.  This must be done before any bytes are flushed.
   //
@@ -49,7 +59,7 @@ class ApacheWriter : public Writer {
   // If set_content_length was previously called, this will set a
   // content length to avoid chunked encoding, otherwise it will clear
   // any content-length specified in the response headers.
-  void OutputHeaders(ResponseHeaders* response_headers);
+  virtual void OutputHeaders(ResponseHeaders* response_headers);
   void set_content_length(int64 x) { content_length_ = x; }
 
   // Disables mod_expires and mod_headers to allow the headers to
@@ -67,6 +77,7 @@ class ApacheWriter : public Writer {
 
  private:
   request_rec* request_;
+  apr_bucket_brigade* brigade_;  // Allocated lazily for WriteShared.
   bool headers_out_;
   bool disable_downstream_header_filters_;
   bool strip_cookies_;
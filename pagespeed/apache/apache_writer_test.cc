@@ -167,4 +167,30 @@ TEST_F(ApacheWriterTest, StripCookies) {
             HeadersOutToString(&request_));
 }
 
+TEST_F(ApacheWriterTest, WriteSharedSmall) {
+  apache_writer_->OutputHeaders(response_headers_.get());
+  MockApache::ActionsSinceLastCall();
+
+  // Short writes are copied into Apache's output buffer like Write.
+  SharedString storage("hello world");
+  EXPECT_TRUE(apache_writer_->WriteShared(
+      storage, storage.Value().substr(6), &message_handler_));
+  EXPECT_EQ("ap_rwrite(world)", MockApache::ActionsSinceLastCall());
+}
+
+TEST_F(ApacheWriterTest, WriteSharedLarge) {
+  apache_writer_->OutputHeaders(response_headers_.get());
+  MockApache::ActionsSinceLastCall();
+
+  // Long writes are passed as a bucket referencing the storage, which is
+  // released once Apache is done with the bucket.
+  GoogleString body(10000, 'x');
+  SharedString storage(StrCat("headers", body));
+  EXPECT_TRUE(apache_writer_->WriteShared(
+      storage, storage.Value().substr(7), &message_handler_));
+  EXPECT_EQ(StrCat("ap_pass_brigade(", body, ")"),
+            MockApache::ActionsSinceLastCall());
+  EXPECT_TRUE(storage.unique());
+}
+
 }  // namespace net_instaweb
@@ -93,7 +93,7 @@ class InstawebContext {
   ApacheServerContext* apache_server_context() { return server_context_; }
   const GoogleString& output() { return output_; }
   bool empty() const { return output_.empty(); }
-  void clear() { output_.clear(); }  // TODO(jmarantz): needed?
+  void clear() { output_.clear(); }
 
   ResponseHeaders* response_headers() {
     return response_headers_.get();
@@ -23,7 +23,6 @@
 #include "net/instaweb/http/public/async_fetch.h"
 #include "net/instaweb/http/public/cache_url_async_fetcher.h"
 #include "net/instaweb/http/public/request_context.h"
-#include "net/instaweb/http/public/sync_fetcher_adapter_callback.h"
 #include "net/instaweb/public/global_constants.h"
 #include "net/instaweb/rewriter/public/domain_lawyer.h"
 #include "net/instaweb/rewriter/public/resource_fetch.h"
@@ -39,6 +38,7 @@
 #include "pagespeed/apache/apache_request_context.h"
 #include "pagespeed/apache/apache_rewrite_driver_factory.h"
 #include "pagespeed/apache/apache_server_context.h"
+#include "pagespeed/apache/apache_writer.h"
 #include "pagespeed/apache/apr_timer.h"
 #include "pagespeed/apache/header_util.h"
 #include "pagespeed/apache/instaweb_context.h"
@@ -52,6 +52,7 @@
 #include "pagespeed/kernel/base/ref_counted_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string_writer.h"
+#include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/http_options.h"
@@ -95,6 +96,31 @@ const size_t kMaxPostSizeBytes = 131072;
 
 }  // namespace
 
+// ResourceFetch adds an X-Page-Speed header, which mod_pagespeed has never
+// sent on its resources, so we remove it here.  Compressible resources are
+// also compressed on the way out, as ApacheFetch doesn't do that itself.
+class InstawebHandler::PagespeedResourceWriter : public ApacheWriter {
+ public:
+  PagespeedResourceWriter(request_rec* request, ThreadSystem* thread_system)
+      : ApacheWriter(request, thread_system),
+        request_(request) {
+  }
+
+  virtual void OutputHeaders(ResponseHeaders* response_headers) {
+    // TODO(sligocki): Consistently use X- headers in MPS and PSOL.
+    // I think it would be good to change X-Mod-Pagespeed -> X-Page-Speed
+    // and use that for all HTML and resource requests.
+    response_headers->RemoveAll(kPageSpeedHeader);
+    ApacheWriter::OutputHeaders(response_headers);
+    AddDeflateFilterIfCompressible(request_);
+  }
+
+ private:
+  request_rec* request_;
+
+  DISALLOW_COPY_AND_ASSIGN(PagespeedResourceWriter);
+};
+
 InstawebHandler::InstawebHandler(request_rec* request)
     : request_(request),
       server_context_(InstawebContext::ServerContextFromServerRec(
@@ -231,6 +257,15 @@ bool InstawebHandler::IsCompressibleContentType(const char* content_type) {
   return res;
 }
 
+/* static */
+void InstawebHandler::AddDeflateFilterIfCompressible(request_rec* request) {
+  if (request->status == HttpStatus::kOK &&
+      IsCompressibleContentType(request->content_type)) {
+    // Make sure compression is enabled for this response.
+    ap_add_output_filter("DEFLATE", NULL, request, request->connection);
+  }
+}
+
 /* static */
 void InstawebHandler::send_out_headers_and_body(
     request_rec* request,
@@ -241,11 +276,7 @@ void InstawebHandler::send_out_headers_and_body(
   ResponseHeadersToApacheRequest(response_headers, request);
   request->status = response_headers.status_code();
   DisableDownstreamHeaderFilters(request);
-  if (response_headers.status_code() == HttpStatus::kOK &&
-      IsCompressibleContentType(request->content_type)) {
-    // Make sure compression is enabled for this response.
-    ap_add_output_filter("DEFLATE", NULL, request, request->connection);
-  }
+  AddDeflateFilterIfCompressible(request);
 
   // Recompute the content-length, because the content may have changed.
   ap_set_content_length(request, output.size());
@@ -414,31 +445,30 @@ void InstawebHandler::RemoveStrippedResponseHeadersFromApacheRequest() {
 // Handle url as .pagespeed. rewritten resource.
 void InstawebHandler::HandleAsPagespeedResource() {
   RewriteDriver* driver = MakeDriver();
-  GoogleString output;  // TODO(jmarantz): Quit buffering resource output.
-  StringWriter writer(&output);
-
-  SyncFetcherAdapterCallback* callback = new SyncFetcherAdapterCallback(
-      server_context_->thread_system(), &writer, request_context_);
-  callback->SetRequestHeadersTakingOwnership(request_headers_.release());
-
-  if (ResourceFetch::BlockingFetch(stripped_gurl_, server_context_, driver,
-                                   callback)) {
-    ResponseHeaders* response_headers = callback->response_headers();
-    // TODO(sligocki): Check that this is already done in ResourceFetch
-    // and remove redundant setting here.
-    response_headers->SetDate(server_context_->timer()->NowMs());
-    // ResourceFetch adds X-Page-Speed header, old mod_pagespeed code
-    // did not. For now, we remove that header for consistency.
-    // TODO(sligocki): Consistently use X- headers in MPS and PSOL.
-    // I think it would be good to change X-Mod-Pagespeed -> X-Page-Speed
-    // and use that for all HTML and resource requests.
-    response_headers->RemoveAll(kPageSpeedHeader);
-    send_out_headers_and_body(request_, *response_headers, output);
-  } else {
+
+  // ResourceFetch hands the request headers to the driver itself, so we don't
+  // use MakeFetch, which would set them first.
+  DCHECK(fetch_ == NULL);
+  fetch_ = new ApacheFetch(
+      original_url_, "resource", server_context_->thread_system(),
+      server_context_->timer(),
+      new PagespeedResourceWriter(request_, server_context_->thread_system()),
+      request_headers_.release(), request_context_, options_,
+      server_context_->message_handler());
+  // Errors are reported below, as a 404 with our own error page.
+  fetch_->set_handle_error(false);
+
+  // Going through ApacheFetch rather than a buffering callback lets cached
+  // resources be passed down the filter chain without copying them.
+  ResourceFetch::StartWithDriver(stripped_gurl_,
+                                 ResourceFetch::kDontAutoCleanupDriver,
+                                 server_context_, driver, fetch_);
+  if (!WaitForFetch() || !fetch_->status_ok()) {
+    // If we gave up waiting, fetch_ has been released, but nothing has been
+    // sent yet either, so we can still report the failure.
     server_context_->ReportResourceNotFound(original_url_, request_);
   }
-
-  callback->Release();
+  driver->Cleanup();
 }
 
 static apr_status_t DeleteInPlaceRecorder(void* object) {
@@ -179,8 +179,16 @@ class InstawebHandler {
   // options to use.
   void ComputeCustomOptions();
 
+  // Writes a .pagespeed. resource out to Apache; see instaweb_handler.cc.
+  class PagespeedResourceWriter;
+
   static bool IsCompressibleContentType(const char* content_type);
 
+  // Makes sure a successful response with a compressible Content-Type gets
+  // compressed on its way out.  Must be called after the response's headers
+  // have been copied into 'request'.
+  static void AddDeflateFilterIfCompressible(request_rec* request);
+
   static void send_out_headers_and_body(
       request_rec* request,
       const ResponseHeaders& response_headers,
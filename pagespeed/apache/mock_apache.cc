@@ -3,6 +3,7 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/http/http_names.h"
 
+#include "apr_buckets.h"  // NOLINT
 #include "httpd.h"        // NOLINT
 #include "util_filter.h"  // NOLINT
 
@@ -40,6 +41,9 @@ void MockApache::PrepareRequest(request_rec* request) {
   request->headers_in = apr_table_make(request->pool, 10);
   request->headers_out = apr_table_make(request->pool, 10);
   request->subprocess_env = apr_table_make(request->pool, 10);
+  request->connection = static_cast<conn_rec*>(
+      apr_pcalloc(request->pool, sizeof(conn_rec)));
+  request->connection->bucket_alloc = apr_bucket_alloc_create(request->pool);
 
   // Create three fake downstream filters so we can make sure the right ones are
   // removed.
@@ -143,9 +147,19 @@ apr_status_t ap_get_brigade(ap_filter_t*, apr_bucket_brigade*,
   return 0;
 }
 
-apr_status_t ap_pass_brigade(ap_filter_t*, apr_bucket_brigade*) {
-  log_fatal("ap_pass_brigade");
-  return 0;
+apr_status_t ap_pass_brigade(ap_filter_t*, apr_bucket_brigade* bb) {
+  GoogleString contents;
+  for (apr_bucket* bucket = APR_BRIGADE_FIRST(bb);
+       bucket != APR_BRIGADE_SENTINEL(bb);
+       bucket = APR_BUCKET_NEXT(bucket)) {
+    const char* data;
+    apr_size_t len;
+    CHECK_EQ(APR_SUCCESS,
+             apr_bucket_read(bucket, &data, &len, APR_BLOCK_READ));
+    contents.append(data, len);
+  }
+  log_action(net_instaweb::StrCat("ap_pass_brigade(", contents, ")"));
+  return APR_SUCCESS;
 }
 
 ap_filter_rec_t* ap_register_output_filter(
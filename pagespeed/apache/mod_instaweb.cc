@@ -180,6 +180,8 @@ const char kModPagespeedUrlPrefix[] = "ModPagespeedUrlPrefix";
 const char kModPagespeedUrlValuedAttribute[] = "ModPagespeedUrlValuedAttribute";
 const char kModPagespeedUsePerVHostStatistics[] =
     "ModPagespeedUsePerVHostStatistics";
+const char kModPagespeedUserAgentCacheEntries[] =
+    "ModPagespeedUserAgentCacheEntries";
 
 // The following are deprecated due to spelling
 const char kModPagespeedImgInlineMaxBytes[] = "ModPagespeedImgInlineMaxBytes";
@@ -235,9 +237,9 @@ bool check_pagespeed_applicable(request_rec* request,
   return true;
 }
 
-// Create a new bucket from buf using HtmlRewriter.
-// TODO(lsong): the content is copied multiple times. The buf is
-// copied/processed to string output, then output is copied to new bucket.
+// Create a new bucket from buf using HtmlRewriter.  The bucket refers to the
+// context's output buffer rather than copying it, so it is only valid until
+// the caller passes it down the filter chain and clears the context.
 apr_bucket* rewrite_html(InstawebContext* context, request_rec* request,
                          RewriteOperation operation, const char* buf, int len) {
   if (context == NULL) {
@@ -278,13 +280,11 @@ apr_bucket* rewrite_html(InstawebContext* context, request_rec* request,
     return NULL;
   }
 
-  // Use the rewritten content. Create in heap since output will
-  // be emptied for reuse.
-  apr_bucket* bucket = apr_bucket_heap_create(
-      output.data(), output.size(), NULL,
-      request->connection->bucket_alloc);
-  context->clear();
-  return bucket;
+  // Filters that hold on to the data past ap_pass_brigade set the bucket
+  // aside, which copies it; the rest send it straight from our buffer, and
+  // the buffer keeps its capacity for the next flush.
+  return apr_bucket_transient_create(output.data(), output.size(),
+                                     request->connection->bucket_alloc);
 }
 
 // Apache's pool-based cleanup is not effective on process shutdown.  To allow
@@ -565,6 +565,8 @@ bool process_bucket(ap_filter_t* filter, request_rec* request,
     APR_BRIGADE_INSERT_TAIL(context_bucket_brigade, bucket);
     // OK, we have seen the EOS. Time to pass it along down the chain.
     *return_code = ap_pass_brigade(filter->next, context_bucket_brigade);
+    apr_brigade_cleanup(context_bucket_brigade);
+    context->clear();
     return false;
   } else if (APR_BUCKET_IS_FLUSH(bucket)) {
     new_bucket = rewrite_html(context, request, FLUSH, NULL, 0);
@@ -574,6 +576,10 @@ bool process_bucket(ap_filter_t* filter, request_rec* request,
     APR_BRIGADE_INSERT_TAIL(context_bucket_brigade, bucket);
     // OK, Time to flush, pass it along down the chain.
     *return_code = ap_pass_brigade(filter->next, context_bucket_brigade);
+    // The rewritten content went down as a transient bucket, so it can be
+    // cleared only now that the brigade has been passed.
+    apr_brigade_cleanup(context_bucket_brigade);
+    context->clear();
     if (*return_code != APR_SUCCESS) {
       return false;
     }
@@ -1719,6 +1725,9 @@ static const command_rec mod_pagespeed_filter_cmds[] = {
   APACHE_CONFIG_OPTION(kModPagespeedUrlPrefix, "No longer used."),
   APACHE_CONFIG_OPTION(kModPagespeedUsePerVHostStatistics,
         "If true, keep track of statistics per VHost and not just globally"),
+  APACHE_CONFIG_OPTION(kModPagespeedUserAgentCacheEntries,
+        "Number of user-agents whose capabilities are cached in shared "
+        "memory. 0 to disable"),
   APACHE_CONFIG_OPTION(kModPagespeedBlockingRewriteRefererUrls,
                        "wildcard_spec for referer urls which trigger blocking "
                        "rewrites"),
@@ -0,0 +1,83 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pagespeed/apache/shared_string_bucket.h"
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/shared_string.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Shared by all buckets split or copied from the same original.  APR
+// requires the refcount to come first.
+struct SharedStringBucketData {
+  apr_bucket_refcount refcount;
+  SharedString* storage;
+};
+
+apr_status_t SharedStringBucketRead(apr_bucket* bucket, const char** str,
+                                    apr_size_t* len, apr_read_type_e block) {
+  SharedStringBucketData* data =
+      static_cast<SharedStringBucketData*>(bucket->data);
+  *str = data->storage->data() + bucket->start;
+  *len = bucket->length;
+  return APR_SUCCESS;
+}
+
+void SharedStringBucketDestroy(void* opaque) {
+  SharedStringBucketData* data = static_cast<SharedStringBucketData*>(opaque);
+  if (apr_bucket_shared_destroy(data)) {
+    delete data->storage;
+    apr_bucket_free(data);
+  }
+}
+
+}  // namespace
+
+// The storage is on the heap, independent of any pool, so setting the bucket
+// aside is a no-op.
+const apr_bucket_type_t kSharedStringBucketType = {
+  "PAGESPEED_SHARED_STRING", 5, apr_bucket_type_t::APR_BUCKET_DATA,
+  SharedStringBucketDestroy,
+  SharedStringBucketRead,
+  apr_bucket_setaside_noop,
+  apr_bucket_shared_split,
+  apr_bucket_shared_copy
+};
+
+apr_bucket* NewSharedStringBucket(const SharedString& storage,
+                                  StringPiece contents,
+                                  apr_bucket_alloc_t* list) {
+  const char* base = storage.data();
+  DCHECK(contents.data() >= base);
+  DCHECK(contents.data() + contents.size() <= base + storage.size());
+
+  apr_bucket* bucket = static_cast<apr_bucket*>(
+      apr_bucket_alloc(sizeof(*bucket), list));
+  APR_BUCKET_INIT(bucket);
+  bucket->free = apr_bucket_free;
+  bucket->list = list;
+
+  SharedStringBucketData* data = static_cast<SharedStringBucketData*>(
+      apr_bucket_alloc(sizeof(*data), list));
+  data->storage = new SharedString(storage);
+  apr_bucket_shared_make(bucket, data, contents.data() - base,
+                         contents.size());
+  bucket->type = &kSharedStringBucketType;
+  return bucket;
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,45 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PAGESPEED_APACHE_SHARED_STRING_BUCKET_H_
+#define PAGESPEED_APACHE_SHARED_STRING_BUCKET_H_
+
+#include "pagespeed/kernel/base/string_util.h"
+
+#include "apr_buckets.h"  // NOLINT
+
+namespace net_instaweb {
+
+class SharedString;
+
+// APR bucket type whose data lives in a SharedString.  The bucket holds a
+// reference to the string's storage rather than a copy of its bytes, so
+// rewritten HTML and cached resource bodies can be handed to Apache's output
+// filters without a memcpy.  Splitting or copying the bucket shares the
+// reference, and the storage is released when the last bucket is destroyed,
+// possibly after the request has finished if the core output filter set the
+// bucket aside.
+extern const apr_bucket_type_t kSharedStringBucketType;
+
+// Makes a bucket for 'contents', which must point into storage.Value().  The
+// storage must not be mutated while the bucket is alive.  Like all buckets,
+// this must be called on the thread that owns 'list', which is normally the
+// Apache request thread.
+apr_bucket* NewSharedStringBucket(const SharedString& storage,
+                                  StringPiece contents,
+                                  apr_bucket_alloc_t* list);
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_APACHE_SHARED_STRING_BUCKET_H_
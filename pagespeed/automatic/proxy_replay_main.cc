@@ -0,0 +1,100 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a directory of HTTP dumps through an in-process proxy and reports
+// throughput, latency, cache hit rates and heap growth for each pass, e.g.
+//
+//   proxy_replay --replay_corpus_dir=/tmp/slurp --replay_concurrency=16 \
+//       --rewrite_level=CoreFilters
+//
+// The corpus is laid out the way slurping writes it, and the usual rewrite
+// flags select the filters.  The first pass runs with cold caches; later
+// passes show the steady state.
+
+#include <cstdio>
+
+#include "net/instaweb/rewriter/public/process_context.h"
+#include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
+#include "net/instaweb/rewriter/public/rewrite_gflags.h"
+#include "pagespeed/automatic/proxy_replayer.h"
+#include "pagespeed/kernel/base/file_system.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/util/gflags.h"
+
+DEFINE_string(replay_corpus_dir, "",
+              "Directory of HTTP dumps to replay, as written by slurping.");
+DEFINE_string(replay_url_file, "",
+              "File listing the URLs to replay, one per line.  Defaults to "
+              "every dump in --replay_corpus_dir, in sorted order.");
+DEFINE_int32(replay_concurrency, 8, "Number of requests kept in flight.");
+DEFINE_int32(replay_passes, 2,
+             "Number of times to replay the URLs.  Caches are kept between "
+             "passes, so the first pass is cold and the rest are warm.");
+
+int main(int argc, char** argv) {
+  net_instaweb::ProcessContext process_context;
+  net_instaweb::RewriteDriverFactory::Initialize();
+  int exit_status = 1;
+  {
+    net_instaweb::RewriteGflags gflags(argv[0], &argc, &argv);
+    if (FLAGS_replay_corpus_dir.empty()) {
+      fprintf(stderr, "Usage: %s --replay_corpus_dir=<dir> [options]\n",
+              argv[0]);
+      fprintf(stderr, "Type '%s --help' to see the options\n", argv[0]);
+    } else {
+      net_instaweb::ProxyReplayer replayer(process_context, &gflags,
+                                           FLAGS_replay_corpus_dir,
+                                           NULL /* origin_fetcher */);
+      net_instaweb::StringVector urls;
+      bool have_urls = false;
+      if (FLAGS_replay_url_file.empty()) {
+        have_urls = replayer.ListCorpusUrls(&urls);
+      } else {
+        net_instaweb::ReplayRewriteDriverFactory* factory = replayer.factory();
+        GoogleString contents;
+        if (factory->file_system()->ReadFile(FLAGS_replay_url_file.c_str(),
+                                             &contents,
+                                             factory->message_handler())) {
+          net_instaweb::StringPieceVector lines;
+          net_instaweb::SplitStringPieceToVector(contents, "\r\n", &lines,
+                                                 true /* omit_empty */);
+          for (int i = 0, n = lines.size(); i < n; ++i) {
+            urls.push_back(lines[i].as_string());
+          }
+          have_urls = true;
+        }
+      }
+
+      if (!have_urls || urls.empty()) {
+        fprintf(stderr, "No URLs to replay\n");
+      } else {
+        for (int pass = 0; pass < FLAGS_replay_passes; ++pass) {
+          net_instaweb::ProxyReplayer::PassResult result;
+          replayer.RunPass(urls, FLAGS_replay_concurrency, &result);
+          printf("Pass %d (%s):\n%s\n", pass + 1,
+                 (pass == 0) ? "cold" : "warm",
+                 net_instaweb::ProxyReplayer::FormatPassResult(
+                     result).c_str());
+        }
+        exit_status = 0;
+      }
+    }
+  }
+  net_instaweb::RewriteDriverFactory::Terminate();
+  return exit_status;
+}
@@ -0,0 +1,446 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/automatic/proxy_replayer.h"
+
+#include <malloc.h>
+#include <algorithm>
+#include <vector>
+
+#include "base/logging.h"
+#include "net/instaweb/http/public/async_fetch.h"
+#include "net/instaweb/http/public/http_cache.h"
+#include "net/instaweb/http/public/request_context.h"
+#include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
+#include "net/instaweb/rewriter/public/rewrite_gflags.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
+#include "net/instaweb/rewriter/public/server_context.h"
+#include "pagespeed/automatic/proxy_interface.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/stdio_file_system.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/cache/threadsafe_cache.h"
+#include "pagespeed/kernel/http/request_headers.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/url_to_filename_encoder.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Requests are answered from local files, so anything slower than this is
+// stuck rather than slow.
+const int64 kFetchTimeoutMs = 60 * Timer::kSecondMs;
+const int64 kBackgroundRewritePollMs = 10;
+
+class ReplayServerContext : public ServerContext {
+ public:
+  explicit ReplayServerContext(RewriteDriverFactory* factory)
+      : ServerContext(factory) {
+  }
+
+  virtual ~ReplayServerContext() {
+  }
+
+  virtual bool ProxiesHtml() const { return true; }
+};
+
+int64 StatValue(Statistics* statistics, const char* name) {
+  return statistics->GetVariable(name)->Get();
+}
+
+int64 HeapBytesInUse() {
+  struct mallinfo info = mallinfo();
+  return info.uordblks + info.hblkhd;
+}
+
+// Returns the value at percentile in sorted, which must not be empty.
+int64 Percentile(const std::vector<int64>& sorted, int percentile) {
+  int index = (static_cast<int>(sorted.size()) * percentile) / 100;
+  return sorted[std::min(index, static_cast<int>(sorted.size()) - 1)];
+}
+
+}  // namespace
+
+ReplayRewriteDriverFactory::ReplayRewriteDriverFactory(
+    const ProcessContext& process_context, const RewriteGflags* gflags,
+    const StringPiece& corpus_dir, UrlAsyncFetcher* origin_fetcher)
+    : RewriteDriverFactory(process_context, Platform::CreateThreadSystem()),
+      gflags_(gflags),
+      simple_stats_(thread_system()) {
+  RewriteDriverFactory::InitStats(&simple_stats_);
+  ProxyInterface::InitStats(&simple_stats_);
+  SetStatistics(&simple_stats_);
+
+  if (origin_fetcher != NULL) {
+    set_base_url_async_fetcher(origin_fetcher);
+  } else {
+    // The corpus is served by the factory's read-only slurping, which
+    // answers from HttpDumpUrlFetcher and never goes to the network.
+    set_slurp_directory(corpus_dir);
+    set_slurp_read_only(true);
+  }
+}
+
+ReplayRewriteDriverFactory::~ReplayRewriteDriverFactory() {
+}
+
+Hasher* ReplayRewriteDriverFactory::NewHasher() {
+  return new MD5Hasher;
+}
+
+UrlAsyncFetcher* ReplayRewriteDriverFactory::DefaultAsyncUrlFetcher() {
+  // Read-only slurping or the origin fetcher replaces the default fetcher
+  // entirely.
+  LOG(DFATAL) << "Replay should only fetch from the corpus";
+  return NULL;
+}
+
+MessageHandler* ReplayRewriteDriverFactory::DefaultHtmlParseMessageHandler() {
+  return new NullMessageHandler;
+}
+
+MessageHandler* ReplayRewriteDriverFactory::DefaultMessageHandler() {
+  return new GoogleMessageHandler;
+}
+
+FileSystem* ReplayRewriteDriverFactory::DefaultFileSystem() {
+  return new StdioFileSystem;
+}
+
+void ReplayRewriteDriverFactory::SetupCaches(ServerContext* server_context) {
+  LRUCache* lru_cache = new LRUCache(gflags_->lru_cache_size_bytes());
+  CacheInterface* cache = new ThreadsafeCache(lru_cache,
+                                              thread_system()->NewMutex());
+  HTTPCache* http_cache = new HTTPCache(cache, timer(), hasher(), statistics());
+  server_context->set_http_cache(http_cache);
+  server_context->set_metadata_cache(cache);
+  server_context->MakePagePropertyCache(
+      server_context->CreatePropertyStore(cache));
+}
+
+Statistics* ReplayRewriteDriverFactory::statistics() {
+  return &simple_stats_;
+}
+
+ServerContext* ReplayRewriteDriverFactory::NewServerContext() {
+  return new ReplayServerContext(this);
+}
+
+ServerContext* ReplayRewriteDriverFactory::NewDecodingServerContext() {
+  ServerContext* sc = NewServerContext();
+  InitStubDecodingServerContext(sc);
+  return sc;
+}
+
+// Counts the response and signals the waiting ClientThread when done.
+class ProxyReplayer::ReplayFetch : public AsyncFetch {
+ public:
+  ReplayFetch(const RequestContextPtr& request_context,
+              ThreadSystem* thread_system)
+      : AsyncFetch(request_context),
+        mutex_(thread_system->NewMutex()),
+        done_condvar_(mutex_->NewCondvar()),
+        done_(false),
+        success_(false),
+        bytes_(0) {
+  }
+
+  virtual ~ReplayFetch() {}
+
+  // Waits for HandleDone, returning false on timeout.
+  bool Wait(Timer* timer) {
+    int64 deadline_ms = timer->NowMs() + kFetchTimeoutMs;
+    ScopedMutex lock(mutex_.get());
+    while (!done_) {
+      int64 remaining_ms = deadline_ms - timer->NowMs();
+      if (remaining_ms <= 0) {
+        return false;
+      }
+      done_condvar_->TimedWait(remaining_ms);
+    }
+    return true;
+  }
+
+  bool success() const { return success_; }
+  int64 bytes() const { return bytes_; }
+
+ protected:
+  virtual bool HandleWrite(const StringPiece& content,
+                           MessageHandler* handler) {
+    bytes_ += content.size();
+    return true;
+  }
+  virtual bool HandleFlush(MessageHandler* handler) { return true; }
+  virtual void HandleHeadersComplete() {}
+  virtual void HandleDone(bool success) {
+    ScopedMutex lock(mutex_.get());
+    success_ = success;
+    done_ = true;
+    done_condvar_->Signal();
+  }
+
+ private:
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  scoped_ptr<ThreadSystem::Condvar> done_condvar_;
+  bool done_;
+  bool success_;
+  int64 bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayFetch);
+};
+
+// Fetches URLs from a shared list, one at a time, until none are left.
+class ProxyReplayer::ClientThread : public ThreadSystem::Thread {
+ public:
+  ClientThread(ProxyReplayer* replayer, const StringVector* urls,
+               AtomicInt32* next_url, int index)
+      : Thread(replayer->server_context()->thread_system(),
+               StrCat("replay-", IntegerToString(index)),
+               ThreadSystem::kJoinable),
+        replayer_(replayer),
+        urls_(urls),
+        next_url_(next_url),
+        num_failures_(0),
+        response_bytes_(0) {
+  }
+
+  virtual ~ClientThread() {}
+
+  const std::vector<int64>& latencies_us() const { return latencies_us_; }
+  int num_failures() const { return num_failures_; }
+  int64 response_bytes() const { return response_bytes_; }
+
+ protected:
+  virtual void Run() {
+    ServerContext* server_context = replayer_->server_context();
+    Timer* timer = server_context->timer();
+    MessageHandler* handler = server_context->message_handler();
+    int num_urls = urls_->size();
+    for (int i = next_url_->NoBarrierIncrement(1) - 1; i < num_urls;
+         i = next_url_->NoBarrierIncrement(1) - 1) {
+      RequestContextPtr request_context(new RequestContext(
+          server_context->global_options()->ComputeHttpOptions(),
+          server_context->thread_system()->NewMutex(), timer));
+      // The fetch can't be deleted if it times out, as the proxy may still
+      // complete it.
+      ReplayFetch* fetch = new ReplayFetch(request_context,
+                                           server_context->thread_system());
+      fetch->request_headers()->set_method(RequestHeaders::kGet);
+      int64 start_us = timer->NowUs();
+      replayer_->proxy_interface_->Fetch((*urls_)[i], handler, fetch);
+      if (!fetch->Wait(timer)) {
+        handler->Message(kError, "Timed out replaying %s",
+                         (*urls_)[i].c_str());
+        ++num_failures_;
+        continue;
+      }
+      latencies_us_.push_back(timer->NowUs() - start_us);
+      if (!fetch->success()) {
+        ++num_failures_;
+      }
+      response_bytes_ += fetch->bytes();
+      delete fetch;
+    }
+  }
+
+ private:
+  ProxyReplayer* replayer_;
+  const StringVector* urls_;
+  AtomicInt32* next_url_;
+  std::vector<int64> latencies_us_;
+  int num_failures_;
+  int64 response_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(ClientThread);
+};
+
+ProxyReplayer::PassResult::PassResult()
+    : num_requests(0),
+      num_failures(0),
+      response_bytes(0),
+      elapsed_us(0),
+      latency_us_p50(0),
+      latency_us_p90(0),
+      latency_us_p99(0),
+      latency_us_max(0),
+      http_cache_hits(0),
+      http_cache_misses(0),
+      metadata_cache_hits(0),
+      metadata_cache_misses(0),
+      heap_growth_bytes(0) {
+}
+
+ProxyReplayer::ProxyReplayer(const ProcessContext& process_context,
+                             const RewriteGflags* gflags,
+                             const StringPiece& corpus_dir,
+                             UrlAsyncFetcher* origin_fetcher)
+    : corpus_dir_(corpus_dir.as_string()),
+      factory_(process_context, gflags, corpus_dir, origin_fetcher),
+      server_context_(NULL) {
+  EnsureEndsInSlash(&corpus_dir_);
+  RewriteOptions* options = factory_.default_options();
+  if (!gflags->SetOptions(&factory_, options)) {
+    LOG(FATAL) << "Invalid rewrite flags";
+  }
+  server_context_ = factory_.CreateServerContext();
+  proxy_interface_.reset(new ProxyInterface(
+      "localhost", 80, server_context_, factory_.statistics()));
+}
+
+ProxyReplayer::~ProxyReplayer() {
+  WaitForBackgroundRewrites();
+  proxy_interface_.reset();
+}
+
+bool ProxyReplayer::ListCorpusUrls(StringVector* urls) {
+  MessageHandler* handler = factory_.message_handler();
+  if (!factory_.file_system()->IsDir(corpus_dir_.c_str(), handler).is_true()) {
+    handler->Message(kError, "%s is not a directory", corpus_dir_.c_str());
+    return false;
+  }
+  int first = urls->size();
+  ListDirectory(corpus_dir_, urls);
+  std::sort(urls->begin() + first, urls->end());
+  return true;
+}
+
+// Dumps live at <corpus>/<host><encoded path>; see
+// HttpDumpUrlFetcher::GetFilenameFromUrl.
+void ProxyReplayer::ListDirectory(const GoogleString& dir,
+                                  StringVector* urls) {
+  FileSystem* file_system = factory_.file_system();
+  MessageHandler* handler = factory_.message_handler();
+  StringVector files;
+  file_system->ListContents(dir, &files, handler);
+  for (int i = 0, n = files.size(); i < n; ++i) {
+    if (file_system->IsDir(files[i].c_str(), handler).is_true()) {
+      ListDirectory(files[i], urls);
+      continue;
+    }
+    StringPiece encoded(files[i]);
+    encoded.remove_prefix(corpus_dir_.size());
+    GoogleString url = "http://";
+    if (UrlToFilenameEncoder::Decode(encoded, &url)) {
+      urls->push_back(url);
+    } else {
+      handler->Message(kWarning, "Skipping undecodable dump %s",
+                       files[i].c_str());
+    }
+  }
+}
+
+void ProxyReplayer::RunPass(const StringVector& urls, int concurrency,
+                            PassResult* result) {
+  DCHECK_LT(0, concurrency);
+  Statistics* statistics = factory_.statistics();
+  RewriteStats* rewrite_stats = server_context_->rewrite_stats();
+  int64 http_cache_hits = StatValue(statistics, HTTPCache::kCacheHits);
+  int64 http_cache_misses = StatValue(statistics, HTTPCache::kCacheMisses);
+  int64 metadata_cache_hits = rewrite_stats->cached_output_hits()->Get();
+  int64 metadata_cache_misses = rewrite_stats->cached_output_misses()->Get();
+  int64 heap_bytes = HeapBytesInUse();
+  Timer* timer = server_context_->timer();
+  int64 start_us = timer->NowUs();
+
+  AtomicInt32 next_url(0);
+  std::vector<ClientThread*> threads;
+  for (int i = 0; i < concurrency; ++i) {
+    threads.push_back(new ClientThread(this, &urls, &next_url, i));
+    CHECK(threads.back()->Start());
+  }
+  std::vector<int64> latencies_us;
+  *result = PassResult();
+  for (int i = 0; i < concurrency; ++i) {
+    threads[i]->Join();
+    latencies_us.insert(latencies_us.end(),
+                        threads[i]->latencies_us().begin(),
+                        threads[i]->latencies_us().end());
+    result->num_failures += threads[i]->num_failures();
+    result->response_bytes += threads[i]->response_bytes();
+  }
+  STLDeleteElements(&threads);
+  result->elapsed_us = timer->NowUs() - start_us;
+
+  // Rewrites that missed their deadline keep going after the response; let
+  // them land so that the next pass sees their results, and so that their
+  // cost is counted in this pass's heap growth.
+  WaitForBackgroundRewrites();
+
+  result->num_requests = urls.size();
+  if (!latencies_us.empty()) {
+    std::sort(latencies_us.begin(), latencies_us.end());
+    result->latency_us_p50 = Percentile(latencies_us, 50);
+    result->latency_us_p90 = Percentile(latencies_us, 90);
+    result->latency_us_p99 = Percentile(latencies_us, 99);
+    result->latency_us_max = latencies_us.back();
+  }
+  result->http_cache_hits =
+      StatValue(statistics, HTTPCache::kCacheHits) - http_cache_hits;
+  result->http_cache_misses =
+      StatValue(statistics, HTTPCache::kCacheMisses) - http_cache_misses;
+  result->metadata_cache_hits =
+      rewrite_stats->cached_output_hits()->Get() - metadata_cache_hits;
+  result->metadata_cache_misses =
+      rewrite_stats->cached_output_misses()->Get() - metadata_cache_misses;
+  result->heap_growth_bytes = HeapBytesInUse() - heap_bytes;
+}
+
+void ProxyReplayer::WaitForBackgroundRewrites() {
+  while (server_context_->num_active_rewrite_drivers() != 0) {
+    server_context_->timer()->SleepMs(kBackgroundRewritePollMs);
+  }
+}
+
+GoogleString ProxyReplayer::FormatPassResult(const PassResult& result) {
+  double seconds = static_cast<double>(result.elapsed_us) / Timer::kSecondUs;
+  double requests_per_second =
+      (seconds > 0) ? result.num_requests / seconds : 0.0;
+  GoogleString out = StringPrintf(
+      "requests: %d (%d failed) in %.3fs, %.1f requests/s, %s bytes\n",
+      result.num_requests, result.num_failures, seconds, requests_per_second,
+      Integer64ToString(result.response_bytes).c_str());
+  StrAppend(&out, StringPrintf(
+      "latency us: p50 %s  p90 %s  p99 %s  max %s\n",
+      Integer64ToString(result.latency_us_p50).c_str(),
+      Integer64ToString(result.latency_us_p90).c_str(),
+      Integer64ToString(result.latency_us_p99).c_str(),
+      Integer64ToString(result.latency_us_max).c_str()));
+  StrAppend(&out, StringPrintf(
+      "http cache: %s hits, %s misses; metadata cache: %s hits, %s misses\n",
+      Integer64ToString(result.http_cache_hits).c_str(),
+      Integer64ToString(result.http_cache_misses).c_str(),
+      Integer64ToString(result.metadata_cache_hits).c_str(),
+      Integer64ToString(result.metadata_cache_misses).c_str()));
+  StrAppend(&out, "heap growth: ",
+            Integer64ToString(result.heap_growth_bytes), " bytes\n");
+  return out;
+}
+
+}  // namespace net_instaweb
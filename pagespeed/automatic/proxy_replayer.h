@@ -0,0 +1,144 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a recorded corpus of pages and resources through ProxyInterface,
+// in-process, to measure the whole proxy path without a live origin.
+
+#ifndef PAGESPEED_AUTOMATIC_PROXY_REPLAYER_H_
+#define PAGESPEED_AUTOMATIC_PROXY_REPLAYER_H_
+
+#include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+
+namespace net_instaweb {
+
+class FileSystem;
+class Hasher;
+class MessageHandler;
+class ProcessContext;
+class ProxyInterface;
+class RewriteGflags;
+class ServerContext;
+class Statistics;
+class UrlAsyncFetcher;
+
+// RewriteDriverFactory whose origin is a directory of HTTP dumps, as written
+// by slurping or by HttpDumpUrlAsyncWriter, with in-memory caches.
+class ReplayRewriteDriverFactory : public RewriteDriverFactory {
+ public:
+  // If origin_fetcher is non-NULL, it answers every fetch in place of the
+  // corpus, and the factory takes ownership of it.  This is for tests.
+  ReplayRewriteDriverFactory(const ProcessContext& process_context,
+                             const RewriteGflags* gflags,
+                             const StringPiece& corpus_dir,
+                             UrlAsyncFetcher* origin_fetcher);
+  virtual ~ReplayRewriteDriverFactory();
+
+  virtual Hasher* NewHasher();
+  virtual UrlAsyncFetcher* DefaultAsyncUrlFetcher();
+  virtual MessageHandler* DefaultHtmlParseMessageHandler();
+  virtual MessageHandler* DefaultMessageHandler();
+  virtual FileSystem* DefaultFileSystem();
+  virtual void SetupCaches(ServerContext* server_context);
+  virtual Statistics* statistics();
+  virtual ServerContext* NewServerContext();
+  virtual ServerContext* NewDecodingServerContext();
+  virtual bool UseBeaconResultsInFilters() const { return false; }
+
+ private:
+  const RewriteGflags* gflags_;
+  SimpleStats simple_stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayRewriteDriverFactory);
+};
+
+// Drives a ReplayRewriteDriverFactory's ProxyInterface with a list of URLs
+// from a fixed number of client threads, and reports what it saw.  Each
+// thread issues one request at a time, so concurrency is the number of
+// requests in flight.
+//
+// The caches persist across passes, so running the same URLs twice gives a
+// cold and a warm measurement.
+class ProxyReplayer {
+ public:
+  struct PassResult {
+    PassResult();
+
+    int num_requests;
+    int num_failures;
+    int64 response_bytes;
+    int64 elapsed_us;
+
+    // Request latency percentiles, in microseconds.
+    int64 latency_us_p50;
+    int64 latency_us_p90;
+    int64 latency_us_p99;
+    int64 latency_us_max;
+
+    // Deltas over the pass.
+    int64 http_cache_hits;
+    int64 http_cache_misses;
+    int64 metadata_cache_hits;
+    int64 metadata_cache_misses;
+    // Change in bytes allocated on the heap, which is only approximate: it
+    // includes anything freed or allocated by background threads.
+    int64 heap_growth_bytes;
+  };
+
+  // origin_fetcher is passed to ReplayRewriteDriverFactory, and is normally
+  // NULL.
+  ProxyReplayer(const ProcessContext& process_context,
+                const RewriteGflags* gflags,
+                const StringPiece& corpus_dir,
+                UrlAsyncFetcher* origin_fetcher);
+  ~ProxyReplayer();
+
+  // Appends the URL of every dump in the corpus to urls, sorted so that
+  // passes are repeatable.  Returns false if the corpus can't be read.
+  bool ListCorpusUrls(StringVector* urls);
+
+  // Fetches every URL in urls through the proxy, from concurrency threads,
+  // then waits for the rewrites it kicked off to finish.
+  void RunPass(const StringVector& urls, int concurrency, PassResult* result);
+
+  // Formats result as human-readable text.
+  static GoogleString FormatPassResult(const PassResult& result);
+
+  ReplayRewriteDriverFactory* factory() { return &factory_; }
+  ServerContext* server_context() { return server_context_; }
+
+ private:
+  class ClientThread;
+  class ReplayFetch;
+
+  void ListDirectory(const GoogleString& dir, StringVector* urls);
+  void WaitForBackgroundRewrites();
+
+  GoogleString corpus_dir_;
+  ReplayRewriteDriverFactory factory_;
+  ServerContext* server_context_;
+  scoped_ptr<ProxyInterface> proxy_interface_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProxyReplayer);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_AUTOMATIC_PROXY_REPLAYER_H_
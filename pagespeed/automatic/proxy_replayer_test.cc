@@ -0,0 +1,130 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-tests for ProxyReplayer.
+
+#include "pagespeed/automatic/proxy_replayer.h"
+
+#include "net/instaweb/http/public/mock_url_fetcher.h"
+#include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
+#include "net/instaweb/rewriter/public/rewrite_gflags.h"
+#include "net/instaweb/rewriter/public/rewrite_test_base.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gmock.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/http/content_type.h"
+#include "pagespeed/kernel/http/http_names.h"
+#include "pagespeed/kernel/http/response_headers.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kPageUrl[] = "http://test.com/index.html";
+const char kCssUrl[] = "http://test.com/style.css";
+const char kPage[] = "<html><body>Hello, world</body></html>";
+const char kCss[] = "body { color: red; }";
+const int kConcurrency = 2;
+
+class ProxyReplayerTest : public testing::Test {
+ protected:
+  ProxyReplayerTest() : mock_url_fetcher_(new MockUrlFetcher) {
+    RewriteDriverFactory::Initialize();
+    // The factory takes ownership of mock_url_fetcher_.
+    replayer_.reset(new ProxyReplayer(RewriteTestBase::process_context(),
+                                      &gflags_, "", mock_url_fetcher_));
+    SetResponse(kPageUrl, kContentTypeHtml, kPage);
+    SetResponse(kCssUrl, kContentTypeCss, kCss);
+    urls_.push_back(kPageUrl);
+    urls_.push_back(kCssUrl);
+  }
+
+  virtual ~ProxyReplayerTest() {
+    replayer_.reset();
+    RewriteDriverFactory::Terminate();
+  }
+
+  void SetResponse(const StringPiece& url, const ContentType& content_type,
+                   const StringPiece& body) {
+    ResponseHeaders headers;
+    headers.SetStatusAndReason(HttpStatus::kOK);
+    headers.Add(HttpAttributes::kContentType, content_type.mime_type());
+    headers.SetDateAndCaching(replayer_->factory()->timer()->NowMs(),
+                              300 * Timer::kSecondMs, ", public");
+    headers.ComputeCaching();
+    mock_url_fetcher_->SetResponse(url, headers, body);
+  }
+
+  RewriteGflags gflags_;
+  MockUrlFetcher* mock_url_fetcher_;
+  scoped_ptr<ProxyReplayer> replayer_;
+  StringVector urls_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ProxyReplayerTest);
+};
+
+TEST_F(ProxyReplayerTest, ColdThenWarmPass) {
+  ProxyReplayer::PassResult cold;
+  replayer_->RunPass(urls_, kConcurrency, &cold);
+  EXPECT_EQ(2, cold.num_requests);
+  EXPECT_EQ(0, cold.num_failures);
+  EXPECT_LE(static_cast<int64>(STATIC_STRLEN(kPage) + STATIC_STRLEN(kCss)),
+            cold.response_bytes);
+  EXPECT_LE(cold.latency_us_p50, cold.latency_us_p90);
+  EXPECT_LE(cold.latency_us_p90, cold.latency_us_p99);
+  EXPECT_LE(cold.latency_us_p99, cold.latency_us_max);
+  EXPECT_LE(cold.latency_us_max, cold.elapsed_us);
+  // Each URL is fetched once, so nothing can be in the cache yet.
+  EXPECT_EQ(0, cold.http_cache_hits);
+  EXPECT_LT(0, cold.http_cache_misses);
+
+  // The caches are kept, so the second pass serves the CSS from the HTTP
+  // cache.
+  ProxyReplayer::PassResult warm;
+  replayer_->RunPass(urls_, kConcurrency, &warm);
+  EXPECT_EQ(2, warm.num_requests);
+  EXPECT_EQ(0, warm.num_failures);
+  EXPECT_EQ(cold.response_bytes, warm.response_bytes);
+  EXPECT_LT(0, warm.http_cache_hits);
+  EXPECT_GT(cold.http_cache_misses, warm.http_cache_misses);
+
+  GoogleString report = ProxyReplayer::FormatPassResult(warm);
+  EXPECT_THAT(report, ::testing::HasSubstr("requests: 2 (0 failed)"));
+  EXPECT_THAT(report, ::testing::HasSubstr(StrCat(
+      "http cache: ", Integer64ToString(warm.http_cache_hits), " hits")));
+}
+
+TEST_F(ProxyReplayerTest, FailedFetchCountsAsFailure) {
+  const char kBrokenUrl[] = "http://test.com/broken.html";
+  SetResponse(kBrokenUrl, kContentTypeHtml, kPage);
+  mock_url_fetcher_->SetResponseFailure(kBrokenUrl);
+  urls_.push_back(kBrokenUrl);
+  ProxyReplayer::PassResult result;
+  replayer_->RunPass(urls_, kConcurrency, &result);
+  EXPECT_EQ(3, result.num_requests);
+  EXPECT_EQ(1, result.num_failures);
+  EXPECT_THAT(ProxyReplayer::FormatPassResult(result),
+              ::testing::HasSubstr("requests: 3 (1 failed)"));
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
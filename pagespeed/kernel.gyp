@@ -49,6 +49,7 @@
         'kernel/base/null_shared_mem.cc',
         'kernel/base/null_writer.cc',
         'kernel/base/print_message_handler.cc',
+        'kernel/base/sampling_profiler.cc',
         'kernel/base/statistics.cc',
         'kernel/base/stdio_file_system.cc',
         'kernel/base/string_convert.cc',
@@ -110,6 +111,7 @@
         'kernel/base/split_statistics.cc',
         'kernel/base/split_writer.cc',
         'kernel/base/thread.cc',
+        'kernel/base/trace_span_ring.cc',
         'kernel/base/waveform.cc',
         'kernel/base/wildcard.cc',
       ],
@@ -165,6 +167,7 @@
         'kernel/sharedmem/shared_mem_lock_manager_test_base.cc',
         'kernel/sharedmem/shared_mem_statistics_test_base.cc',
         'kernel/sharedmem/shared_mem_test_base.cc',
+        'kernel/sharedmem/shared_mem_user_agent_cache_test_base.cc',
         'kernel/thread/thread_system_test_base.cc',
         'kernel/thread/worker_test_base.cc',
         'kernel/util/lock_manager_spammer.cc',
@@ -246,6 +249,7 @@
         'kernel/html/html_parse.cc',
         'kernel/html/html_writer_filter.cc',
         'kernel/html/remove_comments_filter.cc',
+        'kernel/html/shared_name_table.cc',
       ],
       'dependencies': [
         ':pagespeed_base_core',
@@ -303,6 +307,7 @@
       },
       'sources': [
         'kernel/http/bot_checker.gperf',
+        'kernel/http/known_headers.gperf',
       ],
       'includes': [
         '../net/instaweb/gperf.gypi',
@@ -392,6 +397,7 @@
         'kernel/util/nonce_generator.cc',
         'kernel/util/simple_random.cc',
         'kernel/util/statistics_logger.cc',
+        'kernel/util/statistics_time_series.cc',
         'kernel/util/statistics_work_bound.cc',
         'kernel/util/url_escaper.cc',
         'kernel/util/url_multipart_encoder.cc',
@@ -535,10 +541,13 @@
         'kernel/sharedmem/shared_mem_cache_data.cc',
         'kernel/sharedmem/shared_mem_lock_manager.cc',
         'kernel/sharedmem/shared_mem_statistics.cc',
+        'kernel/sharedmem/shared_mem_user_agent_cache.cc',
       ],
       'dependencies': [
         'pagespeed_base',
+        'pagespeed_http',
         'pagespeed_sharedmem_pb',
+        '<(DEPTH)/third_party/re2/re2.gyp:re2',
       ],
       'include_dirs': [
         '<(DEPTH)',
@@ -37,12 +37,13 @@ class Arena {
   // this much room for our work area, as it keeps things simple.
   static const size_t kAlign = 8;
 
-  Arena() {
+  Arena() : max_spare_chunks_(0) {
     InitEmpty();
   }
 
   ~Arena() {
     CHECK(chunks_.empty());
+    set_max_spare_bytes(0);
   }
 
   void* Allocate(size_t size) {
@@ -76,8 +77,19 @@ class Arena {
   }
 
   // Cleans up all the objects in the arena. You must call this explicitly.
+  // Keeps up to max_spare_bytes() worth of the chunks they were in for later
+  // allocations, and frees the rest.
   void DestroyObjects();
 
+  // How much memory DestroyObjects may keep around rather than free, so
+  // that an arena reused for similar work need not allocate it again.
+  // Rounded down to a whole number of chunks.  Defaults to 0.
+  size_t max_spare_bytes() const { return max_spare_chunks_ * Chunk::kSize; }
+  void set_max_spare_bytes(size_t x);
+
+  // The memory kept by DestroyObjects and not yet reused.
+  size_t spare_bytes() const { return spare_chunks_.size() * Chunk::kSize; }
+
   // Rounds block size up to 8; we always align to it, even on 32-bit.
   static size_t ExpandToAlign(size_t in) {
     return (in + kAlign - 1) & ~(kAlign - 1);
@@ -128,11 +140,21 @@ class Arena {
   char* scratch_;
 
   std::vector<Chunk*> chunks_;
+
+  // Chunks kept by DestroyObjects, for AddChunk to use before new ones.
+  std::vector<Chunk*> spare_chunks_;
+  size_t max_spare_chunks_;
 };
 
 template<typename T>
 void Arena<T>::AddChunk() {
-  Chunk* chunk = new Chunk();
+  Chunk* chunk;
+  if (spare_chunks_.empty()) {
+    chunk = new Chunk();
+  } else {
+    chunk = spare_chunks_.back();
+    spare_chunks_.pop_back();
+  }
   chunks_.push_back(chunk);
   next_alloc_ = chunk->buf;
   chunk_end_ = next_alloc_ + Chunk::kSize;
@@ -148,12 +170,25 @@ void Arena<T>::DestroyObjects() {
       reinterpret_cast<T*>(base + kAlign)->~T();
       base = *reinterpret_cast<char**>(base);
     }
-    delete chunks_[i];
+    if (spare_chunks_.size() < max_spare_chunks_) {
+      spare_chunks_.push_back(chunks_[i]);
+    } else {
+      delete chunks_[i];
+    }
   }
   chunks_.clear();
   InitEmpty();
 }
 
+template<typename T>
+void Arena<T>::set_max_spare_bytes(size_t x) {
+  max_spare_chunks_ = x / Chunk::kSize;
+  while (spare_chunks_.size() > max_spare_chunks_) {
+    delete spare_chunks_.back();
+    spare_chunks_.pop_back();
+  }
+}
+
 template<typename T>
 void Arena<T>::InitEmpty() {
   // The way this is initialized ensures that the next call to allocate
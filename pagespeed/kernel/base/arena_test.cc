@@ -175,6 +175,27 @@ TEST_F(ArenaTest, TestReuse) {
   TestCombo(20000, 10000);
 }
 
+// Chunks kept from one use of the arena are used again by the next.
+TEST_F(ArenaTest, TestSpareChunks) {
+  arena_.set_max_spare_bytes(3 * 8192 + 100);
+  EXPECT_EQ(3 * 8192, arena_.max_spare_bytes());
+  TestCombo(10000, 0);  // Uses more than 3 chunks.
+  EXPECT_EQ(3 * 8192, arena_.spare_bytes());
+
+  ClearStats();
+  new (&arena_) KidA(this);
+  EXPECT_EQ(2 * 8192, arena_.spare_bytes());
+  arena_.DestroyObjects();
+  EXPECT_EQ(1, destroyed_a_);
+  EXPECT_EQ(3 * 8192, arena_.spare_bytes());
+
+  ClearStats();
+  TestCombo(5000, 5000);
+
+  arena_.set_max_spare_bytes(8192);
+  EXPECT_EQ(8192, arena_.spare_bytes());
+}
+
 // Tests for alignment helper.
 TEST_F(ArenaTest, TestAlign) {
   // A few that work regardless of arch, to sanity-check
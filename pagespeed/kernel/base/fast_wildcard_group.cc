@@ -19,6 +19,9 @@
 #include "pagespeed/kernel/base/fast_wildcard_group.h"
 
 #include <algorithm>
+#include <deque>
+#include <functional>
+#include <utility>
 #include <vector>
 
 #include "base/logging.h"
@@ -27,22 +30,44 @@
 #include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
-#include "pagespeed/kernel/base/rolling_hash.h"
 #include "pagespeed/kernel/base/wildcard.h"
 
 namespace net_instaweb {
 
 namespace {
-// Don't generate a hash unless there are this many
+// Don't build an automaton unless there are this many
 // non-wildcard-only patterns.
 const int kMinPatterns = 11;
 
-// Maximum rolling hash window size
-const int32 kMaxRollingHashWindow = 256;
-
-// Special index value for unused hash table entry.
+// Special index value meaning "no pattern".
 const int kNoEntry = -1;
 
+// State number of the root of the automaton.
+const int kRootState = 0;
+
+// Number of distinct byte values, for the root transition table.
+const int kNumChars = 256;
+
+// Trie node used while building the automaton; flattened into
+// FastWildcardGroup::AutomatonState once complete.
+struct TrieNode {
+  TrieNode() : failure(kRootState) { }
+  std::vector<std::pair<unsigned char, int> > children;  // sorted by char.
+  std::vector<int> outputs;  // Pattern indices, decreasing.
+  int failure;
+};
+
+// Returns the child of node labeled ch, or kNoEntry.
+int TrieChild(const TrieNode& node, unsigned char ch) {
+  std::vector<std::pair<unsigned char, int> >::const_iterator iter =
+      std::lower_bound(node.children.begin(), node.children.end(),
+                       std::make_pair(ch, static_cast<int>(kNoEntry)));
+  if (iter != node.children.end() && iter->first == ch) {
+    return iter->second;
+  }
+  return kNoEntry;
+}
+
 StringPiece LongestLiteralStringInWildcard(const Wildcard* wildcard) {
   StringPiece spec = wildcard->spec();
   const char kWildcardChars[] = { Wildcard::kMatchAny, Wildcard::kMatchOne };
@@ -72,14 +97,16 @@ FastWildcardGroup::~FastWildcardGroup() {
 }
 
 void FastWildcardGroup::Uncompile() {
-  if (rolling_hash_length_.value() == kUncompiled) {
+  if (compile_state_.value() == kUncompiled) {
     return;
   }
-  rolling_hash_length_.set_value(kUncompiled);
-  rolling_hashes_.clear();
+  compile_state_.set_value(kUncompiled);
   effective_indices_.clear();
   wildcard_only_indices_.clear();
-  pattern_hash_index_.clear();
+  states_.clear();
+  edges_.clear();
+  outputs_.clear();
+  root_transitions_.clear();
 }
 
 void FastWildcardGroup::Clear() {
@@ -88,47 +115,50 @@ void FastWildcardGroup::Clear() {
   allow_.clear();
 }
 
-inline int& FastWildcardGroup::pattern_hash_index(uint64 rolling_hash) const {
-  // We exploit the fact that pattern_hash_index.size() is a power of two
-  // to do integer modulus by bit masking.
-  return pattern_hash_index_[rolling_hash & (pattern_hash_index_.size() - 1)];
+inline int FastWildcardGroup::NextState(int state, unsigned char ch) const {
+  // Follow failure links until we find a state with an edge labeled ch.  The
+  // root has (via root_transitions_) an edge for every character, so this
+  // terminates.
+  while (state != kRootState) {
+    const AutomatonState& s = states_[state];
+    const AutomatonEdge* begin = &edges_[s.first_edge];
+    const AutomatonEdge* end = begin + s.num_edges;
+    for (const AutomatonEdge* edge = begin; edge < end; ++edge) {
+      if (edge->ch == ch) {
+        return edge->target;
+      } else if (edge->ch > ch) {
+        break;
+      }
+    }
+    state = s.failure;
+  }
+  return root_transitions_[ch];
 }
 
 void FastWildcardGroup::CompileNonTrivial() const {
   // First, assemble longest literal strings of each pattern
   std::vector<StringPiece> longest_literal_strings;
   int num_nontrivial_patterns = 0;
-  int32 rolling_hash_length = kMaxRollingHashWindow;
   for (int i = 0; i < static_cast<int>(wildcards_.size()); ++i) {
     longest_literal_strings.push_back(
         LongestLiteralStringInWildcard(wildcards_[i]));
     DCHECK_EQ(i + 1, static_cast<int>(longest_literal_strings.size()));
-    int length = longest_literal_strings[i].size();
-    if (length > 0) {
+    if (!longest_literal_strings[i].empty()) {
       ++num_nontrivial_patterns;
-      rolling_hash_length = std::min(rolling_hash_length, length);
     }
   }
   if (num_nontrivial_patterns < kMinPatterns) {
     // Not enough non-trivial patterns.
-    DCHECK_EQ(kDontHash, rolling_hash_length_.value());
+    DCHECK_EQ(kDontCompile, compile_state_.value());
     return;
   }
-  // Allocate a hash table that's power-of-2 sized and >=
-  // 2*num_nontrivial_patterns.
-  int hash_index_size;
-  for (hash_index_size = 8;
-       hash_index_size < 2 * num_nontrivial_patterns;
-       hash_index_size *= 2) { }
-  pattern_hash_index_.resize(hash_index_size, kNoEntry);
-  rolling_hashes_.resize(wildcards_.size());
   effective_indices_.resize(allow_.size());
   int current_effective_index = allow_.size() - 1;
   bool current_allow = allow_[current_effective_index];
-  // Fill in the hash table with a rolling hash.  We do this in
-  // reverse order so that collisions will result in the later
-  // pattern being matched first (if that succeeds, no further
-  // matching will be required).
+  // Build a trie of the literals.  We do this in reverse order so that the
+  // outputs of each trie node end up in decreasing index order, meaning the
+  // pattern that would override all the others is checked first.
+  std::vector<TrieNode> trie(1);
   for (int i = longest_literal_strings.size() - 1; i >= 0; --i) {
     const StringPiece literal(longest_literal_strings[i]);
     if (allow_[i] != current_allow) {
@@ -141,76 +171,134 @@ void FastWildcardGroup::CompileNonTrivial() const {
     DCHECK_LE(i, current_effective_index);
     DCHECK_EQ(allow_[i], current_allow);
     DCHECK_EQ(current_allow, allow_[effective_indices_[i]]);
-    if (literal.size() == 0) {
+    if (literal.empty()) {
       // All-wildcard pattern.
       wildcard_only_indices_.push_back(i);
-      rolling_hashes_[i] = 0;
-    } else {
-      DCHECK_GE(static_cast<int>(literal.size()), rolling_hash_length);
-      // If possible, find a non-colliding rolling hash taken from literal.  If
-      // the first hash collides, using a different hash is OK; we'll still end
-      // up checking both matches in the table for an input that matches both.
-      // The goal is to avoid chaining by spreading the entries out across the
-      // table.
-      // TODO(jmaessen): Consider re-hashing the current entry as well on
-      // collision to favor collision-free hash tables.
-      int max_start = literal.size() - rolling_hash_length;
-      int start = 0;
-      uint64 rolling_hash =
-          RollingHash(literal.data(), start, rolling_hash_length);
-      for (start = 1;
-           start <= max_start && pattern_hash_index(rolling_hash) != kNoEntry;
-           ++start) {
-        rolling_hash = NextRollingHash(literal.data(), start,
-                                       rolling_hash_length, rolling_hash);
+      continue;
+    }
+    int node = kRootState;
+    for (int pos = 0, n = literal.size(); pos < n; ++pos) {
+      unsigned char ch = literal[pos];
+      int child = TrieChild(trie[node], ch);
+      if (child == kNoEntry) {
+        child = trie.size();
+        std::vector<std::pair<unsigned char, int> >& children =
+            trie[node].children;
+        children.insert(
+            std::upper_bound(children.begin(), children.end(),
+                             std::make_pair(ch, child)),
+            std::make_pair(ch, child));
+        // Note that this may invalidate references into trie.
+        trie.push_back(TrieNode());
+      }
+      node = child;
+    }
+    trie[node].outputs.push_back(i);
+  }
+  // wildcard_only_indices_ should be in increasing order.
+  std::reverse(wildcard_only_indices_.begin(), wildcard_only_indices_.end());
+
+  // Compute failure links breadth-first, so that the failure target of each
+  // node (which is shallower) is complete before the node itself.  Each node
+  // inherits the outputs of its failure target, as any literal that is a
+  // suffix of the string read so far has also been found.
+  root_transitions_.assign(kNumChars, kRootState);
+  std::deque<int> queue;
+  for (int c = 0, n = trie[kRootState].children.size(); c < n; ++c) {
+    const std::pair<unsigned char, int>& child =
+        trie[kRootState].children[c];
+    root_transitions_[child.first] = child.second;
+    queue.push_back(child.second);
+  }
+  while (!queue.empty()) {
+    int node = queue.front();
+    queue.pop_front();
+    for (int c = 0, n = trie[node].children.size(); c < n; ++c) {
+      unsigned char ch = trie[node].children[c].first;
+      int child = trie[node].children[c].second;
+      int failure = trie[node].failure;
+      int target;
+      while ((target = TrieChild(trie[failure], ch)) == kNoEntry &&
+             failure != kRootState) {
+        failure = trie[failure].failure;
       }
-      // Now insert the entry, dealing with any collisions.
-      rolling_hashes_[i] = rolling_hash;
-      while (pattern_hash_index(rolling_hash) != kNoEntry) {
-        ++rolling_hash;
+      TrieNode& child_node = trie[child];
+      child_node.failure = (target == kNoEntry) ? kRootState : target;
+      const std::vector<int>& inherited = trie[child_node.failure].outputs;
+      if (!inherited.empty()) {
+        std::vector<int> merged(child_node.outputs.size() + inherited.size());
+        std::merge(child_node.outputs.begin(), child_node.outputs.end(),
+                   inherited.begin(), inherited.end(), merged.begin(),
+                   std::greater<int>());
+        child_node.outputs.swap(merged);
       }
-      pattern_hash_index(rolling_hash) = i;
+      queue.push_back(child);
     }
   }
-  // Finally, after all the metadata is initialized, make rolling_hash_length
+
+  // Flatten the trie into states_, edges_ and outputs_.
+  states_.resize(trie.size());
+  for (int i = 0, n = trie.size(); i < n; ++i) {
+    const TrieNode& node = trie[i];
+    AutomatonState& state = states_[i];
+    state.first_edge = edges_.size();
+    state.num_edges = node.children.size();
+    state.failure = node.failure;
+    for (int c = 0; c < state.num_edges; ++c) {
+      AutomatonEdge edge;
+      edge.ch = node.children[c].first;
+      edge.target = node.children[c].second;
+      edges_.push_back(edge);
+    }
+    state.first_output = outputs_.size();
+    outputs_.insert(outputs_.end(), node.outputs.begin(), node.outputs.end());
+    state.end_output = outputs_.size();
+  }
+  // Make sure edges_[first_edge] is valid even for the last leaf state.
+  AutomatonEdge sentinel;
+  sentinel.ch = 0;
+  sentinel.target = kRootState;
+  edges_.push_back(sentinel);
+
+  // Finally, after all the metadata is initialized, make the compiled state
   // visible to the world.  This has release semantics, meaning that if another
-  // thread reads rolling_hash_length_ (with acquire semantics) and gets the
-  // value we set here, it is guaranteed to see all the preceding writes we did
-  // to the other compilation metadata.
-  rolling_hash_length_.set_value(rolling_hash_length);
+  // thread reads compile_state_ (with acquire semantics) and gets the value we
+  // set here, it is guaranteed to see all the preceding writes we did to the
+  // other compilation metadata.
+  compile_state_.set_value(kCompiled);
 }
 
 void FastWildcardGroup::Compile() const {
   // Basic invariant
   CHECK_EQ(wildcards_.size(), allow_.size());
   // Make sure we don't have cruft left around from a previous compile.
-  CHECK_EQ(0, static_cast<int>(rolling_hashes_.size()));
   CHECK_EQ(0, static_cast<int>(effective_indices_.size()));
   CHECK_EQ(0, static_cast<int>(wildcard_only_indices_.size()));
-  CHECK_EQ(0, static_cast<int>(pattern_hash_index_.size()));
-  CHECK_EQ(kDontHash, rolling_hash_length_.value());
+  CHECK_EQ(0, static_cast<int>(states_.size()));
+  CHECK_EQ(0, static_cast<int>(edges_.size()));
+  CHECK_EQ(0, static_cast<int>(outputs_.size()));
+  CHECK_EQ(0, static_cast<int>(root_transitions_.size()));
+  CHECK_EQ(kDontCompile, compile_state_.value());
 
   if (static_cast<int>(wildcards_.size()) >= kMinPatterns) {
-    // Slow path, compute metadata and set rolling_hash_length_ to
-    // its final value.
+    // Slow path, build the automaton and set compile_state_ to kCompiled.
     CompileNonTrivial();
   }
 
   // When we're done, things should be in a sensible state.
-  int32 rolling_hash_length = rolling_hash_length_.value();
-  DCHECK_NE(kUncompiled, rolling_hash_length);
-  if (rolling_hash_length == kDontHash) {
-    DCHECK_EQ(0, static_cast<int>(rolling_hashes_.size()));
+  int32 compile_state = compile_state_.value();
+  DCHECK_NE(kUncompiled, compile_state);
+  if (compile_state == kDontCompile) {
     DCHECK_EQ(0, static_cast<int>(effective_indices_.size()));
-    DCHECK_EQ(0, static_cast<int>(wildcard_only_indices_.size()));
-    DCHECK_EQ(0, static_cast<int>(pattern_hash_index_.size()));
+    DCHECK_EQ(0, static_cast<int>(states_.size()));
+    DCHECK_EQ(0, static_cast<int>(root_transitions_.size()));
   } else {
-    DCHECK_LT(0, rolling_hash_length);
-    DCHECK_EQ(wildcards_.size(), rolling_hashes_.size());
+    DCHECK_EQ(kCompiled, compile_state);
     DCHECK_EQ(wildcards_.size(), effective_indices_.size());
-    int hash_pats = wildcards_.size() - wildcard_only_indices_.size();
-    DCHECK_LE(kMinPatterns, hash_pats);
-    DCHECK_LE(2 * hash_pats, static_cast<int>(pattern_hash_index_.size()));
+    DCHECK_LT(0, static_cast<int>(states_.size()));
+    DCHECK_EQ(kNumChars, static_cast<int>(root_transitions_.size()));
+    int automaton_pats = wildcards_.size() - wildcard_only_indices_.size();
+    DCHECK_LE(kMinPatterns, automaton_pats);
   }
 }
 
@@ -229,33 +317,33 @@ void FastWildcardGroup::Disallow(const StringPiece& expr) {
 }
 
 bool FastWildcardGroup::Match(const StringPiece& str, bool allow) const {
-  int32 rolling_hash_length = rolling_hash_length_.value();
+  int32 compile_state = compile_state_.value();
   // The previous read has acquire semantics, and all writes to
-  // rolling_hash_length_ have release semantics.  This means we'll see the
-  // results of compilation if rolling_hash_length > 0.
+  // compile_state_ have release semantics.  This means we'll see the
+  // results of compilation if compile_state == kCompiled.
   //
   // NOTE: it is unsafe (and expensive) to just CompareAndSwap (CAS) here.
   //  AtomicInt32::CAS guarantees release semantics but not acquire semantics.
   //  As a result we would potentially miss the results of compilation released
-  //  by a prior write to rolling_hash_length_.  This would cause us to read
+  //  by a prior write to compile_state_.  This would cause us to read
   //  inconsistent compilation metadata, possibly resulting in a crash.
-  if (rolling_hash_length == kUncompiled) {
-    if (rolling_hash_length_.CompareAndSwap(kUncompiled, kDontHash) ==
+  if (compile_state == kUncompiled) {
+    if (compile_state_.CompareAndSwap(kUncompiled, kDontCompile) ==
         kUncompiled) {
-      // During compilation other Match attempts will see kDontHash
+      // During compilation other Match attempts will see kDontCompile
       // and will perform matching naively.  Only the caller that
-      // does the kUncompiled -> kDontHash transition is permitted
+      // does the kUncompiled -> kDontCompile transition is permitted
       // to compile.
       Compile();
     }
-    // rolling_hash_length is no longer kUncompiled, due to some call to
+    // compile_state is no longer kUncompiled, due to some call to
     // Compile().  Re-acquire it so that we can safely view the results of
     // compilation so far.
-    rolling_hash_length = rolling_hash_length_.value();
+    compile_state = compile_state_.value();
   }
-  if (rolling_hash_length == kDontHash) {
+  if (compile_state == kDontCompile) {
     // Set of wildcards is small, or compilation was ongoing when we last read
-    // rolling_hash_length_.
+    // compile_state_.
     // Just match against each pattern in reverse order (starting with most
     // recent, which overrides less recent), returning when a match succeeds.
     for (int i = wildcards_.size() - 1; i >= 0; --i) {
@@ -278,42 +366,27 @@ bool FastWildcardGroup::Match(const StringPiece& str, bool allow) const {
       break;
     }
   }
-  int rolling_end = str.size() - rolling_hash_length;
-  if (rolling_end >= 0) {
-    // Do a Rabin-Karp rolling match through the string.
-    uint64 rolling_hash = RollingHash(str.data(), 0, rolling_hash_length);
-    int exit_effective_index = wildcards_.size() - 1;
-      // Uses signed arithmetic for correct comparison below.
-    for (int ofs = 0;
-         max_effective_index < exit_effective_index && ofs <= rolling_end; ) {
-      // Look up rolling_hash in table, stopping if we find a:
-      //   1) Smaller index than max_effective_index
-      //   2) Matching string (update max_effective_index).
-      // In either case, all subsequent hash matches will be overridden by
-      // max_effective_index, so we need not search the bucket anymore.  This is
-      // guaranteed by the order of table insertion (largest index first)
-      // and the fact that later smaller colliding entries are further along
-      // in the linear probe.  This is true even if intervening slots are
-      // occupied by entries with completely different hash values - those
-      // entries will still have larger indices as they were inserted earlier.
-      for (uint64 probe = 0; ; ++probe) {
-        // The following invariant (and thus loop termination) should be
-        // guaranteed by the sparseness of pattern_hash_index_.
-        DCHECK_GT(pattern_hash_index_.size(), probe);
-        int index = pattern_hash_index(rolling_hash + probe);
-        if (index <= max_effective_index) {
-          // This also includes the kNoEntry case.
-          break;
-        }
-        if (rolling_hash == rolling_hashes_[index] &&
-            wildcards_[index]->Match(str)) {
-          max_effective_index = effective_indices_[index];
-          break;
-        }
+  // Run the automaton over the string.  Uses signed arithmetic for correct
+  // comparison below.
+  int exit_effective_index = wildcards_.size() - 1;
+  int state = kRootState;
+  for (int pos = 0, n = str.size();
+       max_effective_index < exit_effective_index && pos < n; ++pos) {
+    state = NextState(state, static_cast<unsigned char>(str[pos]));
+    // Check the patterns whose literal ends here, stopping if we find a:
+    //   1) Smaller index than max_effective_index
+    //   2) Matching string (update max_effective_index).
+    // In either case, all subsequent patterns in the list will be overridden
+    // by max_effective_index, as the list is in decreasing index order.
+    const AutomatonState& s = states_[state];
+    for (int out = s.first_output; out < s.end_output; ++out) {
+      int index = outputs_[out];
+      if (index <= max_effective_index) {
+        break;
       }
-      if (++ofs <= rolling_end) {
-        rolling_hash = NextRollingHash(str.data(), ofs, rolling_hash_length,
-                                       rolling_hash);
+      if (wildcards_[index]->Match(str)) {
+        max_effective_index = effective_indices_[index];
+        break;
       }
     }
   }
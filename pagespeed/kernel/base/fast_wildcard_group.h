@@ -61,19 +61,25 @@ chunks of diverse literals and so it's good enough in practice.
 WildcardGroup simply iterates through wildcards in the group, attempting to
 match against each one in turn.
 
-In FastWildcardGroup we attempt a Rabin-Karp string match for a fixed-size
-substring of each of the wildcards.  We choose the largest possible substring
-size for a given group (for a single wildcard pattern, this will be the length
-of the longest literal in the pattern; for the group, it is the minimum such
-length).  Note that in the worst case this is a single character (we treat
-all-wildcard patterns specially).  We track the insertion index of the
-latest-inserted matched pattern (so the first pattern in the set has index 0,
-and initially our insertion index is -1).  As in Rabin-Karp we traverse the
-string using a rolling hash; when we encounter a hash match, we retrieve the
-corresponding insertion index.  If it's larger than our current insertion index
-(the pattern would override), we retrieve the pattern and attempt to match the
-whole string against it.  If the match succeeds we update the insertion index.
-Our return value is the corresponding "allow" status.
+In FastWildcardGroup we instead compile the whole group into a single
+Aho-Corasick automaton over one literal substring of each of the wildcards (the
+longest literal in the pattern), so that a single left-to-right pass over the
+string finds every pattern whose literal occurs in it, no matter how many
+patterns there are.  Any string matching a pattern must contain that pattern's
+longest literal, so only patterns reported by the automaton need to be verified
+using Wildcard::Match.  Patterns with no literal at all (eg "*" or "???") are
+all-wildcard patterns, which we treat specially.
+
+We track the insertion index of the latest-inserted matched pattern (so the
+first pattern in the set has index 0, and initially our insertion index is -1).
+Each automaton state carries the list of patterns whose literal ends at that
+point in the string (including literals that are suffixes of longer ones), in
+decreasing insertion order.  When we enter a state we walk this list, stopping
+as soon as we reach an index no larger than our current insertion index (it
+would be overridden anyway).  For larger indices we attempt to match the whole
+string against the pattern, and if the match succeeds we update the insertion
+index.  This preserves the "last matching rule wins" semantics.  Our return
+value is the corresponding "allow" status.
 
 We actually optimize this a little in two ways: rather than remembering the
 insertion index, we actually remember the insertion index just before the next
@@ -84,19 +90,20 @@ first "allow" pattern means that we will subsequently check only against the
 is the last pattern in the group (always true if the group is nothing but
 "allow" or "deny" entries) then we can immediately return.
 
-We use a simple vector of indexes to store the hash table, dealing with
-collisions by linear probing.  Metadata (eg a cached hash) is stored with the
-patterns.  We make the table size >= 2x the number of patterns so that chains
-don't get long, and all failed probes terminate in an empty bucket.
+The automaton is stored as flat vectors: each state has a sorted run of
+outgoing edges, a failure link, and a run of pattern indices.  Transitions out
+of the root state, which are taken for most characters of most strings, are
+looked up in a direct-indexed 256-entry table.  Small groups are not compiled
+at all; we simply try each wildcard in turn, as in WildcardGroup.
 
 */
 
 class FastWildcardGroup {
  public:
   FastWildcardGroup()
-      : rolling_hash_length_(kUncompiled) { }
+      : compile_state_(kUncompiled) { }
   FastWildcardGroup(const FastWildcardGroup& src)
-      : rolling_hash_length_(kUncompiled) {
+      : compile_state_(kUncompiled) {
     CopyFrom(src);
   }
 
@@ -131,13 +138,31 @@ class FastWildcardGroup {
   bool empty() const { return wildcards_.empty(); }
 
  private:
-  // Special values for rolling hash size.
+  // Values for compile_state_.
   static const int32 kUncompiled = -1;
-  static const int32 kDontHash = 0;
+  static const int32 kDontCompile = 0;
+  static const int32 kCompiled = 1;
+
+  // A state of the Aho-Corasick automaton.  The outgoing edges of the state
+  // are edges_[first_edge, first_edge + num_edges), sorted by character.  The
+  // patterns recognized on entering the state are
+  // outputs_[first_output, end_output), in decreasing index order.
+  struct AutomatonState {
+    int first_edge;
+    int num_edges;
+    int failure;
+    int first_output;
+    int end_output;
+  };
+
+  struct AutomatonEdge {
+    unsigned char ch;
+    int target;
+  };
 
   void Uncompile();
   void Clear();
-  inline int& pattern_hash_index(uint64 rolling_hash) const;
+  inline int NextState(int state, unsigned char ch) const;
   void Compile() const;
   void CompileNonTrivial() const;
 
@@ -148,11 +173,13 @@ class FastWildcardGroup {
   std::vector<bool> allow_;  // parallel array (actually a bitvector)
 
   // Information that is computed during compilation.
-  mutable std::vector<uint64> rolling_hashes_;  // One per wildcard
   mutable std::vector<int> effective_indices_;  // One per wildcard
   mutable std::vector<int> wildcard_only_indices_;
-  mutable std::vector<int> pattern_hash_index_;  // hash table
-  mutable AtomicInt32 rolling_hash_length_;
+  mutable std::vector<AutomatonState> states_;  // states_[0] is the root.
+  mutable std::vector<AutomatonEdge> edges_;
+  mutable std::vector<int> outputs_;
+  mutable std::vector<int> root_transitions_;  // Indexed by character.
+  mutable AtomicInt32 compile_state_;
 
   // This is copyable, since we want to use this with CopyOnWrite<>
 };
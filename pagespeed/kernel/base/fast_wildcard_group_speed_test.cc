@@ -20,6 +20,7 @@
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/benchmark.h"
 #include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/fast_wildcard_group.h"
 #include "pagespeed/kernel/base/wildcard_group.h"
@@ -182,6 +183,92 @@ void BM_FastWildcardGroup(int iters, int size) {
 
 
 
+bool ScaledPatternIsAllowed(int i) { return (i / 3) % 2 == 1; }
+const char* ScaledPatternDirectory(int i) {
+  return (i % 2 == 0) ? "js" : "lib";
+}
+
+// Adds num_patterns site-specific patterns to group, of the sort produced by
+// a long generated list of Allow/Disallow directives, to measure how matching
+// scales with the number of patterns.  The patterns alternate between Disallow
+// and Allow in runs, so that later patterns keep overriding earlier ones, and
+// a couple of short-literal patterns are mixed in to exercise the case where a
+// literal occurs in almost every string.
+template<class G>
+void AddScaledPatterns(int num_patterns, G* group) {
+  group->Disallow("*.swf");
+  for (int i = 0; i < num_patterns; ++i) {
+    GoogleString pattern = StrCat("*//host", IntegerToString(i),
+                                  ".example.com/", ScaledPatternDirectory(i),
+                                  "/*");
+    if (ScaledPatternIsAllowed(i)) {
+      group->Allow(pattern);
+    } else {
+      group->Disallow(pattern);
+    }
+  }
+  group->Allow("*/static/*.js?v=*");
+}
+
+template<class G>
+class ScaledBlacklistTest {
+ public:
+  explicit ScaledBlacklistTest(int num_patterns)
+      : num_patterns_(num_patterns) {
+    AddScaledPatterns(num_patterns, &blacklist_);
+  }
+
+  void PerformLookups() {
+    for (int i = 0; i < kNumLookups; ++i) {
+      int host = (i * 7919) % (2 * num_patterns_);
+      bool matches_site = host < num_patterns_;
+      GoogleString prefix = StrCat("http://host", IntegerToString(host),
+                                   ".example.com/");
+      CHECK_EQ(!matches_site || ScaledPatternIsAllowed(host),
+               blacklist_.Match(
+                   StrCat(prefix, ScaledPatternDirectory(host), "/a.js"),
+                   true));
+      CHECK(!blacklist_.Match(StrCat(prefix, "movie.swf"), true));
+      CHECK(blacklist_.Match(StrCat(prefix, "static/b.js?v=1"), false));
+    }
+  }
+
+  // Checks that blacklist_ agrees with reference on a mix of URLs that do
+  // and do not match the site-specific patterns.
+  void CheckAgainst(const WildcardGroup& reference) {
+    for (int i = 0; i < kNumLookups; ++i) {
+      int host = (i * 7919) % (2 * num_patterns_);
+      GoogleString url = StrCat("http://host", IntegerToString(host),
+                                ".example.com/", ScaledPatternDirectory(i),
+                                "/x.js");
+      CHECK_EQ(reference.Match(url, true), blacklist_.Match(url, true));
+      CHECK_EQ(reference.Match(url, false), blacklist_.Match(url, false));
+    }
+  }
+
+ private:
+  static const int kNumLookups = 100;
+
+  G blacklist_;
+  int num_patterns_;
+};
+
+void BM_ScaledWildcardGroup(int iters, int num_patterns) {
+  ScaledBlacklistTest<WildcardGroup> test_object(num_patterns);
+  for (int i = 0; i < iters; ++i) {
+    test_object.PerformLookups();
+  }
+}
+
+void BM_ScaledFastWildcardGroup(int iters, int num_patterns) {
+  ScaledBlacklistTest<FastWildcardGroup> test_object(num_patterns);
+  for (int i = 0; i < iters; ++i) {
+    test_object.PerformLookups();
+  }
+}
+
+
+
 // Test version of this code, designed to make sure larger wildcard groups are
 // routinely exercised.
 class FastWildcardGroupScaleTest : public testing::Test {
@@ -195,6 +282,20 @@ TEST_F(FastWildcardGroupScaleTest, LargeFastWildcardGroup) {
   UrlBlacklistBenchmark<FastWildcardGroup>(1, 14, true);
 }
 
+TEST_F(FastWildcardGroupScaleTest, TenThousandPatterns) {
+  BM_ScaledFastWildcardGroup(1, 10000);
+}
+
+TEST_F(FastWildcardGroupScaleTest, TenThousandPatternsMatchWildcardGroup) {
+  WildcardGroup reference;
+  AddScaledPatterns(10000, &reference);
+  ScaledBlacklistTest<FastWildcardGroup> test_object(10000);
+  test_object.CheckAgainst(reference);
+}
+
 }  // namespace
 
+BENCHMARK_RANGE(BM_ScaledWildcardGroup, 1 << 4, 1 << 14);
+BENCHMARK_RANGE(BM_ScaledFastWildcardGroup, 1 << 4, 1 << 14);
+
 }  // namespace net_instaweb
@@ -194,5 +194,31 @@ TEST_F(FastWildcardGroupTest, IncrementalUpdate) {
   EXPECT_TRUE(group_.Match("Another complicated literal pattern", true));
 }
 
+TEST_F(FastWildcardGroupTest, AllWildcardPatternsLarge) {
+  // The latest all-wildcard pattern that matches must win, just as for
+  // patterns containing literals.
+  MakeLarge();
+  group_.Disallow("*");
+  group_.Allow("?*");
+  EXPECT_TRUE(group_.Match("x", false));
+  EXPECT_FALSE(group_.Match("", true));
+  EXPECT_TRUE(group_.Match("1034", false));
+  group_.Disallow("1034");
+  EXPECT_FALSE(group_.Match("1034", true));
+}
+
+TEST_F(FastWildcardGroupTest, OverlappingLiteralsLarge) {
+  // Literals that are suffixes or substrings of each other end up sharing
+  // automaton states; make sure each of them is still found.
+  MakeLarge();
+  group_.Disallow("*example.com*");
+  group_.Allow("*ample*");
+  group_.Disallow("*le.c*");
+  EXPECT_FALSE(group_.Match("http://www.example.com/", true));
+  EXPECT_TRUE(group_.Match("http://www.sample.org/", false));
+  EXPECT_FALSE(group_.Match("http://www.example.co.uk/", true));
+  EXPECT_TRUE(group_.Match("http://www.examples.com/", false));
+}
+
 }  // namespace
 }  // namespace net_instaweb
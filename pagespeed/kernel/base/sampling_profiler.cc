@@ -0,0 +1,397 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pagespeed/kernel/base/sampling_profiler.h"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <utility>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/atomicops.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/base/writer.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kMaxFrames = 32;
+
+// Linux thread names are at most 16 bytes, including the terminating NUL.
+const int kMaxThreadNameLength = 16;
+const int kMaxLabelLength = 32;
+
+// A frame pointer further than this above the one before it is taken to be
+// garbage left by code built without frame pointers, and ends the walk.
+const uintptr_t kMaxFrameBytes = 128 * 1024;
+
+// The profiler the signal handler records into, or 0.
+base::subtle::AtomicWord active_profiler = 0;
+
+// Number of signal handlers currently running, so Stop can wait for them
+// before the samples are read or freed.
+base::subtle::Atomic32 handlers_running = 0;
+
+// Only touched by the profiler that won active_profiler in Start.
+bool handler_installed = false;
+
+// Each thread's current ScopedLabel lives in a slot of a fixed table keyed
+// by kernel thread id, rather than in a __thread variable: in a dlopen'ed
+// module the first access to TLS from a thread may allocate, so the signal
+// handler can't touch it.  The handler finds the slot with gettid(), which
+// is async-signal-safe.  Slots are claimed on a thread's first ScopedLabel
+// and never freed; a new thread reusing an id inherits the slot.
+const int kMaxLabelledThreads = 1024;  // Must be a power of two.
+
+struct LabelSlot {
+  base::subtle::Atomic32 thread_id;  // 0 until claimed.
+  base::subtle::AtomicWord label;
+};
+
+LabelSlot label_slots[kMaxLabelledThreads];
+
+// Handed out once the table is full, so the labels of those threads are
+// kept but never recorded.
+LabelSlot unlisted_label_slot;
+
+// Where ScopedLabel finds the calling thread's slot without a system call.
+// Never read from the signal handler.
+__thread LabelSlot* current_label_slot = NULL;
+
+base::subtle::Atomic32 CurrentThreadId() {
+  return static_cast<base::subtle::Atomic32>(syscall(SYS_gettid));
+}
+
+// Returns the slot for thread_id, claiming a free one if claim is set, or
+// NULL if there is none.  Async-signal-safe.
+LabelSlot* FindLabelSlot(base::subtle::Atomic32 thread_id, bool claim) {
+  for (int i = 0; i < kMaxLabelledThreads; ++i) {
+    LabelSlot* slot =
+        &label_slots[(thread_id + i) & (kMaxLabelledThreads - 1)];
+    base::subtle::Atomic32 owner = base::subtle::Acquire_Load(&slot->thread_id);
+    if ((owner == 0) && claim) {
+      owner = base::subtle::Acquire_CompareAndSwap(&slot->thread_id, 0,
+                                                   thread_id);
+      if (owner == 0) {
+        return slot;  // We claimed it.
+      }
+    }
+    if (owner == thread_id) {
+      return slot;
+    } else if (owner == 0) {
+      return NULL;  // Slots are claimed in probe order, so it's not further on.
+    }
+  }
+  return NULL;
+}
+
+LabelSlot* CurrentLabelSlot() {
+  if (current_label_slot == NULL) {
+    current_label_slot = FindLabelSlot(CurrentThreadId(), true);
+    if (current_label_slot == NULL) {
+      current_label_slot = &unlisted_label_slot;
+    }
+  }
+  return current_label_slot;
+}
+
+// Workers are named "<pool>-<n>"; strip the "-<n>" so that samples are
+// aggregated per pool.
+StringPiece PoolName(StringPiece thread_name) {
+  StringPiece::size_type dash = thread_name.rfind('-');
+  if ((dash != StringPiece::npos) && (dash + 1 < thread_name.size())) {
+    for (StringPiece::size_type i = dash + 1; i < thread_name.size(); ++i) {
+      if ((thread_name[i] < '0') || (thread_name[i] > '9')) {
+        return thread_name;
+      }
+    }
+    return thread_name.substr(0, dash);
+  }
+  return thread_name;
+}
+
+// Fills in the program counter, stack pointer and frame pointer of the code
+// the signal interrupted, from the context passed to the handler.  Returns
+// false on platforms where we don't know how.
+bool GetInterruptedRegisters(void* context, void** pc, uintptr_t* sp,
+                             void*** fp) {
+  const mcontext_t& mcontext = static_cast<ucontext_t*>(context)->uc_mcontext;
+#if defined(__x86_64__)
+  *pc = reinterpret_cast<void*>(mcontext.gregs[REG_RIP]);
+  *sp = static_cast<uintptr_t>(mcontext.gregs[REG_RSP]);
+  *fp = reinterpret_cast<void**>(mcontext.gregs[REG_RBP]);
+  return true;
+#elif defined(__i386__)
+  *pc = reinterpret_cast<void*>(mcontext.gregs[REG_EIP]);
+  *sp = static_cast<uintptr_t>(mcontext.gregs[REG_ESP]);
+  *fp = reinterpret_cast<void**>(mcontext.gregs[REG_EBP]);
+  return true;
+#elif defined(__aarch64__)
+  *pc = reinterpret_cast<void*>(mcontext.pc);
+  *sp = static_cast<uintptr_t>(mcontext.sp);
+  *fp = reinterpret_cast<void**>(mcontext.regs[29]);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Records up to max_frames return addresses, innermost first, by following
+// the chain of saved frame pointers up from fp.  Unlike backtrace(), this
+// neither allocates nor takes locks, so it can run in a signal handler.
+// Each frame holds the caller's frame pointer followed by the return
+// address; a pointer that isn't aligned, doesn't move up the stack, or
+// jumps too far ends the walk, so code built without frame pointers gives
+// a short stack rather than a crash.
+int WalkFramePointers(void* pc, uintptr_t sp, void** fp, void** frames,
+                      int max_frames) {
+  int num_frames = 0;
+  frames[num_frames++] = pc;
+  uintptr_t lowest = sp;  // Stacks grow down, so callers' frames lie above.
+  while (num_frames < max_frames) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(fp);
+    if ((address < lowest) || (address - lowest > kMaxFrameBytes) ||
+        ((address % sizeof(void*)) != 0)) {
+      break;
+    }
+    void* return_address = fp[1];
+    if (return_address == NULL) {
+      break;
+    }
+    frames[num_frames++] = return_address;
+    lowest = address + 2 * sizeof(void*);
+    fp = static_cast<void**>(fp[0]);
+  }
+  return num_frames;
+}
+
+GoogleString Symbolize(void* pc) {
+  Dl_info info;
+  if ((dladdr(pc, &info) == 0) || (info.dli_sname == NULL)) {
+    return StringPrintf("%p", pc);
+  }
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+  if (demangled == NULL) {
+    return info.dli_sname;
+  }
+  GoogleString result(demangled);
+  free(demangled);
+  return result;
+}
+
+}  // namespace
+
+struct SamplingProfiler::Sample {
+  char thread_name[kMaxThreadNameLength];
+  char label[kMaxLabelLength];
+  int num_frames;
+  void* frames[kMaxFrames];
+};
+
+// The signal handler that reads a label runs on the thread that wrote it,
+// so no barriers are needed.
+SamplingProfiler::ScopedLabel::ScopedLabel(const char* label) {
+  LabelSlot* slot = CurrentLabelSlot();
+  previous_ = reinterpret_cast<const char*>(
+      base::subtle::NoBarrier_Load(&slot->label));
+  base::subtle::NoBarrier_Store(
+      &slot->label, reinterpret_cast<base::subtle::AtomicWord>(label));
+}
+
+SamplingProfiler::ScopedLabel::~ScopedLabel() {
+  base::subtle::NoBarrier_Store(
+      &CurrentLabelSlot()->label,
+      reinterpret_cast<base::subtle::AtomicWord>(previous_));
+}
+
+SamplingProfiler::SamplingProfiler(int max_samples)
+    : max_samples_(max_samples),
+      samples_(new Sample[max_samples]),
+      running_(false) {
+}
+
+SamplingProfiler::~SamplingProfiler() {
+  Stop();
+}
+
+void SamplingProfiler::SetCurrentThreadName(const char* name) {
+  prctl(PR_SET_NAME, name, 0, 0, 0);
+}
+
+// Everything here must be async-signal-safe, which is why we walk the
+// stack ourselves rather than call backtrace(): it may load libgcc, and
+// its unwinder takes locks.
+void SamplingProfiler::HandleSignal(int signal_number, siginfo_t* info,
+                                    void* context) {
+  int saved_errno = errno;
+  base::subtle::Barrier_AtomicIncrement(&handlers_running, 1);
+  SamplingProfiler* profiler = reinterpret_cast<SamplingProfiler*>(
+      base::subtle::Acquire_Load(&active_profiler));
+  if (profiler != NULL) {
+    int index = profiler->next_sample_.NoBarrierIncrement(1) - 1;
+    if (index < profiler->max_samples_) {
+      Sample* sample = &profiler->samples_[index];
+      sample->thread_name[0] = '\0';
+      prctl(PR_GET_NAME, sample->thread_name, 0, 0, 0);
+      sample->thread_name[kMaxThreadNameLength - 1] = '\0';
+      LabelSlot* slot = FindLabelSlot(CurrentThreadId(), false);
+      const char* label = (slot == NULL) ? NULL : reinterpret_cast<const char*>(
+          base::subtle::NoBarrier_Load(&slot->label));
+      int i = 0;
+      if (label != NULL) {
+        for (; (i < kMaxLabelLength - 1) && (label[i] != '\0'); ++i) {
+          sample->label[i] = label[i];
+        }
+      }
+      sample->label[i] = '\0';
+      void* pc;
+      uintptr_t sp;
+      void** fp;
+      sample->num_frames = 0;
+      if (GetInterruptedRegisters(context, &pc, &sp, &fp)) {
+        sample->num_frames =
+            WalkFramePointers(pc, sp, fp, sample->frames, kMaxFrames);
+      }
+    }
+  }
+  base::subtle::Barrier_AtomicIncrement(&handlers_running, -1);
+  errno = saved_errno;
+}
+
+bool SamplingProfiler::Start(int64 interval_us, MessageHandler* handler) {
+  DCHECK(!running_);
+  DCHECK_LT(0, interval_us);
+
+  if (base::subtle::Acquire_CompareAndSwap(
+          &active_profiler, 0, reinterpret_cast<base::subtle::AtomicWord>(
+              this)) != 0) {
+    handler->Message(kWarning, "A profile is already running.");
+    return false;
+  }
+
+  // The handler is never uninstalled: a SIGPROF still pending when we stop
+  // would otherwise kill the process.  It does nothing while no profile runs.
+  if (!handler_installed) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = &SamplingProfiler::HandleSignal;
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, NULL) != 0) {
+      handler->Message(kError, "Unable to install SIGPROF handler: %s",
+                       strerror(errno));
+      base::subtle::Release_Store(&active_profiler, 0);
+      return false;
+    }
+    handler_installed = true;
+  }
+
+  struct itimerval timer;
+  timer.it_interval.tv_sec = interval_us / Timer::kSecondUs;
+  timer.it_interval.tv_usec = interval_us % Timer::kSecondUs;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+    handler->Message(kError, "Unable to start profiling timer: %s",
+                     strerror(errno));
+    base::subtle::Release_Store(&active_profiler, 0);
+    return false;
+  }
+  running_ = true;
+  return true;
+}
+
+void SamplingProfiler::Stop() {
+  if (!running_) {
+    return;
+  }
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, NULL);
+  base::subtle::Release_Store(&active_profiler, 0);
+  // A handler increments handlers_running and then reads active_profiler;
+  // we clear active_profiler and then read handlers_running.  Without a
+  // full barrier here the load could be done before the store, missing a
+  // handler that has already seen this profiler.
+  base::subtle::MemoryBarrier();
+  while (base::subtle::Acquire_Load(&handlers_running) != 0) {
+    sched_yield();
+  }
+  running_ = false;
+}
+
+int SamplingProfiler::num_samples() const {
+  return std::min(next_sample_.value(), max_samples_);
+}
+
+int SamplingProfiler::num_dropped_samples() const {
+  return std::max(next_sample_.value() - max_samples_, 0);
+}
+
+void SamplingProfiler::WriteCollapsedStacks(Writer* writer,
+                                            MessageHandler* handler) const {
+  DCHECK(!running_);
+  typedef std::map<void*, GoogleString> SymbolMap;
+  typedef std::map<GoogleString, int> StackCountMap;
+  SymbolMap symbols;
+  StackCountMap stacks;
+  GoogleString stack;
+  for (int i = 0, n = num_samples(); i < n; ++i) {
+    const Sample& sample = samples_[i];
+    StringPiece pool = PoolName(sample.thread_name);
+    stack.assign(pool.data(), pool.size());
+    if (stack.empty()) {
+      stack = "unnamed";
+    }
+    StrAppend(&stack, ";", (sample.label[0] == '\0') ? "-" : sample.label);
+    for (int f = sample.num_frames - 1; f >= 0; --f) {
+      std::pair<SymbolMap::iterator, bool> inserted = symbols.insert(
+          SymbolMap::value_type(sample.frames[f], GoogleString()));
+      if (inserted.second) {
+        inserted.first->second = Symbolize(sample.frames[f]);
+      }
+      StrAppend(&stack, ";", inserted.first->second);
+    }
+    ++stacks[stack];
+  }
+
+  for (StackCountMap::const_iterator p = stacks.begin(); p != stacks.end();
+       ++p) {
+    writer->Write(StrCat(p->first, " ", IntegerToString(p->second), "\n"),
+                  handler);
+  }
+  if (num_dropped_samples() > 0) {
+    handler->Message(kWarning, "Profile dropped %d samples past the first %d.",
+                     num_dropped_samples(), max_samples_);
+  }
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,98 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PAGESPEED_KERNEL_BASE_SAMPLING_PROFILER_H_
+#define PAGESPEED_KERNEL_BASE_SAMPLING_PROFILER_H_
+
+#include <signal.h>
+
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+
+namespace net_instaweb {
+
+class MessageHandler;
+class Writer;
+
+// In-process, SIGPROF-driven stack sampler, for finding out where a running
+// server spends its CPU without attaching an external profiler.
+//
+// While a profile runs, an ITIMER_PROF interval timer interrupts whichever
+// thread is consuming CPU; the signal handler records that thread's stack,
+// its name (worker pools name their threads "<pool>-<n>") and its current
+// ScopedLabel, which filters use to say which filter is running.  Samples go
+// into a fixed array allocated up front, so the handler never allocates or
+// locks.  Stacks are found by following frame pointers, so they are only
+// complete through code built with -fno-omit-frame-pointer.  Symbolization
+// and aggregation happen after Stop.
+//
+// Only one profile can run in a process at a time.
+class SamplingProfiler {
+ public:
+  // Labels the work the calling thread does while this object lives, e.g.
+  // with the id of the filter being run.  Labels nest.  label must outlive
+  // this object; it's copied into samples as they are taken.
+  class ScopedLabel {
+   public:
+    explicit ScopedLabel(const char* label);
+    ~ScopedLabel();
+
+   private:
+    const char* previous_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedLabel);
+  };
+
+  // Keeps at most max_samples samples; later ones are counted but dropped.
+  explicit SamplingProfiler(int max_samples);
+  ~SamplingProfiler();
+
+  // Names the calling thread, for threads not started via ThreadSystem.
+  static void SetCurrentThreadName(const char* name);
+
+  // Starts sampling every interval_us of process CPU time.  Returns false,
+  // with a message to handler, if another profile is running or the timer
+  // could not be set up.
+  bool Start(int64 interval_us, MessageHandler* handler);
+
+  // Stops sampling, waiting for any signal handler still running.  Safe to
+  // call if Start failed or was never called.
+  void Stop();
+
+  int num_samples() const;
+  int num_dropped_samples() const;
+
+  // Writes the samples as collapsed stacks, one line per distinct stack:
+  //   <thread pool>;<label>;<outermost frame>;...;<innermost frame> <count>
+  // which is the input format of flamegraph.pl and similar tools.  Must be
+  // called after Stop.
+  void WriteCollapsedStacks(Writer* writer, MessageHandler* handler) const;
+
+ private:
+  struct Sample;
+
+  static void HandleSignal(int signal_number, siginfo_t* info, void* context);
+
+  const int max_samples_;
+  scoped_array<Sample> samples_;
+  AtomicInt32 next_sample_;
+  bool running_;
+
+  DISALLOW_COPY_AND_ASSIGN(SamplingProfiler);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_BASE_SAMPLING_PROFILER_H_
@@ -0,0 +1,86 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pagespeed/kernel/base/sampling_profiler.h"
+
+#include <ctime>
+
+#include "pagespeed/kernel/base/gmock.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_writer.h"
+#include "pagespeed/kernel/base/timer.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Spins until the process has used at least cpu_ms of CPU time.
+void BurnCpu(int64 cpu_ms) {
+  clock_t end = clock() + cpu_ms * CLOCKS_PER_SEC / Timer::kSecondMs;
+  volatile int64 sink = 0;
+  while (clock() < end) {
+    for (int i = 0; i < 10000; ++i) {
+      sink += i;
+    }
+  }
+}
+
+class SamplingProfilerTest : public ::testing::Test {
+ protected:
+  NullMessageHandler handler_;
+};
+
+TEST_F(SamplingProfilerTest, CollapsedStacksCarryThreadAndLabel) {
+  SamplingProfiler::SetCurrentThreadName("burner-3");
+  SamplingProfiler profiler(1000);
+  ASSERT_TRUE(profiler.Start(Timer::kMsUs, &handler_));
+  {
+    SamplingProfiler::ScopedLabel label("test_filter");
+    BurnCpu(200);
+  }
+  profiler.Stop();
+  EXPECT_LT(0, profiler.num_samples());
+
+  GoogleString report;
+  StringWriter writer(&report);
+  profiler.WriteCollapsedStacks(&writer, &handler_);
+  // The pool name has the worker number stripped.
+  EXPECT_THAT(report, ::testing::HasSubstr("burner;test_filter;"));
+  EXPECT_THAT(report, ::testing::Not(::testing::HasSubstr("burner-3")));
+}
+
+TEST_F(SamplingProfilerTest, OneProfileAtATime) {
+  SamplingProfiler first(10);
+  SamplingProfiler second(10);
+  ASSERT_TRUE(first.Start(Timer::kMsUs, &handler_));
+  EXPECT_FALSE(second.Start(Timer::kMsUs, &handler_));
+  first.Stop();
+  EXPECT_TRUE(second.Start(Timer::kMsUs, &handler_));
+  second.Stop();
+}
+
+TEST_F(SamplingProfilerTest, DropsSamplesPastCapacity) {
+  SamplingProfiler profiler(2);
+  ASSERT_TRUE(profiler.Start(Timer::kMsUs, &handler_));
+  BurnCpu(50);
+  profiler.Stop();
+  EXPECT_EQ(2, profiler.num_samples());
+  EXPECT_LT(0, profiler.num_dropped_samples());
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
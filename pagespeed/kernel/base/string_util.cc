@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 
 #include "pagespeed/kernel/base/string.h"
@@ -652,4 +653,75 @@ bool SplitStringPieceToIntegerVector(StringPiece src, StringPiece separators,
   return true;
 }
 
+namespace {
+
+// Returns the length of the UTF-8 sequence starting at p, or 0 if there
+// isn't a valid one in the size bytes there.  See the table of well-formed
+// byte sequences in http://www.unicode.org/versions/Unicode6.0.0/ch03.pdf
+// (Table 3-7), which rules out overlong forms and surrogates.
+int Utf8SequenceLength(const uint8* p, size_t size) {
+  uint8 lead = p[0];
+  int length;
+  uint8 min2 = 0x80, max2 = 0xbf;  // The range allowed for the second byte.
+  if ((lead >= 0xc2) && (lead <= 0xdf)) {
+    length = 2;
+  } else if ((lead >= 0xe0) && (lead <= 0xef)) {
+    length = 3;
+    if (lead == 0xe0) {
+      min2 = 0xa0;
+    } else if (lead == 0xed) {
+      max2 = 0x9f;
+    }
+  } else if ((lead >= 0xf0) && (lead <= 0xf4)) {
+    length = 4;
+    if (lead == 0xf0) {
+      min2 = 0x90;
+    } else if (lead == 0xf4) {
+      max2 = 0x8f;
+    }
+  } else {
+    return 0;
+  }
+  if ((static_cast<size_t>(length) > size) || (p[1] < min2) || (p[1] > max2)) {
+    return 0;
+  }
+  for (int i = 2; i < length; ++i) {
+    if ((p[i] & 0xc0) != 0x80) {
+      return 0;
+    }
+  }
+  return length;
+}
+
+}  // namespace
+
+TextEncoding ClassifyTextEncoding(StringPiece str) {
+  const uint8* p = reinterpret_cast<const uint8*>(str.data());
+  const size_t size = str.size();
+  const uint64 kHighBits = 0x8080808080808080ULL;
+  TextEncoding encoding = kAsciiText;
+  size_t i = 0;
+  while (i < size) {
+    if (i + sizeof(uint64) <= size) {
+      uint64 word;
+      memcpy(&word, p + i, sizeof(word));  // p + i need not be aligned.
+      if ((word & kHighBits) == 0) {
+        i += sizeof(word);
+        continue;
+      }
+    }
+    if (p[i] < 0x80) {
+      ++i;
+    } else {
+      int length = Utf8SequenceLength(p + i, size - i);
+      if (length == 0) {
+        return kNonUtf8Text;
+      }
+      encoding = kUtf8Text;
+      i += length;
+    }
+  }
+  return encoding;
+}
+
 }  // namespace net_instaweb
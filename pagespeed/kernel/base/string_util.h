@@ -744,6 +744,20 @@ inline bool IsNonControlAscii(char c) {
   return ('\x20' <= c) && (c <= '\x7E');
 }
 
+// What can be told of a string's character encoding from its bytes alone.
+enum TextEncoding {
+  kUnknownTextEncoding,  // Not looked at.
+  kAsciiText,            // 7-bit bytes only, so also valid UTF-8.
+  kUtf8Text,             // Valid UTF-8, with some multi-byte characters.
+  kNonUtf8Text,          // Not valid UTF-8: another charset, or garbage.
+};
+
+// Classifies str, which is valid UTF-8 if it has no stray continuation
+// bytes, truncated or overlong sequences, surrogates, or code points past
+// U+10FFFF.  Runs of ASCII are passed over a word at a time.  Never returns
+// kUnknownTextEncoding.
+TextEncoding ClassifyTextEncoding(StringPiece str);
+
 
 }  // namespace net_instaweb
 
@@ -867,6 +867,39 @@ TEST(IsAsciiTest, IsNonControlAscii) {
   }
 }
 
+TEST(ClassifyTextEncodingTest, AsciiAndUtf8) {
+  EXPECT_EQ(kAsciiText, ClassifyTextEncoding(""));
+  EXPECT_EQ(kAsciiText, ClassifyTextEncoding("plain"));
+  EXPECT_EQ(kAsciiText,
+            ClassifyTextEncoding("a longer run, more than a word or two"));
+  EXPECT_EQ(kUtf8Text, ClassifyTextEncoding("\xc3\xa9"));          // é
+  EXPECT_EQ(kUtf8Text, ClassifyTextEncoding("snow\xe2\x98\x83"));  // ☃
+  EXPECT_EQ(kUtf8Text,
+            ClassifyTextEncoding("an emoji, \xf0\x9f\x98\x80, at the end"));
+  EXPECT_EQ(kUtf8Text, ClassifyTextEncoding("\xef\xbf\xbf\xf4\x8f\xbf\xbf"));
+}
+
+TEST(ClassifyTextEncodingTest, NotUtf8) {
+  EXPECT_EQ(kNonUtf8Text, ClassifyTextEncoding("mu\xf1" "ecos"));  // Latin-1.
+  EXPECT_EQ(kNonUtf8Text, ClassifyTextEncoding("\xa9"));    // Stray.
+  EXPECT_EQ(kNonUtf8Text, ClassifyTextEncoding("\xc3"));    // Truncated.
+  EXPECT_EQ(kNonUtf8Text, ClassifyTextEncoding("\xe2\x98"));
+  EXPECT_EQ(kNonUtf8Text, ClassifyTextEncoding("\xc0\xaf"));  // Overlong.
+  EXPECT_EQ(kNonUtf8Text, ClassifyTextEncoding("\xe0\x80\xaf"));
+  EXPECT_EQ(kNonUtf8Text, ClassifyTextEncoding("\xed\xa0\x80"));  // Surrogate.
+  EXPECT_EQ(kNonUtf8Text,
+            ClassifyTextEncoding("\xf4\x90\x80\x80"));  // Past U+10FFFF.
+  EXPECT_EQ(kNonUtf8Text, ClassifyTextEncoding("\xf5\x80\x80\x80"));
+
+  // A bad byte is found wherever it is in a long string.
+  const GoogleString text("0123456789abcdefghijklmnopqrstuvwxyz");
+  for (int i = 0, n = text.size(); i <= n; ++i) {
+    GoogleString bad = text;
+    bad.insert(i, "\xff");
+    EXPECT_EQ(kNonUtf8Text, ClassifyTextEncoding(bad)) << i;
+  }
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -0,0 +1,164 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pagespeed/kernel/base/trace_span_ring.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/atomicops.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/escaping.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/base/writer.h"
+
+namespace net_instaweb {
+
+namespace {
+
+int RoundUpToPowerOfTwo(int n) {
+  int power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+}  // namespace
+
+// The sequence number is odd while the record is being written and even once
+// it is complete, and changes on every write, so a reader that sees the same
+// even number before and after copying the record has a consistent copy.
+struct TraceSpanRing::Slot {
+  AtomicInt32 sequence;
+  TraceSpanRecord record;
+};
+
+TraceSpanRing::TraceSpanRing(int capacity, Timer* timer)
+    : capacity_(RoundUpToPowerOfTwo(capacity)),
+      timer_(timer),
+      slots_(new Slot[capacity_]) {
+  DCHECK_LT(0, capacity);
+}
+
+TraceSpanRing::~TraceSpanRing() {
+}
+
+int64 TraceSpanRing::NewTraceId() {
+  return next_trace_id_.NoBarrierIncrement(1);
+}
+
+void TraceSpanRing::Record(const char* category, const char* name,
+                           int64 trace_id, int64 start_us, int64 end_us) {
+  uint32 ticket = static_cast<uint32>(next_slot_.NoBarrierIncrement(1)) - 1;
+  Slot* slot = &slots_[ticket & (capacity_ - 1)];
+  slot->sequence.BarrierIncrement(1);
+  TraceSpanRecord* record = &slot->record;
+  record->category = category;
+  record->name = name;
+  record->trace_id = trace_id;
+  record->start_us = start_us;
+  record->duration_us = std::max(static_cast<int64>(0), end_us - start_us);
+  slot->sequence.BarrierIncrement(1);
+}
+
+void TraceSpanRing::Snapshot(std::vector<TraceSpanRecord>* spans) const {
+  // Walk the last capacity_ tickets, oldest first.  Since capacity_ is a
+  // power of two this visits every slot once, in order, even across the
+  // wrap of the ticket counter; slots never written are skipped below.
+  uint32 end = static_cast<uint32>(next_slot_.value());
+  uint32 count = static_cast<uint32>(capacity_);
+  spans->reserve(spans->size() + std::min(end, count));
+  for (uint32 ticket = end - count; ticket != end; ++ticket) {
+    const Slot& slot = slots_[ticket & (capacity_ - 1)];
+    int32 before = slot.sequence.value();
+    if ((before == 0) || ((before & 1) != 0)) {
+      continue;
+    }
+    TraceSpanRecord record = slot.record;
+    base::subtle::MemoryBarrier();
+    if (slot.sequence.value() == before) {
+      spans->push_back(record);
+    }
+  }
+}
+
+void TraceSpanRing::WriteChromeTraceJson(Writer* writer,
+                                         MessageHandler* handler) const {
+  std::vector<TraceSpanRecord> spans;
+  Snapshot(&spans);
+
+  GoogleString json = "{\"traceEvents\":[";
+  GoogleString category, name;
+  for (int i = 0, n = spans.size(); i < n; ++i) {
+    const TraceSpanRecord& span = spans[i];
+    EscapeToJsStringLiteral(span.category, true /* add_quotes */, &category);
+    EscapeToJsStringLiteral(span.name, true /* add_quotes */, &name);
+    StrAppend(&json, (i == 0) ? "\n" : ",\n",
+              "{\"name\":", name, ",\"cat\":", category, ",\"ph\":\"X\"");
+    StrAppend(&json, ",\"ts\":", Integer64ToString(span.start_us),
+              ",\"dur\":", Integer64ToString(span.duration_us),
+              ",\"pid\":0,\"tid\":", Integer64ToString(span.trace_id), "}");
+  }
+  json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+  writer->Write(json, handler);
+}
+
+ScopedTraceSpan::ScopedTraceSpan()
+    : ring_(NULL),
+      trace_id_(0),
+      category_(NULL),
+      name_(NULL),
+      start_us_(0) {
+}
+
+ScopedTraceSpan::ScopedTraceSpan(TraceSpanRing* ring, int64 trace_id,
+                                 const char* category, const char* name)
+    : ring_(NULL),
+      trace_id_(0),
+      category_(NULL),
+      name_(NULL),
+      start_us_(0) {
+  Start(ring, trace_id, category, name);
+}
+
+ScopedTraceSpan::~ScopedTraceSpan() {
+  End();
+}
+
+void ScopedTraceSpan::Start(TraceSpanRing* ring, int64 trace_id,
+                            const char* category, const char* name) {
+  End();
+  if (ring != NULL) {
+    ring_ = ring;
+    trace_id_ = trace_id;
+    category_ = category;
+    name_ = name;
+    start_us_ = ring->timer()->NowUs();
+  }
+}
+
+void ScopedTraceSpan::End() {
+  if (ring_ != NULL) {
+    ring_->Record(category_, name_, trace_id_, start_us_,
+                  ring_->timer()->NowUs());
+    ring_ = NULL;
+  }
+}
+
+}  // namespace net_instaweb
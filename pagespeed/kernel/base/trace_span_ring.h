@@ -0,0 +1,116 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PAGESPEED_KERNEL_BASE_TRACE_SPAN_RING_H_
+#define PAGESPEED_KERNEL_BASE_TRACE_SPAN_RING_H_
+
+#include <vector>
+
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+
+namespace net_instaweb {
+
+class MessageHandler;
+class Timer;
+class Writer;
+
+// One timed span of work done on behalf of a request.  category and name
+// must be string literals (or otherwise outlive the ring), so that recording
+// a span never allocates.
+struct TraceSpanRecord {
+  const char* category;
+  const char* name;
+  int64 trace_id;   // Groups the spans of one request.
+  int64 start_us;
+  int64 duration_us;
+};
+
+// A fixed-size, per-process ring of TraceSpanRecords.  Recording is
+// lock-free: each writer claims a slot with an atomic increment and
+// publishes it with a per-slot sequence number, so readers can skip a slot
+// that is being overwritten.  When the ring is full the oldest spans are
+// overwritten.
+//
+// Typical use goes through ScopedTraceSpan, below, usually via
+// RequestContext::StartTraceSpan.
+class TraceSpanRing {
+ public:
+  // capacity is rounded up to a power of two, so that slots can be picked
+  // by masking a ticket counter that is allowed to wrap.  Does not take
+  // ownership of timer.
+  TraceSpanRing(int capacity, Timer* timer);
+  ~TraceSpanRing();
+
+  Timer* timer() const { return timer_; }
+
+  // Returns a new id to group the spans of one request under.
+  int64 NewTraceId();
+
+  void Record(const char* category, const char* name, int64 trace_id,
+              int64 start_us, int64 end_us);
+
+  // Appends a consistent copy of the spans currently in the ring to spans.
+  // Spans being written while we copy are left out.
+  void Snapshot(std::vector<TraceSpanRecord>* spans) const;
+
+  // Writes the spans in the Chrome trace-event JSON format understood by
+  // chrome://tracing, with each request in its own thread lane.
+  void WriteChromeTraceJson(Writer* writer, MessageHandler* handler) const;
+
+ private:
+  struct Slot;
+
+  const int capacity_;  // Always a power of two.
+  Timer* timer_;
+  scoped_array<Slot> slots_;
+  AtomicInt32 next_slot_;
+  AtomicInt32 next_trace_id_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceSpanRing);
+};
+
+// Times a span from Start (or construction) until End (or destruction) and
+// records it in a TraceSpanRing.  A default-constructed span, or one started
+// with a NULL ring, does nothing, so call sites need no checks of their own.
+// Not thread-safe; a span should be started and ended by code that is
+// already serialized, e.g. the two halves of an asynchronous callback.
+class ScopedTraceSpan {
+ public:
+  ScopedTraceSpan();
+  ScopedTraceSpan(TraceSpanRing* ring, int64 trace_id, const char* category,
+                  const char* name);
+  ~ScopedTraceSpan();
+
+  // Starts timing, ending any span that is already in progress.
+  void Start(TraceSpanRing* ring, int64 trace_id, const char* category,
+             const char* name);
+
+  // Records the span.  Further calls do nothing until the next Start.
+  void End();
+
+ private:
+  TraceSpanRing* ring_;
+  int64 trace_id_;
+  const char* category_;
+  const char* name_;
+  int64 start_us_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedTraceSpan);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_BASE_TRACE_SPAN_RING_H_
@@ -0,0 +1,132 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pagespeed/kernel/base/trace_span_ring.h"
+
+#include <vector>
+
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/json.h"
+#include "pagespeed/kernel/base/mock_timer.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_writer.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kCapacity = 4;
+
+class TraceSpanRingTest : public ::testing::Test {
+ protected:
+  TraceSpanRingTest()
+      : timer_(new NullMutex, MockTimer::kApr_5_2010_ms),
+        ring_(kCapacity, &timer_) {
+  }
+
+  void RecordSpan(const char* name, int64 trace_id, int64 duration_us) {
+    ScopedTraceSpan span(&ring_, trace_id, "test", name);
+    timer_.AdvanceUs(duration_us);
+  }
+
+  MockTimer timer_;
+  TraceSpanRing ring_;
+  NullMessageHandler handler_;
+};
+
+TEST_F(TraceSpanRingTest, RecordsSpans) {
+  int64 trace_id = ring_.NewTraceId();
+  EXPECT_NE(trace_id, ring_.NewTraceId());
+  int64 start_us = timer_.NowUs();
+  RecordSpan("a", trace_id, 10);
+  RecordSpan("b", trace_id, 20);
+
+  std::vector<TraceSpanRecord> spans;
+  ring_.Snapshot(&spans);
+  ASSERT_EQ(2, spans.size());
+  EXPECT_STREQ("a", spans[0].name);
+  EXPECT_STREQ("test", spans[0].category);
+  EXPECT_EQ(trace_id, spans[0].trace_id);
+  EXPECT_EQ(start_us, spans[0].start_us);
+  EXPECT_EQ(10, spans[0].duration_us);
+  EXPECT_STREQ("b", spans[1].name);
+  EXPECT_EQ(start_us + 10, spans[1].start_us);
+  EXPECT_EQ(20, spans[1].duration_us);
+}
+
+TEST_F(TraceSpanRingTest, OverwritesOldest) {
+  const char* kNames[] = {"0", "1", "2", "3", "4", "5"};
+  for (int i = 0; i < arraysize(kNames); ++i) {
+    RecordSpan(kNames[i], 1, i);
+  }
+  std::vector<TraceSpanRecord> spans;
+  ring_.Snapshot(&spans);
+  ASSERT_EQ(kCapacity, spans.size());
+  EXPECT_STREQ("2", spans[0].name);
+  EXPECT_STREQ("5", spans[kCapacity - 1].name);
+}
+
+TEST_F(TraceSpanRingTest, CapacityRoundedUpToPowerOfTwo) {
+  TraceSpanRing ring(kCapacity - 1, &timer_);
+  const char* kNames[] = {"0", "1", "2", "3", "4", "5"};
+  for (int i = 0; i < arraysize(kNames); ++i) {
+    ring.Record("test", kNames[i], 1, 0, i);
+  }
+  std::vector<TraceSpanRecord> spans;
+  ring.Snapshot(&spans);
+  ASSERT_EQ(kCapacity, spans.size());
+  EXPECT_STREQ("2", spans[0].name);
+  EXPECT_STREQ("5", spans[kCapacity - 1].name);
+}
+
+TEST_F(TraceSpanRingTest, InactiveSpans) {
+  {
+    ScopedTraceSpan disabled(NULL, 1, "test", "disabled");
+    ScopedTraceSpan unstarted;
+    unstarted.End();
+  }
+  ScopedTraceSpan span(&ring_, 1, "test", "once");
+  span.End();
+  span.End();
+
+  std::vector<TraceSpanRecord> spans;
+  ring_.Snapshot(&spans);
+  ASSERT_EQ(1, spans.size());
+  EXPECT_STREQ("once", spans[0].name);
+}
+
+TEST_F(TraceSpanRingTest, ChromeTraceJson) {
+  RecordSpan("Find \"quoted\"", 7, 5);
+
+  GoogleString json;
+  StringWriter writer(&json);
+  ring_.WriteChromeTraceJson(&writer, &handler_);
+
+  Json::Value trace;
+  Json::Reader reader;
+  ASSERT_TRUE(reader.parse(json, trace)) << json;
+  const Json::Value& events = trace["traceEvents"];
+  ASSERT_EQ(1, events.size());
+  EXPECT_EQ("Find \"quoted\"", events[0]["name"].asString());
+  EXPECT_EQ("test", events[0]["cat"].asString());
+  EXPECT_EQ("X", events[0]["ph"].asString());
+  EXPECT_EQ(5, events[0]["dur"].asInt());
+  EXPECT_EQ(7, events[0]["tid"].asInt());
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -18,19 +18,33 @@
 
 #include "pagespeed/kernel/cache/cache_batcher.h"
 
+#include <algorithm>
+#include <map>
+#include <vector>
 
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/atomic_int32.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/cache/delegating_cache_callback.h"
 
 namespace {
 
 const char kDroppedGets[] = "cache_batcher_dropped_gets";
+const char kCoalescedGets[] = "cache_batcher_coalesced_gets";
+const char kQueueDelayHistogram[] = "cache_batcher_queue_delay_us";
+const char kBatchSizeHistogram[] = "cache_batcher_batch_size";
+const char kUnderbatchedKeysHistogram[] = "cache_batcher_underbatched_keys";
+const char kOverbatchedLatencyHistogram[] =
+    "cache_batcher_overbatched_latency_us";
+
+const int kQueueDelayHistogramMaxValueUs = 1*1000*1000;
+const int kBatchSizeHistogramMaxValue = 1000;
 
 }  // namespace
 
@@ -41,20 +55,26 @@ namespace net_instaweb {
 // lookup independent of how many keys it has.
 class CacheBatcher::Group {
  public:
-  Group(CacheBatcher* batcher, int group_size)
+  Group(CacheBatcher* batcher, int group_size, int64 start_us, int epoch)
       : batcher_(batcher),
+        group_size_(group_size),
+        start_us_(start_us),
+        epoch_(epoch),
         outstanding_lookups_(group_size) {
   }
 
   void Done() {
     if (outstanding_lookups_.BarrierIncrement(-1) == 0) {
-      batcher_->GroupComplete();
+      batcher_->GroupComplete(start_us_, group_size_, epoch_);
       delete this;
     }
   }
 
  private:
   CacheBatcher* batcher_;
+  int group_size_;
+  int64 start_us_;
+  int epoch_;
   AtomicInt32 outstanding_lookups_;
 
   DISALLOW_COPY_AND_ASSIGN(Group);
@@ -62,109 +82,327 @@ class CacheBatcher::Group {
 
 class CacheBatcher::BatcherCallback : public DelegatingCacheCallback {
  public:
-  BatcherCallback(CacheInterface::Callback* callback, Group* group)
+  BatcherCallback(CacheInterface::Callback* callback, CacheBatcher* batcher,
+                  const GoogleString& key, CallbackVector* waiters,
+                  Group* group)
       : DelegatingCacheCallback(callback),
-        group_(group) {
+        batcher_(batcher),
+        key_(key),
+        waiters_(waiters),
+        group_(group),
+        found_state_(CacheInterface::kNotFound) {
   }
 
   virtual ~BatcherCallback() {}
 
+  // Remember what the cache actually found, independent of whether the
+  // original callback likes it, as the coalesced callbacks may differ in
+  // what they accept.
+  virtual bool ValidateCandidate(const GoogleString& key,
+                                 CacheInterface::KeyState state) {
+    found_state_ = state;
+    return DelegatingCacheCallback::ValidateCandidate(key, state);
+  }
+
   virtual void Done(CacheInterface::KeyState state) {
+    CacheBatcher* batcher = batcher_;
+    CallbackVector* waiters = waiters_;
     Group* group = group_;
+    GoogleString key;
+    key.swap(key_);
+    CacheInterface::KeyState found_state = found_state_;
+    SharedString found_value(*value());
     DelegatingCacheCallback::Done(state);  // deletes this.
+    batcher->CoalescedGetsDone(key, waiters, found_state, &found_value);
     group->Done();
   }
 
  private:
+  CacheBatcher* batcher_;
+  GoogleString key_;
+  CallbackVector* waiters_;
   Group* group_;
+  CacheInterface::KeyState found_state_;
 
   DISALLOW_COPY_AND_ASSIGN(BatcherCallback);
 };
 
 CacheBatcher::CacheBatcher(CacheInterface* cache, AbstractMutex* mutex,
-                           Statistics* statistics)
+                           Timer* timer, Statistics* statistics)
     : cache_(cache),
+      timer_(timer),
       mutex_(mutex),
       last_batch_size_(-1),
       pending_(0),
       max_parallel_lookups_(kDefaultMaxParallelLookups),
       max_queue_size_(kDefaultMaxQueueSize),
-      dropped_gets_(statistics->GetVariable(kDroppedGets)) {
+      adaptive_(false),
+      parallel_limit_(kDefaultMaxParallelLookups),
+      batch_limit_(kDefaultMaxQueueSize),
+      baseline_latency_us_(-1),
+      window_min_latency_us_(-1),
+      window_lookups_(0),
+      adapt_epoch_(0),
+      dropped_gets_(statistics->GetVariable(kDroppedGets)),
+      coalesced_gets_(statistics->GetVariable(kCoalescedGets)),
+      queue_delay_us_histogram_(statistics->GetHistogram(
+          kQueueDelayHistogram)),
+      batch_size_histogram_(statistics->GetHistogram(kBatchSizeHistogram)),
+      underbatched_keys_histogram_(statistics->GetHistogram(
+          kUnderbatchedKeysHistogram)),
+      overbatched_latency_us_histogram_(statistics->GetHistogram(
+          kOverbatchedLatencyHistogram)) {
+  queue_delay_us_histogram_->SetMaxValue(kQueueDelayHistogramMaxValueUs);
+  batch_size_histogram_->SetMaxValue(kBatchSizeHistogramMaxValue);
+  underbatched_keys_histogram_->SetMaxValue(kBatchSizeHistogramMaxValue);
+  overbatched_latency_us_histogram_->SetMaxValue(
+      kQueueDelayHistogramMaxValueUs);
 }
 
 CacheBatcher::~CacheBatcher() {
 }
 
 GoogleString CacheBatcher::FormatName(StringPiece cache, int parallelism,
-                                      int max) {
+                                      int max, bool adaptive) {
   return StrCat("Batcher(cache=", cache,
                 ",parallelism=", IntegerToString(parallelism),
-                ",max=", IntegerToString(max), ")");
+                ",max=", IntegerToString(max),
+                adaptive ? ",adaptive)" : ")");
 }
 
 GoogleString CacheBatcher::Name() const {
-  return FormatName(cache_->Name(), max_parallel_lookups_, max_queue_size_);
+  return FormatName(cache_->Name(), max_parallel_lookups_, max_queue_size_,
+                    adaptive_);
 }
 
 void CacheBatcher::InitStats(Statistics* statistics) {
   statistics->AddVariable(kDroppedGets);
+  statistics->AddVariable(kCoalescedGets);
+  Histogram* queue_delay_us_histogram =
+      statistics->AddHistogram(kQueueDelayHistogram);
+  queue_delay_us_histogram->SetMaxValue(kQueueDelayHistogramMaxValueUs);
+  Histogram* batch_size_histogram =
+      statistics->AddHistogram(kBatchSizeHistogram);
+  batch_size_histogram->SetMaxValue(kBatchSizeHistogramMaxValue);
+  Histogram* underbatched_keys_histogram =
+      statistics->AddHistogram(kUnderbatchedKeysHistogram);
+  underbatched_keys_histogram->SetMaxValue(kBatchSizeHistogramMaxValue);
+  Histogram* overbatched_latency_us_histogram =
+      statistics->AddHistogram(kOverbatchedLatencyHistogram);
+  overbatched_latency_us_histogram->SetMaxValue(
+      kQueueDelayHistogramMaxValueUs);
+}
+
+void CacheBatcher::set_adaptive(bool x) {
+  adaptive_ = x;
+  parallel_limit_ = max_parallel_lookups_;
+  batch_limit_ = max_queue_size_;
+}
+
+int CacheBatcher::parallel_limit() {
+  ScopedMutex mutex(mutex_.get());
+  return parallel_limit_;
+}
+
+size_t CacheBatcher::batch_limit() {
+  ScopedMutex mutex(mutex_.get());
+  return batch_limit_;
 }
 
 bool CacheBatcher::CanIssueGet() const {
-  return (pending_ < max_parallel_lookups_);
+  return (pending_ < parallel_limit_);
 }
 
 void CacheBatcher::Get(const GoogleString& key, Callback* callback) {
   bool immediate = false;
   bool drop_get = false;
+  bool coalesced = false;
+  int epoch = 0;
+  CallbackVector* waiters = NULL;
   {
     ScopedMutex mutex(mutex_.get());
 
-    if (CanIssueGet()) {
+    CoalescedGetMap::iterator p = in_flight_.find(key);
+    if (p != in_flight_.end()) {
+      p->second->push_back(callback);
+      coalesced = true;
+    } else if (CanIssueGet()) {
       immediate = true;
       ++pending_;
+      epoch = adapt_epoch_;
+      waiters = new CallbackVector;
+      in_flight_[key] = waiters;
     } else if (queue_.size() >= max_queue_size_) {
       drop_get = true;
     } else {
+      waiters = new CallbackVector;
       queue_.push_back(KeyCallback(key, callback));
+      queue_times_us_.push_back(timer_->NowUs());
+      queue_waiters_.push_back(waiters);
+      in_flight_[key] = waiters;
     }
   }
   if (immediate) {
-    Group* group = new Group(this, 1);
-    callback = new BatcherCallback(callback, group);
+    Group* group = new Group(this, 1, timer_->NowUs(), epoch);
+    callback = new BatcherCallback(callback, this, key, waiters, group);
     cache_->Get(key, callback);
   } else if (drop_get) {
     ValidateAndReportResult(key, CacheInterface::kNotFound, callback);
     dropped_gets_->Add(1);
+  } else if (coalesced) {
+    coalesced_gets_->Add(1);
   }
 }
 
-void CacheBatcher::GroupComplete() {
-  MultiGetRequest* request = NULL;
+void CacheBatcher::CoalescedGetsDone(const GoogleString& key,
+                                     CallbackVector* waiters,
+                                     CacheInterface::KeyState state,
+                                     SharedString* value) {
+  {
+    // Once nothing else can find waiters, we own it.
+    ScopedMutex mutex(mutex_.get());
+    CoalescedGetMap::iterator p = in_flight_.find(key);
+    if ((p != in_flight_.end()) && (p->second == waiters)) {
+      in_flight_.erase(p);
+    }
+  }
+  for (int i = 0, n = waiters->size(); i < n; ++i) {
+    Callback* waiter = (*waiters)[i];
+    *waiter->value() = *value;
+    ValidateAndReportResult(key, state, waiter);
+  }
+  delete waiters;
+}
+
+void CacheBatcher::DetachCoalescedGets(const GoogleString& key) {
+  ScopedMutex mutex(mutex_.get());
+  in_flight_.erase(key);
+}
+
+void CacheBatcher::GroupComplete(int64 start_us, int batch_size, int epoch) {
+  int64 latency_us = timer_->NowUs() - start_us;
+  std::vector<MultiGetRequest*> requests;
+  std::vector<std::vector<int64> > queue_times_us;
+  std::vector<std::vector<CallbackVector*> > waiters;
+  int next_epoch;
 
   {
     ScopedMutex mutex(mutex_.get());
-    if (queue_.empty()) {
-      --pending_;
-      return;
+    bool saturated = (pending_ >= parallel_limit_) && !queue_.empty();
+    --pending_;
+    if (adaptive_) {
+      AdaptLimits(latency_us, batch_size, epoch, saturated);
+    }
+    next_epoch = adapt_epoch_;
+
+    // Without adaptation there is no batch limit to speak of, so this sends
+    // the whole queue as one MultiGet.
+    while (!queue_.empty() && CanIssueGet()) {
+      queue_times_us.resize(queue_times_us.size() + 1);
+      waiters.resize(waiters.size() + 1);
+      requests.push_back(DequeueBatch(&queue_times_us.back(),
+                                      &waiters.back()));
     }
-    request = new MultiGetRequest;
-    last_batch_size_ = queue_.size();
+  }
+  for (int i = 0, n = requests.size(); i < n; ++i) {
+    IssueBatch(requests[i], queue_times_us[i], waiters[i], next_epoch);
+  }
+}
+
+CacheInterface::MultiGetRequest* CacheBatcher::DequeueBatch(
+    std::vector<int64>* queue_times_us,
+    std::vector<CallbackVector*>* waiters) {
+  MultiGetRequest* request = new MultiGetRequest;
+  if (queue_.size() <= batch_limit_) {
     request->swap(queue_);
+    queue_times_us->swap(queue_times_us_);
+    waiters->swap(queue_waiters_);
+  } else {
+    request->assign(queue_.begin(), queue_.begin() + batch_limit_);
+    queue_.erase(queue_.begin(), queue_.begin() + batch_limit_);
+    queue_times_us->assign(queue_times_us_.begin(),
+                           queue_times_us_.begin() + batch_limit_);
+    queue_times_us_.erase(queue_times_us_.begin(),
+                          queue_times_us_.begin() + batch_limit_);
+    waiters->assign(queue_waiters_.begin(),
+                    queue_waiters_.begin() + batch_limit_);
+    queue_waiters_.erase(queue_waiters_.begin(),
+                         queue_waiters_.begin() + batch_limit_);
+    underbatched_keys_histogram_->Add(queue_.size());
   }
-  Group* group = new Group(this, request->size());
+  ++pending_;
+  last_batch_size_ = request->size();
+  return request;
+}
+
+void CacheBatcher::IssueBatch(MultiGetRequest* request,
+                              const std::vector<int64>& queue_times_us,
+                              const std::vector<CallbackVector*>& waiters,
+                              int epoch) {
+  int64 now_us = timer_->NowUs();
+  for (int i = 0, n = queue_times_us.size(); i < n; ++i) {
+    queue_delay_us_histogram_->Add(now_us - queue_times_us[i]);
+  }
+  batch_size_histogram_->Add(request->size());
+  Group* group = new Group(this, request->size(), now_us, epoch);
   for (int i = 0, n = request->size(); i < n; ++i) {
-    (*request)[i].callback = new BatcherCallback((*request)[i].callback,
-                                                 group);
+    KeyCallback* key_callback = &(*request)[i];
+    key_callback->callback = new BatcherCallback(
+        key_callback->callback, this, key_callback->key, waiters[i], group);
   }
   cache_->MultiGet(request);
 }
 
+void CacheBatcher::AdaptLimits(int64 latency_us, int batch_size, int epoch,
+                               bool saturated) {
+  // Track the lowest latency seen over a window of lookups, and adopt it as
+  // the baseline at the end of each window.  The very first lookup seeds the
+  // baseline.
+  if ((window_min_latency_us_ < 0) || (latency_us < window_min_latency_us_)) {
+    window_min_latency_us_ = latency_us;
+  }
+  if ((baseline_latency_us_ < 0) || (latency_us < baseline_latency_us_)) {
+    baseline_latency_us_ = latency_us;
+  }
+  if (++window_lookups_ >= kAdaptiveBaselineLookups) {
+    baseline_latency_us_ = window_min_latency_us_;
+    window_min_latency_us_ = -1;
+    window_lookups_ = 0;
+  }
+
+  int64 tolerable_latency_us =
+      kAdaptiveLatencyTolerance * baseline_latency_us_ +
+      kAdaptiveLatencySlackUs;
+  if (latency_us > tolerable_latency_us) {
+    // Multiplicative decrease: the backend is struggling, or we're asking
+    // for too much at once.  A burst of slow lookups that were all issued
+    // under the old limits only counts once.
+    overbatched_latency_us_histogram_->Add(latency_us - tolerable_latency_us);
+    if (epoch == adapt_epoch_) {
+      parallel_limit_ = std::max(1, parallel_limit_ / 2);
+      batch_limit_ = std::max(static_cast<size_t>(1), batch_limit_ / 2);
+      ++adapt_epoch_;
+    }
+  } else {
+    // Additive increase, but only of limits that are actually holding us
+    // back, so that they don't grow without bound under light load.
+    if (saturated && (parallel_limit_ < kMaxAdaptiveParallelLookups)) {
+      ++parallel_limit_;
+    }
+    if (static_cast<size_t>(batch_size) >= batch_limit_) {
+      batch_limit_ = std::min(batch_limit_ + kAdaptiveBatchIncrement,
+                              max_queue_size_);
+    }
+  }
+}
+
 void CacheBatcher::Put(const GoogleString& key, SharedString* value) {
+  DetachCoalescedGets(key);
   cache_->Put(key, value);
 }
 
 void CacheBatcher::Delete(const GoogleString& key) {
+  DetachCoalescedGets(key);
   cache_->Delete(key);
 }
 
@@ -175,15 +413,24 @@ int CacheBatcher::Pending() {
 
 void CacheBatcher::ShutDown() {
   MultiGetRequest* request = NULL;
+  std::vector<CallbackVector*> waiters;
   {
     ScopedMutex mutex(mutex_.get());
     if (!queue_.empty()) {
       request = new MultiGetRequest;
       request->swap(queue_);
+      queue_times_us_.clear();
+      waiters.swap(queue_waiters_);
     }
   }
 
   if (request != NULL) {
+    // The Gets coalesced onto the queued keys will never be looked up either.
+    SharedString empty;
+    for (int i = 0, n = request->size(); i < n; ++i) {
+      CoalescedGetsDone((*request)[i].key, waiters[i],
+                        CacheInterface::kNotFound, &empty);
+    }
     ReportMultiGetNotFound(request);
   }
   cache_->ShutDown();
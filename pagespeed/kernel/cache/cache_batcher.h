@@ -20,6 +20,8 @@
 #define PAGESPEED_KERNEL_CACHE_CACHE_BATCHER_H_
 
 #include <cstddef>
+#include <map>
+#include <vector>
 
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
@@ -30,8 +32,10 @@
 namespace net_instaweb {
 
 class AbstractMutex;
+class Histogram;
 class SharedString;
 class Statistics;
+class Timer;
 class Variable;
 
 // Batches up cache lookups to exploit implementations that have MultiGet
@@ -44,6 +48,25 @@ class Variable;
 // There is also a maximum queue size.  If Gets stream in faster than they
 // are completed and the queue overflows, then we respond with a fast kNotFound.
 //
+// Gets for a key that is already queued or outstanding are coalesced: rather
+// than looking the key up again, the callback waits for the lookup already
+// in progress and is handed the same value.  This matters when many
+// concurrent requests hit the same hot key, e.g. the cached copy of a popular
+// resource.  A Put or Delete of a key stops later Gets from joining a
+// lookup of it that was issued earlier, so they see the new value.
+//
+// In adaptive mode the parallelism and the maximum number of keys per
+// MultiGet are not fixed, but tuned from the observed lookup latency, in the
+// style of an AIMD concurrency limit.  The lowest recently observed latency
+// is taken as the baseline.  While lookups complete within a tolerance of
+// it and Gets are backing up, the limits grow additively.  When a lookup
+// takes much longer, the backend is assumed to be overloaded (or the batches
+// too big) and both limits are halved.  They are halved at most once per
+// adjustment epoch: lookups issued before the last decrease were sized by
+// the old limits, so their being slow says nothing about the new ones.  This
+// lets one configuration serve both a fast local cache and a remote
+// memcached.
+//
 // Note that this class is designed for use with an asynchronous cache
 // implementation.  To use this with a blocking cache implementation, please
 // wrap the blocking cache in an AsyncCache.
@@ -68,8 +91,28 @@ class CacheBatcher : public CacheInterface {
   // requests, calling the callback immediately with kNotFound.
   static const size_t kDefaultMaxQueueSize = 1000;
 
-  // Does not take ownership of the cache. Takes ownership of the mutex.
-  CacheBatcher(CacheInterface* cache, AbstractMutex* mutex,
+  // In adaptive mode, the parallelism is allowed to grow up to this many
+  // lookups.
+  static const int kMaxAdaptiveParallelLookups = 16;
+
+  // In adaptive mode, a lookup is considered slow if it takes longer than
+  // kAdaptiveLatencyTolerance times the baseline latency plus
+  // kAdaptiveLatencySlackUs.  The slack keeps scheduling noise from
+  // counting against very fast caches.
+  static const int kAdaptiveLatencyTolerance = 2;
+  static const int64 kAdaptiveLatencySlackUs = 500;
+
+  // In adaptive mode, the baseline latency is re-measured after this many
+  // lookups, so the batcher can adapt to the backend becoming slower.
+  static const int kAdaptiveBaselineLookups = 100;
+
+  // In adaptive mode, how many keys are added to the batch limit when a
+  // batch was capped and completed quickly.
+  static const size_t kAdaptiveBatchIncrement = 8;
+
+  // Does not take ownership of the cache or timer. Takes ownership of the
+  // mutex.  The timer is used to measure how long Gets wait in the queue.
+  CacheBatcher(CacheInterface* cache, AbstractMutex* mutex, Timer* timer,
                Statistics* statistics);
   virtual ~CacheBatcher();
 
@@ -82,15 +125,32 @@ class CacheBatcher : public CacheInterface {
   virtual void Put(const GoogleString& key, SharedString* value);
   virtual void Delete(const GoogleString& key);
   virtual GoogleString Name() const;
-  static GoogleString FormatName(StringPiece cache, int parallelism, int max);
+  static GoogleString FormatName(StringPiece cache, int parallelism, int max,
+                                 bool adaptive);
 
   // Note: CacheBatcher cannot do any batching if given a blocking cache,
   // however it is still functional so pass on the bit.
   virtual bool IsBlocking() const { return cache_->IsBlocking(); }
 
   int last_batch_size() const { return last_batch_size_; }  // for testing
-  void set_max_queue_size(size_t n) { max_queue_size_ = n; }
-  void set_max_parallel_lookups(size_t n) { max_parallel_lookups_ = n; }
+  void set_max_queue_size(size_t n) {
+    max_queue_size_ = n;
+    batch_limit_ = n;
+  }
+  void set_max_parallel_lookups(size_t n) {
+    max_parallel_lookups_ = n;
+    parallel_limit_ = n;
+  }
+
+  // Enables adaptive tuning of the parallelism and batch size, starting from
+  // max_parallel_lookups and max_queue_size.  Must be called before the
+  // first Get.
+  void set_adaptive(bool x);
+  bool adaptive() const { return adaptive_; }
+
+  // The limits currently in effect; these only change in adaptive mode.
+  int parallel_limit();  // Maximum number of lookups in flight.
+  size_t batch_limit();  // Maximum number of keys in a MultiGet.
 
   int Pending();  // This is used to help synchronize tests.
 
@@ -101,17 +161,71 @@ class CacheBatcher : public CacheInterface {
   class Group;
   class BatcherCallback;
 
-  void GroupComplete();
+  // Callbacks waiting on a Get for the same key that is already queued or
+  // outstanding.  Each queued or outstanding lookup owns one, which is
+  // usually empty.  CoalescedGetMap indexes those that later Gets may still
+  // join by key; a Put or Delete of the key removes its entry, leaving the
+  // lookup to serve only the Gets that came before.
+  typedef std::vector<Callback*> CallbackVector;
+  typedef std::map<GoogleString, CallbackVector*> CoalescedGetMap;
+
+  // Called when a lookup of batch_size keys, issued at start_us during
+  // adjustment epoch, completes.
+  void GroupComplete(int64 start_us, int batch_size, int epoch);
   bool CanIssueGet() const;  // must be called with mutex_ held.
 
+  // Moves up to batch_limit_ keys from the queue into a new MultiGet request,
+  // counting it as a pending lookup, along with their arrival times and
+  // coalesced Gets.  Must be called with mutex_ held, and the queue
+  // non-empty.
+  MultiGetRequest* DequeueBatch(std::vector<int64>* queue_times_us,
+                                std::vector<CallbackVector*>* waiters);
+
+  // Sends a MultiGet built by DequeueBatch during adjustment epoch.  Must be
+  // called without the mutex held.
+  void IssueBatch(MultiGetRequest* request,
+                  const std::vector<int64>& queue_times_us,
+                  const std::vector<CallbackVector*>& waiters, int epoch);
+
+  // Adjusts parallel_limit_ and batch_limit_ given the latency of a lookup of
+  // batch_size keys issued during adjustment epoch.  saturated indicates that
+  // all the allowed lookups were in flight and Gets were queued.  Must be
+  // called with mutex_ held.
+  void AdaptLimits(int64 latency_us, int batch_size, int epoch,
+                   bool saturated);
+
+  // Called when the lookup of key completes, to hand value (which was found
+  // in state) to all the Gets that were coalesced onto it, and delete waiters.
+  void CoalescedGetsDone(const GoogleString& key, CallbackVector* waiters,
+                         CacheInterface::KeyState state, SharedString* value);
+
+  // Stops later Gets from joining the lookup of key, if there is one.
+  void DetachCoalescedGets(const GoogleString& key);
+
   CacheInterface* cache_;
+  Timer* timer_;
   scoped_ptr<AbstractMutex> mutex_;
   MultiGetRequest queue_;
+  std::vector<int64> queue_times_us_;  // When each entry in queue_ arrived.
+  std::vector<CallbackVector*> queue_waiters_;  // Parallel to queue_.
+  CoalescedGetMap in_flight_;
   int last_batch_size_;
   int pending_;
   int max_parallel_lookups_;
   size_t max_queue_size_;  // size_t so it can be compared to queue_.size().
+  bool adaptive_;
+  int parallel_limit_;
+  size_t batch_limit_;
+  int64 baseline_latency_us_;         // -1 until the first lookup completes.
+  int64 window_min_latency_us_;       // Lowest latency in the current window.
+  int window_lookups_;
+  int adapt_epoch_;  // Bumped whenever the limits are decreased.
   Variable* dropped_gets_;
+  Variable* coalesced_gets_;
+  Histogram* queue_delay_us_histogram_;
+  Histogram* batch_size_histogram_;
+  Histogram* underbatched_keys_histogram_;
+  Histogram* overbatched_latency_us_histogram_;
 
   DISALLOW_COPY_AND_ASSIGN(CacheBatcher);
 };
@@ -23,6 +23,7 @@
 #include <cstddef>
 
 #include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/mock_timer.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/thread_system.h"
@@ -61,7 +62,7 @@ class CacheBatcherTest : public CacheTestBase {
                                       thread_system_.get()));
     batcher_.reset(new CacheBatcher(delay_cache_.get(),
                                     thread_system_->NewMutex(),
-                                    statistics_.get()));
+                                    timer_.get(), statistics_.get()));
     set_mutex(thread_system_->NewMutex());
   }
 
@@ -102,6 +103,26 @@ class CacheBatcherTest : public CacheTestBase {
     }
   }
 
+  // Replaces the batcher with one that measures latencies with a MockTimer,
+  // so that tests can control what the adaptive mode sees.
+  void UseMockTimer() {
+    mock_timer_.reset(new MockTimer(thread_system_->NewMutex(), 0));
+    batcher_.reset(new CacheBatcher(delay_cache_.get(),
+                                    thread_system_->NewMutex(),
+                                    mock_timer_.get(), statistics_.get()));
+  }
+
+  // Looks up key, making the lookup appear to take delay_us.
+  void CheckGetWithLatency(const GoogleString& key,
+                           const GoogleString& expected_value,
+                           int64 delay_us) {
+    DelayKey(key);
+    Callback* callback = InitiateGet(key);
+    mock_timer_->AdvanceUs(delay_us);
+    ReleaseKey(key);
+    WaitAndCheck(callback, expected_value);
+  }
+
   void DelayKey(const GoogleString& key) {
     delay_cache_->DelayKey(key);
     ++expected_pending_;
@@ -116,6 +137,7 @@ class CacheBatcherTest : public CacheTestBase {
   scoped_ptr<ThreadSystem> thread_system_;
   scoped_ptr<ThreadsafeCache> threadsafe_cache_;
   scoped_ptr<Timer> timer_;
+  scoped_ptr<MockTimer> mock_timer_;
   scoped_ptr<QueuedWorkerPool> pool_;
   scoped_ptr<AsyncCache> async_cache_;
   scoped_ptr<DelayCache> delay_cache_;
@@ -254,4 +276,193 @@ TEST_F(CacheBatcherTest, ExceedMaxQueueAndDrop) {
   CheckGet("n4", "v4");
 }
 
+TEST_F(CacheBatcherTest, CoalesceIdenticalKeys) {
+  batcher_->set_max_parallel_lookups(1);
+
+  PopulateCache(2);
+
+  // The second lookup of "n0" joins the one already in progress, and the
+  // repeated lookups of "n1" and "not found" are queued only once each.
+  DelayKey("n0");
+  Callback* n0 = InitiateGet("n0");
+  Callback* n0_again = InitiateGet("n0");
+  Callback* n1 = InitiateGet("n1");
+  Callback* n1_again = InitiateGet("n1");
+  Callback* not_found = InitiateGet("not found");
+  Callback* not_found_again = InitiateGet("not found");
+  EXPECT_EQ(6, outstanding_fetches());
+  EXPECT_EQ(3, statistics_->GetVariable("cache_batcher_coalesced_gets")->Get());
+
+  ReleaseKey("n0");
+  WaitAndCheck(n0, "v0");
+  WaitAndCheck(n0_again, "v0");
+  WaitAndCheck(n1, "v1");
+  WaitAndCheck(n1_again, "v1");
+  WaitAndCheckNotFound(not_found);
+  WaitAndCheckNotFound(not_found_again);
+  EXPECT_EQ(0, outstanding_fetches());
+  EXPECT_EQ(2, batcher_->last_batch_size());
+
+  // Only the two queued keys waited for a batch.
+  EXPECT_EQ(2, statistics_->GetHistogram(
+      "cache_batcher_queue_delay_us")->Count());
+
+  // Once the lookup is complete, the key is fetched afresh.
+  CheckPut("n0", "new v0");
+  CheckGet("n0", "new v0");
+  EXPECT_EQ(3, statistics_->GetVariable("cache_batcher_coalesced_gets")->Get());
+}
+
+TEST_F(CacheBatcherTest, PutStopsCoalescing) {
+  batcher_->set_max_parallel_lookups(1);
+
+  PopulateCache(1);
+
+  // A Get issued after a Put must see the new value, rather than joining
+  // the lookup issued before it.
+  DelayKey("n0");
+  Callback* n0 = InitiateGet("n0");
+  CheckPut("n0", "new v0");
+  Callback* n0_after_put = InitiateGet("n0");
+  EXPECT_EQ(0, statistics_->GetVariable("cache_batcher_coalesced_gets")->Get());
+
+  ReleaseKey("n0");
+  n0->Wait();
+  EXPECT_TRUE(n0->called());
+  WaitAndCheck(n0_after_put, "new v0");
+
+  // Likewise for a Delete.
+  DelayKey("n0");
+  n0 = InitiateGet("n0");
+  CheckDelete("n0");
+  Callback* n0_after_delete = InitiateGet("n0");
+  ReleaseKey("n0");
+  n0->Wait();
+  EXPECT_TRUE(n0->called());
+  WaitAndCheckNotFound(n0_after_delete);
+  EXPECT_EQ(0, statistics_->GetVariable("cache_batcher_coalesced_gets")->Get());
+}
+
+TEST_F(CacheBatcherTest, ShutDownReportsCoalescedGets) {
+  batcher_->set_max_parallel_lookups(1);
+
+  PopulateCache(2);
+
+  DelayKey("n0");
+  Callback* n0 = InitiateGet("n0");
+  Callback* n1 = InitiateGet("n1");
+  Callback* n1_again = InitiateGet("n1");
+  EXPECT_EQ(3, outstanding_fetches());
+
+  // Shutting down drops the queued lookup of "n1", and with it the Get that
+  // was waiting on it.
+  batcher_->ShutDown();
+  WaitAndCheckNotFound(n1);
+  WaitAndCheckNotFound(n1_again);
+
+  // Depending on whether the lookup of "n0" beat the shutdown of the
+  // AsyncCache, it may or may not have been found, but it must complete.
+  ReleaseKey("n0");
+  n0->Wait();
+  EXPECT_TRUE(n0->called());
+  PostOpCleanup();
+}
+
+TEST_F(CacheBatcherTest, AdaptiveShrinksOnSlowLookup) {
+  UseMockTimer();
+  batcher_->set_max_parallel_lookups(4);
+  batcher_->set_max_queue_size(8);
+  batcher_->set_adaptive(true);
+
+  PopulateCache(2);
+
+  // A fast lookup establishes the baseline latency, and does not change the
+  // limits as nothing was waiting on them.
+  CheckGetWithLatency("n0", "v0", 0);
+  EXPECT_EQ(4, batcher_->parallel_limit());
+  EXPECT_EQ(static_cast<size_t>(8), batcher_->batch_limit());
+
+  // A lookup taking far longer than that halves both limits.
+  CheckGetWithLatency("n1", "v1", 10 * CacheBatcher::kAdaptiveLatencySlackUs);
+  EXPECT_EQ(2, batcher_->parallel_limit());
+  EXPECT_EQ(static_cast<size_t>(4), batcher_->batch_limit());
+  EXPECT_EQ(1, statistics_->GetHistogram(
+      "cache_batcher_overbatched_latency_us")->Count());
+}
+
+TEST_F(CacheBatcherTest, AdaptiveShrinksOncePerEpoch) {
+  UseMockTimer();
+  batcher_->set_max_parallel_lookups(8);
+  batcher_->set_max_queue_size(16);
+  batcher_->set_adaptive(true);
+
+  PopulateCache(5);
+  CheckGetWithLatency("n0", "v0", 0);
+
+  // Three lookups issued together all turn out slow.  They were sized by the
+  // same limits, so those are halved once, not three times.
+  DelayKey("n1");
+  DelayKey("n2");
+  DelayKey("n3");
+  Callback* n1 = InitiateGet("n1");
+  Callback* n2 = InitiateGet("n2");
+  Callback* n3 = InitiateGet("n3");
+  mock_timer_->AdvanceUs(10 * CacheBatcher::kAdaptiveLatencySlackUs);
+  ReleaseKey("n1");
+  WaitAndCheck(n1, "v1");
+  ReleaseKey("n2");
+  WaitAndCheck(n2, "v2");
+  ReleaseKey("n3");
+  WaitAndCheck(n3, "v3");
+  EXPECT_EQ(4, batcher_->parallel_limit());
+  EXPECT_EQ(static_cast<size_t>(8), batcher_->batch_limit());
+  EXPECT_EQ(3, statistics_->GetHistogram(
+      "cache_batcher_overbatched_latency_us")->Count());
+
+  // A slow lookup issued under the new limits halves them again.
+  CheckGetWithLatency("n4", "v4", 10 * CacheBatcher::kAdaptiveLatencySlackUs);
+  EXPECT_EQ(2, batcher_->parallel_limit());
+  EXPECT_EQ(static_cast<size_t>(4), batcher_->batch_limit());
+}
+
+TEST_F(CacheBatcherTest, AdaptiveGrowsWhenSaturated) {
+  UseMockTimer();
+  batcher_->set_max_parallel_lookups(1);
+  batcher_->set_max_queue_size(4);
+  batcher_->set_adaptive(true);
+
+  PopulateCache(6);
+
+  // Shrink the batch limit to 2 with a slow lookup.
+  CheckGetWithLatency("n0", "v0", 0);
+  CheckGetWithLatency("n1", "v1", 10 * CacheBatcher::kAdaptiveLatencySlackUs);
+  EXPECT_EQ(1, batcher_->parallel_limit());
+  EXPECT_EQ(static_cast<size_t>(2), batcher_->batch_limit());
+
+  // Now queue up three keys behind "n2".  When "n2" completes quickly with
+  // all the allowed lookups in use and keys waiting, a second parallel lookup
+  // is allowed.  The queued keys are more than one batch can take, so they
+  // go out as two MultiGets, in parallel.
+  DelayKey("n2");
+  Callback* n2 = InitiateGet("n2");
+  Callback* n3 = InitiateGet("n3");
+  Callback* n4 = InitiateGet("n4");
+  Callback* n5 = InitiateGet("n5");
+  ReleaseKey("n2");
+  WaitAndCheck(n2, "v2");
+  WaitAndCheck(n3, "v3");
+  WaitAndCheck(n4, "v4");
+  WaitAndCheck(n5, "v5");
+  EXPECT_EQ(0, outstanding_fetches());
+  EXPECT_EQ(1, batcher_->last_batch_size());
+  EXPECT_EQ(2, batcher_->parallel_limit());
+  EXPECT_EQ(2, statistics_->GetHistogram("cache_batcher_batch_size")->Count());
+  EXPECT_EQ(1, statistics_->GetHistogram(
+      "cache_batcher_underbatched_keys")->Count());
+
+  // The full batch of two completed quickly, so the batch limit grew back,
+  // up to the queue size.
+  EXPECT_EQ(static_cast<size_t>(4), batcher_->batch_limit());
+}
+
 }  // namespace net_instaweb
@@ -56,6 +56,12 @@ CollapseWhitespaceFilter::CollapseWhitespaceFilter(HtmlParse* html_parse)
 
 CollapseWhitespaceFilter::~CollapseWhitespaceFilter() {}
 
+const HtmlName::Keyword* CollapseWhitespaceFilter::ElementKeywords(
+    int* num_keywords) const {
+  *num_keywords = arraysize(kSensitiveTags);
+  return kSensitiveTags;
+}
+
 void CollapseWhitespaceFilter::StartDocument() {
   keyword_stack_.clear();
 }
@@ -48,6 +48,11 @@ class CollapseWhitespaceFilter : public EmptyHtmlFilter {
   virtual void StartElement(HtmlElement* element);
   virtual void EndElement(HtmlElement* element);
   virtual void Characters(HtmlCharactersNode* characters);
+  virtual int EventMask() const {
+    return kStartElementEvent | kEndElementEvent | kCharactersEvent;
+  }
+  virtual const HtmlName::Keyword* ElementKeywords(int* num_keywords) const;
+  virtual bool CanShareFlushPass() const { return true; }
   virtual const char* Name() const { return "CollapseWhitespace"; }
 
  private:
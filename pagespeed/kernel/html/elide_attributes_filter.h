@@ -37,6 +37,8 @@ class ElideAttributesFilter : public EmptyHtmlFilter {
   virtual ~ElideAttributesFilter();
 
   virtual void StartElement(HtmlElement* element);
+  virtual int EventMask() const { return kStartElementEvent; }
+  virtual bool CanShareFlushPass() const { return true; }
   virtual const char* Name() const { return "ElideAttributes"; }
 
  private:
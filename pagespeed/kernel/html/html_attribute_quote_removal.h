@@ -46,6 +46,8 @@ class HtmlAttributeQuoteRemoval : public EmptyHtmlFilter {
   // Given context in object, does attribute value val require quotes?
   bool NeedsQuotes(const char *val);
   virtual void StartElement(HtmlElement* element);
+  virtual int EventMask() const { return kStartElementEvent; }
+  virtual bool CanShareFlushPass() const { return true; }
   // # of quote pairs removed from attributes in *all* documents processed.
   int total_quotes_removed() const {
     return total_quotes_removed_;
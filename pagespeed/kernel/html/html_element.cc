@@ -54,6 +54,9 @@ HtmlElement::Data::Data(const HtmlName& name,
 HtmlElement::Data::~Data() {
 }
 
+HtmlElement::AttributeCache::~AttributeCache() {
+}
+
 void HtmlElement::MarkAsDead(const HtmlEventListIterator& end) {
   if (data_.get() != NULL) {
     data_->live_ = false;
@@ -171,12 +174,14 @@ void HtmlElement::AddAttribute(const Attribute& src_attr) {
   Attribute* attr = new Attribute(src_attr.name(),
                                   src_attr.escaped_value(),
                                   src_attr.quote_style());
+  attr->escaped_value_encoding_ = src_attr.escaped_value_encoding_;
   if (src_attr.decoded_value_computed_) {
     attr->decoded_value_computed_ = true;
     attr->decoding_error_ = src_attr.decoding_error_;
     Attribute::CopyValue(src_attr.decoded_value_.get(), &attr->decoded_value_);
   }
   data_->attributes_.Append(attr);
+  ClearAttributeCache();
 }
 
 void HtmlElement::AddAttribute(const HtmlName& name,
@@ -186,10 +191,12 @@ void HtmlElement::AddAttribute(const HtmlName& name,
   Attribute* attr = new Attribute(name,
                                   HtmlKeywords::Escape(decoded_value, &buf),
                                   quote_style);
+  attr->escaped_value_encoding_ = kAsciiText;
   attr->decoded_value_computed_ = true;
   attr->decoding_error_ = false;
   Attribute::CopyValue(decoded_value, &attr->decoded_value_);
   data_->attributes_.Append(attr);
+  ClearAttributeCache();
 }
 
 void HtmlElement::AddEscapedAttribute(const HtmlName& name,
@@ -197,6 +204,7 @@ void HtmlElement::AddEscapedAttribute(const HtmlName& name,
                                       QuoteStyle quote_style) {
   Attribute* attr = new Attribute(name, escaped_value, quote_style);
   data_->attributes_.Append(attr);
+  ClearAttributeCache();
 }
 
 void HtmlElement::Attribute::CopyValue(const StringPiece& src,
@@ -218,6 +226,7 @@ HtmlElement::Attribute::Attribute(const HtmlName& name,
                                   QuoteStyle quote_style)
     : name_(name),
       quote_style_(quote_style),
+      escaped_value_encoding_(kUnknownTextEncoding),
       decoding_error_(false),
       decoded_value_computed_(false) {
   CopyValue(escaped_value, &escaped_value_);
@@ -237,6 +246,7 @@ void HtmlElement::Attribute::SetValue(const StringPiece& decoded_value) {
       << "Setting unescaped value from substring of escaped value.";
   CopyValue(HtmlKeywords::Escape(decoded_value, &buf), &escaped_value_);
   CopyValue(decoded_value, &decoded_value_);
+  escaped_value_encoding_ = kAsciiText;
 }
 
 void HtmlElement::Attribute::SetEscapedValue(const StringPiece& escaped_value) {
@@ -254,6 +264,7 @@ void HtmlElement::Attribute::SetEscapedValue(const StringPiece& escaped_value) {
   decoded_value_.reset();
   decoding_error_ = false;
   decoded_value_computed_ = false;
+  escaped_value_encoding_ = kUnknownTextEncoding;
 
   CopyValue(escaped_value, &escaped_value_);
 }
@@ -270,12 +281,33 @@ const char* HtmlElement::Attribute::quote_str() const {
   }
 }
 
+TextEncoding HtmlElement::Attribute::escaped_value_encoding() const {
+  if (escaped_value_encoding_ == kUnknownTextEncoding) {
+    escaped_value_encoding_ = (escaped_value_.get() == NULL) ? kAsciiText :
+        ClassifyTextEncoding(escaped_value_.get());
+  }
+  return escaped_value_encoding_;
+}
+
 void HtmlElement::Attribute::ComputeDecodedValue() const {
+  if ((escaped_value_encoding_ == kUtf8Text) ||
+      (escaped_value_encoding_ == kNonUtf8Text)) {
+    // We already know there are 8-bit characters, which we can't decode, so
+    // don't scan for them again.
+    decoded_value_.reset();
+    decoding_error_ = true;
+    decoded_value_computed_ = true;
+    return;
+  }
   GoogleString buf;
   StringPiece unescaped_value = HtmlKeywords::Unescape(
       escaped_value_.get(), &buf, &decoding_error_);
   CopyValue(unescaped_value, &decoded_value_);
   decoded_value_computed_ = true;
+  if (!decoding_error_) {
+    // Decoding fails on any 8-bit character, so now we know this too.
+    escaped_value_encoding_ = kAsciiText;
+  }
 }
 
 }  // namespace net_instaweb
@@ -130,6 +130,12 @@ class HtmlElement : public HtmlNode {
       return decoding_error_;
     }
 
+    // The encoding of escaped_value(), classified on the first call and
+    // kept until the value changes.  Values set from decoded ones are known
+    // to be kAsciiText without a scan, as escaping leaves no 8-bit
+    // characters.
+    TextEncoding escaped_value_encoding() const;
+
     // See comment about quote on constructor for Attribute.
     // Returns the quotation mark associated with this URL.
     QuoteStyle quote_style() const { return quote_style_; }
@@ -180,6 +186,7 @@ class HtmlElement : public HtmlNode {
 
     HtmlName name_;
     QuoteStyle quote_style_ : 8;
+    mutable TextEncoding escaped_value_encoding_ : 8;
     mutable bool decoding_error_;
     mutable bool decoded_value_computed_;
 
@@ -218,6 +225,23 @@ class HtmlElement : public HtmlNode {
   typedef InlineSList<Attribute>::Iterator AttributeIterator;
   typedef InlineSList<Attribute>::ConstIterator AttributeConstIterator;
 
+  // Something computed from an element's name and attributes that several
+  // filters would otherwise each recompute.  There is one slot per element,
+  // used by resource_tag_scanner::ScanElement for the categories of the
+  // element's url-valued attributes.  The element owns its cache, and drops
+  // it whenever its name or attribute list changes through this class, which
+  // includes any call to mutable_attributes().  Changes made directly to an
+  // Attribute, such as SetValue(), are not seen, so a cache must not depend
+  // on them without checking.
+  class AttributeCache {
+   public:
+    AttributeCache() {}
+    virtual ~AttributeCache();
+
+   private:
+    DISALLOW_COPY_AND_ASSIGN(AttributeCache);
+  };
+
   virtual ~HtmlElement();
 
   // Determines whether this node is still accessible via API.  Note that
@@ -321,10 +345,26 @@ class HtmlElement : public HtmlNode {
   // Changing that tag of an element should only occur if the caller knows
   // that the old attributes make sense for the new tag.  E.g. a div could
   // be changed to a span.
-  void set_name(const HtmlName& new_tag) { data_->name_ = new_tag; }
+  void set_name(const HtmlName& new_tag) {
+    data_->name_ = new_tag;
+    ClearAttributeCache();
+  }
 
   const AttributeList& attributes() const { return data_->attributes_; }
-  AttributeList* mutable_attributes() { return &data_->attributes_; }
+  AttributeList* mutable_attributes() {
+    ClearAttributeCache();
+    return &data_->attributes_;
+  }
+
+  // Returns the cache installed by set_attribute_cache, or NULL if there is
+  // none or it has been dropped since.
+  AttributeCache* attribute_cache() const {
+    return data_->attribute_cache_.get();
+  }
+  // Takes ownership of cache, replacing any previous one.
+  void set_attribute_cache(AttributeCache* cache) {
+    data_->attribute_cache_.reset(cache);
+  }
 
   friend class HtmlParse;
   friend class HtmlLexer;
@@ -380,6 +420,7 @@ class HtmlElement : public HtmlNode {
     AttributeList attributes_;
     HtmlEventListIterator begin_;
     HtmlEventListIterator end_;
+    scoped_ptr<AttributeCache> attribute_cache_;
   };
 
   // Begin/end event iterators are used by HtmlParse to keep track
@@ -403,6 +444,8 @@ class HtmlElement : public HtmlNode {
   // is deleted.
   void FreeData() { data_.reset(NULL); }
 
+  void ClearAttributeCache() { data_->attribute_cache_.reset(NULL); }
+
   scoped_ptr<Data> data_;
 
   DISALLOW_COPY_AND_ASSIGN(HtmlElement);
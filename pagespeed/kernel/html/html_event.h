@@ -30,7 +30,9 @@ namespace net_instaweb {
 
 class HtmlEvent {
  public:
-  explicit HtmlEvent(int line_number) : line_number_(line_number) {
+  HtmlEvent(int line_number, HtmlFilter::EventKind kind)
+      : line_number_(line_number),
+        kind_(kind) {
   }
   virtual ~HtmlEvent();
   virtual void Run(HtmlFilter* filter) = 0;
@@ -51,15 +53,20 @@ class HtmlEvent {
 
   int line_number() const { return line_number_; }
 
+  // Which of the HtmlFilter handlers Run() calls.
+  HtmlFilter::EventKind kind() const { return kind_; }
+
  private:
   int line_number_;
+  HtmlFilter::EventKind kind_;
 
   DISALLOW_COPY_AND_ASSIGN(HtmlEvent);
 };
 
 class HtmlStartDocumentEvent: public HtmlEvent {
  public:
-  explicit HtmlStartDocumentEvent(int line_number) : HtmlEvent(line_number) {}
+  explicit HtmlStartDocumentEvent(int line_number)
+      : HtmlEvent(line_number, HtmlFilter::kDocumentEvents) {}
   virtual void Run(HtmlFilter* filter) { filter->StartDocument(); }
   virtual GoogleString ToString() const { return "StartDocument"; }
 
@@ -69,7 +76,8 @@ class HtmlStartDocumentEvent: public HtmlEvent {
 
 class HtmlEndDocumentEvent: public HtmlEvent {
  public:
-  explicit HtmlEndDocumentEvent(int line_number) : HtmlEvent(line_number) {}
+  explicit HtmlEndDocumentEvent(int line_number)
+      : HtmlEvent(line_number, HtmlFilter::kDocumentEvents) {}
   virtual void Run(HtmlFilter* filter) { filter->EndDocument(); }
   virtual GoogleString ToString() const { return "EndDocument"; }
 
@@ -80,7 +88,7 @@ class HtmlEndDocumentEvent: public HtmlEvent {
 class HtmlStartElementEvent: public HtmlEvent {
  public:
   HtmlStartElementEvent(HtmlElement* element, int line_number)
-      : HtmlEvent(line_number),
+      : HtmlEvent(line_number, HtmlFilter::kStartElementEvent),
         element_(element) {
   }
   virtual void Run(HtmlFilter* filter) { filter->StartElement(element_); }
@@ -98,7 +106,7 @@ class HtmlStartElementEvent: public HtmlEvent {
 class HtmlEndElementEvent: public HtmlEvent {
  public:
   HtmlEndElementEvent(HtmlElement* element, int line_number)
-      : HtmlEvent(line_number),
+      : HtmlEvent(line_number, HtmlFilter::kEndElementEvent),
         element_(element) {
   }
   virtual void Run(HtmlFilter* filter) { filter->EndElement(element_); }
@@ -115,7 +123,8 @@ class HtmlEndElementEvent: public HtmlEvent {
 
 class HtmlLeafNodeEvent: public HtmlEvent {
  public:
-  explicit HtmlLeafNodeEvent(int line_number) : HtmlEvent(line_number) { }
+  HtmlLeafNodeEvent(int line_number, HtmlFilter::EventKind kind)
+      : HtmlEvent(line_number, kind) { }
   virtual HtmlNode* GetNode() { return GetLeafNode(); }
 
  private:
@@ -125,7 +134,7 @@ class HtmlLeafNodeEvent: public HtmlEvent {
 class HtmlIEDirectiveEvent: public HtmlLeafNodeEvent {
  public:
   HtmlIEDirectiveEvent(HtmlIEDirectiveNode* directive, int line_number)
-      : HtmlLeafNodeEvent(line_number),
+      : HtmlLeafNodeEvent(line_number, HtmlFilter::kIEDirectiveEvent),
         directive_(directive) {
   }
   virtual void Run(HtmlFilter* filter) { filter->IEDirective(directive_); }
@@ -142,7 +151,7 @@ class HtmlIEDirectiveEvent: public HtmlLeafNodeEvent {
 class HtmlCdataEvent: public HtmlLeafNodeEvent {
  public:
   HtmlCdataEvent(HtmlCdataNode* cdata, int line_number)
-      : HtmlLeafNodeEvent(line_number),
+      : HtmlLeafNodeEvent(line_number, HtmlFilter::kCdataEvent),
         cdata_(cdata) {
   }
   virtual void Run(HtmlFilter* filter) { filter->Cdata(cdata_); }
@@ -159,7 +168,7 @@ class HtmlCdataEvent: public HtmlLeafNodeEvent {
 class HtmlCommentEvent: public HtmlLeafNodeEvent {
  public:
   HtmlCommentEvent(HtmlCommentNode* comment, int line_number)
-      : HtmlLeafNodeEvent(line_number),
+      : HtmlLeafNodeEvent(line_number, HtmlFilter::kCommentEvent),
         comment_(comment) {
   }
   virtual void Run(HtmlFilter* filter) { filter->Comment(comment_); }
@@ -177,7 +186,7 @@ class HtmlCommentEvent: public HtmlLeafNodeEvent {
 class HtmlCharactersEvent: public HtmlLeafNodeEvent {
  public:
   HtmlCharactersEvent(HtmlCharactersNode* characters, int line_number)
-      : HtmlLeafNodeEvent(line_number),
+      : HtmlLeafNodeEvent(line_number, HtmlFilter::kCharactersEvent),
         characters_(characters) {
   }
   virtual void Run(HtmlFilter* filter) { filter->Characters(characters_); }
@@ -195,7 +204,7 @@ class HtmlCharactersEvent: public HtmlLeafNodeEvent {
 class HtmlDirectiveEvent: public HtmlLeafNodeEvent {
  public:
   HtmlDirectiveEvent(HtmlDirectiveNode* directive, int line_number)
-      : HtmlLeafNodeEvent(line_number),
+      : HtmlLeafNodeEvent(line_number, HtmlFilter::kDirectiveEvent),
         directive_(directive) {
   }
   virtual void Run(HtmlFilter* filter) { filter->Directive(directive_); }
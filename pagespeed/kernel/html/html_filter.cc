@@ -18,6 +18,10 @@
 
 #include "pagespeed/kernel/html/html_filter.h"
 
+#include <cstddef>
+
+#include "pagespeed/kernel/html/html_name.h"
+
 namespace net_instaweb {
 
 HtmlFilter::HtmlFilter() : is_enabled_(true) {
@@ -29,4 +33,24 @@ HtmlFilter::~HtmlFilter() {
 void HtmlFilter::RenderDone() {
 }
 
+int HtmlFilter::EventMask() const {
+  return kAllEvents;
+}
+
+const HtmlName::Keyword* HtmlFilter::ElementKeywords(int* num_keywords) const {
+  return NULL;
+}
+
+bool HtmlFilter::CanShareFlushPass() const {
+  return false;
+}
+
+bool HtmlFilter::NeedsCompleteHead() const {
+  return false;
+}
+
+bool HtmlFilter::AcceptsRawMarkup() const {
+  return false;
+}
+
 }  // namespace net_instaweb
@@ -20,6 +20,7 @@
 #define PAGESPEED_KERNEL_HTML_HTML_FILTER_H_
 
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/html/html_name.h"
 
 namespace net_instaweb {
 
@@ -34,6 +35,19 @@ class HtmlIEDirectiveNode;
 // class and register with HtmlParse::AddFilter to use the HTML Parser.
 class HtmlFilter {
  public:
+  // The kinds of event a filter can ask for in EventMask().
+  enum EventKind {
+    kDocumentEvents = 1 << 0,  // StartDocument and EndDocument; always sent.
+    kStartElementEvent = 1 << 1,
+    kEndElementEvent = 1 << 2,
+    kCdataEvent = 1 << 3,
+    kCommentEvent = 1 << 4,
+    kIEDirectiveEvent = 1 << 5,
+    kCharactersEvent = 1 << 6,
+    kDirectiveEvent = 1 << 7,
+    kAllEvents = (1 << 8) - 1
+  };
+
   HtmlFilter();
   virtual ~HtmlFilter();
 
@@ -103,9 +117,51 @@ class HtmlFilter {
   // Returns whether a filter is enabled.
   bool is_enabled() const { return is_enabled_; }
 
+  // Returns the EventKinds whose handlers do something in this filter.
+  // HtmlParse does not call the handlers for other kinds of event, so a
+  // filter must only leave out kinds it ignores.  Default is kAllEvents.
+  virtual int EventMask() const;
+
+  // A filter that only handles a few elements can return an array of their
+  // keywords here, setting *num_keywords, and StartElement and EndElement
+  // will only be called for those.  The default, NULL, means all elements.
+  // Called at the start of every pass over a flush window.
+  virtual const HtmlName::Keyword* ElementKeywords(int* num_keywords) const;
+
+  // Returns true if HtmlParse may run this filter in the same walk over the
+  // flush window as adjacent filters that also return true, which passes
+  // each event to all of them before moving on to the next event.  That
+  // only gives the same result as walking the window once per filter if,
+  // in its handlers and Flush(), each such filter:
+  //   - adds, removes, moves and defers no nodes;
+  //   - changes nothing but the attributes of the element passed to
+  //     StartElement, or the contents of the node passed to a leaf handler;
+  //   - looks at other nodes, including the element passed to EndElement,
+  //     only for their names, close style and place in the tree.
+  // Defaults to false.
+  virtual bool CanShareFlushPass() const;
+
+  // Returns true if the filter does much better when the whole <head> is in
+  // one flush window, e.g. because it combines the resources there.  Flushes
+  // the server injects of its own accord are held back until the end of the
+  // <head> while such a filter is enabled; flushes from upstream are not.
+  // Defaults to false.
+  virtual bool NeedsCompleteHead() const;
+
+  // Returns true if the filter is just as happy to see a run of markup as
+  // one Characters node holding the raw bytes, as the writer is, except for
+  // any elements it lists in ElementKeywords().  Such filters don't stop
+  // HtmlParse from prescanning the rest of the markup; see
+  // HtmlParse::set_prescan_uninteresting_markup.  Defaults to false.
+  virtual bool AcceptsRawMarkup() const;
+
   // The name of this filter -- used for logging and debugging.
   virtual const char* Name() const = 0;
 
+  // Labels the samples taken while this filter runs in a SamplingProfiler
+  // profile.  Defaults to Name().
+  virtual const char* ProfileLabel() const { return Name(); }
+
  protected:
   void set_is_enabled(bool is_enabled) { is_enabled_ = is_enabled; }
 
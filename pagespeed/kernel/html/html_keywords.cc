@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <map>
 #include <utility>
 
@@ -373,6 +374,90 @@ const char kParagraphTerminators[] =
 // TODO(jmarantz): handle & test Ruby containment.
 // const char kRubyElements[] = "ruby rt rp ";
 
+// Attribute values and text are mostly long runs of bytes that Escape and
+// Unescape pass through unchanged.  To copy such runs in bulk rather than
+// byte by byte, we scan for the end of a run eight bytes at a time, using
+// the bit tricks from http://graphics.stanford.edu/~seander/bithacks.html .
+// Each of the Word functions below is nonzero iff the predicate holds for
+// some byte of the word; a word for which any is nonzero is then examined
+// byte by byte.
+typedef uint64 Word;
+const Word kLowBits = 0x0101010101010101ULL;
+const Word kHighBits = 0x8080808080808080ULL;
+
+// Some byte of x is less than n, which must be at most 128.
+inline Word HasByteLessThan(Word x, uint8 n) {
+  return (x - kLowBits * n) & ~x & kHighBits;
+}
+
+// Some byte of x is equal to c.
+inline Word HasByte(Word x, uint8 c) {
+  return HasByteLessThan(x ^ (kLowBits * c), 1);
+}
+
+// Some byte of x is above 127.
+inline Word Has8BitByte(Word x) {
+  return x & kHighBits;
+}
+
+inline Word LoadWord(const char* p) {
+  Word x;
+  memcpy(&x, p, sizeof(x));  // p need not be aligned.
+  return x;
+}
+
+// Whether EscapeHelper must escape ch.
+//
+// According to http://www.htmlescape.net/htmlescape_tool.html,
+// single-quote does not need to be escaped.  However, input HTML
+// might have used single-quote to quote attribute values, in
+// which case we better escape any single-quotes in the value.
+//
+// This function, unfortunately, does not know what quoting was used.
+// TODO(jmarantz): in remove_quotes filter, switch between ' and " for
+// quoting based on whatever is in the attr value.
+inline bool NeedsEscape(uint8 ch) {
+  return (!IsHtmlSpace(ch) &&
+          ((ch > 127) || (ch < 32) || (ch == '"') || (ch == '\'') ||
+           (ch == '&') || (ch == '<') || (ch == '>')));
+}
+
+// Returns the number of bytes at the start of [s, s + size) that
+// EscapeHelper copies unchanged.
+size_t SpanNotNeedingEscape(const char* s, size_t size) {
+  size_t i = 0;
+  for (; i + sizeof(Word) <= size; i += sizeof(Word)) {
+    Word x = LoadWord(s + i);
+    // HTML spaces other than ' ' are below 32, so a word with a newline or
+    // tab in it goes the slow way, though they don't need escaping.
+    if (Has8BitByte(x) | HasByteLessThan(x, 32) | HasByte(x, '"') |
+        HasByte(x, '\'') | HasByte(x, '&') | HasByte(x, '<') |
+        HasByte(x, '>')) {
+      break;
+    }
+  }
+  while ((i < size) && !NeedsEscape(static_cast<uint8>(s[i]))) {
+    ++i;
+  }
+  return i;
+}
+
+// Returns the number of bytes at the start of [s, s + size) that are
+// neither '&' nor 8-bit.
+size_t SpanWithoutAmpersandOr8Bit(const char* s, size_t size) {
+  size_t i = 0;
+  for (; i + sizeof(Word) <= size; i += sizeof(Word)) {
+    Word x = LoadWord(s + i);
+    if (Has8BitByte(x) | HasByte(x, '&')) {
+      break;
+    }
+  }
+  while ((i < size) && (s[i] != '&') && (static_cast<uint8>(s[i]) <= 127)) {
+    ++i;
+  }
+  return i;
+}
+
 }  // namespace
 
 HtmlKeywords* HtmlKeywords::singleton_ = NULL;
@@ -463,18 +548,14 @@ StringPiece HtmlKeywords::UnescapeHelper(const StringPiece& escaped,
   }
   *decoding_error = true;
 
-  // It would be nice to short-circuit the loop below via a memchr
-  // looking for "&".  Unfortunately we must at least also scan for
-  // 8-bit characters, as we cannot unescape those in a manner that's
-  // bidirectionally safe.  Consider CanonicalAttributesTest.Spanish,
-  // where a non-utf8 multi-byte 8-bit character is present.  If we
-  // short-circuit looking for "&" we'll wind up escaping each piece
-  // of the multi-byte sequence individually and that will not reverse
-  // properly.
-  // if (memchr(escaped.data(), '&', escaped.size()) == NULL) {
-  //   return escaped;
-  // }
-
+  // We can't short-circuit the loop below via a memchr looking for
+  // "&".  We must also scan for 8-bit characters, as we cannot unescape
+  // those in a manner that's bidirectionally safe.  Consider
+  // CanonicalAttributesTest.Spanish, where a non-utf8 multi-byte 8-bit
+  // character is present.  If we short-circuit looking for "&" we'll wind
+  // up escaping each piece of the multi-byte sequence individually and
+  // that will not reverse properly.  So outside of escapes we skip over
+  // runs with neither, with SpanWithoutAmpersandOr8Bit.
   buf->clear();
 
   // Attribute values may have HTML escapes in them, e.g.
@@ -488,6 +569,17 @@ StringPiece HtmlKeywords::UnescapeHelper(const StringPiece& escaped,
   bool in_escape = false;
   bool found_ampersand = false;
   for (size_t i = 0; i < escaped.size(); ++i) {
+    if (!in_escape) {
+      size_t run = SpanWithoutAmpersandOr8Bit(escaped.data() + i,
+                                              escaped.size() - i);
+      if (found_ampersand) {
+        buf->append(escaped.data() + i, run);
+      }
+      i += run;
+      if (i == escaped.size()) {
+        break;
+      }
+    }
     uint8 ch = static_cast<uint8>(escaped[i]);
     if (!in_escape) {
       if (ch == '&') {
@@ -500,10 +592,9 @@ StringPiece HtmlKeywords::UnescapeHelper(const StringPiece& escaped,
         numeric_value = 0;
         accumulate_numeric_code = false;
         hex_mode = false;
-      } else if (ch > 127) {
+      } else {
+        DCHECK_LT(127, ch);
         return StringPiece(NULL, 0);
-      } else if (found_ampersand) {
-        *buf += ch;
       }
     } else if (escape.empty() && (ch == '#')) {
       escape += ch;
@@ -648,31 +739,25 @@ StringPiece HtmlKeywords::EscapeHelper(const StringPiece& unescaped,
 
   GoogleString char_to_escape;
   for (size_t i = 0; i < unescaped.size(); ++i) {
+    size_t run = SpanNotNeedingEscape(unescaped.data() + i,
+                                      unescaped.size() - i);
+    buf->append(unescaped.data() + i, run);
+    i += run;
+    if (i == unescaped.size()) {
+      break;
+    }
     int ch = static_cast<unsigned char>(unescaped[i]);
-    // According to http://www.htmlescape.net/htmlescape_tool.html,
-    // single-quote does not need to be escaped.  However, input HTML
-    // might have used single-quote to quote attribute values, in
-    // which case we better escape any single-quotes in the value.
-    //
-    // This function, unfortunately, does not know what quoting was used.
-    // TODO(jmarantz): in remove_quotes filter, switch between ' and " for
-    // quoting based on whatever is in the attr value.
-    if (!IsHtmlSpace(ch) &&
-        ((ch > 127) || (ch < 32) || (ch == '"') || (ch == '\'') ||
-         (ch == '&') || (ch == '<') || (ch == '>'))) {
-      char_to_escape.clear();
-      char_to_escape += ch;
-      StringStringSparseHashMapSensitive::const_iterator p =
-          escape_map_.find(char_to_escape);
-      if (p == escape_map_.end()) {
-        StringAppendF(buf, "&#%02d;", static_cast<int>(ch));
-      } else {
-        *buf += '&';
-        *buf += p->second;
-        *buf += ';';
-      }
+    DCHECK(NeedsEscape(ch));
+    char_to_escape.clear();
+    char_to_escape += ch;
+    StringStringSparseHashMapSensitive::const_iterator p =
+        escape_map_.find(char_to_escape);
+    if (p == escape_map_.end()) {
+      StringAppendF(buf, "&#%02d;", static_cast<int>(ch));
     } else {
-      *buf += unescaped[i];
+      *buf += '&';
+      *buf += p->second;
+      *buf += ';';
     }
   }
   return StringPiece(*buf);
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Escapes and unescapes every attribute value found in the HTML testdata.
+// Per iteration, before and after Escape and Unescape learned to skip over
+// runs of plain bytes a word at a time:
+//
+// Benchmark                    Before(us)   After(us)
+// ---------------------------------------------------
+// BM_EscapeAttributes                 200          65
+// BM_UnescapeAttributes               120          31
+
+#include "pagespeed/kernel/html/html_keywords.h"
+
+#include <algorithm>
+#include <cstdlib>  // for exit
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/stdio_file_system.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/html/empty_html_filter.h"
+#include "pagespeed/kernel/html/html_element.h"
+#include "pagespeed/kernel/html/html_parse.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Collects the escaped and decoded values of every attribute in a document.
+class AttributeCollector : public EmptyHtmlFilter {
+ public:
+  AttributeCollector(StringVector* escaped, StringVector* decoded)
+      : escaped_(escaped), decoded_(decoded) {}
+
+  virtual void StartElement(HtmlElement* element) {
+    const HtmlElement::AttributeList& attrs = element->attributes();
+    for (HtmlElement::AttributeConstIterator i(attrs.begin());
+         i != attrs.end(); ++i) {
+      const HtmlElement::Attribute& attr = *i;
+      if (attr.escaped_value() != NULL) {
+        escaped_->push_back(attr.escaped_value());
+      }
+      if (attr.DecodedValueOrNull() != NULL) {
+        decoded_->push_back(attr.DecodedValueOrNull());
+      }
+    }
+  }
+  virtual const char* Name() const { return "AttributeCollector"; }
+
+ private:
+  StringVector* escaped_;
+  StringVector* decoded_;
+
+  DISALLOW_COPY_AND_ASSIGN(AttributeCollector);
+};
+
+// Lazily parse all the HTML in testdata and grab its attribute values.
+// As with the text in html_parse_speed_test.cc, these are never freed.
+StringVector* sEscapedValues = NULL;
+StringVector* sDecodedValues = NULL;
+void GetAttributeValues() {
+  if (sEscapedValues != NULL) {
+    return;
+  }
+  sEscapedValues = new StringVector;
+  sDecodedValues = new StringVector;
+  StdioFileSystem file_system;
+  StringVector files;
+  GoogleMessageHandler handler;
+  static const char kDir[] = "net/instaweb/htmlparse/testdata";
+  if (!file_system.ListContents(kDir, &files, &handler)) {
+    LOG(ERROR) << "Unable to find test data for HTML benchmark, skipping";
+    return;
+  }
+  std::sort(files.begin(), files.end());
+  NullMessageHandler null_handler;
+  HtmlParse parser(&null_handler);
+  AttributeCollector collector(sEscapedValues, sDecodedValues);
+  parser.AddFilter(&collector);
+  for (int i = 0, n = files.size(); i < n; ++i) {
+    if (!StringPiece(files[i]).ends_with(".html")) {
+      continue;
+    }
+    GoogleString buffer;
+    if (!file_system.ReadFile(files[i].c_str(), &buffer, &handler)) {
+      LOG(ERROR) << "Unable to open:" << files[i];
+      exit(1);
+    }
+    parser.StartParse("http://example.com/benchmark");
+    parser.ParseText(buffer);
+    parser.FinishParse();
+  }
+}
+
+static void BM_EscapeAttributes(int iters) {
+  StopBenchmarkTiming();
+  HtmlKeywords::Init();
+  GetAttributeValues();
+  if (sDecodedValues->empty()) {
+    return;
+  }
+  GoogleString buf;
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0, n = sDecodedValues->size(); j < n; ++j) {
+      HtmlKeywords::Escape((*sDecodedValues)[j], &buf);
+    }
+  }
+}
+BENCHMARK(BM_EscapeAttributes);
+
+static void BM_UnescapeAttributes(int iters) {
+  StopBenchmarkTiming();
+  HtmlKeywords::Init();
+  GetAttributeValues();
+  if (sEscapedValues->empty()) {
+    return;
+  }
+  GoogleString buf;
+  bool decoding_error;
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0, n = sEscapedValues->size(); j < n; ++j) {
+      HtmlKeywords::Unescape((*sEscapedValues)[j], &buf, &decoding_error);
+    }
+  }
+}
+BENCHMARK(BM_UnescapeAttributes);
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -5,6 +5,7 @@
 
 #include "pagespeed/kernel/html/html_keywords.h"
 
+#include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/gtest.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -291,4 +292,36 @@ TEST_F(HtmlKeywordsTest, WhitespaceNotChanged) {
   Unchanged("a\fb");
 }
 
+TEST_F(HtmlKeywordsTest, LongRuns) {
+  // Escape and Unescape skip over runs of plain text several bytes at a
+  // time, so put each special character at every offset in a long string,
+  // and make sure the text on either side of it comes through.
+  const char kPlain[] = "http://example.com/a/long/path/to/image.png?w=100";
+  const GoogleString plain(kPlain);
+  const char* kSpecials[][2] = {
+    {"&", "&amp;"}, {"<", "&lt;"}, {">", "&gt;"}, {"\"", "&quot;"},
+    {"'", "&#39;"}, {"\007", "&#07;"}, {"\200", "&#128;"},
+  };
+  for (int i = 0, n = arraysize(kSpecials); i < n; ++i) {
+    for (int offset = 0, size = plain.size(); offset <= size; ++offset) {
+      SCOPED_TRACE(StrCat(kSpecials[i][1], " at ", IntegerToString(offset)));
+      GoogleString unescaped = plain;
+      unescaped.insert(offset, kSpecials[i][0]);
+      GoogleString escaped = plain;
+      escaped.insert(offset, kSpecials[i][1]);
+      BiTest(escaped, unescaped);
+    }
+  }
+  Unchanged(plain);
+  Unchanged(StrCat(plain, "\n", plain, "\t", plain));
+
+  // 8-bit bytes outside of escapes can't be unescaped, wherever they are.
+  for (int offset = 0, size = plain.size(); offset <= size; ++offset) {
+    GoogleString text = plain;
+    text.insert(offset, "\xe9");
+    EXPECT_TRUE(UnescapeEncodingError(text)) << offset;
+    EXPECT_TRUE(UnescapeEncodingError(StrCat("&amp;", text))) << offset;
+  }
+}
+
 }  // namespace net_instaweb
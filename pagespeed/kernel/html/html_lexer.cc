@@ -23,6 +23,7 @@
 #include <cstdarg>
 #include <cstddef>  // for size_t
 #include <cstdio>
+#include <cstring>
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/message_handler.h"
@@ -38,6 +39,22 @@ namespace net_instaweb {
 
 namespace {
 
+// Returns the number of bytes at the end of text that start, but don't
+// complete, a UTF-8 character.
+int PartialUtf8CharacterSize(const StringPiece& text) {
+  // A character is at most 4 bytes, so at most the last 3 can be partial.
+  int size = text.size();
+  for (int i = 1; (i <= 3) && (i <= size); ++i) {
+    uint8 c = static_cast<uint8>(text[size - i]);
+    if ((c & 0xc0) != 0x80) {
+      // Not a continuation byte, so it is the start of the last character.
+      int length = (c >= 0xf0) ? 4 : (c >= 0xe0) ? 3 : (c >= 0xc0) ? 2 : 1;
+      return (length > i) ? i : 0;
+    }
+  }
+  return 0;
+}
+
 // TODO(jmarantz): consider making these sorted-lists be an enum field
 // in the table in html_name.gperf.  I'm not sure if that would make things
 // noticably faster or not.
@@ -166,7 +183,9 @@ HtmlLexer::HtmlLexer(HtmlParse* html_parse)
       discard_until_start_state_for_error_recovery_(false),
       size_limit_exceeded_(false),
       skip_parsing_(false),
-      size_limit_(-1) {
+      size_limit_(-1),
+      prescan_keywords_(NULL),
+      prescan_skips_comments_(false) {
 #ifndef NDEBUG
   CHECK_KEYWORD_SET_ORDERING(kImplicitlyClosedHtmlTags);
   CHECK_KEYWORD_SET_ORDERING(kNonBriefTerminatedTags);
@@ -1035,6 +1054,29 @@ void HtmlLexer::Parse(const char* text, int size) {
       // Return without doing anything if skip_parsing_ is true.
       return;
     }
+    if ((prescan_keywords_ != NULL) && (state_ == START)) {
+      // Pass over any markup the filters aren't interested in, adding it to
+      // the literal as if it were text.
+      int skipped = PrescanUninterestingMarkup(text + i, size - i);
+      if (skipped > 0) {
+        StringPiece markup(text + i, skipped);
+        line_ += std::count(markup.begin(), markup.end(), '\n');
+        markup.AppendToString(&literal_);
+        i += skipped;
+        if (i == size) {
+          // Send the run on now, rather than holding it until the next tag,
+          // but hold back any character split across the chunk boundary so
+          // that no node ends mid-character, which would make its encoding
+          // look invalid.
+          int partial = PartialUtf8CharacterSize(literal_);
+          GoogleString rest(literal_, literal_.size() - partial);
+          literal_.resize(literal_.size() - partial);
+          EmitLiteral();
+          literal_.swap(rest);
+          break;
+        }
+      }
+    }
     char c = text[i];
     if (c == '\n') {
       ++line_;
@@ -1093,6 +1135,122 @@ bool HtmlLexer::IsImplicitlyClosedTag(HtmlName::Keyword keyword) const {
   return IS_IN_SET(kImplicitlyClosedHtmlTags, keyword);
 }
 
+int HtmlLexer::PrescanUninterestingMarkup(const char* text, int size) const {
+  int pos = 0;
+  while (pos < size) {
+    const char* tag = static_cast<const char*>(
+        memchr(text + pos, '<', size - pos));
+    if (tag == NULL) {
+      return size;
+    }
+    pos = tag - text;
+    int tag_size = PrescanTag(tag, size - pos);
+    if (tag_size == 0) {
+      break;
+    }
+    pos += tag_size;
+  }
+  return pos;
+}
+
+int HtmlLexer::PrescanTag(const char* text, int size) const {
+  DCHECK_EQ('<', text[0]);
+  if (size < 2) {
+    return 0;
+  }
+  if (text[1] == '!') {
+    // Only plain comments are skipped; directives, CDATA and the like are
+    // left to the lexer.  The "-->" can't share the "--" of the "<!--".
+    if (!prescan_skips_comments_ || (size < 4) ||
+        (text[2] != '-') || (text[3] != '-')) {
+      return 0;
+    }
+    stringpiece_ssize_type end = StringPiece(text, size).find("-->", 4);
+    return (end == StringPiece::npos) ? 0 : end + 3;
+  }
+
+  bool is_close = (text[1] == '/');
+  int pos = is_close ? 2 : 1;
+  if ((pos == size) || !IsLegalTagFirstChar(text[pos])) {
+    return 0;
+  }
+  int name_start = pos;
+  while ((pos < size) && IsLegalTagChar(text[pos]) && (text[pos] != '<')) {
+    ++pos;
+  }
+  if (pos == size) {
+    return 0;
+  }
+  HtmlName::Keyword keyword =
+      HtmlName::Lookup(StringPiece(text + name_start, pos - name_start));
+  if ((*prescan_keywords_)[keyword] || IsLiteralTag(keyword) ||
+      IsSometimesLiteralTag(keyword)) {
+    return 0;
+  }
+
+  if (is_close) {
+    // "</x >" is all we expect; leave anything odder to the lexer.
+    while ((pos < size) && IsHtmlSpace(text[pos])) {
+      ++pos;
+    }
+    return ((pos < size) && (text[pos] == '>')) ? pos + 1 : 0;
+  }
+
+  // Find the '>' that ends the tag, following the lexer's attribute states
+  // closely enough to know when a quote starts a value that might hold one.
+  enum { kAttribute, kName, kNameSpace, kEquals, kValue } state = kAttribute;
+  if ((text[pos] != '>') && (text[pos] != '/') && !IsHtmlSpace(text[pos])) {
+    return 0;
+  }
+  for (; pos < size; ++pos) {
+    char c = text[pos];
+    if (c == '>') {
+      return pos + 1;
+    } else if (c == '<') {
+      // Let the lexer recover from this as it usually does.
+      return 0;
+    }
+    switch (state) {
+      case kAttribute:
+        if (!IsHtmlSpace(c) && (c != '/')) {
+          state = kName;
+        }
+        break;
+      case kName:
+      case kNameSpace:
+        if (c == '=') {
+          state = kEquals;
+        } else if (c == '/') {
+          state = kAttribute;
+        } else if (IsHtmlSpace(c)) {
+          state = kNameSpace;
+        } else {
+          state = kName;
+        }
+        break;
+      case kEquals:
+        if ((c == '"') || (c == '\'')) {
+          const char* quote = static_cast<const char*>(
+              memchr(text + pos + 1, c, size - pos - 1));
+          if (quote == NULL) {
+            return 0;
+          }
+          pos = quote - text;
+          state = kAttribute;
+        } else if (!IsHtmlSpace(c)) {
+          state = kValue;
+        }
+        break;
+      case kValue:
+        if (IsHtmlSpace(c)) {
+          state = kAttribute;
+        }
+        break;
+    }
+  }
+  return 0;
+}
+
 bool HtmlLexer::IsLiteralTag(HtmlName::Keyword keyword) {
   return IS_IN_SET(kLiteralTags, keyword);
 }
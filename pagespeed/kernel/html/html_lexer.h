@@ -95,6 +95,22 @@ class HtmlLexer {
   // that we should parse.
   bool size_limit_exceeded() const { return size_limit_exceeded_; }
 
+  // Has Parse() pass over markup that no filter is interested in without
+  // building events for it.  Between tags it finds interesting, Parse() then
+  // looks only for the names of tags, and sends everything else on as raw
+  // Characters.  keywords, indexed by keyword, marks the elements filters
+  // want events for, and must outlive the parse; NULL turns the prescan off.
+  // Comments are skipped too if skip_comments is true.
+  //
+  // Uninteresting tags never reach the element stack, so the output stays
+  // byte-for-byte the same as the input, but an uninteresting close tag
+  // can't implicitly close an interesting element, which then ends later
+  // than it otherwise would.
+  void SetPrescan(const std::vector<bool>* keywords, bool skip_comments) {
+    prescan_keywords_ = keywords;
+    prescan_skips_comments_ = skip_comments;
+  }
+
  private:
   // Most of these routines expect c to be the last character of literal_
   inline void EvalStart(char c);
@@ -145,6 +161,13 @@ class HtmlLexer {
   void EmitDirective();
   void Restart(char c);
 
+  // Returns the length of the run of uninteresting markup at the start of
+  // text, stopping at the first tag it can't be sure is uninteresting.
+  int PrescanUninterestingMarkup(const char* text, int size) const;
+  // Returns the length of the uninteresting tag or comment starting at
+  // text[0] == '<', or 0 if it's interesting or doesn't end within size.
+  int PrescanTag(const char* text, int size) const;
+
   // Emits a syntax error message.
   void SyntaxError(const char* format, ...) INSTAWEB_PRINTF_FORMAT(2, 3);
 
@@ -250,6 +273,10 @@ class HtmlLexer {
   int64 num_bytes_parsed_;
   int64 size_limit_;
 
+  // Set by SetPrescan.
+  const std::vector<bool>* prescan_keywords_;
+  bool prescan_skips_comments_;
+
   DISALLOW_COPY_AND_ASSIGN(HtmlLexer);
 };
 
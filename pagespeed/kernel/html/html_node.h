@@ -172,8 +172,21 @@ class HtmlCharactersNode : public HtmlLeafNode {
   }
   friend class HtmlParse;
 
-  // Expose writable contents for Characters nodes.
-  using HtmlLeafNode::mutable_contents;
+  // Expose writable contents for Characters nodes.  As the caller may
+  // change them, this forgets their encoding.
+  GoogleString* mutable_contents() {
+    encoding_ = kUnknownTextEncoding;
+    return HtmlLeafNode::mutable_contents();
+  }
+
+  // The encoding of contents(), classified on the first call and kept
+  // until the contents change, so that filters need not each scan them.
+  TextEncoding encoding() const {
+    if (encoding_ == kUnknownTextEncoding) {
+      encoding_ = ClassifyTextEncoding(contents());
+    }
+    return encoding_;
+  }
 
  protected:
   virtual void SynthesizeEvents(const HtmlEventListIterator& iter,
@@ -183,9 +196,12 @@ class HtmlCharactersNode : public HtmlLeafNode {
   HtmlCharactersNode(HtmlElement* parent,
                      const StringPiece& contents,
                      const HtmlEventListIterator& iter)
-      : HtmlLeafNode(parent, iter, contents) {
+      : HtmlLeafNode(parent, iter, contents),
+        encoding_(kUnknownTextEncoding) {
   }
 
+  mutable TextEncoding encoding_;  // kUnknownTextEncoding until classified.
+
   DISALLOW_COPY_AND_ASSIGN(HtmlCharactersNode);
 };
 
@@ -18,6 +18,7 @@
 
 #include "pagespeed/kernel/html/html_parse.h"
 
+#include <algorithm>
 #include <list>
 #include <vector>
 
@@ -26,6 +27,7 @@
 #include "pagespeed/kernel/base/atom.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/print_message_handler.h"
+#include "pagespeed/kernel/base/sampling_profiler.h"
 #include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -39,10 +41,63 @@
 #include "pagespeed/kernel/html/html_lexer.h"
 #include "pagespeed/kernel/html/html_name.h"
 #include "pagespeed/kernel/html/html_node.h"
+#include "pagespeed/kernel/html/shared_name_table.h"
 #include "pagespeed/kernel/http/google_url.h"
 
 namespace net_instaweb {
 
+namespace {
+
+// Roughly what a std::list node of HtmlEventList takes: the event pointer,
+// and links forwards and back.
+const int kEventLinkBytes = 3 * sizeof(void*);
+
+}  // namespace
+
+// The events a filter's handlers are called for, from its EventMask() and
+// ElementKeywords().
+class HtmlParse::FilterEvents {
+ public:
+  explicit FilterEvents(HtmlFilter* filter)
+      : filter_(filter),
+        mask_(filter->EventMask() | HtmlFilter::kDocumentEvents) {
+    int num_keywords = 0;
+    const HtmlName::Keyword* keywords = filter->ElementKeywords(&num_keywords);
+    if (keywords != NULL) {
+      keywords_.resize(HtmlName::kNotAKeyword + 1, false);
+      for (int i = 0; i < num_keywords; ++i) {
+        keywords_[keywords[i]] = true;
+      }
+    }
+  }
+
+  HtmlFilter* filter() const { return filter_; }
+
+  bool Wants(HtmlEvent* event) const {
+    HtmlFilter::EventKind kind = event->kind();
+    if ((mask_ & kind) == 0) {
+      return false;
+    }
+    if (keywords_.empty()) {
+      return true;
+    }
+    HtmlElement* element;
+    if (kind == HtmlFilter::kStartElementEvent) {
+      element = event->GetElementIfStartEvent();
+    } else if (kind == HtmlFilter::kEndElementEvent) {
+      element = event->GetElementIfEndEvent();
+    } else {
+      return true;
+    }
+    return keywords_[element->keyword()];
+  }
+
+ private:
+  HtmlFilter* filter_;
+  int mask_;
+  std::vector<bool> keywords_;  // Indexed by keyword; empty means all.
+};
+
 HtmlParse::HtmlParse(MessageHandler* message_handler)
     : lexer_(NULL),  // Can't initialize here, since "this" should not be used
                      // in the initializer list (it generates an error in
@@ -55,15 +110,24 @@ HtmlParse::HtmlParse(MessageHandler* message_handler)
       need_sanity_check_(false),
       coalesce_characters_(true),
       need_coalesce_characters_(false),
+      fuse_filters_(true),
+      prescan_uninteresting_markup_(false),
       url_valid_(false),
       log_rewrite_timing_(false),
       running_filters_(false),
       parse_start_time_us_(0),
       timer_(NULL),
       current_filter_(NULL),
-      dynamically_disabled_filter_list_(NULL) {
+      dynamically_disabled_filter_list_(NULL),
+      prescan_possible_(false),
+      prescan_event_mask_(0),
+      num_shared_name_hits_(0),
+      num_shared_name_misses_(0),
+      num_spare_event_links_(0),
+      max_spare_event_links_(0) {
   lexer_ = new HtmlLexer(this);
   HtmlKeywords::Init();
+  SharedNameTable::Init();
 }
 
 HtmlParse::~HtmlParse() {
@@ -106,7 +170,14 @@ void HtmlParse::CheckParentFromAddEvent(HtmlEvent* event) {
 
 void HtmlParse::AddEvent(HtmlEvent* event) {
   CheckParentFromAddEvent(event);
-  queue_.push_back(event);
+  if (spare_event_links_.empty()) {
+    queue_.push_back(event);
+  } else {
+    spare_event_links_.front() = event;
+    queue_.splice(queue_.end(), spare_event_links_,
+                  spare_event_links_.begin());
+    --num_spare_event_links_;
+  }
   need_sanity_check_ = true;
   need_coalesce_characters_ = true;
 
@@ -230,6 +301,11 @@ bool HtmlParse::StartParseId(const StringPiece& url, const StringPiece& id,
                              const ContentType& content_type) {
   delayed_start_literal_.reset();
   determine_enabled_filters_called_ = false;
+  prescan_possible_ = prescan_uninteresting_markup_;
+  prescan_event_mask_ = 0;
+  prescan_keywords_.assign(HtmlName::kNotAKeyword + 1, false);
+  num_shared_name_hits_ = 0;
+  num_shared_name_misses_ = 0;
 
   // Paranoid debug-checking and unconditional clearing of state variables.
   DCHECK(!skip_increment_);
@@ -309,16 +385,39 @@ void HtmlParse::Clear() {
   string_table_.Clear();
 }
 
+void HtmlParse::set_max_retained_bytes(int64 x) {
+  int64 half = std::max(x, static_cast<int64>(0)) / 2;
+  nodes_.set_max_spare_bytes(half);
+  max_spare_event_links_ = half / kEventLinkBytes;
+  while (num_spare_event_links_ > max_spare_event_links_) {
+    spare_event_links_.pop_back();
+    --num_spare_event_links_;
+  }
+}
+
+int64 HtmlParse::retained_bytes() const {
+  return nodes_.spare_bytes() +
+      static_cast<int64>(num_spare_event_links_) * kEventLinkBytes;
+}
+
 void HtmlParse::ParseTextInternal(const char* text, int size) {
   DCHECK(url_valid_) << "Invalid to call ParseText with invalid url";
   if (url_valid_) {
     DetermineEnabledFilters();
+    const int kCommentEvents =
+        HtmlFilter::kCommentEvent | HtmlFilter::kIEDirectiveEvent;
+    lexer_->SetPrescan(prescan_possible_ ? &prescan_keywords_ : NULL,
+                       (prescan_event_mask_ & kCommentEvents) == 0);
     lexer_->Parse(text, size);
   }
 }
 
 void HtmlParse::DetermineEnabledFiltersImpl() {
   DetermineEnabledFiltersInList(filters_);
+  for (FilterVector::iterator it = event_listeners_.begin();
+       it != event_listeners_.end(); ++it) {
+    NotePrescanInterest(*it);
+  }
 }
 
 void HtmlParse::CheckFilterEnabled(HtmlFilter* filter) {
@@ -333,6 +432,40 @@ void HtmlParse::CheckFilterEnabled(HtmlFilter* filter) {
 
     dynamically_disabled_filter_list_->push_back(final_reason);
   }
+  if (filter->is_enabled()) {
+    NotePrescanInterest(filter);
+  }
+}
+
+void HtmlParse::NotePrescanInterest(HtmlFilter* filter) {
+  if (!prescan_possible_) {
+    return;
+  }
+  int mask = filter->EventMask();
+  int num_keywords = 0;
+  const HtmlName::Keyword* keywords = filter->ElementKeywords(&num_keywords);
+  if (filter->AcceptsRawMarkup()) {
+    // Raw Characters do for everything but the elements it lists.
+    if (keywords != NULL) {
+      for (int i = 0; i < num_keywords; ++i) {
+        prescan_keywords_[keywords[i]] = true;
+      }
+    }
+    return;
+  }
+  if ((mask & HtmlFilter::kCharactersEvent) != 0) {
+    prescan_possible_ = false;
+  } else if ((mask & (HtmlFilter::kStartElementEvent |
+                      HtmlFilter::kEndElementEvent)) != 0) {
+    if (keywords == NULL) {
+      prescan_possible_ = false;
+    } else {
+      for (int i = 0; i < num_keywords; ++i) {
+        prescan_keywords_[keywords[i]] = true;
+      }
+    }
+  }
+  prescan_event_mask_ |= mask;
 }
 
 // This is factored out of Flush() for testing purposes.
@@ -365,17 +498,17 @@ void HtmlParse::ApplyFilter(HtmlFilter* filter) {
     }
   }
 
-  if (coalesce_characters_ && need_coalesce_characters_) {
-    CoalesceAdjacentCharactersNodes();
-    DelayLiteralTag();
-    need_coalesce_characters_ = false;
-  }
+  PrepareQueueForFilters();
 
   ShowProgress(StrCat("ApplyFilter:", filter->Name()).c_str());
+  SamplingProfiler::ScopedLabel profiler_label(filter->ProfileLabel());
+  FilterEvents filter_events(filter);
   for (current_ = queue_.begin(); current_ != queue_.end(); NextEvent()) {
     HtmlEvent* event = *current_;
     line_number_ = event->line_number();
-    event->Run(filter);
+    if (filter_events.Wants(event)) {
+      event->Run(filter);
+    }
   }
   filter->Flush();
 
@@ -386,6 +519,91 @@ void HtmlParse::ApplyFilter(HtmlFilter* filter) {
   current_filter_ = NULL;
 }
 
+void HtmlParse::ApplyFusedFilters(const FilterVector& filters) {
+  DCHECK(current_filter_ == NULL);
+  PrepareQueueForFilters();
+
+  ShowProgress("ApplyFusedFilters");
+  SamplingProfiler::ScopedLabel profiler_label("FusedFilters");
+  std::vector<FilterEvents> filter_events;
+  filter_events.reserve(filters.size());
+  for (int i = 0, n = filters.size(); i < n; ++i) {
+    // Filters that share a pass never defer nodes, so there are no events
+    // to move into deferred nodes for them; see ApplyFilter.
+    DCHECK(filters[i]->CanShareFlushPass()) << filters[i]->Name();
+    DCHECK(open_deferred_nodes_.find(filters[i]) ==
+           open_deferred_nodes_.end()) << filters[i]->Name();
+    filter_events.push_back(FilterEvents(filters[i]));
+  }
+
+  int num_filters = filter_events.size();
+  for (current_ = queue_.begin(); current_ != queue_.end(); ++current_) {
+    HtmlEvent* event = *current_;
+    line_number_ = event->line_number();
+    for (int i = 0; i < num_filters; ++i) {
+      if (filter_events[i].Wants(event)) {
+        current_filter_ = filter_events[i].filter();
+        event->Run(current_filter_);
+        DCHECK(!skip_increment_) << current_filter_->Name()
+                                 << " moved events in a shared flush pass";
+      }
+    }
+  }
+  for (int i = 0; i < num_filters; ++i) {
+    current_filter_ = filters[i];
+    current_filter_->Flush();
+  }
+
+  if (need_sanity_check_) {
+    SanityCheck();
+    need_sanity_check_ = false;
+  }
+  current_filter_ = NULL;
+}
+
+void HtmlParse::ApplyFilters(const FilterList& filters) {
+  FilterVector fused;
+  FilterList::const_iterator i = filters.begin();
+  while (i != filters.end()) {
+    HtmlFilter* filter = *i++;
+    if (!filter->is_enabled()) {
+      continue;
+    }
+    if (!fuse_filters_ || !filter->CanShareFlushPass()) {
+      ApplyFilter(filter);
+      continue;
+    }
+
+    // Gather the run of filters that can share this one's pass.  Disabled
+    // filters don't run at all, so they don't end the run.
+    fused.clear();
+    fused.push_back(filter);
+    for (; i != filters.end(); ++i) {
+      if ((*i)->is_enabled()) {
+        if (!(*i)->CanShareFlushPass()) {
+          break;
+        }
+        fused.push_back(*i);
+      }
+    }
+    if (fused.size() == 1) {
+      ApplyFilter(filter);
+    } else {
+      ApplyFusedFilters(fused);
+    }
+  }
+}
+
+// Coalesces characters nodes that were split up, by the lexer or by the
+// filters run so far, before the next filter walks the queue.
+void HtmlParse::PrepareQueueForFilters() {
+  if (coalesce_characters_ && need_coalesce_characters_) {
+    CoalesceAdjacentCharactersNodes();
+    DelayLiteralTag();
+    need_coalesce_characters_ = false;
+  }
+}
+
 void HtmlParse::NextEvent() {
   if (skip_increment_) {
     skip_increment_ = false;
@@ -530,13 +748,7 @@ void HtmlParse::Flush() {
   DCHECK(url_valid_) << "Invalid to call FinishParse with invalid url";
   if (url_valid_) {
     ShowProgress("Flush");
-
-    for (FilterList::iterator i = filters_.begin(); i != filters_.end(); ++i) {
-      HtmlFilter* filter = *i;
-      if (filter->is_enabled()) {
-        ApplyFilter(filter);
-      }
-    }
+    ApplyFilters(filters_);
     ClearEvents();
   }
 }
@@ -566,7 +778,17 @@ void HtmlParse::ClearEvents() {
       }
     }
     delete event;
+    *current_ = NULL;
+  }
+  // Keep the queue's links for the events of the next flush window.
+  HtmlEventList::iterator keep_end = queue_.begin();
+  while ((num_spare_event_links_ < max_spare_event_links_) &&
+         (keep_end != queue_.end())) {
+    ++keep_end;
+    ++num_spare_event_links_;
   }
+  spare_event_links_.splice(spare_event_links_.end(), queue_,
+                            queue_.begin(), keep_end);
   queue_.clear();
   need_sanity_check_ = false;
   need_coalesce_characters_ = false;
@@ -1184,12 +1406,23 @@ HtmlName HtmlParse::MakeName(const StringPiece& str_piece) {
   const StringPiece* str = HtmlKeywords::KeywordToString(keyword);
 
   // If the passed-in string is not in its canonical form, or is not a
-  // recognized keyword, then we must make a permanent copy in our
-  // string table.  Note that we are comparing the bytes of the
-  // keyword from the table, not the pointer.
+  // recognized keyword, then we must make a permanent copy: in the table
+  // shared by all parses if there's room, else in our own string table.
+  // Note that we are comparing the bytes of the keyword from the table,
+  // not the pointer.
   if ((str == NULL) || (str_piece != *str)) {
-    Atom atom = string_table_.Intern(str_piece);
-    str = atom.Rep();
+    SharedNameTable* shared = SharedNameTable::Singleton();
+    bool found = false;
+    str = (shared == NULL) ? NULL : shared->Intern(str_piece, &found);
+    if (found) {
+      ++num_shared_name_hits_;
+    } else {
+      ++num_shared_name_misses_;
+    }
+    if (str == NULL) {
+      Atom atom = string_table_.Intern(str_piece);
+      str = atom.Rep();
+    }
   }
   return HtmlName(keyword, str);
 }
@@ -436,8 +436,9 @@ class HtmlParse {
   void CloseElement(HtmlElement* element, HtmlElement::Style style,
                     int line_number);
 
-  // Run a filter on the current queue of parse nodes.
-  void ApplyFilter(HtmlFilter* filter);
+  // Run a filter on the current queue of parse nodes.  Subclasses may
+  // override this to account for the work each filter does.
+  virtual void ApplyFilter(HtmlFilter* filter);
 
   // Provide timer to helping to report timing of each filter.  You must also
   // set_log_rewrite_timing(true) to turn on this reporting.
@@ -465,6 +466,29 @@ class HtmlParse {
   // Returns whether we have exceeded the size limit.
   bool size_limit_exceeded() const;
 
+  // Lets the lexer pass over markup that no enabled filter or event listener
+  // has asked to see, in its EventMask() and ElementKeywords(), sending it
+  // on as raw Characters.  Any filter that wants every element, or any
+  // Characters, turns this off for the document unless it AcceptsRawMarkup.
+  // See HtmlLexer::SetPrescan.  Off by default.
+  void set_prescan_uninteresting_markup(bool x) {
+    prescan_uninteresting_markup_ = x;
+  }
+
+  // How much of the memory used for one document the parser may keep for
+  // the next, rather than free it and allocate it again: half for the arena
+  // holding its nodes, half for the links of its event queue.  Nodes are
+  // kept once the document is finished, and links after every flush.
+  // 0, the default, keeps nothing.
+  void set_max_retained_bytes(int64 x);
+  // The memory kept so far and not yet reused.
+  int64 retained_bytes() const;
+
+  // The number of times, in the current document, that a name with no
+  // canonical keyword string was or wasn't already in the SharedNameTable.
+  int64 num_shared_name_hits() const { return num_shared_name_hits_; }
+  int64 num_shared_name_misses() const { return num_shared_name_misses_; }
+
   // For debugging purposes. If this vector is supplied, DetermineEnabledFilters
   // will populate it with the list of Filters that were disabled, plus the
   // associated reason, if supplied by the Filter. Caller retains ownership
@@ -528,6 +552,18 @@ class HtmlParse {
   // Returns the number of events on the event queue.
   size_t GetEventQueueSize();
 
+  // Runs the enabled filters in the list on the current queue of parse
+  // nodes, in order.  Runs of adjacent filters that return true from
+  // HtmlFilter::CanShareFlushPass are passed to ApplyFusedFilters, and the
+  // rest to ApplyFilter.
+  void ApplyFilters(const FilterList& filters);
+
+  // Runs filters, which all return true from CanShareFlushPass, in a single
+  // walk over the current queue of parse nodes.  As that is equivalent to
+  // calling ApplyFilter on each in turn, subclasses may override this to do
+  // so when they need to account for each filter's work separately.
+  virtual void ApplyFusedFilters(const FilterVector& filters);
+
   virtual void ParseTextInternal(const char* content, int size);
 
   // Calls DetermineEnabledFiltersImpl in an idempotent way.
@@ -546,6 +582,10 @@ class HtmlParse {
 
   void CheckFilterEnabled(HtmlFilter* filter);
 
+  // Adds the events an enabled filter wants to those the prescan must stop
+  // for, or rules out the prescan if it wants them all.
+  void NotePrescanInterest(HtmlFilter* filter);
+
   // Call DetermineEnabled() on each filter. Should be called after
   // the property cache lookup has finished since some filters depend on
   // pcache results in their DetermineEnabled implementation. If a subclass has
@@ -555,6 +595,8 @@ class HtmlParse {
   virtual void DetermineEnabledFiltersImpl();
 
  private:
+  class FilterEvents;
+
   void ApplyFilterHelper(HtmlFilter* filter);
   HtmlEventListIterator Last();  // Last element in queue
   bool IsInEventWindow(const HtmlEventListIterator& iter) const;
@@ -573,6 +615,7 @@ class HtmlParse {
                   const HtmlEventListIterator& end_inclusive,
                   HtmlElement* new_parent);
   void CoalesceAdjacentCharactersNodes();
+  void PrepareQueueForFilters();
   void ClearEvents();
   void EmitQueue(MessageHandler* handler);
   inline void NextEvent();
@@ -586,6 +629,7 @@ class HtmlParse {
   void AddEvent(HtmlEvent* event);
   void SetCurrent(HtmlNode* node);
   void set_coalesce_characters(bool x) { coalesce_characters_ = x; }
+  void set_fuse_filters(bool x) { fuse_filters_ = x; }
   size_t symbol_table_size() const {
     return string_table_.string_bytes_allocated();
   }
@@ -615,6 +659,8 @@ class HtmlParse {
   bool need_sanity_check_;
   bool coalesce_characters_;
   bool need_coalesce_characters_;
+  bool fuse_filters_;
+  bool prescan_uninteresting_markup_;
   bool url_valid_;
   bool log_rewrite_timing_;  // Should we time the speed of parsing?
   bool running_filters_;
@@ -641,6 +687,21 @@ class HtmlParse {
 
   StringVector* dynamically_disabled_filter_list_;
 
+  // What the enabled filters want to see of this document, which decides
+  // whether and how the lexer may prescan it.
+  bool prescan_possible_;
+  int prescan_event_mask_;
+  std::vector<bool> prescan_keywords_;  // Indexed by keyword.
+
+  int64 num_shared_name_hits_;
+  int64 num_shared_name_misses_;
+
+  // Links of queue_ whose events have been flushed, kept for AddEvent to
+  // use before allocating new ones.  The events they point to are gone.
+  HtmlEventList spare_event_links_;
+  int num_spare_event_links_;
+  int max_spare_event_links_;
+
   DISALLOW_COPY_AND_ASSIGN(HtmlParse);
 };
 
@@ -38,7 +38,12 @@
 #include "pagespeed/kernel/base/stdio_file_system.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/html/collapse_whitespace_filter.h"
+#include "pagespeed/kernel/html/elide_attributes_filter.h"
+#include "pagespeed/kernel/html/html_attribute_quote_removal.h"
+#include "pagespeed/kernel/html/html_testing_peer.h"
 #include "pagespeed/kernel/html/html_writer_filter.h"
+#include "pagespeed/kernel/html/remove_comments_filter.h"
 
 namespace net_instaweb {
 
@@ -160,6 +165,50 @@ static void BM_ParseAndSerializeReuseParserX50(int iters) {
 }
 BENCHMARK(BM_ParseAndSerializeReuseParserX50);
 
+// Runs the minifying filters ahead of the writer, with the filters that can
+// share a walk over each flush window either sharing it or walking it
+// separately.
+void MinifyAndSerialize(int iters, bool fuse_filters) {
+  StopBenchmarkTiming();
+  StringPiece text = GetHtmlText();
+  if (text.empty()) {
+    return;
+  }
+
+  NullWriter writer;
+  NullMessageHandler handler;
+  HtmlParse parser(&handler);
+  HtmlTestingPeer::set_fuse_filters(&parser, fuse_filters);
+  RemoveCommentsFilter remove_comments(&parser);
+  CollapseWhitespaceFilter collapse_whitespace(&parser);
+  ElideAttributesFilter elide_attributes(&parser);
+  HtmlAttributeQuoteRemoval quote_removal(&parser);
+  HtmlWriterFilter writer_filter(&parser);
+  parser.AddFilter(&remove_comments);
+  parser.AddFilter(&collapse_whitespace);
+  parser.AddFilter(&elide_attributes);
+  parser.AddFilter(&quote_removal);
+  parser.AddFilter(&writer_filter);
+  writer_filter.set_writer(&writer);
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    parser.StartParse("http://example.com/benchmark");
+    parser.ParseText(text);
+    parser.FinishParse();
+  }
+}
+
+static void BM_MinifyAndSerializeSeparatePasses(int iters) {
+  MinifyAndSerialize(iters, false);
+}
+BENCHMARK(BM_MinifyAndSerializeSeparatePasses);
+
+static void BM_MinifyAndSerializeSharedPass(int iters) {
+  MinifyAndSerialize(iters, true);
+}
+BENCHMARK(BM_MinifyAndSerializeSharedPass);
+
 }  // namespace
 
 }  // namespace net_instaweb
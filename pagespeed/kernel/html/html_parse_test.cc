@@ -30,9 +30,12 @@
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/string_writer.h"
+#include "pagespeed/kernel/html/collapse_whitespace_filter.h"
 #include "pagespeed/kernel/html/disable_test_filter.h"
+#include "pagespeed/kernel/html/elide_attributes_filter.h"
 #include "pagespeed/kernel/html/empty_html_filter.h"
 #include "pagespeed/kernel/html/explicit_close_tag.h"
+#include "pagespeed/kernel/html/html_attribute_quote_removal.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_event.h"
 #include "pagespeed/kernel/html/html_filter.h"
@@ -42,6 +45,7 @@
 #include "pagespeed/kernel/html/html_parse_test_base.h"
 #include "pagespeed/kernel/html/html_testing_peer.h"
 #include "pagespeed/kernel/html/html_writer_filter.h"
+#include "pagespeed/kernel/html/shared_name_table.h"
 
 using testing::UnorderedElementsAre;
 
@@ -186,6 +190,119 @@ TEST_F(HtmlParseTest, AttrDecodeError) {
   EXPECT_EQ("<ERROR>", attr_saver.value());
 }
 
+// Logs the encoding of each characters node and attribute value.
+class EncodingLogFilter : public EmptyHtmlFilter {
+ public:
+  EncodingLogFilter() { }
+
+  virtual void StartElement(HtmlElement* element) {
+    const HtmlElement::AttributeList& attrs = element->attributes();
+    for (HtmlElement::AttributeConstIterator i(attrs.begin());
+         i != attrs.end(); ++i) {
+      StrAppend(&log_, i->name_str(), ":",
+                EncodingName(i->escaped_value_encoding()), " ");
+    }
+  }
+  virtual void Characters(HtmlCharactersNode* characters) {
+    StrAppend(&log_, characters->contents(), ":",
+              EncodingName(characters->encoding()), " ");
+  }
+
+  const GoogleString& log() { return log_; }
+  virtual const char* Name() const { return "encoding_log"; }
+
+ private:
+  static const char* EncodingName(TextEncoding encoding) {
+    switch (encoding) {
+      case kAsciiText: return "ascii";
+      case kUtf8Text: return "utf8";
+      case kNonUtf8Text: return "other";
+      case kUnknownTextEncoding: break;
+    }
+    return "unknown";
+  }
+
+  GoogleString log_;
+
+  DISALLOW_COPY_AND_ASSIGN(EncodingLogFilter);
+};
+
+TEST_F(HtmlParseTest, ClassifiesEncodings) {
+  EncodingLogFilter encoding_log;
+  html_parse_.AddFilter(&encoding_log);
+  Parse("encodings",
+        "<a href='x&amp;y' title='caf\xc3\xa9' alt='mu\xf1" "ecos'>plain</a>"
+        "<p>caf\xc3\xa9</p><p>mu\xf1" "ecos</p>");
+  EXPECT_EQ("\n:ascii href:ascii title:utf8 alt:other plain:ascii "
+            "caf\xc3\xa9:utf8 mu\xf1" "ecos:other \n:ascii ",
+            encoding_log.log());
+}
+
+TEST_F(HtmlParseTest, EncodingsFollowChanges) {
+  SetupWriter();
+  html_parse_.StartParse("http://test.com/encodings");
+  html_parse_.ParseText("<img src='caf\xc3\xa9' alt='x'>");
+  html_parse_.Flush();
+  HtmlElement* img = html_parse_.NewElement(NULL, HtmlName::kImg);
+  html_parse_.AddAttribute(img, HtmlName::kSrc, "caf\xc3\xa9");
+  html_parse_.AddEscapedAttribute(img, HtmlName::kAlt, "y");
+  const HtmlElement::Attribute* src = img->FindAttribute(HtmlName::kSrc);
+  EXPECT_EQ(kAsciiText, src->escaped_value_encoding());
+  EXPECT_STREQ("caf\xc3\xa9", src->DecodedValueOrNull());
+  HtmlElement::Attribute* alt = img->FindAttribute(HtmlName::kAlt);
+  EXPECT_EQ(kAsciiText, alt->escaped_value_encoding());
+  alt->SetEscapedValue("caf\xc3\xa9");
+  EXPECT_EQ(kUtf8Text, alt->escaped_value_encoding());
+  // Knowing there are 8-bit characters, decoding fails without a scan.
+  EXPECT_EQ(NULL, alt->DecodedValueOrNull());
+
+  HtmlCharactersNode* text = html_parse_.NewCharactersNode(NULL, "x");
+  EXPECT_EQ(kAsciiText, text->encoding());
+  text->Append("\xf1");
+  EXPECT_EQ(kNonUtf8Text, text->encoding());
+  html_parse_.FinishParse();
+}
+
+TEST_F(HtmlParseTest, NonAsciiAttributeNotDecoded) {
+  // Decoding fails on 8-bit characters whether or not their encoding has
+  // been asked for first.
+  AttrValuesSaverFilter attr_saver;
+  html_parse_.AddFilter(&attr_saver);
+  Parse("utf8_attr", "<img src='caf\xc3\xa9' alt='&amp;'/>");
+  EXPECT_EQ("<ERROR>&", attr_saver.value());
+}
+
+TEST_F(HtmlParseTest, RetainsMemoryBetweenDocuments) {
+  GoogleString html;
+  for (int i = 0; i < 500; ++i) {
+    StrAppend(&html, "<p id=", IntegerToString(i), ">text</p>");
+  }
+  ValidateNoChanges("nothing_retained", html);
+  EXPECT_EQ(0, html_parse_.retained_bytes());
+
+  const int64 kMaxRetainedBytes = 64 * 1024;
+  html_parse_.set_max_retained_bytes(kMaxRetainedBytes);
+  ValidateNoChanges("retained", html);
+  int64 retained = html_parse_.retained_bytes();
+  EXPECT_LT(kMaxRetainedBytes / 2, retained);
+  EXPECT_GE(kMaxRetainedBytes, retained);
+
+  // The next document reuses what was kept, and is parsed just the same,
+  // flushes and all.
+  SetupWriter();
+  html_parse_.StartParse("http://test.com/reused.html");
+  for (int i = 0, n = html.size(); i < n; i += 1000) {
+    html_parse_.ParseText(html.substr(i, 1000));
+    html_parse_.Flush();
+  }
+  html_parse_.FinishParse();
+  EXPECT_EQ(html, output_buffer_);
+  EXPECT_EQ(retained, html_parse_.retained_bytes());
+
+  html_parse_.set_max_retained_bytes(0);
+  EXPECT_EQ(0, html_parse_.retained_bytes());
+}
+
 TEST_F(HtmlParseTest, UnclosedQuote) {
   // In this test, the system automatically closes the 'a' tag, which
   // didn't really get closed in the input text.  The exact syntax
@@ -1149,29 +1266,51 @@ TEST_F(HtmlParseTest, MakeName) {
 
   // But when we introduce a new capitalization, we want to retain the
   // case, even though we do html keyword matching.  We will have to
-  // store the new form in the symbol table so we'll be allocating
-  // some bytes, including the nul terminator.
+  // store the new form, which goes in the table shared by all parses
+  // rather than in our own symbol table.
   HtmlName body_new_capitalization = html_parse_.MakeName("Body");
-  EXPECT_EQ(4, HtmlTestingPeer::symbol_table_size(&html_parse_));
+  EXPECT_EQ(0, HtmlTestingPeer::symbol_table_size(&html_parse_));
   EXPECT_EQ(HtmlName::kBody, body_new_capitalization.keyword());
+  EXPECT_EQ("Body", body_new_capitalization.value());
 
-  // Make a name out of something that is not a keyword.
-  // This should also increase the symbol-table size.
+  // Make a name out of something that is not a keyword.  This also goes in
+  // the shared table, so a second parser gets the very same copy of it.
   HtmlName non_keyword = html_parse_.MakeName("hiybbprqag");
-  EXPECT_EQ(14, HtmlTestingPeer::symbol_table_size(&html_parse_));
+  EXPECT_EQ(0, HtmlTestingPeer::symbol_table_size(&html_parse_));
   EXPECT_EQ(HtmlName::kNotAKeyword, non_keyword.keyword());
-
-  // Empty names are a corner case that we hope does not crash.  Note
-  // that empty-string atoms are special-cased in the symbol table
-  // and require no new allocated bytes.
+  HtmlParse other_parse(&message_handler_);
+  EXPECT_EQ(non_keyword.value().data(),
+            other_parse.MakeName("hiybbprqag").value().data());
+
+  // Names too long for the shared table are kept in our own.
+  GoogleString long_name(SharedNameTable::kMaxNameLength + 1, 'x');
+  HtmlName long_non_keyword = html_parse_.MakeName(long_name);
+  EXPECT_EQ(long_name.size(),
+            HtmlTestingPeer::symbol_table_size(&html_parse_));
+  EXPECT_EQ(long_name, long_non_keyword.value());
+
+  // Empty names are a corner case that we hope does not crash.
   {
     HtmlName empty = html_parse_.MakeName("");
-    EXPECT_EQ(14, HtmlTestingPeer::symbol_table_size(&html_parse_));
+    EXPECT_EQ(long_name.size(),
+              HtmlTestingPeer::symbol_table_size(&html_parse_));
     EXPECT_EQ(HtmlName::kNotAKeyword, empty.keyword());
     EXPECT_EQ("", empty.value());
   }
 }
 
+TEST_F(HtmlParseTest, SharedNameStats) {
+  static const char kHtml[] =
+      "<x-shared-stats x-shared-stats-attr=1></x-shared-stats>";
+  Parse("first", kHtml);
+  EXPECT_EQ(0, html_parse_.num_shared_name_hits());
+  EXPECT_EQ(2, html_parse_.num_shared_name_misses());
+  Parse("second", kHtml);
+  EXPECT_EQ(2, html_parse_.num_shared_name_hits());
+  EXPECT_EQ(0, html_parse_.num_shared_name_misses());
+  EXPECT_EQ(0, HtmlTestingPeer::symbol_table_size(&html_parse_));
+}
+
 // bug 2508140 : <noscript> in <head>
 TEST_F(HtmlParseTestNoBody, NoscriptInHead) {
   // Some real websites (ex: google.com) have <noscript> in the <head> even
@@ -1402,6 +1541,238 @@ TEST_F(HandlerCalledTest, IEDirectiveCalledRevealedClose) {
   EXPECT_TRUE(second_event_listener_->called_ie_directive_.Test());
 }
 
+// Logs the events it is called for, to check which handlers HtmlParse calls
+// and in what order.
+class EventLogFilter : public EmptyHtmlFilter {
+ public:
+  EventLogFilter(const char* name, GoogleString* log)
+      : name_(name),
+        log_(log),
+        event_mask_(kAllEvents),
+        can_share_flush_pass_(false),
+        accepts_raw_markup_(false) {
+  }
+
+  virtual void StartElement(HtmlElement* element) {
+    StrAppend(log_, name_, ":", element->name_str(), " ");
+  }
+  virtual void EndElement(HtmlElement* element) {
+    StrAppend(log_, name_, ":/", element->name_str(), " ");
+  }
+  virtual void Characters(HtmlCharactersNode* characters) {
+    StrAppend(log_, name_, ":", characters->contents(), " ");
+  }
+  virtual void Comment(HtmlCommentNode* comment) {
+    StrAppend(log_, name_, ":!", comment->contents(), " ");
+  }
+
+  virtual int EventMask() const { return event_mask_; }
+  virtual const HtmlName::Keyword* ElementKeywords(int* num_keywords) const {
+    *num_keywords = keywords_.size();
+    return keywords_.empty() ? NULL : &keywords_[0];
+  }
+  virtual bool CanShareFlushPass() const { return can_share_flush_pass_; }
+  virtual bool AcceptsRawMarkup() const { return accepts_raw_markup_; }
+  virtual const char* Name() const { return name_; }
+
+  void set_event_mask(int x) { event_mask_ = x; }
+  void add_keyword(HtmlName::Keyword keyword) { keywords_.push_back(keyword); }
+  void set_can_share_flush_pass(bool x) { can_share_flush_pass_ = x; }
+  void set_accepts_raw_markup(bool x) { accepts_raw_markup_ = x; }
+
+ private:
+  const char* name_;
+  GoogleString* log_;
+  int event_mask_;
+  std::vector<HtmlName::Keyword> keywords_;
+  bool can_share_flush_pass_;
+  bool accepts_raw_markup_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventLogFilter);
+};
+
+class FilterDispatchTest : public HtmlParseTestNoBodyNoHtml {
+ protected:
+  FilterDispatchTest()
+      : a_("a", &log_),
+        b_("b", &log_),
+        c_("c", &log_) {
+  }
+
+  GoogleString log_;
+  EventLogFilter a_;
+  EventLogFilter b_;
+  EventLogFilter c_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FilterDispatchTest);
+};
+
+TEST_F(FilterDispatchTest, OnlyRequestedEventKinds) {
+  a_.set_event_mask(HtmlFilter::kCommentEvent);
+  html_parse_.AddFilter(&a_);
+  Parse("event_kinds", "<div>x<!--y--></div>");
+  EXPECT_EQ("a:!y ", log_);
+}
+
+TEST_F(FilterDispatchTest, OnlyRequestedElements) {
+  a_.set_event_mask(HtmlFilter::kStartElementEvent |
+                    HtmlFilter::kEndElementEvent);
+  a_.add_keyword(HtmlName::kSpan);
+  html_parse_.AddFilter(&a_);
+  Parse("element_keywords", "<div><span>x</span><p>y</p><span/></div>");
+  EXPECT_EQ("a:span a:/span a:span a:/span ", log_);
+}
+
+TEST_F(FilterDispatchTest, SharedPassInterleavesFilters) {
+  a_.set_can_share_flush_pass(true);
+  b_.set_can_share_flush_pass(true);
+  html_parse_.AddFilter(&a_);
+  html_parse_.AddFilter(&b_);
+  Parse("shared_pass", "<div>x</div>");
+  EXPECT_EQ("a:div b:div a:x b:x a:/div b:/div ", log_);
+
+  log_.clear();
+  HtmlTestingPeer::set_fuse_filters(&html_parse_, false);
+  Parse("separate_passes", "<div>x</div>");
+  EXPECT_EQ("a:div a:x a:/div b:div b:x b:/div ", log_);
+}
+
+TEST_F(FilterDispatchTest, UnsharedFilterEndsSharedPass) {
+  a_.set_can_share_flush_pass(true);
+  c_.set_can_share_flush_pass(true);
+  html_parse_.AddFilter(&a_);
+  html_parse_.AddFilter(&b_);
+  html_parse_.AddFilter(&c_);
+  Parse("unshared_filter", "<div></div>");
+  EXPECT_EQ("a:div a:/div b:div b:/div c:div c:/div ", log_);
+}
+
+TEST_F(FilterDispatchTest, DisabledFilterDoesNotEndSharedPass) {
+  DisableTestFilter disabled("disabled", false, "");
+  a_.set_can_share_flush_pass(true);
+  b_.set_can_share_flush_pass(true);
+  html_parse_.AddFilter(&a_);
+  html_parse_.AddFilter(&disabled);
+  html_parse_.AddFilter(&b_);
+  Parse("disabled_filter", "<div></div>");
+  EXPECT_EQ("a:div b:div a:/div b:/div ", log_);
+}
+
+TEST_F(FilterDispatchTest, PrescanPassesUninterestingMarkupThrough) {
+  a_.set_event_mask(HtmlFilter::kStartElementEvent |
+                    HtmlFilter::kEndElementEvent);
+  a_.add_keyword(HtmlName::kImg);
+  html_parse_.AddFilter(&a_);
+  static const char kInput[] =
+      "<div  class = 'a>b'><!--c--><IMG src=x.png><p>d</p></div >";
+  Parse("parsed", kInput);
+  EXPECT_EQ("<div class='a>b'><!--c--><IMG src=x.png><p>d</p></div>",
+            output_buffer_);
+  EXPECT_EQ("a:IMG a:/IMG ", log_);
+
+  log_.clear();
+  html_parse_.set_prescan_uninteresting_markup(true);
+  Parse("prescanned", kInput);
+  EXPECT_EQ(kInput, output_buffer_);
+  EXPECT_EQ("a:IMG a:/IMG ", log_);
+}
+
+TEST_F(FilterDispatchTest, NoPrescanForCharactersFilter) {
+  a_.set_event_mask(HtmlFilter::kCharactersEvent);
+  html_parse_.AddFilter(&a_);
+  html_parse_.set_prescan_uninteresting_markup(true);
+  Parse("characters", "<div  id=x>y</div>");
+  EXPECT_EQ("<div id=x>y</div>", output_buffer_);
+  EXPECT_EQ("a:y ", log_);
+}
+
+TEST_F(FilterDispatchTest, PrescanStopsForRawMarkupFilterKeywords) {
+  // a_ takes every event, but raw markup will do for all but <img>.
+  a_.set_accepts_raw_markup(true);
+  a_.add_keyword(HtmlName::kImg);
+  html_parse_.AddFilter(&a_);
+  html_parse_.set_prescan_uninteresting_markup(true);
+  static const char kInput[] = "<div  id=x>y<!--c--><img src=z></div >";
+  Parse("raw_markup", kInput);
+  EXPECT_EQ(kInput, output_buffer_);
+  EXPECT_EQ("a:<div  id=x>y<!--c--> a:img a:/img a:</div > ", log_);
+}
+
+TEST_F(FilterDispatchTest, PrescanWithFlush) {
+  a_.set_event_mask(HtmlFilter::kStartElementEvent |
+                    HtmlFilter::kEndElementEvent | HtmlFilter::kCommentEvent);
+  a_.add_keyword(HtmlName::kImg);
+  html_parse_.AddFilter(&a_);
+  html_parse_.set_prescan_uninteresting_markup(true);
+  SetupWriter();
+  static const char kInput[] = "<p a=1>x<!--c--></p><img src=y><br/>z";
+  StringPiece input(kInput);
+  for (int flush_index = 0, n = input.size(); flush_index < n;
+       ++flush_index) {
+    log_.clear();
+    output_buffer_.clear();
+    html_parse_.StartParse(StringPrintf("http://test.com/%d", flush_index));
+    html_parse_.ParseText(input.substr(0, flush_index));
+    html_parse_.Flush();
+    html_parse_.ParseText(input.substr(flush_index));
+    html_parse_.FinishParse();
+    EXPECT_EQ(kInput, output_buffer_) << "flush at " << flush_index;
+    EXPECT_EQ("a:!c a:img a:/img ", log_) << "flush at " << flush_index;
+  }
+}
+
+TEST_F(FilterDispatchTest, PrescanKeepsSplitCharacterWhole) {
+  // A multi-byte character split between two chunks of prescanned text is
+  // held back until the rest of it arrives, so that it is classified whole.
+  // Wherever the split falls, the text must come through intact.
+  a_.set_event_mask(HtmlFilter::kStartElementEvent);
+  a_.add_keyword(HtmlName::kImg);
+  html_parse_.AddFilter(&a_);
+  html_parse_.set_prescan_uninteresting_markup(true);
+  SetupWriter();
+  static const char kInput[] = "<p>caf\xc3\xa9 \xe2\x98\x83</p><img src=y>";
+  StringPiece input(kInput);
+  for (int split = 0, n = input.size(); split < n; ++split) {
+    output_buffer_.clear();
+    html_parse_.StartParse(StringPrintf("http://test.com/%d", split));
+    html_parse_.ParseText(input.substr(0, split));
+    html_parse_.ParseText(input.substr(split));
+    html_parse_.FinishParse();
+    EXPECT_EQ(kInput, output_buffer_) << "split at " << split;
+  }
+}
+
+// The minifying filters share a pass with the writer, and must produce the
+// same output as when each walks the flush window on its own.
+TEST_F(HtmlParseTest, SharedPassMatchesSeparatePasses) {
+  CollapseWhitespaceFilter collapse_whitespace(&html_parse_);
+  ElideAttributesFilter elide_attributes(&html_parse_);
+  HtmlAttributeQuoteRemoval quote_removal(&html_parse_);
+  html_parse_.AddFilter(&collapse_whitespace);
+  html_parse_.AddFilter(&elide_attributes);
+  html_parse_.AddFilter(&quote_removal);
+  SetupWriter();
+
+  static const char kInput[] =
+      "<form method=\"get\">  <input type=\"checkbox\" checked=\"checked\"/>"
+      "\n\n  <pre>  keep   this  </pre>  <img src='a.png'/>  </form>";
+  GoogleString shared;
+  GoogleString separate;
+  for (int flush_index = 0, n = STATIC_STRLEN(kInput); flush_index < n;
+       ++flush_index) {
+    HtmlTestingPeer::set_fuse_filters(&html_parse_, true);
+    ParseWithFlush(kInput, flush_index);
+    shared.swap(output_buffer_);
+    HtmlTestingPeer::set_fuse_filters(&html_parse_, false);
+    ParseWithFlush(kInput, flush_index);
+    separate.swap(output_buffer_);
+    EXPECT_EQ(separate, shared) << "flush at " << flush_index;
+  }
+  EXPECT_EQ("<form> <input type=checkbox checked />\n<pre>  keep   this  </pre>"
+            " <img src=a.png /> </form>", shared);
+}
+
 // Unit tests for event-list manipulation.  In these tests, we do not parse
 // HTML input text, but instead create two 'Characters' nodes and use the
 // event-list manipulation methods and make sure they render as expected.
@@ -2030,6 +2401,32 @@ TEST_F(AttributeManipulationTest, CloneElement) {
                 " selected />");
 }
 
+TEST_F(AttributeManipulationTest, AttributeCacheDroppedOnChange) {
+  EXPECT_TRUE(node_->attribute_cache() == NULL);
+  node_->set_attribute_cache(new HtmlElement::AttributeCache);
+  EXPECT_TRUE(node_->attribute_cache() != NULL);
+
+  // Looking at the attributes, or changing a value, keeps the cache.
+  EXPECT_EQ(4, NumAttributes(node_));
+  node_->FindAttribute(HtmlName::kId)->SetValue("38");
+  EXPECT_TRUE(node_->attribute_cache() != NULL);
+
+  html_parse_.AddAttribute(node_, HtmlName::kLang, "ENG-US");
+  EXPECT_TRUE(node_->attribute_cache() == NULL);
+
+  node_->set_attribute_cache(new HtmlElement::AttributeCache);
+  node_->DeleteAttribute(HtmlName::kLang);
+  EXPECT_TRUE(node_->attribute_cache() == NULL);
+
+  node_->set_attribute_cache(new HtmlElement::AttributeCache);
+  node_->set_name(html_parse_.MakeName(HtmlName::kSpan));
+  EXPECT_TRUE(node_->attribute_cache() == NULL);
+
+  node_->set_attribute_cache(new HtmlElement::AttributeCache);
+  AttributeAt(node_, 0);
+  EXPECT_TRUE(node_->attribute_cache() == NULL);
+}
+
 TEST_F(HtmlParseTest, NoDisabledFilter) {
   std::vector<GoogleString> disabled_filters;
   ASSERT_TRUE(disabled_filters.empty());
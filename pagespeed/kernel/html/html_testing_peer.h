@@ -46,6 +46,9 @@ class HtmlTestingPeer {
   static void set_coalesce_characters(HtmlParse* parser, bool x) {
     parser->set_coalesce_characters(x);
   }
+  static void set_fuse_filters(HtmlParse* parser, bool x) {
+    parser->set_fuse_filters(x);
+  }
   static size_t symbol_table_size(HtmlParse* parser) {
     return parser->symbol_table_size();
   }
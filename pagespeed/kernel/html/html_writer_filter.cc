@@ -45,6 +45,7 @@ HtmlWriterFilter::~HtmlWriterFilter() {
 
 void HtmlWriterFilter::Clear() {
   lazy_close_element_ = NULL;
+  lazy_close_needs_space_ = false;
   column_ = 0;
   write_errors_ = 0;
 }
@@ -131,6 +132,18 @@ void HtmlWriterFilter::StartElement(HtmlElement* element) {
   // a regold.  But the changes could be validated with the normalizer.
   if (element_style == HtmlElement::BRIEF_CLOSE) {
     lazy_close_element_ = element;
+
+    // If the last attribute was unquoted, or lacked a value, then we'll need
+    // to add a space before the '/>' to ensure that HTML parsers don't
+    // interpret the '/' as part of the attribute.  Decide that now, while
+    // the attributes are the ones we wrote.
+    lazy_close_needs_space_ = false;
+    if (!attrs.IsEmpty()) {
+      const HtmlElement::Attribute& attribute = *attrs.Last();
+      lazy_close_needs_space_ =
+          ((attribute.escaped_value() == NULL) ||
+           (attribute.quote_style() == HtmlElement::NO_QUOTE));
+    }
   } else {
     EmitBytes(">");
   }
@@ -182,17 +195,8 @@ void HtmlWriterFilter::EndElement(HtmlElement* element) {
       // explicitly close it, so we fall through.
       if (lazy_close_element_ == element) {
         lazy_close_element_ = NULL;
-
-        // If this attribute was unquoted, or lacked a value, then we'll need
-        // to add a space here to ensure that HTML parsers don't interpret the
-        // '/' in the '/>' as part of the attribute.
-        if (!element->attributes().IsEmpty()) {
-          const HtmlElement::Attribute& attribute =
-              *element->attributes().Last();
-          if ((attribute.escaped_value() == NULL) ||
-              (attribute.quote_style() == HtmlElement::NO_QUOTE)) {
-            EmitBytes(" ");
-          }
+        if (lazy_close_needs_space_) {
+          EmitBytes(" ");
         }
         EmitBytes("/>");
         break;
@@ -56,6 +56,18 @@ class HtmlWriterFilter : public HtmlFilter {
   virtual void Flush();
   virtual void DetermineEnabled(GoogleString* disabled_reason);
 
+  // Only serializes each event as it comes, so it can share a pass.
+  // Subclasses that change nodes, or look at other elements' attributes,
+  // must override this to return false.
+  virtual bool CanShareFlushPass() const { return true; }
+
+  // Raw markup is written out as is, which is what we'd have written for it
+  // anyway unless we are folding case or wrapping lines.  Subclasses that
+  // write anything but the markup they are given must return false.
+  virtual bool AcceptsRawMarkup() const {
+    return !case_fold_ && (max_column_ <= 0);
+  }
+
   void set_max_column(int max_column) { max_column_ = max_column; }
   void set_case_fold(bool case_fold) { case_fold_ = case_fold; }
 
@@ -93,6 +105,10 @@ class HtmlWriterFilter : public HtmlFilter {
   // first emit the delayed ">" before continuing.
   HtmlElement* lazy_close_element_;
 
+  // Whether "/>" must be preceded by a space for lazy_close_element_, as
+  // seen when its attributes were written.
+  bool lazy_close_needs_space_;
+
   int column_;
   int max_column_;
   int write_errors_;
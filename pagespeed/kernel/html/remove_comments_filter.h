@@ -68,6 +68,7 @@ class RemoveCommentsFilter : public EmptyHtmlFilter {
   virtual ~RemoveCommentsFilter();
 
   virtual void Comment(HtmlCommentNode* comment);
+  virtual int EventMask() const { return kCommentEvent; }
   virtual const char* Name() const { return "RemoveComments"; }
 
  private:
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/html/shared_name_table.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+#include "pagespeed/kernel/base/string_hash.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Room for two thousand distinct names, at well under a megabyte.
+const int kSingletonNumSlots = 4096;
+
+int RoundUpToPowerOfTwo(int n) {
+  int power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+}  // namespace
+
+SharedNameTable* SharedNameTable::singleton_ = NULL;
+
+SharedNameTable::SharedNameTable(int num_slots)
+    : num_slots_(RoundUpToPowerOfTwo(num_slots)),
+      capacity_(std::max(1, num_slots_ / 2)),
+      slots_(new base::subtle::AtomicWord[num_slots_]) {
+  for (int i = 0; i < num_slots_; ++i) {
+    slots_[i] = 0;
+  }
+}
+
+SharedNameTable::~SharedNameTable() {
+  for (int i = 0; i < num_slots_; ++i) {
+    DeleteEntry(reinterpret_cast<StringPiece*>(slots_[i]));
+  }
+}
+
+void SharedNameTable::Init() {
+  if (singleton_ == NULL) {
+    singleton_ = new SharedNameTable(kSingletonNumSlots);
+  }
+}
+
+void SharedNameTable::ShutDown() {
+  if (singleton_ != NULL) {
+    delete singleton_;
+    singleton_ = NULL;
+  }
+}
+
+const StringPiece* SharedNameTable::Intern(const StringPiece& name,
+                                           bool* found) {
+  *found = false;
+  if (name.size() > static_cast<size_t>(kMaxNameLength)) {
+    return NULL;
+  }
+  size_t hash = HashString<CasePreserve, size_t>(name.data(), name.size());
+  hash ^= hash >> 16;  // HashString leaves the low bits poorly mixed.
+  StringPiece* entry = NULL;  // Made when we first find a free slot.
+  const StringPiece* result = NULL;
+  for (int probe = 0; probe < kMaxProbes; ++probe) {
+    base::subtle::AtomicWord* slot =
+        &slots_[(hash + probe) & (num_slots_ - 1)];
+    const StringPiece* current = reinterpret_cast<const StringPiece*>(
+        base::subtle::Acquire_Load(slot));
+    if (current == NULL) {
+      // Names are never removed, so the name can't be in a later slot.
+      if (full()) {
+        break;
+      }
+      if (entry == NULL) {
+        entry = NewEntry(name);
+      }
+      if (base::subtle::Release_CompareAndSwap(
+              slot, 0, reinterpret_cast<base::subtle::AtomicWord>(entry))
+          == 0) {
+        num_names_.NoBarrierIncrement(1);
+        result = entry;
+        entry = NULL;
+        break;
+      }
+      // Another thread filled the slot first; see what it put there.
+      current = reinterpret_cast<const StringPiece*>(
+          base::subtle::Acquire_Load(slot));
+    }
+    if (*current == name) {
+      *found = true;
+      result = current;
+      break;
+    }
+  }
+  DeleteEntry(entry);
+  return result;
+}
+
+// The bytes of the name are allocated along with the StringPiece, right
+// after it.
+StringPiece* SharedNameTable::NewEntry(const StringPiece& name) {
+  char* block = new char[sizeof(StringPiece) + name.size()];
+  char* bytes = block + sizeof(StringPiece);
+  memcpy(bytes, name.data(), name.size());
+  return new(block) StringPiece(bytes, name.size());
+}
+
+void SharedNameTable::DeleteEntry(StringPiece* entry) {
+  if (entry != NULL) {
+    entry->~StringPiece();
+    delete[] reinterpret_cast<char*>(entry);
+  }
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_HTML_SHARED_NAME_TABLE_H_
+#define PAGESPEED_KERNEL_HTML_SHARED_NAME_TABLE_H_
+
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/atomicops.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+// A bounded table of the tag and attribute names that HtmlName has no
+// canonical string for (custom elements, data-* attributes, keywords in odd
+// case), shared by every HtmlParse in the process.  Sites repeat the same
+// few hundred such names on every page, so sharing them saves copying each
+// of them into every parse's own symbol table.
+//
+// Lookups take no lock.  Each slot is filled once, by compare-and-swap, and
+// never changes after that, so a name, once interned, stays put until the
+// table is destroyed.  Nothing is ever evicted: a parse may hold on to any
+// interned name without a lock, so a slot can't be safely reused.
+//
+// Instead, the table stops taking new names once it holds capacity() of
+// them, half its slots, which keeps probe sequences short.  From then on
+// Intern only looks names up, and a name it hasn't got costs no more than
+// the probes up to the first empty slot.  A process that sees more distinct
+// names than that shares the first ones it saw; the rest are copied into
+// each parse's own table, as they would be with no shared table at all.
+// When a name is too long, the table is full, or the slots it may go in are
+// all taken by other names, Intern returns NULL and the caller must keep its
+// own copy.
+class SharedNameTable {
+ public:
+  // Names longer than this are never interned, which bounds the memory the
+  // table can use along with its number of slots.
+  static const int kMaxNameLength = 64;
+
+  // num_slots is rounded up to a power of two, and capacity() is half that.
+  explicit SharedNameTable(int num_slots);
+  ~SharedNameTable();
+
+  // Initialize the process-wide instance used by HtmlParse.  This call is
+  // inherently thread unsafe, but only the first time it is called.
+  // If multi-threaded programs call this function before spawning
+  // threads then there will be no races.
+  static void Init();
+
+  // Tear down the process-wide instance.  This call is inherently thread
+  // unsafe.
+  static void ShutDown();
+
+  // The process-wide instance, or NULL if Init hasn't been called.
+  static SharedNameTable* Singleton() { return singleton_; }
+
+  // Returns the table's copy of name, adding it if it isn't there yet, or
+  // NULL if there is no room for it.  Sets *found to whether the name was
+  // there already.  Names are case-sensitive.  Thread-safe.
+  const StringPiece* Intern(const StringPiece& name, bool* found);
+
+  // The number of names interned so far.  Threads racing to add names as
+  // the table fills up can take this a little past capacity().
+  int num_names() const { return num_names_.value(); }
+
+  // How many names the table takes before it stops adding them.
+  int capacity() const { return capacity_; }
+  bool full() const { return num_names() >= capacity_; }
+
+ private:
+  // How many slots, starting at its hash, a name may go in.
+  static const int kMaxProbes = 8;
+
+  static StringPiece* NewEntry(const StringPiece& name);
+  static void DeleteEntry(StringPiece* entry);
+
+  const int num_slots_;  // A power of two.
+  const int capacity_;
+  // Each holds a StringPiece* and its bytes, allocated by NewEntry, or 0.
+  scoped_array<base::subtle::AtomicWord> slots_;
+  AtomicInt32 num_names_;
+
+  static SharedNameTable* singleton_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedNameTable);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_HTML_SHARED_NAME_TABLE_H_
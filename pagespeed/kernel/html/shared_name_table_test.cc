@@ -0,0 +1,97 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/html/shared_name_table.h"
+
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+namespace {
+
+TEST(SharedNameTableTest, InternsOneCopy) {
+  SharedNameTable table(16);
+  bool found = true;
+  GoogleString name("ng-click");
+  const StringPiece* first = table.Intern(name, &found);
+  ASSERT_TRUE(first != NULL);
+  EXPECT_FALSE(found);
+  EXPECT_EQ("ng-click", *first);
+  EXPECT_NE(name.data(), first->data());
+
+  const StringPiece* second = table.Intern("ng-click", &found);
+  EXPECT_TRUE(found);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(1, table.num_names());
+}
+
+TEST(SharedNameTableTest, CaseSensitive) {
+  SharedNameTable table(16);
+  bool found;
+  const StringPiece* lower = table.Intern("v-if", &found);
+  const StringPiece* upper = table.Intern("V-IF", &found);
+  EXPECT_FALSE(found);
+  EXPECT_NE(lower, upper);
+  EXPECT_EQ("V-IF", *upper);
+  EXPECT_EQ(2, table.num_names());
+}
+
+TEST(SharedNameTableTest, LongNamesNotInterned) {
+  SharedNameTable table(16);
+  bool found;
+  GoogleString name(SharedNameTable::kMaxNameLength, 'a');
+  EXPECT_TRUE(table.Intern(name, &found) != NULL);
+  name += 'a';
+  EXPECT_TRUE(table.Intern(name, &found) == NULL);
+  EXPECT_FALSE(found);
+  EXPECT_EQ(1, table.num_names());
+}
+
+TEST(SharedNameTableTest, Full) {
+  // 8 slots take 4 names; after that, names are only looked up.
+  SharedNameTable table(8);
+  EXPECT_EQ(4, table.capacity());
+  bool found;
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_FALSE(table.full()) << i;
+    EXPECT_TRUE(table.Intern(IntegerToString(i), &found) != NULL) << i;
+  }
+  EXPECT_TRUE(table.full());
+  EXPECT_TRUE(table.Intern("4", &found) == NULL);
+  EXPECT_FALSE(found);
+  EXPECT_EQ(4, table.num_names());
+
+  // Names already there are still found.
+  EXPECT_EQ("3", *table.Intern("3", &found));
+  EXPECT_TRUE(found);
+
+  // A name turned away once is turned away again, rather than taking one of
+  // the free slots.
+  EXPECT_TRUE(table.Intern("4", &found) == NULL);
+  EXPECT_FALSE(found);
+  EXPECT_EQ(4, table.num_names());
+}
+
+TEST(SharedNameTableTest, CapacityRoundsUp) {
+  EXPECT_EQ(8, SharedNameTable(10).capacity());
+  EXPECT_EQ(1, SharedNameTable(1).capacity());
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -288,6 +288,23 @@ void MimeTypeListToContentTypeSet(
   }
 }
 
+bool ContentType::IsCompressible() const {
+  switch (type_) {
+    case kHtml:
+    case kXhtml:
+    case kCeHtml:
+    case kJavascript:
+    case kCss:
+    case kText:
+    case kXml:
+    case kJson:
+    case kSourceMap:
+      return true;
+    default:
+      return false;
+  }
+}
+
 bool ContentType::IsLikelyStaticResource() const {
   switch (type_) {
     case kCeHtml:
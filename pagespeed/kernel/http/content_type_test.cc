@@ -136,6 +136,20 @@ TEST_F(ContentTypeTest, ConstantSanityCheck) {
   EXPECT_EQ(ContentType::kOctetStream, kContentTypeBinaryOctetStream.type());
 }
 
+TEST_F(ContentTypeTest, IsCompressible) {
+  EXPECT_TRUE(kContentTypeHtml.IsCompressible());
+  EXPECT_TRUE(kContentTypeJavascript.IsCompressible());
+  EXPECT_TRUE(kContentTypeCss.IsCompressible());
+  EXPECT_TRUE(kContentTypeText.IsCompressible());
+  EXPECT_TRUE(kContentTypeJson.IsCompressible());
+  EXPECT_TRUE(kContentTypeSourceMap.IsCompressible());
+  EXPECT_FALSE(kContentTypePng.IsCompressible());
+  EXPECT_FALSE(kContentTypeJpeg.IsCompressible());
+  EXPECT_FALSE(kContentTypeWebp.IsCompressible());
+  EXPECT_FALSE(kContentTypePdf.IsCompressible());
+  EXPECT_FALSE(kContentTypeBinaryOctetStream.IsCompressible());
+}
+
 // Checks that empty string is parsed correctly and results in empty set and
 // nothing is crashing.
 TEST(MimeTypeListToContentTypeSetTest, EmptyTest) {
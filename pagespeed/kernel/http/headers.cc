@@ -26,11 +26,11 @@
 #include "pagespeed/kernel/base/proto_util.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
-#include "pagespeed/kernel/base/string_multi_map.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/writer.h"
 #include "pagespeed/kernel/http/http.pb.h"
 #include "pagespeed/kernel/http/http_names.h"
+#include "pagespeed/kernel/http/known_headers.h"
 
 namespace net_instaweb {
 
@@ -123,19 +123,22 @@ template<class Proto> Headers<Proto>::~Headers() {
   Clear();
 }
 
+// Note that subclasses clear the headers in the proto after calling this,
+// so we clear the index rather than rebuilding it.
 template<class Proto> void Headers<Proto>::Clear() {
   proto_->clear_major_version();
   proto_->clear_minor_version();
-  map_.reset(NULL);
-  cookies_.reset(NULL);
+  ClearIndex();
 }
 
 template<class Proto> void Headers<Proto>::SetProto(Proto* proto) {
   proto_.reset(proto);
+  RebuildIndex();
 }
 
 template<class Proto> void Headers<Proto>::CopyProto(const Proto& proto) {
   proto_->CopyFrom(proto);
+  RebuildIndex();
 }
 
 template<class Proto> int Headers<Proto>::major_version() const {
@@ -174,24 +177,44 @@ template<class Proto> const GoogleString& Headers<Proto>::Value(int i) const {
 
 template<class Proto> void Headers<Proto>::SetValue(int i, StringPiece value) {
   value.CopyToString(proto_->mutable_header(i)->mutable_value());
-  map_.reset(NULL);
+  RebuildIndex();
+}
+
+template<class Proto> void Headers<Proto>::ClearIndex() {
+  names_.clear();
+  split_values_.clear();
+  for (int i = 0; i < KnownHeaders::kNumKnownHeaders; ++i) {
+    known_names_[i] = -1;
+  }
   cookies_.reset(NULL);
 }
 
-template<class Proto> void Headers<Proto>::PopulateMap() const {
-  if (map_.get() == NULL) {
-    map_.reset(new StringMultiMapInsensitive);
-    cookies_.reset(NULL);
-    for (int i = 0, n = NumAttributes(); i < n; ++i) {
-      AddToMap(Name(i), Value(i));
+template<class Proto> void Headers<Proto>::RebuildIndex() {
+  ClearIndex();
+  for (int i = 0, n = NumAttributes(); i < n; ++i) {
+    IndexHeader(i);
+  }
+}
+
+template<class Proto> int Headers<Proto>::FindName(
+    const StringPiece& name) const {
+  int known_id = KnownHeaders::Lookup(name);
+  if (known_id != KnownHeaders::kNotKnown) {
+    return known_names_[known_id];
+  }
+  for (int i = 0, n = names_.size(); i < n; ++i) {
+    const NameEntry& entry = names_[i];
+    if ((entry.known_id == KnownHeaders::kNotKnown) &&
+        StringCaseEqual(*entry.name, name)) {
+      return i;
     }
   }
+  return -1;
 }
 
 template<class Proto> const typename Headers<Proto>::CookieMultimap*
 Headers<Proto>::PopulateCookieMap(StringPiece header_name) const {
   if (cookies_.get() == NULL) {
-    PopulateMap();  // Since this resets cookies_ if map_ is NULL.
     cookies_.reset(new CookieMultimap);
     ConstStringStarVector cookies;
     if (Lookup(header_name, &cookies)) {
@@ -226,14 +249,17 @@ Headers<Proto>::PopulateCookieMap(StringPiece header_name) const {
 }
 
 template<class Proto> int Headers<Proto>::NumAttributeNames() const {
-  PopulateMap();
-  return map_->num_names();
+  return names_.size();
 }
 
 template<class Proto> bool Headers<Proto>::Lookup(
     const StringPiece& name, ConstStringStarVector* values) const {
-  PopulateMap();
-  return map_->Lookup(name, values);
+  int index = FindName(name);
+  if (index < 0) {
+    return false;
+  }
+  *values = names_[index].values;
+  return true;
 }
 
 template<class Proto> const char* Headers<Proto>::Lookup1(
@@ -246,8 +272,7 @@ template<class Proto> const char* Headers<Proto>::Lookup1(
 }
 
 template<class Proto> bool Headers<Proto>::Has(const StringPiece& name) const {
-  PopulateMap();
-  return map_->Has(name);
+  return FindName(name) >= 0;
 }
 
 template<class Proto> bool Headers<Proto>::HasValue(
@@ -306,19 +331,38 @@ template<class Proto> void Headers<Proto>::Add(
   NameValue* name_value = proto_->add_header();
   name_value->set_name(name.data(), name.size());
   name_value->set_value(value.data(), value.size());
-  AddToMap(name, value);
+  IndexHeader(NumAttributes() - 1);
+  cookies_.reset(NULL);  // Pessimistically assume this.
   UpdateHook();
 }
 
-template<class Proto> void Headers<Proto>::AddToMap(
-    const StringPiece& name, const StringPiece& value) const {
-  if (map_.get() != NULL) {
-    StringPieceVector split;
-    SplitValues(name, value, &split);
-    for (int i = 0, n = split.size(); i < n; ++i) {
-      map_->Add(name, split[i]);
+template<class Proto> void Headers<Proto>::IndexHeader(int i) {
+  const NameValue& name_value = proto_->header(i);
+  const GoogleString& name = name_value.name();
+  int index = FindName(name);
+  if (index < 0) {
+    index = names_.size();
+    names_.push_back(NameEntry());
+    NameEntry& entry = names_.back();
+    entry.name = &name;
+    entry.known_id = KnownHeaders::Lookup(name);
+    if (entry.known_id != KnownHeaders::kNotKnown) {
+      known_names_[entry.known_id] = index;
+    }
+  }
+  ConstStringStarVector* values = &names_[index].values;
+
+  const GoogleString& value = name_value.value();
+  StringPieceVector split;
+  SplitValues(name, value, &split);
+  if ((split.size() == 1) && (split[0] == value)) {
+    // Nothing to split or trim: point at the value in the proto.
+    values->push_back(&value);
+  } else {
+    for (int j = 0, n = split.size(); j < n; ++j) {
+      split_values_.push_back(split[j].as_string());
+      values->push_back(&split_values_.back());
     }
-    cookies_.reset(NULL);  // Pessimistically assume this.
   }
 }
 
@@ -357,9 +401,8 @@ template<class Proto> void Headers<Proto>::RemoveCookie(
 // listed a header with 100 (or more) values.
 template<class Proto> bool Headers<Proto>::Remove(const StringPiece& name,
                                                   const StringPiece& value) {
-  PopulateMap();
   ConstStringStarVector values;
-  bool found = map_->Lookup(name, &values);
+  bool found = Lookup(name, &values);
   if (found) {
     int val_index = -1;
     for (int i = values.size() - 1; i >= 0; --i) {
@@ -411,37 +454,20 @@ template<class Proto> bool Headers<Proto>::RemoveAll(const StringPiece& name) {
 
 template<class Proto> bool Headers<Proto>::RemoveAllFromSortedArray(
     const StringPiece* names, int names_size) {
-  // First, we update the map.
-  PopulateMap();
-  bool removed_anything = map_->RemoveAllFromSortedArray(names, names_size);
-
-  // If we removed anything, we update the proto as well.
-  if (removed_anything) {
-    // Remove all headers that are slated for removal.
-    protobuf::RepeatedPtrField<NameValue>* headers = proto_->mutable_header();
-    // Note: you might be tempted to consider repopulating the protobuf
-    // from the map, which should be correct at this point, rather
-    // than doing more searches.  This is feasible, but will result in
-    // splitting multi-value entries into separate headers, e.g.
-    // Cache-Control:max-age=0, no-cache will become two separate Cache-Control
-    // entries, which will cause
-    // ResponseHeadersTest.TestRemoveDoesntSeparateCommaValues to fail.
-    // headers->Clear();
-    // for (int i = 0; i < map_->num_values(); ++i) {
-    //   NameValue* name_value = proto_->add_header();
-    //   name_value->set_name(map_->name(i));
-    //   const GoogleString* value = map_->value(i);
-    //   name_value->set_value(value->data(), value->size());
-    // }
-    //
-    // Instead, we call this helper, which re-implements StringMultiMap
-    // functionality in the protobuf.
-    RemoveFromHeaders(names, names_size, headers);
-    cookies_.reset(NULL);  // Pessimistically assume this.
-    UpdateHook();
+  // Most of the time none of the names are present, so check the index
+  // before scanning the protobuf.
+  bool any_present = false;
+  for (int i = 0; !any_present && (i < names_size); ++i) {
+    any_present = Has(names[i]);
+  }
+  if (!any_present) {
+    return false;
   }
 
-  return removed_anything;
+  RemoveFromHeaders(names, names_size, proto_->mutable_header());
+  RebuildIndex();
+  UpdateHook();
+  return true;
 }
 
 template<class Proto> bool Headers<Proto>::RemoveFromHeaders(
@@ -470,8 +496,7 @@ template<class Proto> bool Headers<Proto>::RemoveAllWithPrefix(
   }
   bool ret = RemoveUnneeded(to_keep, headers);
   if (ret) {
-    map_.reset(NULL);  // Map must be repopulated before next lookup operation.
-    cookies_.reset(NULL);
+    RebuildIndex();
     UpdateHook();
   }
   return ret;
@@ -479,9 +504,9 @@ template<class Proto> bool Headers<Proto>::RemoveAllWithPrefix(
 
 template<class Proto> bool Headers<Proto>::RemoveIfNotIn(const Headers& keep) {
   // There are two removal scenarios: removing every value for a header, and
-  // leaving some behind.  We don't use this->map_ to do this operation, but
-  // we must invalidate the map if we make any mutations.  However we do use
-  // keep.map_ via calls to keep.Lookup(name).
+  // leaving some behind.  We don't use this index to do this operation, but
+  // we must rebuild it if we make any mutations.  However we do use keep's
+  // index via calls to keep.Lookup(name).
   //
   // Keep in mind also, that names may appear multiple times in the protobuf,
   // each with multiple values.  Typically Set-Cookie appears multiple times
@@ -555,11 +580,10 @@ template<class Proto> bool Headers<Proto>::RemoveIfNotIn(const Headers& keep) {
   // Next we remove any protobuf entries with no matching values.
   ret |= RemoveUnneeded(to_keep, proto_->mutable_header());
 
-  // Finally, if we did any mutations, clear the map_.  We didn't use this->map_
+  // Finally, if we did any mutations, rebuild the index.  We didn't use it
   // to execute the removals, but we may have invalidated it.
   if (ret) {
-    map_.reset(NULL);
-    cookies_.reset(NULL);
+    RebuildIndex();
     UpdateHook();
   }
   return ret;
@@ -605,7 +629,9 @@ template<class Proto> bool Headers<Proto>::ReadFromBinary(
     const StringPiece& buf, MessageHandler* message_handler) {
   Clear();
   ArrayInputStream input(buf.data(), buf.size());
-  return proto_->ParseFromZeroCopyStream(&input);
+  bool ret = proto_->ParseFromZeroCopyStream(&input);
+  RebuildIndex();
+  return ret;
 }
 
 template<class Proto> bool Headers<Proto>::WriteAsHttp(
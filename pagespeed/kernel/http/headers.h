@@ -17,20 +17,22 @@
 #ifndef PAGESPEED_KERNEL_HTTP_HEADERS_H_
 #define PAGESPEED_KERNEL_HTTP_HEADERS_H_
 
+#include <deque>
 #include <map>
 #include <utility>
+#include <vector>
 
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/proto_util.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/http/known_headers.h"
 
 namespace net_instaweb {
 
 class MessageHandler;
 class NameValue;
-class StringMultiMapInsensitive;
 class Writer;
 
 // Read/write API for HTTP headers (shared base class)
@@ -68,13 +70,11 @@ template<class Proto> class Headers {
   // equivalent either way.  See:
   //   http://tools.ietf.org/html/draft-ietf-httpbis-p1-messaging-26#section-3.2.2
   //
-  // Note that Lookup, though declared const, is NOT thread-safe.  This
-  // is because it lazily generates a map.
-  // TODO(jmarantz): this is a problem waiting to happen, but I believe it
-  // will not be a problem in the immediate future.  We can refactor our way
-  // around this problem by moving the Map to an explicit separate class that
-  // can be instantiated to assist with Lookups and Remove.  But that should
-  // be done in a separate CL from the one I'm typing into now.
+  // Lookup and the other const accessors are thread-safe, as the index they
+  // use is kept up to date by every mutation rather than built lazily.  The
+  // exception is the cookie map used by subclasses; see PopulateCookieMap.
+  //
+  // The returned pointers are invalidated by any mutation other than Add.
   bool Lookup(const StringPiece& name, ConstStringStarVector* values) const;
 
   // Looks up a single attribute value.  Returns NULL if the attribute is not
@@ -88,7 +88,7 @@ template<class Proto> class Headers {
   // Is value one of the values in Lookup(name)?
   bool HasValue(const StringPiece& name, const StringPiece& value) const;
 
-  // NumAttributeNames is also const but not thread-safe.
+  // Returns the number of distinct (case-insensitive) header names.
   int NumAttributeNames() const;
 
   // Remove all instances of cookie_name in all the cookie headers.
@@ -185,8 +185,6 @@ template<class Proto> class Headers {
   void SetProto(Proto* proto);  // Takes ownership of the argument.
   void CopyProto(const Proto& proto);
 
-  void PopulateMap() const;  // const is a lie, mutates map_.
-
   // Populates the cookies map and returns a const pointer to it. 'name' is
   // the name of the header to lookup: either "Cookie" for request headers or
   // "Set-Cookie" for response headers. The header is assumed to contain semi-
@@ -209,26 +207,44 @@ template<class Proto> class Headers {
   Proto* mutable_proto() { return proto_.get(); }
 
  private:
-  // If name is a comma-separated field (above), then split value at commas,
-  // and add name, val for each of the comma-separated values
-  // (removing whitespace and commas).
-  // Otherwise, add the name, value pair to the map_.
-  // const is a lie
-  // NOTE: the map will contain the comma-split values, but the protobuf
-  // will contain the original pairs including comma-separated values.
-  void AddToMap(const StringPiece& name, const StringPiece& value) const;
-
-  // We have two representations for the name/value pairs.  Proto contains a
-  // simple string-pair vector, but lacks a fast associative lookup.  So we
-  // will build structures for associative lookup lazily, and keep them
-  // up-to-date if they are present.
-  mutable scoped_ptr<StringMultiMapInsensitive> map_;
+  // All the values of one header name, in the order they were added.
+  struct NameEntry {
+    const GoogleString* name;  // The first occurrence's name, in proto_.
+    int known_id;              // KnownHeaders id, or KnownHeaders::kNotKnown.
+    ConstStringStarVector values;
+  };
+
+  // Returns the index into names_ for name, or -1 if absent.
+  int FindName(const StringPiece& name) const;
+
+  // Adds the i'th header in proto_ to the index.  If its name is a
+  // comma-separated field, the value is split at commas (removing
+  // whitespace), and each piece is indexed separately.  Note that the
+  // protobuf keeps the original pairs including comma-separated values.
+  void IndexHeader(int i);
+
+  // Rebuilds the index from proto_ after a mutation that can remove or
+  // change existing headers.
+  void RebuildIndex();
+  void ClearIndex();
+
+  // The name/value pairs live in proto_, in order.  For fast associative
+  // lookup we also keep an index of them, pointing into proto_ rather than
+  // copying, except for comma-separated values which are split apart into
+  // split_values_.  Well-known names are found through known_names_,
+  // indexed by their perfect-hashed KnownHeaders id; others are searched
+  // for among the (typically few) entries in names_.
   scoped_ptr<Proto> proto_;
+  std::vector<NameEntry> names_;
+  int known_names_[KnownHeaders::kNumKnownHeaders];
+  std::deque<GoogleString> split_values_;
 
   // Furthermore, we also have a map of cookie names to <value, attributes>.
-  // It is lazilyloaded by PopulateCookieMap as/when required. The keys and
-  // values all point into the map_ data element. We cater for the same cookie
-  // being set multiple times though we don't necessarily handle that correctly.
+  // It is lazily loaded by PopulateCookieMap as/when required, so unlike the
+  // rest of the const interface it is not thread-safe until populated. The
+  // keys and values all point into proto_ values. We cater for the same
+  // cookie being set multiple times though we don't necessarily handle that
+  // correctly.
   mutable scoped_ptr<CookieMultimap> cookies_;
 
   DISALLOW_COPY_AND_ASSIGN(Headers);
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_HTTP_KNOWN_HEADERS_H_
+#define PAGESPEED_KERNEL_HTTP_KNOWN_HEADERS_H_
+
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+// Maps the commonly used HTTP header names to small dense ids, using a
+// perfect hash generated by gperf from known_headers.gperf.  Headers uses
+// this to index well-known headers without string comparisons.
+class KnownHeaders {
+ public:
+  static const int kNumKnownHeaders = 50;
+  static const int kNotKnown = -1;
+
+  // Returns the id of name, matched case-insensitively, in
+  // [0, kNumKnownHeaders), or kNotKnown.
+  static int Lookup(const StringPiece& name);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_HTTP_KNOWN_HEADERS_H_
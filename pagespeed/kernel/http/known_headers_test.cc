@@ -0,0 +1,64 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/http/known_headers.h"
+
+#include <set>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/http/http_names.h"
+
+namespace net_instaweb {
+
+namespace {
+
+TEST(KnownHeadersTest, LookupIsCaseInsensitive) {
+  int id = KnownHeaders::Lookup(HttpAttributes::kCacheControl);
+  ASSERT_NE(KnownHeaders::kNotKnown, id);
+  EXPECT_EQ(id, KnownHeaders::Lookup("cache-control"));
+  EXPECT_EQ(id, KnownHeaders::Lookup("CACHE-CONTROL"));
+}
+
+TEST(KnownHeadersTest, Unknown) {
+  EXPECT_EQ(KnownHeaders::kNotKnown, KnownHeaders::Lookup(""));
+  EXPECT_EQ(KnownHeaders::kNotKnown, KnownHeaders::Lookup("X-Not-A-Header"));
+  EXPECT_EQ(KnownHeaders::kNotKnown, KnownHeaders::Lookup("Cache-Contro"));
+  EXPECT_EQ(KnownHeaders::kNotKnown, KnownHeaders::Lookup("Cache-Controls"));
+}
+
+TEST(KnownHeadersTest, IdsAreDistinct) {
+  const char* names[] = {
+    HttpAttributes::kAccept, HttpAttributes::kAcceptEncoding,
+    HttpAttributes::kCacheControl, HttpAttributes::kContentEncoding,
+    HttpAttributes::kContentLength, HttpAttributes::kContentType,
+    HttpAttributes::kCookie, HttpAttributes::kDate, HttpAttributes::kEtag,
+    HttpAttributes::kExpires, HttpAttributes::kLastModified,
+    HttpAttributes::kSetCookie, HttpAttributes::kUserAgent,
+    HttpAttributes::kVary,
+  };
+  std::set<int> ids;
+  for (int i = 0, n = arraysize(names); i < n; ++i) {
+    int id = KnownHeaders::Lookup(names[i]);
+    EXPECT_LE(0, id) << names[i];
+    EXPECT_GT(KnownHeaders::kNumKnownHeaders, id) << names[i];
+    EXPECT_TRUE(ids.insert(id).second) << names[i];
+  }
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -89,7 +89,7 @@ class RequestHeaders : public Headers<HttpRequestHeaders> {
   // Calling this method on an object that will not have any mutating
   // operations called on it afterwards will ensure that it will not do any
   // lazy initialization behind the scenes.
-  void PopulateLazyCaches() { PopulateMap(); }
+  void PopulateLazyCaches() { GetAllCookies(); }
 
   Properties GetProperties() const;
 
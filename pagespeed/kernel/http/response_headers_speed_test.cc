@@ -0,0 +1,93 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks parsing response headers, computing their caching fields, and
+// looking them up.
+//
+// .../src/out/Release/mod_pagespeed_speed_test "BM_ResponseHeaders*"
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/http/http_names.h"
+#include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/http/response_headers_parser.h"
+
+namespace {
+
+const char kResponse[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Date: Fri, 22 Apr 2011 19:34:33 GMT\r\n"
+    "Server: Apache/2.2.22 (Ubuntu)\r\n"
+    "Last-Modified: Thu, 21 Apr 2011 10:00:00 GMT\r\n"
+    "Etag: \"2a4c3-5b6-4a17d1b9c6f40\"\r\n"
+    "Accept-Ranges: bytes\r\n"
+    "Cache-Control: max-age=300, public\r\n"
+    "Expires: Fri, 22 Apr 2011 19:39:33 GMT\r\n"
+    "Vary: Accept-Encoding, User-Agent\r\n"
+    "Content-Type: text/css\r\n"
+    "Content-Length: 1462\r\n"
+    "Set-Cookie: CG=US:CA:Mountain+View; path=/\r\n"
+    "Set-Cookie: UA=chrome; path=/\r\n"
+    "X-Content-Type-Options: nosniff\r\n"
+    "X-Frame-Options: SAMEORIGIN\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+void ParseHeaders(net_instaweb::ResponseHeaders* headers) {
+  net_instaweb::NullMessageHandler handler;
+  net_instaweb::ResponseHeadersParser parser(headers);
+  parser.ParseChunk(kResponse, &handler);
+  CHECK(parser.headers_complete());
+}
+
+void BM_ResponseHeadersParse(int iters) {
+  for (int i = 0; i < iters; ++i) {
+    net_instaweb::ResponseHeaders headers;
+    ParseHeaders(&headers);
+  }
+}
+
+void BM_ResponseHeadersComputeCaching(int iters) {
+  for (int i = 0; i < iters; ++i) {
+    net_instaweb::ResponseHeaders headers;
+    ParseHeaders(&headers);
+    headers.ComputeCaching();
+    CHECK(headers.IsBrowserCacheable());
+    CHECK_EQ(300 * 1000, headers.cache_ttl_ms());
+  }
+}
+
+void BM_ResponseHeadersLookup(int iters) {
+  net_instaweb::ResponseHeaders headers;
+  ParseHeaders(&headers);
+  net_instaweb::ConstStringStarVector values;
+  for (int i = 0; i < iters; ++i) {
+    CHECK(headers.Lookup(net_instaweb::HttpAttributes::kCacheControl,
+                         &values));
+    CHECK(headers.Has(net_instaweb::HttpAttributes::kContentType));
+    CHECK(headers.Has("x-frame-options"));
+    CHECK(!headers.Has(net_instaweb::HttpAttributes::kContentEncoding));
+    CHECK(!headers.Has("X-Not-Present"));
+  }
+}
+
+}  // namespace
+
+BENCHMARK(BM_ResponseHeadersParse);
+BENCHMARK(BM_ResponseHeadersComputeCaching);
+BENCHMARK(BM_ResponseHeadersLookup);
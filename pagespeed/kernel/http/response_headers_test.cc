@@ -1292,6 +1292,42 @@ TEST_F(ResponseHeadersTest, TestProxyAndMustRevalidate) {
 
 // There was a bug that calling RemoveAll would re-populate the proto from
 // map_ which would separate all comma-separated values.
+TEST_F(ResponseHeadersTest, LookupTracksMutations) {
+  response_headers_.Add(HttpAttributes::kCacheControl, "max-age=0, no-cache");
+  response_headers_.Add("X-Custom", "a");
+  response_headers_.Add("x-custom", "b");
+  response_headers_.Add(HttpAttributes::kContentType, "text/css");
+  EXPECT_EQ(3, response_headers_.NumAttributeNames());
+
+  // Both well-known and other names are matched case-insensitively.
+  ConstStringStarVector values;
+  ASSERT_TRUE(response_headers_.Lookup("CACHE-CONTROL", &values));
+  ASSERT_EQ(2, values.size());
+  EXPECT_EQ("max-age=0", *values[0]);
+  EXPECT_EQ("no-cache", *values[1]);
+  ASSERT_TRUE(response_headers_.Lookup("X-CUSTOM", &values));
+  ASSERT_EQ(2, values.size());
+  EXPECT_EQ("a", *values[0]);
+  EXPECT_EQ("b", *values[1]);
+
+  response_headers_.SetValue(1, "c");
+  ASSERT_TRUE(response_headers_.Lookup("X-Custom", &values));
+  ASSERT_EQ(2, values.size());
+  EXPECT_EQ("c", *values[0]);
+
+  EXPECT_TRUE(response_headers_.RemoveAllWithPrefix("X-"));
+  EXPECT_FALSE(response_headers_.Has("X-Custom"));
+  EXPECT_STREQ("text/css",
+               response_headers_.Lookup1(HttpAttributes::kContentType));
+  EXPECT_EQ(2, response_headers_.NumAttributeNames());
+
+  EXPECT_FALSE(response_headers_.RemoveAll("X-Custom"));
+  EXPECT_TRUE(response_headers_.RemoveAll(HttpAttributes::kContentType));
+  EXPECT_FALSE(response_headers_.Has(HttpAttributes::kContentType));
+  EXPECT_TRUE(response_headers_.Has(HttpAttributes::kCacheControl));
+  EXPECT_EQ(1, response_headers_.NumAttributeNames());
+}
+
 TEST_F(ResponseHeadersTest, TestRemoveDoesntSeparateCommaValues) {
   response_headers_.Add(HttpAttributes::kCacheControl, "max-age=0, no-cache");
   response_headers_.Add(HttpAttributes::kSetCookie, "blah");
@@ -380,7 +380,8 @@ const Dimension kKnownScreenDimensions[] = {
 // https://developers.google.com/speed/pagespeed/service/CacheHtml
 
 UserAgentMatcher::UserAgentMatcher()
-    : chrome_version_pattern_(kChromeVersionPattern) {
+    : chrome_version_pattern_(kChromeVersionPattern),
+      capability_cache_(NULL) {
   // Initialize FastWildcardGroup for image inlining whitelist & blacklist.
   for (int i = 0, n = arraysize(kImageInliningWhitelist); i < n; ++i) {
     supports_image_inlining_.Allow(kImageInliningWhitelist[i]);
@@ -493,7 +494,65 @@ UserAgentMatcher::UserAgentMatcher()
 UserAgentMatcher::~UserAgentMatcher() {
 }
 
+uint32 UserAgentMatcher::ComputeCapabilities(StringPiece user_agent) const {
+  DeviceType device_type = MatchDeviceType(user_agent);
+  uint32 capabilities = device_type;
+  capabilities |= (MatchPrefetchMechanism(user_agent) <<
+                   kPrefetchMechanismShift);
+  if (MatchIe(user_agent)) {
+    capabilities |= kCapabilityIsIe;
+  }
+  if (MatchImageInlining(user_agent)) {
+    capabilities |= kCapabilityImageInlining;
+  }
+  if (supports_lazyload_images_.Match(user_agent, true)) {
+    capabilities |= kCapabilityLazyloadImages;
+  }
+  if (MatchJsDefer(user_agent, device_type, false)) {
+    capabilities |= kCapabilityJsDefer;
+  }
+  if (MatchJsDefer(user_agent, device_type, true)) {
+    capabilities |= kCapabilityJsDeferAllowMobile;
+  }
+  if (supports_webp_.Match(user_agent, false)) {
+    capabilities |= kCapabilityWebp;
+  }
+  if (supports_webp_lossless_alpha_.Match(user_agent, false)) {
+    capabilities |= kCapabilityWebpLosslessAlpha;
+  }
+  if (supports_webp_animated_.Match(user_agent, false)) {
+    capabilities |= kCapabilityWebpAnimated;
+  }
+  if (supports_dns_prefetch_.Match(user_agent, false)) {
+    capabilities |= kCapabilityDnsPrefetch;
+  }
+  if (mobilization_user_agents_.Match(user_agent, false)) {
+    capabilities |= kCapabilityMobilization;
+  }
+  return capabilities;
+}
+
+bool UserAgentMatcher::LookupCapabilities(StringPiece user_agent,
+                                          uint32* capabilities) const {
+  if (capability_cache_ == NULL) {
+    return false;
+  }
+  if (!capability_cache_->Lookup(user_agent, capabilities)) {
+    *capabilities = ComputeCapabilities(user_agent);
+    capability_cache_->Insert(user_agent, *capabilities);
+  }
+  return true;
+}
+
 bool UserAgentMatcher::IsIe(const StringPiece& user_agent) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return (capabilities & kCapabilityIsIe) != 0;
+  }
+  return MatchIe(user_agent);
+}
+
+bool UserAgentMatcher::MatchIe(StringPiece user_agent) const {
   return ie_user_agents_.Match(user_agent, false);
 }
 
@@ -503,6 +562,14 @@ bool UserAgentMatcher::IsIe9(const StringPiece& user_agent) const {
 
 bool UserAgentMatcher::SupportsImageInlining(
     const StringPiece& user_agent) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return (capabilities & kCapabilityImageInlining) != 0;
+  }
+  return MatchImageInlining(user_agent);
+}
+
+bool UserAgentMatcher::MatchImageInlining(StringPiece user_agent) const {
   if (user_agent.empty()) {
     return true;
   }
@@ -510,6 +577,10 @@ bool UserAgentMatcher::SupportsImageInlining(
 }
 
 bool UserAgentMatcher::SupportsLazyloadImages(StringPiece user_agent) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return (capabilities & kCapabilityLazyloadImages) != 0;
+  }
   return supports_lazyload_images_.Match(user_agent, true);
 }
 
@@ -535,6 +606,16 @@ UserAgentMatcher::BlinkRequestType UserAgentMatcher::GetBlinkRequestType(
 
 UserAgentMatcher::PrefetchMechanism UserAgentMatcher::GetPrefetchMechanism(
     const StringPiece& user_agent) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return static_cast<PrefetchMechanism>(
+        (capabilities & kPrefetchMechanismMask) >> kPrefetchMechanismShift);
+  }
+  return MatchPrefetchMechanism(user_agent);
+}
+
+UserAgentMatcher::PrefetchMechanism UserAgentMatcher::MatchPrefetchMechanism(
+    StringPiece user_agent) const {
   // Chrome >= 42 has link rel=prefetch that's good at actually using the
   // prefetch result, prioritize using that.
   int major, minor, build, patch;
@@ -553,19 +634,39 @@ UserAgentMatcher::PrefetchMechanism UserAgentMatcher::GetPrefetchMechanism(
 
 bool UserAgentMatcher::SupportsDnsPrefetch(
     const StringPiece& user_agent) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return (capabilities & kCapabilityDnsPrefetch) != 0;
+  }
   return supports_dns_prefetch_.Match(user_agent, false);
 }
 
 bool UserAgentMatcher::SupportsJsDefer(const StringPiece& user_agent,
                                        bool allow_mobile) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return (capabilities & (allow_mobile ? kCapabilityJsDeferAllowMobile
+                                         : kCapabilityJsDefer)) != 0;
+  }
+  return MatchJsDefer(user_agent, GetDeviceTypeForUA(user_agent),
+                      allow_mobile);
+}
+
+bool UserAgentMatcher::MatchJsDefer(StringPiece user_agent,
+                                    DeviceType device_type,
+                                    bool allow_mobile) const {
   // TODO(ksimbili): Use IsMobileRequest?
-  if (GetDeviceTypeForUA(user_agent) != kDesktop) {
+  if (device_type != kDesktop) {
     return allow_mobile && blink_mobile_whitelist_.Match(user_agent, false);
   }
   return user_agent.empty() || defer_js_whitelist_.Match(user_agent, false);
 }
 
 bool UserAgentMatcher::SupportsWebp(const StringPiece& user_agent) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return (capabilities & kCapabilityWebp) != 0;
+  }
   // TODO(jmaessen): this is a stub for regression testing purposes.
   // Put in real detection without treading on fengfei's toes.
   return supports_webp_.Match(user_agent, false);
@@ -573,11 +674,19 @@ bool UserAgentMatcher::SupportsWebp(const StringPiece& user_agent) const {
 
 bool UserAgentMatcher::SupportsWebpLosslessAlpha(
     const StringPiece& user_agent) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return (capabilities & kCapabilityWebpLosslessAlpha) != 0;
+  }
   return supports_webp_lossless_alpha_.Match(user_agent, false);
 }
 
 bool UserAgentMatcher::SupportsWebpAnimated(
     const StringPiece& user_agent) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return (capabilities & kCapabilityWebpAnimated) != 0;
+  }
   return supports_webp_animated_.Match(user_agent, false);
 }
 
@@ -621,6 +730,15 @@ bool UserAgentMatcher::SupportsSplitHtml(const StringPiece& user_agent,
 // http request.
 UserAgentMatcher::DeviceType UserAgentMatcher::GetDeviceTypeForUA(
     const StringPiece& user_agent) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return static_cast<DeviceType>(capabilities & kDeviceTypeMask);
+  }
+  return MatchDeviceType(user_agent);
+}
+
+UserAgentMatcher::DeviceType UserAgentMatcher::MatchDeviceType(
+    StringPiece user_agent) const {
   if (mobile_user_agents_.Match(user_agent, false)) {
     return kMobile;
   }
@@ -730,6 +848,10 @@ bool UserAgentMatcher::UserAgentExceedsChromeBuildAndPatch(
 
 bool UserAgentMatcher::SupportsMobilization(
     StringPiece user_agent) const {
+  uint32 capabilities;
+  if (LookupCapabilities(user_agent, &capabilities)) {
+    return (capabilities & kCapabilityMobilization) != 0;
+  }
   return mobilization_user_agents_.Match(user_agent, false);
 }
 
@@ -71,9 +71,66 @@ class UserAgentMatcher {
     kPrefetchLinkRelPrefetchTag,
   };
 
+  // Bits describing everything we can compute about a browser from its
+  // user-agent string alone.  The low bits hold the DeviceType and the
+  // PrefetchMechanism; the remaining bits are boolean capabilities.
+  enum Capability {
+    kDeviceTypeMask                  = 0x3,
+    kPrefetchMechanismShift          = 2,
+    kPrefetchMechanismMask           = 0x3 << kPrefetchMechanismShift,
+    kCapabilityIsIe                  = 1 << 4,
+    kCapabilityImageInlining         = 1 << 5,
+    kCapabilityLazyloadImages        = 1 << 6,
+    kCapabilityJsDefer               = 1 << 7,
+    kCapabilityJsDeferAllowMobile    = 1 << 8,
+    kCapabilityWebp                  = 1 << 9,
+    kCapabilityWebpLosslessAlpha     = 1 << 10,
+    kCapabilityWebpAnimated          = 1 << 11,
+    kCapabilityDnsPrefetch           = 1 << 12,
+    kCapabilityMobilization          = 1 << 13,
+  };
+
+  // Cache mapping user-agent strings to the Capability bits computed for
+  // them, so that repeat user-agents do not need to re-run the wildcard
+  // matchers.  Implementations must be thread-safe, and may forget entries
+  // at any time.  See SharedMemUserAgentCache for the shared-memory version
+  // used by the servers.
+  class CapabilityCache {
+   public:
+    CapabilityCache() {}
+    virtual ~CapabilityCache() {}
+
+    // Returns true and fills in *capabilities if user_agent is cached.
+    virtual bool Lookup(StringPiece user_agent, uint32* capabilities) = 0;
+    virtual void Insert(StringPiece user_agent, uint32 capabilities) = 0;
+
+   private:
+    DISALLOW_COPY_AND_ASSIGN(CapabilityCache);
+  };
+
   UserAgentMatcher();
   virtual ~UserAgentMatcher();
 
+  // Makes the matcher consult 'cache' before running its wildcard matchers
+  // for the capability queries listed in the Capability enum.  Does not take
+  // ownership.  Pass NULL to turn caching off.
+  void set_capability_cache(CapabilityCache* cache) {
+    capability_cache_ = cache;
+  }
+
+  // Computes the Capability bits for user_agent from scratch, bypassing any
+  // capability cache.
+  uint32 ComputeCapabilities(StringPiece user_agent) const;
+
+  // Looks user_agent up in the capability cache, computing all of its
+  // Capability bits and inserting them on a miss, so each distinct
+  // user-agent pays for the full computation once.  Returns false if there
+  // is no cache, in which case callers should use the predicates below.
+  // Each predicate does its own lookup, which hashes the user-agent and
+  // takes a lock, so code asking several of them about the same request
+  // should call this once and keep the result; see DeviceProperties.
+  bool LookupCapabilities(StringPiece user_agent, uint32* capabilities) const;
+
   // Before calling IsIe, ask if you're doing the right thing: are you doing
   // something that will mess up IE 11 in standards mode?  Are you in a position
   // where you can't tell what compatibility mode IE 11 is in?  Right now we use
@@ -173,6 +230,14 @@ class UserAgentMatcher {
   bool SupportsMobilization(StringPiece user_agent) const;
 
  private:
+  // Uncached versions of the corresponding public methods.
+  bool MatchIe(StringPiece user_agent) const;
+  bool MatchImageInlining(StringPiece user_agent) const;
+  bool MatchJsDefer(StringPiece user_agent, DeviceType device_type,
+                    bool allow_mobile) const;
+  DeviceType MatchDeviceType(StringPiece user_agent) const;
+  PrefetchMechanism MatchPrefetchMechanism(StringPiece user_agent) const;
+
   FastWildcardGroup supports_image_inlining_;
   FastWildcardGroup supports_lazyload_images_;
   FastWildcardGroup defer_js_whitelist_;
@@ -194,6 +259,7 @@ class UserAgentMatcher {
   const RE2 chrome_version_pattern_;
   scoped_ptr<RE2> known_devices_pattern_;
   mutable map <GoogleString, pair<int, int> > screen_dimensions_map_;
+  CapabilityCache* capability_cache_;
 
   DISALLOW_COPY_AND_ASSIGN(UserAgentMatcher);
 };
@@ -12,8 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <map>
+
+#include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/gtest.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/http/request_headers.h"
 #include "pagespeed/kernel/http/user_agent_matcher.h"
 #include "pagespeed/kernel/http/user_agent_matcher_test_base.h"
@@ -23,6 +28,34 @@ namespace net_instaweb {
 class UserAgentMatcherTest : public UserAgentMatcherTestBase {
 };
 
+// Trivial single-threaded CapabilityCache that counts lookups.
+class MapCapabilityCache : public UserAgentMatcher::CapabilityCache {
+ public:
+  MapCapabilityCache() : hits_(0) {}
+
+  virtual bool Lookup(StringPiece user_agent, uint32* capabilities) {
+    std::map<GoogleString, uint32>::const_iterator p =
+        map_.find(user_agent.as_string());
+    if (p == map_.end()) {
+      return false;
+    }
+    ++hits_;
+    *capabilities = p->second;
+    return true;
+  }
+
+  virtual void Insert(StringPiece user_agent, uint32 capabilities) {
+    map_[user_agent.as_string()] = capabilities;
+  }
+
+  int hits() const { return hits_; }
+  int size() const { return map_.size(); }
+
+ private:
+  std::map<GoogleString, uint32> map_;
+  int hits_;
+};
+
 TEST_F(UserAgentMatcherTest, IsIeTest) {
   EXPECT_TRUE(user_agent_matcher_->IsIe(kIe6UserAgent));
   EXPECT_TRUE(user_agent_matcher_->IsIe(kIe7UserAgent));
@@ -641,4 +674,51 @@ TEST_F(UserAgentMatcherTest, DoesntSupportAnimatedWebp) {
       kWindowsPhoneUserAgent));
 }
 
+TEST_F(UserAgentMatcherTest, CapabilityCacheMatchesUncached) {
+  const char* kUserAgents[] = {
+    "", kAndroidChrome21UserAgent, kBlackBerryOS5UserAgent,
+    kChrome12UserAgent, kChrome42UserAgent, kCriOS32UserAgent,
+    kFirefoxUserAgent, kGooglePlusUserAgent, kIe6UserAgent, kIe9UserAgent,
+    kIPadUserAgent, kIPhoneUserAgent, kNexus7ChromeUserAgent,
+    kOpera1101UserAgent, kOperaMiniMobileUserAgent, kWindowsPhoneUserAgent,
+  };
+  UserAgentMatcher uncached;
+  MapCapabilityCache cache;
+  user_agent_matcher_->set_capability_cache(&cache);
+  for (int i = 0, n = arraysize(kUserAgents); i < n; ++i) {
+    const char* ua = kUserAgents[i];
+    // Go through twice, so the second round is served from the cache.
+    for (int round = 0; round < 2; ++round) {
+      EXPECT_EQ(uncached.IsIe(ua), user_agent_matcher_->IsIe(ua)) << ua;
+      EXPECT_EQ(uncached.SupportsImageInlining(ua),
+                user_agent_matcher_->SupportsImageInlining(ua)) << ua;
+      EXPECT_EQ(uncached.SupportsLazyloadImages(ua),
+                user_agent_matcher_->SupportsLazyloadImages(ua)) << ua;
+      EXPECT_EQ(uncached.GetPrefetchMechanism(ua),
+                user_agent_matcher_->GetPrefetchMechanism(ua)) << ua;
+      EXPECT_EQ(uncached.SupportsDnsPrefetch(ua),
+                user_agent_matcher_->SupportsDnsPrefetch(ua)) << ua;
+      EXPECT_EQ(uncached.SupportsJsDefer(ua, false),
+                user_agent_matcher_->SupportsJsDefer(ua, false)) << ua;
+      EXPECT_EQ(uncached.SupportsJsDefer(ua, true),
+                user_agent_matcher_->SupportsJsDefer(ua, true)) << ua;
+      EXPECT_EQ(uncached.SupportsWebp(ua),
+                user_agent_matcher_->SupportsWebp(ua)) << ua;
+      EXPECT_EQ(uncached.SupportsWebpLosslessAlpha(ua),
+                user_agent_matcher_->SupportsWebpLosslessAlpha(ua)) << ua;
+      EXPECT_EQ(uncached.SupportsWebpAnimated(ua),
+                user_agent_matcher_->SupportsWebpAnimated(ua)) << ua;
+      EXPECT_EQ(uncached.GetDeviceTypeForUA(ua),
+                user_agent_matcher_->GetDeviceTypeForUA(ua)) << ua;
+      EXPECT_EQ(uncached.SupportsMobilization(ua),
+                user_agent_matcher_->SupportsMobilization(ua)) << ua;
+    }
+  }
+  // Each user-agent was computed once and inserted; every other query hit.
+  EXPECT_EQ(static_cast<int>(arraysize(kUserAgents)), cache.size());
+  EXPECT_EQ(static_cast<int>(arraysize(kUserAgents)) * (2 * 12 - 1),
+            cache.hits());
+  user_agent_matcher_->set_capability_cache(NULL);
+}
+
 }  // namespace net_instaweb
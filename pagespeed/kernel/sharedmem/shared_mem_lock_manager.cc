@@ -17,17 +17,30 @@
 // Author: morlovich@google.com (Maksim Orlovich)
 #include "pagespeed/kernel/sharedmem/shared_mem_lock_manager.h"
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <climits>
 #include <cstddef>
+#include <ctime>
+#include <vector>
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/atomicops.h"
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/hasher.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/thread/scheduler.h"
 #include "pagespeed/kernel/thread/scheduler_based_abstract_lock.h"
@@ -38,6 +51,9 @@ namespace SharedMemLockData {
 
 // Memory structure:
 //
+// Header:
+//  wake sequence (32-bit)
+//  (pad to 64 bytes)
 // Bucket 0:
 //  Slot 0
 //     lock name hash (64-bit)
@@ -45,6 +61,7 @@ namespace SharedMemLockData {
 //  Slot 1
 //  ...
 //  Slot kSlotsPerBucket - 1
+//  number of waiters (64-bit)
 //  Mutex
 //  (pad to 64-byte alignment)
 // Bucket 1:
@@ -73,6 +90,13 @@ namespace SharedMemLockData {
 // getting filled suggests it's under heavy load as it is, in which case
 // blocking further operations is desirable.
 //
+// Waiters that sleep rather than poll (see set_use_wakeups) count themselves
+// in their bucket's number of waiters while they wait.  Unlocking a lock in a
+// bucket with waiters bumps the wake sequence and wakes everyone sleeping on
+// it, in every process; each then retries its own lock.  A single wake word
+// means waiters on unrelated buckets also wake, but it lets one thread per
+// process sleep on behalf of all of that process's waiters.
+//
 const size_t kBuckets = 512;   // needs to be <= 65536 as we use 2 bytes of
                                // hash to pick a bucket.
 const size_t kSlotsPerBucket = 32;
@@ -86,9 +110,16 @@ const int64 kNotAcquired = 0;
 
 struct Bucket {
   Slot slots[kSlotsPerBucket];
+  int64 num_waiters;
   char mutex_base[1];
 };
 
+struct Header {
+  base::subtle::Atomic32 wake_sequence;
+};
+
+const size_t kHeaderSize = 64;
+
 inline size_t Align64(size_t in) {
   return (in + 63) & ~63;
 }
@@ -98,13 +129,55 @@ inline size_t BucketSize(size_t lock_size) {
 }
 
 inline size_t SegmentSize(size_t lock_size) {
-  return kBuckets * BucketSize(lock_size);
+  return kHeaderSize + kBuckets * BucketSize(lock_size);
 }
 
 }  // namespace SharedMemLockData
 
 namespace Data = SharedMemLockData;
 
+namespace {
+
+// While waiting to steal a lock, we must recheck it at least this many times
+// per steal interval, since a lock that is merely old is never unlocked, and
+// so never wakes anyone.  Matches SchedulerBasedAbstractLock.
+const int64 kMinTriesPerSteal = 2;
+
+#ifdef __linux__
+const bool kHaveFutex = true;
+
+// Sleeps until *word != expected, FutexWakeAll(word), or timeout_ms.  These
+// are not FUTEX_PRIVATE_FLAG operations, as the word is shared by processes.
+void FutexWait(base::subtle::Atomic32* word, int32 expected,
+               int64 timeout_ms) {
+  struct timespec timeout;
+  struct timespec* timeout_ptr = NULL;
+  if (timeout_ms >= 0) {
+    timeout.tv_sec = timeout_ms / Timer::kSecondMs;
+    timeout.tv_nsec = (timeout_ms % Timer::kSecondMs) *
+        (Timer::kSecondNs / Timer::kSecondMs);
+    timeout_ptr = &timeout;
+  }
+  syscall(SYS_futex, word, FUTEX_WAIT, expected, timeout_ptr, NULL, 0);
+}
+
+void FutexWakeAll(base::subtle::Atomic32* word) {
+  syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+#else
+const bool kHaveFutex = false;
+
+void FutexWait(base::subtle::Atomic32* word, int32 expected,
+               int64 timeout_ms) {
+  LOG(DFATAL) << "No futex on this platform";
+}
+
+void FutexWakeAll(base::subtle::Atomic32* word) {
+}
+#endif
+
+}  // namespace
+
 class SharedMemLock : public SchedulerBasedAbstractLock {
  public:
   virtual ~SharedMemLock() {
@@ -124,26 +197,67 @@ class SharedMemLock : public SchedulerBasedAbstractLock {
       return;
     }
 
-    // Protect the bucket.
-    scoped_ptr<AbstractMutex> lock(AttachMutex());
-    ScopedMutex hold_lock(lock.get());
-
-    // Search for this lock.
-    // note: we permit empty slots in the middle, and start search at different
-    // positions depending on the hash to increase chance of quick hit.
-    // TODO(morlovich): Consider remembering which bucket we locked to avoid
-    // the search. (Could potentially be made lock-free, too).
-    size_t base = hash_ % Data::kSlotsPerBucket;
-    for (size_t offset = 0; offset < Data::kSlotsPerBucket; ++offset) {
-      size_t s = (base + offset) % Data::kSlotsPerBucket;
-      Data::Slot& slot = bucket_->slots[s];
-      if (slot.hash == hash_ && slot.acquired_at_ms == acquisition_time_) {
-        slot.acquired_at_ms = Data::kNotAcquired;
-        break;
+    bool have_waiters;
+    {
+      // Protect the bucket.
+      scoped_ptr<AbstractMutex> lock(AttachMutex());
+      ScopedMutex hold_lock(lock.get());
+
+      // Search for this lock.
+      // note: we permit empty slots in the middle, and start search at
+      // different positions depending on the hash to increase chance of quick
+      // hit.
+      // TODO(morlovich): Consider remembering which bucket we locked to avoid
+      // the search. (Could potentially be made lock-free, too).
+      size_t base = hash_ % Data::kSlotsPerBucket;
+      for (size_t offset = 0; offset < Data::kSlotsPerBucket; ++offset) {
+        size_t s = (base + offset) % Data::kSlotsPerBucket;
+        Data::Slot& slot = bucket_->slots[s];
+        if (slot.hash == hash_ && slot.acquired_at_ms == acquisition_time_) {
+          slot.acquired_at_ms = Data::kNotAcquired;
+          break;
+        }
       }
+      have_waiters = (bucket_->num_waiters > 0);
     }
 
     acquisition_time_ = Data::kNotAcquired;
+    if (have_waiters) {
+      manager_->WakeWaiters();
+    }
+  }
+
+  virtual bool LockTimedWait(int64 wait_ms) {
+    if (!manager_->use_wakeups()) {
+      return SchedulerBasedAbstractLock::LockTimedWait(wait_ms);
+    }
+    return BlockingWait(false, wait_ms, 0);
+  }
+
+  virtual void LockTimedWait(int64 wait_ms, Function* callback) {
+    if (!manager_->use_wakeups()) {
+      SchedulerBasedAbstractLock::LockTimedWait(wait_ms, callback);
+    } else {
+      WaitWithCallback(false, wait_ms, 0, callback);
+    }
+  }
+
+  virtual bool LockTimedWaitStealOld(int64 wait_ms, int64 steal_ms) {
+    if (!manager_->use_wakeups()) {
+      return SchedulerBasedAbstractLock::LockTimedWaitStealOld(wait_ms,
+                                                               steal_ms);
+    }
+    return BlockingWait(true, wait_ms, steal_ms);
+  }
+
+  virtual void LockTimedWaitStealOld(int64 wait_ms, int64 steal_ms,
+                                     Function* callback) {
+    if (!manager_->use_wakeups()) {
+      SchedulerBasedAbstractLock::LockTimedWaitStealOld(wait_ms, steal_ms,
+                                                        callback);
+    } else {
+      WaitWithCallback(true, wait_ms, steal_ms, callback);
+    }
   }
 
   virtual GoogleString name() const {
@@ -154,6 +268,34 @@ class SharedMemLock : public SchedulerBasedAbstractLock {
     return (acquisition_time_ != Data::kNotAcquired);
   }
 
+  // The following are for waiting with wakeups, and are used by
+  // SharedMemLockManager::WakeupThread.
+
+  bool TryLockForWait(bool steal, int64 steal_ms) {
+    return TryLockImpl(steal, steal_ms);
+  }
+
+  // Adds delta to the number of waiters in our bucket.  Waiters must be
+  // counted before they first try the lock, so that an Unlock() after that
+  // attempt is sure to wake them.
+  void AddBucketWaiters(int delta) {
+    scoped_ptr<AbstractMutex> lock(AttachMutex());
+    ScopedMutex hold_lock(lock.get());
+    bucket_->num_waiters += delta;
+    DCHECK_LE(0, bucket_->num_waiters);
+  }
+
+  // How long a waiter that wants the lock by end_ms should sleep before
+  // trying again if not woken.
+  static int64 SleepMs(bool steal, int64 steal_ms, int64 end_ms,
+                       int64 now_ms) {
+    int64 sleep_ms = end_ms - now_ms;
+    if (steal) {
+      sleep_ms = std::min(sleep_ms, (steal_ms + 1) / kMinTriesPerSteal);
+    }
+    return std::max(sleep_ms, static_cast<int64>(1));
+  }
+
  protected:
   virtual Scheduler* scheduler() const {
     return manager_->scheduler_;
@@ -251,6 +393,33 @@ class SharedMemLock : public SchedulerBasedAbstractLock {
     return false;
   }
 
+  bool BlockingWait(bool steal, int64 wait_ms, int64 steal_ms) {
+    if (TryLock() || (steal && TryLockStealOld(steal_ms))) {
+      return true;
+    }
+    Timer* timer = manager_->scheduler_->timer();
+    int64 end_ms = timer->NowMs() + wait_ms;
+    bool locked = false;
+    AddBucketWaiters(1);
+    while (!locked) {
+      int32 sequence = manager_->WakeSequence();
+      locked = TryLockImpl(steal, steal_ms);
+      if (!locked) {
+        int64 now_ms = timer->NowMs();
+        if (now_ms >= end_ms) {
+          break;
+        }
+        manager_->SleepUntilWoken(sequence,
+                                  SleepMs(steal, steal_ms, end_ms, now_ms));
+      }
+    }
+    AddBucketWaiters(-1);
+    return locked;
+  }
+
+  void WaitWithCallback(bool steal, int64 wait_ms, int64 steal_ms,
+                        Function* callback);
+
   // Writes out our ID and current timestamp into the slot, and marks the
   // fact of our acquisition.
   void DoLockSlot(size_t s, int64 now_ms) {
@@ -274,6 +443,151 @@ class SharedMemLock : public SchedulerBasedAbstractLock {
   DISALLOW_COPY_AND_ASSIGN(SharedMemLock);
 };
 
+// Waits for locks on behalf of a process's LockTimedWait callers, running
+// each callback as soon as its lock is obtained or its wait times out.
+class SharedMemLockManager::WakeupThread : public ThreadSystem::Thread {
+ public:
+  WakeupThread(SharedMemLockManager* manager, ThreadSystem* thread_system)
+      : Thread(thread_system, "shm_lock_wakeup", ThreadSystem::kJoinable),
+        manager_(manager),
+        mutex_(thread_system->NewMutex()),
+        quit_(false) {
+  }
+
+  virtual ~WakeupThread() {
+    DCHECK(waiters_.empty());
+  }
+
+  // lock must already be counted in its bucket's waiters.
+  void AddWaiter(SharedMemLock* lock, bool steal, int64 steal_ms,
+                 int64 end_ms, Function* callback) {
+    Waiter waiter = {lock, steal, steal_ms, end_ms, callback};
+    {
+      ScopedMutex hold_lock(mutex_.get());
+      waiters_.push_back(waiter);
+    }
+    manager_->WakeWaiters();
+  }
+
+  // Stops the thread, canceling all outstanding waits.
+  void Quit() {
+    {
+      ScopedMutex hold_lock(mutex_.get());
+      quit_ = true;
+    }
+    manager_->WakeWaiters();
+    Join();
+    for (int i = 0, n = waiters_.size(); i < n; ++i) {
+      waiters_[i].lock->AddBucketWaiters(-1);
+      waiters_[i].callback->CallCancel();
+    }
+    waiters_.clear();
+  }
+
+ protected:
+  virtual void Run() {
+    Timer* timer = manager_->scheduler_->timer();
+    WaiterVector waiting, still_waiting, granted, denied;
+    while (true) {
+      int32 sequence = manager_->WakeSequence();
+      {
+        ScopedMutex hold_lock(mutex_.get());
+        if (quit_) {
+          break;
+        }
+        waiting.insert(waiting.end(), waiters_.begin(), waiters_.end());
+        waiters_.clear();
+      }
+
+      int64 now_ms = timer->NowMs();
+      int64 sleep_ms = -1;
+      for (int i = 0, n = waiting.size(); i < n; ++i) {
+        Waiter& waiter = waiting[i];
+        if (waiter.lock->TryLockForWait(waiter.steal, waiter.steal_ms)) {
+          granted.push_back(waiter);
+        } else if (now_ms >= waiter.end_ms) {
+          denied.push_back(waiter);
+        } else {
+          int64 waiter_sleep_ms = SharedMemLock::SleepMs(
+              waiter.steal, waiter.steal_ms, waiter.end_ms, now_ms);
+          if ((sleep_ms < 0) || (waiter_sleep_ms < sleep_ms)) {
+            sleep_ms = waiter_sleep_ms;
+          }
+          still_waiting.push_back(waiter);
+        }
+      }
+      waiting.swap(still_waiting);
+      still_waiting.clear();
+
+      // Callbacks may well Unlock, or wait for other locks, so run them
+      // last.  Any wakeup they cause will show up in the wake sequence.
+      if (!granted.empty() || !denied.empty()) {
+        for (int i = 0, n = granted.size(); i < n; ++i) {
+          granted[i].lock->AddBucketWaiters(-1);
+          granted[i].callback->CallRun();
+        }
+        for (int i = 0, n = denied.size(); i < n; ++i) {
+          denied[i].lock->AddBucketWaiters(-1);
+          denied[i].callback->CallCancel();
+        }
+        granted.clear();
+        denied.clear();
+        continue;
+      }
+
+      manager_->SleepUntilWoken(sequence, sleep_ms);
+    }
+
+    // Hand anything still waiting back to Quit() to cancel.
+    ScopedMutex hold_lock(mutex_.get());
+    waiters_.insert(waiters_.end(), waiting.begin(), waiting.end());
+  }
+
+ private:
+  struct Waiter {
+    SharedMemLock* lock;
+    bool steal;
+    int64 steal_ms;
+    int64 end_ms;
+    Function* callback;
+  };
+  typedef std::vector<Waiter> WaiterVector;
+
+  SharedMemLockManager* manager_;
+  scoped_ptr<AbstractMutex> mutex_;
+  WaiterVector waiters_;  // guarded by mutex_
+  bool quit_;  // guarded by mutex_
+
+  DISALLOW_COPY_AND_ASSIGN(WakeupThread);
+};
+
+void SharedMemLock::WaitWithCallback(bool steal, int64 wait_ms,
+                                     int64 steal_ms, Function* callback) {
+  if (TryLock() || (steal && TryLockStealOld(steal_ms))) {
+    callback->CallRun();
+    return;
+  }
+  if (wait_ms == 0) {
+    callback->CallCancel();
+    return;
+  }
+  SharedMemLockManager::WakeupThread* wakeup_thread =
+      manager_->GetWakeupThread();
+  if (wakeup_thread == NULL) {
+    // Fall back to polling.
+    if (steal) {
+      SchedulerBasedAbstractLock::LockTimedWaitStealOld(wait_ms, steal_ms,
+                                                        callback);
+    } else {
+      SchedulerBasedAbstractLock::LockTimedWait(wait_ms, callback);
+    }
+    return;
+  }
+  int64 end_ms = manager_->scheduler_->timer()->NowMs() + wait_ms;
+  AddBucketWaiters(1);
+  wakeup_thread->AddWaiter(this, steal, steal_ms, end_ms, callback);
+}
+
 SharedMemLockManager::SharedMemLockManager(
     AbstractSharedMem* shm, const GoogleString& path, Scheduler* scheduler,
     Hasher* hasher, MessageHandler* handler)
@@ -282,11 +596,20 @@ SharedMemLockManager::SharedMemLockManager(
       scheduler_(scheduler),
       hasher_(hasher),
       handler_(handler),
-      lock_size_(shm->SharedMutexSize()) {
+      lock_size_(shm->SharedMutexSize()),
+      use_wakeups_(false),
+      wakeup_thread_mutex_(scheduler->thread_system()->NewMutex()) {
   CHECK_GE(hasher_->RawHashSizeInBytes(), 9) << "Need >= 9 byte hashes";
 }
 
 SharedMemLockManager::~SharedMemLockManager() {
+  if (wakeup_thread_.get() != NULL) {
+    wakeup_thread_->Quit();
+  }
+}
+
+void SharedMemLockManager::set_use_wakeups(bool x) {
+  use_wakeups_ = x && kHaveFutex;
 }
 
 bool SharedMemLockManager::Initialize() {
@@ -297,6 +620,8 @@ bool SharedMemLockManager::Initialize() {
     return false;
   }
 
+  Header()->wake_sequence = 0;
+
   // Create the mutexes for each bucket
   for (size_t bucket = 0; bucket < Data::kBuckets; ++bucket) {
     if (!seg_->InitializeSharedMutex(MutexOffset(Bucket(bucket)), handler_)) {
@@ -331,9 +656,42 @@ SchedulerBasedAbstractLock* SharedMemLockManager::CreateNamedLock(
   return new SharedMemLock(this, name);
 }
 
+Data::Header* SharedMemLockManager::Header() {
+  return reinterpret_cast<Data::Header*>(const_cast<char*>(seg_->Base()));
+}
+
 Data::Bucket* SharedMemLockManager::Bucket(size_t bucket) {
   return reinterpret_cast<Data::Bucket*>(
-      const_cast<char*>(seg_->Base()) + bucket * Data::BucketSize(lock_size_));
+      const_cast<char*>(seg_->Base()) + Data::kHeaderSize +
+      bucket * Data::BucketSize(lock_size_));
+}
+
+SharedMemLockManager::WakeupThread* SharedMemLockManager::GetWakeupThread() {
+  ScopedMutex hold_lock(wakeup_thread_mutex_.get());
+  if (wakeup_thread_.get() == NULL) {
+    scoped_ptr<WakeupThread> thread(
+        new WakeupThread(this, scheduler_->thread_system()));
+    if (!thread->Start()) {
+      handler_->Message(kWarning,
+                        "Unable to start lock wakeup thread; polling.");
+      return NULL;
+    }
+    wakeup_thread_.reset(thread.release());
+  }
+  return wakeup_thread_.get();
+}
+
+int32 SharedMemLockManager::WakeSequence() {
+  return base::subtle::Acquire_Load(&Header()->wake_sequence);
+}
+
+void SharedMemLockManager::WakeWaiters() {
+  base::subtle::Barrier_AtomicIncrement(&Header()->wake_sequence, 1);
+  FutexWakeAll(&Header()->wake_sequence);
+}
+
+void SharedMemLockManager::SleepUntilWoken(int32 sequence, int64 timeout_ms) {
+  FutexWait(&Header()->wake_sequence, sequence, timeout_ms);
 }
 
 size_t SharedMemLockManager::MutexOffset(SharedMemLockData::Bucket* bucket) {
@@ -30,6 +30,7 @@
 
 namespace net_instaweb {
 
+class AbstractMutex;
 class AbstractSharedMem;
 class AbstractSharedMemSegment;
 class Hasher;
@@ -39,13 +40,15 @@ class Scheduler;
 namespace SharedMemLockData {
 
 struct Bucket;
+struct Header;
 
 }  // namespace SharedMemLockData
 
-// A simple shared memory named locking manager, which uses scheduler alarms
-// (via SchedulerBasedAbstractLock) when it needs to block.
-//
-// TODO(morlovich): Implement condvars?
+// A simple shared memory named locking manager.  By default it uses scheduler
+// alarms (via SchedulerBasedAbstractLock) when it needs to block, polling the
+// lock with exponential backoff.  With set_use_wakeups(true), waiters instead
+// sleep on a futex in the shared segment and are woken as soon as a lock in
+// their bucket is released, by any process.
 class SharedMemLockManager : public NamedLockManager {
  public:
   // Note that you must call Initialize() in the root process, and Attach in
@@ -75,11 +78,33 @@ class SharedMemLockManager : public NamedLockManager {
 
   virtual SchedulerBasedAbstractLock* CreateNamedLock(const StringPiece& name);
 
+  // Makes locks that have to wait sleep until Unlock() wakes them, rather
+  // than poll.  The sleeps are timed by the wall clock, so this must not be
+  // combined with a mock timer.  It is only available on Linux; elsewhere
+  // this does nothing.  Processes sharing a segment may differ in this
+  // setting.
+  void set_use_wakeups(bool x);
+  bool use_wakeups() const { return use_wakeups_; }
+
  private:
+  class WakeupThread;
   friend class SharedMemLock;
 
+  SharedMemLockData::Header* Header();
   SharedMemLockData::Bucket* Bucket(size_t bucket);
 
+  // Returns the thread that waits for locks on behalf of LockTimedWait
+  // callers in this process, starting it on first use.  Returns NULL if the
+  // thread can't be started.
+  WakeupThread* GetWakeupThread();
+
+  // Waiters read the wake sequence before trying their lock, and then sleep
+  // until it changes, which WakeWaiters does, or timeout_ms passes.  A
+  // negative timeout_ms sleeps until woken.
+  int32 WakeSequence();
+  void WakeWaiters();
+  void SleepUntilWoken(int32 sequence, int64 timeout_ms);
+
   // Offset of mutex wrt to segment base.
   size_t MutexOffset(SharedMemLockData::Bucket*);
 
@@ -92,6 +117,10 @@ class SharedMemLockManager : public NamedLockManager {
   MessageHandler* handler_;
   size_t lock_size_;
 
+  bool use_wakeups_;
+  scoped_ptr<AbstractMutex> wakeup_thread_mutex_;
+  scoped_ptr<WakeupThread> wakeup_thread_;  // guarded by wakeup_thread_mutex_
+
   DISALLOW_COPY_AND_ASSIGN(SharedMemLockManager);
 };
 
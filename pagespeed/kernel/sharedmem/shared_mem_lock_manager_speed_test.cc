@@ -0,0 +1,155 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares SharedMemLockManager waiters that poll with backoff against ones
+// that are woken on Unlock.
+//
+// BM_Handoff* measure how long an async waiter takes to get a lock that
+// another owner releases after 5ms; with polling, the waiter's backoff has
+// grown well past that by the time the lock is free.  BM_Spammer* hammer a
+// few lock names from several threads via LockManagerSpammer.
+
+#include "pagespeed/kernel/sharedmem/shared_mem_lock_manager.h"
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/named_lock_manager.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/sharedmem/inprocess_shared_mem.h"
+#include "pagespeed/kernel/thread/scheduler.h"
+#include "pagespeed/kernel/thread/scheduler_thread.h"
+#include "pagespeed/kernel/thread/worker_test_base.h"
+#include "pagespeed/kernel/util/lock_manager_spammer.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kSegmentName[] = "lock_speed_test";
+const char kLockName[] = "handoff";
+const int64 kHoldMs = 5;
+const int64 kWaitMs = 10 * Timer::kSecondMs;
+const int64 kStealMs = 20 * Timer::kSecondMs;
+
+// Owns a SharedMemLockManager on an in-process segment, with a scheduler
+// whose alarms run in the background for the polling waiters.
+class LockManagerFixture {
+ public:
+  explicit LockManagerFixture(bool use_wakeups)
+      : thread_system_(Platform::CreateThreadSystem()),
+        timer_(Platform::CreateTimer()),
+        scheduler_(thread_system_.get(), timer_.get()),
+        shm_(thread_system_.get()),
+        lock_manager_(&shm_, kSegmentName, &scheduler_, &hasher_, &handler_) {
+    CHECK(lock_manager_.Initialize());
+    lock_manager_.set_use_wakeups(use_wakeups);
+  }
+
+  ThreadSystem* thread_system() { return thread_system_.get(); }
+  Timer* timer() { return timer_.get(); }
+  Scheduler* scheduler() { return &scheduler_; }
+  SharedMemLockManager* lock_manager() { return &lock_manager_; }
+
+ private:
+  scoped_ptr<ThreadSystem> thread_system_;
+  scoped_ptr<Timer> timer_;
+  Scheduler scheduler_;
+  InProcessSharedMem shm_;
+  MD5Hasher hasher_;
+  NullMessageHandler handler_;
+  SharedMemLockManager lock_manager_;
+
+  DISALLOW_COPY_AND_ASSIGN(LockManagerFixture);
+};
+
+void Handoff(int iters, bool use_wakeups) {
+  StopBenchmarkTiming();
+  LockManagerFixture fixture(use_wakeups);
+  SchedulerThread* scheduler_thread =
+      new SchedulerThread(fixture.thread_system(), fixture.scheduler());
+  CHECK(scheduler_thread->Start());
+  scoped_ptr<NamedLock> owner(
+      fixture.lock_manager()->CreateNamedLock(kLockName));
+  scoped_ptr<NamedLock> waiter(
+      fixture.lock_manager()->CreateNamedLock(kLockName));
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    WorkerTestBase::SyncPoint acquired(fixture.thread_system());
+    owner->LockTimedWait(kWaitMs,
+                         new WorkerTestBase::NotifyRunFunction(&acquired));
+    acquired.Wait();
+    WorkerTestBase::SyncPoint granted(fixture.thread_system());
+    waiter->LockTimedWaitStealOld(
+        kWaitMs, kStealMs,
+        new WorkerTestBase::NotifyRunFunction(&granted));
+    fixture.timer()->SleepMs(kHoldMs);
+    owner->Unlock();
+    granted.Wait();
+    waiter->Unlock();
+  }
+
+  StopBenchmarkTiming();
+  scheduler_thread->MakeDeleter()->CallRun();
+}
+
+void Spam(int iters, bool use_wakeups) {
+  StopBenchmarkTiming();
+  LockManagerFixture fixture(use_wakeups);
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    LockManagerSpammer::RunTests(8,      // num threads
+                                 20,     // num iters
+                                 2,      // num names
+                                 false,  // expecting denials
+                                 false,  // delay unlocks
+                                 fixture.lock_manager(),
+                                 fixture.scheduler(),
+                                 fixture.timer());
+  }
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
+
+static void BM_HandoffPolling(int iters) {
+  net_instaweb::Handoff(iters, false);
+}
+
+static void BM_HandoffWakeups(int iters) {
+  net_instaweb::Handoff(iters, true);
+}
+
+static void BM_SpammerPolling(int iters) {
+  net_instaweb::Spam(iters, false);
+}
+
+static void BM_SpammerWakeups(int iters) {
+  net_instaweb::Spam(iters, true);
+}
+
+BENCHMARK(BM_HandoffPolling);
+BENCHMARK(BM_HandoffWakeups);
+BENCHMARK(BM_SpammerPolling);
+BENCHMARK(BM_SpammerWakeups);
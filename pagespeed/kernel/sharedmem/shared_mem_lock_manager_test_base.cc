@@ -25,7 +25,9 @@
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_lock_manager.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_test_base.h"
+#include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/thread/scheduler_based_abstract_lock.h"
+#include "pagespeed/kernel/thread/worker_test_base.h"
 #include "pagespeed/kernel/util/platform.h"
 
 namespace net_instaweb {
@@ -36,6 +38,28 @@ const char kPath[] = "shm_locks";
 const char kLockA[] = "lock_a";
 const char kLockB[] = "lock_b";
 
+// Records whether the lock was granted, then notifies sync.
+class NotifyDoneFunction : public Function {
+ public:
+  NotifyDoneFunction(WorkerTestBase::SyncPoint* sync, bool* granted)
+      : sync_(sync), granted_(granted) {}
+
+  virtual void Run() {
+    *granted_ = true;
+    sync_->Notify();
+  }
+
+  virtual void Cancel() {
+    *granted_ = false;
+    sync_->Notify();
+  }
+
+ private:
+  WorkerTestBase::SyncPoint* sync_;
+  bool* granted_;
+  DISALLOW_COPY_AND_ASSIGN(NotifyDoneFunction);
+};
+
 }  // namespace
 
 SharedMemLockManagerTestBase::SharedMemLockManagerTestBase(
@@ -194,4 +218,43 @@ void SharedMemLockManagerTestBase::TestStealChild() {
   }
 }
 
+void SharedMemLockManagerTestBase::TestWakeups() {
+  scoped_ptr<SharedMemLockManager> lock_manager(AttachDefault());
+  ASSERT_TRUE(lock_manager.get() != NULL);
+  lock_manager->set_use_wakeups(true);
+  if (!lock_manager->use_wakeups()) {
+    return;  // Not supported on this platform.
+  }
+  scoped_ptr<SchedulerBasedAbstractLock> lock_a(
+      lock_manager->CreateNamedLock(kLockA));
+  scoped_ptr<SchedulerBasedAbstractLock> lock_a2(
+      lock_manager->CreateNamedLock(kLockA));
+  EXPECT_TRUE(lock_a->TryLock());
+
+  // Nothing advances the mock timer, so the waiter only gets the lock if
+  // the Unlock wakes it.
+  bool granted = false;
+  {
+    WorkerTestBase::SyncPoint sync(thread_system_.get());
+    lock_a2->LockTimedWait(Timer::kMinuteMs,
+                           new NotifyDoneFunction(&sync, &granted));
+    EXPECT_FALSE(lock_a2->Held());
+    lock_a->Unlock();
+    sync.Wait();
+  }
+  EXPECT_TRUE(granted);
+  EXPECT_TRUE(lock_a2->Held());
+
+  // Waits still time out.
+  {
+    WorkerTestBase::SyncPoint sync(thread_system_.get());
+    lock_a->LockTimedWait(10, new NotifyDoneFunction(&sync, &granted));
+    timer_.AdvanceMs(11);
+    sync.Wait();
+  }
+  EXPECT_FALSE(granted);
+  EXPECT_FALSE(lock_a->Held());
+  EXPECT_TRUE(lock_a2->Held());
+}
+
 }  // namespace net_instaweb
@@ -42,6 +42,7 @@ class SharedMemLockManagerTestBase : public testing::Test {
   void TestBasic();
   void TestDestructorUnlock();
   void TestSteal();
+  void TestWakeups();
 
  private:
   bool CreateChild(TestMethod method);
@@ -89,8 +90,12 @@ TYPED_TEST_P(SharedMemLockManagerTestTemplate, TestSteal) {
   SharedMemLockManagerTestBase::TestSteal();
 }
 
+TYPED_TEST_P(SharedMemLockManagerTestTemplate, TestWakeups) {
+  SharedMemLockManagerTestBase::TestWakeups();
+}
+
 REGISTER_TYPED_TEST_CASE_P(SharedMemLockManagerTestTemplate, TestBasic,
-                           TestDestructorUnlock, TestSteal);
+                           TestDestructorUnlock, TestSteal, TestWakeups);
 
 }  // namespace net_instaweb
 
@@ -31,6 +31,7 @@
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/util/statistics_logger.h"
+#include "pagespeed/kernel/util/statistics_time_series.h"
 
 namespace net_instaweb {
 
@@ -46,6 +47,7 @@ const int kOutOfBoundsCatcherBuckets = 2;
 // Default upper bound of values in histogram. Can be reset by SetMaxValue().
 const double kMaxValue = 5000;
 const char kStatisticsObjName[] = "statistics";
+const char kStatisticsHistoryObjName[] = "statistics_history";
 
 // Variable name for the timestamp used to decide whether we should dump
 // statistics.
@@ -587,6 +589,7 @@ bool SharedMemStatistics::Init(bool parent,
 
   if (console_logger_.get() != NULL) {
     console_logger_->Init();
+    console_logger_->InitTimeSeries(shm_runtime_, HistorySegmentName(), parent);
   }
 
   return ok;
@@ -596,6 +599,10 @@ void SharedMemStatistics::GlobalCleanup(MessageHandler* message_handler) {
   if (segment_.get() != NULL) {
     shm_runtime_->DestroySegment(SegmentName(), message_handler);
   }
+  if (has_history_segment()) {
+    StatisticsTimeSeries::GlobalCleanup(shm_runtime_, HistorySegmentName(),
+                                        message_handler);
+  }
 }
 
 void SharedMemStatistics::GlobalCleanup(AbstractSharedMem* shm_runtime,
@@ -608,4 +615,12 @@ GoogleString SharedMemStatistics::SegmentName() const {
   return StrCat(filename_prefix_, kStatisticsObjName);
 }
 
+GoogleString SharedMemStatistics::HistorySegmentName() const {
+  return StrCat(filename_prefix_, kStatisticsHistoryObjName);
+}
+
+bool SharedMemStatistics::has_history_segment() const {
+  return (console_logger_.get() != NULL) && console_logger_->has_time_series();
+}
+
 }  // namespace net_instaweb
@@ -215,6 +215,11 @@ class SharedMemStatistics : public ScalarStatisticsTemplate<
 
   GoogleString SegmentName() const;
 
+  // Name of the segment holding the statistics logger's history, which
+  // exists only if has_history_segment().
+  GoogleString HistorySegmentName() const;
+  bool has_history_segment() const;
+
   // TODO(sligocki): Rename to statistics_logger().
   virtual StatisticsLogger* console_logger() {
     return console_logger_.get();
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/sharedmem/shared_mem_user_agent_cache.h"
+
+#include <cstddef>
+#include <cstring>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+namespace SharedMemUserAgentCacheData {
+
+// Memory structure:
+//
+// Bucket 0:
+//  use clock (64-bit)
+//  Slot 0
+//     user-agent hash (128-bit raw MD5)
+//     last use, as a value of the bucket's use clock (64-bit), 0 if the
+//       slot is free
+//     user-agent length (32-bit)
+//     capability bits (32-bit)
+//  Slot 1
+//  ...
+//  Slot kSlotsPerBucket - 1
+//  Mutex
+//  (pad to 64-byte alignment)
+// Bucket 1:
+//  ..
+//
+// Each user-agent is statically assigned to a bucket based on its hash. The
+// use clock is bumped on every hit or insert into the bucket, and stamped
+// into the slot involved, so the slot with the smallest last_use is the
+// least-recently used one.
+const size_t kSlotsPerBucket = 8;
+const int kHashBytes = 16;
+
+struct Slot {
+  char hash[kHashBytes];
+  uint64 last_use;
+  uint32 user_agent_size;
+  uint32 capabilities;
+};
+
+struct Bucket {
+  uint64 use_clock;
+  Slot slots[kSlotsPerBucket];
+  char mutex_base[1];
+};
+
+inline size_t Align64(size_t in) {
+  return (in + 63) & ~63;
+}
+
+}  // namespace SharedMemUserAgentCacheData
+
+namespace Data = SharedMemUserAgentCacheData;
+
+const char SharedMemUserAgentCache::kUserAgentCacheHits[] =
+    "user_agent_cache_hits";
+const char SharedMemUserAgentCache::kUserAgentCacheMisses[] =
+    "user_agent_cache_misses";
+const char SharedMemUserAgentCache::kUserAgentCacheInserts[] =
+    "user_agent_cache_inserts";
+const char SharedMemUserAgentCache::kUserAgentCacheEvictions[] =
+    "user_agent_cache_evictions";
+
+SharedMemUserAgentCache::SharedMemUserAgentCache(
+    AbstractSharedMem* shm_runtime, const GoogleString& path, int entries,
+    Statistics* statistics, MessageHandler* handler)
+    : shm_runtime_(shm_runtime),
+      path_(path),
+      num_buckets_(1),
+      bucket_size_(Data::Align64(offsetof(Data::Bucket, mutex_base) +
+                                 shm_runtime->SharedMutexSize())),
+      handler_(handler),
+      hasher_(Data::kHashBytes),
+      hits_(statistics->GetVariable(kUserAgentCacheHits)),
+      misses_(statistics->GetVariable(kUserAgentCacheMisses)),
+      inserts_(statistics->GetVariable(kUserAgentCacheInserts)),
+      evictions_(statistics->GetVariable(kUserAgentCacheEvictions)) {
+  if (entries > 0) {
+    num_buckets_ =
+        (entries + Data::kSlotsPerBucket - 1) / Data::kSlotsPerBucket;
+  }
+}
+
+SharedMemUserAgentCache::~SharedMemUserAgentCache() {
+  STLDeleteElements(&mutexes_);
+}
+
+void SharedMemUserAgentCache::InitStats(Statistics* statistics) {
+  statistics->AddVariable(kUserAgentCacheHits);
+  statistics->AddVariable(kUserAgentCacheMisses);
+  statistics->AddVariable(kUserAgentCacheInserts);
+  statistics->AddVariable(kUserAgentCacheEvictions);
+}
+
+size_t SharedMemUserAgentCache::SegmentSize() const {
+  return num_buckets_ * bucket_size_;
+}
+
+int SharedMemUserAgentCache::capacity() const {
+  return num_buckets_ * Data::kSlotsPerBucket;
+}
+
+bool SharedMemUserAgentCache::Initialize() {
+  STLDeleteElements(&mutexes_);
+  // CreateSegment zeroes the memory, so all slots start out free.
+  segment_.reset(shm_runtime_->CreateSegment(path_, SegmentSize(), handler_));
+  if (segment_.get() == NULL) {
+    handler_->MessageS(kError,
+                       "Unable to create memory segment for user-agent cache.");
+    return false;
+  }
+
+  for (size_t b = 0; b < num_buckets_; ++b) {
+    size_t mutex_offset =
+        b * bucket_size_ + offsetof(Data::Bucket, mutex_base);
+    if (!segment_->InitializeSharedMutex(mutex_offset, handler_)) {
+      handler_->MessageS(kError,
+                         StrCat("Unable to create user-agent cache mutex #",
+                                Integer64ToString(b)));
+      segment_.reset(NULL);
+      return false;
+    }
+  }
+  AttachMutexes();
+  return true;
+}
+
+bool SharedMemUserAgentCache::Attach() {
+  STLDeleteElements(&mutexes_);
+  segment_.reset(shm_runtime_->AttachToSegment(path_, SegmentSize(),
+                                               handler_));
+  if (segment_.get() == NULL) {
+    handler_->MessageS(kWarning,
+                       "Unable to attach to user-agent cache SHM segment");
+    return false;
+  }
+  AttachMutexes();
+  return true;
+}
+
+void SharedMemUserAgentCache::GlobalCleanup(AbstractSharedMem* shm_runtime,
+                                            const GoogleString& path,
+                                            MessageHandler* message_handler) {
+  shm_runtime->DestroySegment(path, message_handler);
+}
+
+void SharedMemUserAgentCache::GetHashAndBucket(StringPiece user_agent,
+                                               GoogleString* hash,
+                                               size_t* bucket_num) const {
+  *hash = hasher_.RawHash(user_agent);
+  DCHECK_EQ(static_cast<size_t>(Data::kHashBytes), hash->size());
+  uint64 prefix;
+  memcpy(&prefix, hash->data(), sizeof(prefix));
+  *bucket_num = prefix % num_buckets_;
+}
+
+namespace {
+
+bool SlotMatches(const Data::Slot& slot, const GoogleString& hash,
+                 StringPiece user_agent) {
+  return ((slot.last_use != 0) &&
+          (slot.user_agent_size == user_agent.size()) &&
+          (memcmp(slot.hash, hash.data(), Data::kHashBytes) == 0));
+}
+
+}  // namespace
+
+Data::Bucket* SharedMemUserAgentCache::GetBucket(size_t bucket_num) {
+  return reinterpret_cast<Data::Bucket*>(
+      const_cast<char*>(segment_->Base() + bucket_num * bucket_size_));
+}
+
+void SharedMemUserAgentCache::AttachMutexes() {
+  mutexes_.reserve(num_buckets_);
+  for (size_t b = 0; b < num_buckets_; ++b) {
+    mutexes_.push_back(segment_->AttachToSharedMutex(
+        b * bucket_size_ + offsetof(Data::Bucket, mutex_base)));
+  }
+}
+
+bool SharedMemUserAgentCache::Lookup(StringPiece user_agent,
+                                     uint32* capabilities) {
+  if (segment_.get() == NULL) {
+    return false;
+  }
+  GoogleString hash;
+  size_t bucket_num;
+  GetHashAndBucket(user_agent, &hash, &bucket_num);
+  Data::Bucket* bucket = GetBucket(bucket_num);
+
+  ScopedMutex hold_lock(mutexes_[bucket_num]);
+  for (size_t s = 0; s < Data::kSlotsPerBucket; ++s) {
+    Data::Slot& slot = bucket->slots[s];
+    if (SlotMatches(slot, hash, user_agent)) {
+      slot.last_use = ++bucket->use_clock;
+      *capabilities = slot.capabilities;
+      hits_->Add(1);
+      return true;
+    }
+  }
+  misses_->Add(1);
+  return false;
+}
+
+void SharedMemUserAgentCache::Insert(StringPiece user_agent,
+                                     uint32 capabilities) {
+  if (segment_.get() == NULL) {
+    return;
+  }
+  GoogleString hash;
+  size_t bucket_num;
+  GetHashAndBucket(user_agent, &hash, &bucket_num);
+  Data::Bucket* bucket = GetBucket(bucket_num);
+
+  ScopedMutex hold_lock(mutexes_[bucket_num]);
+
+  // Re-use the slot if another process got here first, otherwise take a free
+  // slot, or failing that, the least-recently used one.
+  size_t victim = 0;
+  bool replacing = false;
+  for (size_t s = 0; s < Data::kSlotsPerBucket; ++s) {
+    const Data::Slot& slot = bucket->slots[s];
+    if (SlotMatches(slot, hash, user_agent)) {
+      victim = s;
+      replacing = true;
+      break;
+    }
+    // Free slots have a last_use of 0, so they win over any used one.
+    if (slot.last_use < bucket->slots[victim].last_use) {
+      victim = s;
+    }
+  }
+
+  Data::Slot& slot = bucket->slots[victim];
+  if ((slot.last_use != 0) && !replacing) {
+    evictions_->Add(1);
+  }
+  memcpy(slot.hash, hash.data(), Data::kHashBytes);
+  slot.user_agent_size = user_agent.size();
+  slot.capabilities = capabilities;
+  slot.last_use = ++bucket->use_clock;
+  inserts_->Add(1);
+}
+
+}  // namespace net_instaweb
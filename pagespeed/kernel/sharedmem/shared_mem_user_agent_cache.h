@@ -0,0 +1,127 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_USER_AGENT_CACHE_H_
+#define PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_USER_AGENT_CACHE_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/http/user_agent_matcher.h"
+
+namespace net_instaweb {
+
+class AbstractMutex;
+class AbstractSharedMem;
+class AbstractSharedMemSegment;
+class MessageHandler;
+class Statistics;
+class Variable;
+
+namespace SharedMemUserAgentCacheData {
+
+struct Bucket;
+
+}  // namespace SharedMemUserAgentCacheData
+
+// A fixed-size shared-memory table mapping user-agent strings to the
+// capability bits computed for them by UserAgentMatcher, so that all
+// processes on a server share the results of matching a popular user-agent.
+//
+// The table is split into buckets of a few slots each, and every user-agent
+// maps to a single bucket by its hash. Each bucket has its own mutex and is
+// kept in LRU order: when a bucket is full the least-recently used slot in it
+// is evicted.  Entries are keyed by the full 128-bit MD5 of the user-agent
+// and its length, rather than by a cheaper hash, since user-agents come from
+// clients: a user-agent crafted to collide with a popular browser's would
+// otherwise hand that browser its capability bits.
+class SharedMemUserAgentCache : public UserAgentMatcher::CapabilityCache {
+ public:
+  static const char kUserAgentCacheHits[];
+  static const char kUserAgentCacheMisses[];
+  static const char kUserAgentCacheInserts[];
+  static const char kUserAgentCacheEvictions[];
+
+  // The table will have room for at least 'entries' user-agents. You must
+  // call Initialize() in the root process and Attach() in child processes to
+  // finish the initialization.  'path' names the shared memory segment.
+  SharedMemUserAgentCache(AbstractSharedMem* shm_runtime,
+                          const GoogleString& path, int entries,
+                          Statistics* statistics, MessageHandler* handler);
+  virtual ~SharedMemUserAgentCache();
+
+  static void InitStats(Statistics* statistics);
+
+  // Sets up our shared state for use of all child processes. Returns
+  // whether successful.
+  bool Initialize();
+
+  // Connects to already initialized state from a child process.
+  // Returns whether successful.
+  bool Attach();
+
+  // This should be called from the root process as it is about to exit,
+  // with the same path as was passed to the constructor of the instance on
+  // which Initialize() was called.
+  static void GlobalCleanup(AbstractSharedMem* shm_runtime,
+                            const GoogleString& path,
+                            MessageHandler* message_handler);
+
+  // UserAgentMatcher::CapabilityCache implementation.  Both of these do
+  // nothing if the segment could not be set up.
+  virtual bool Lookup(StringPiece user_agent, uint32* capabilities);
+  virtual void Insert(StringPiece user_agent, uint32 capabilities);
+
+  // Number of user-agents the table can hold.
+  int capacity() const;
+
+ private:
+  // Computes the raw key hash and bucket number for user_agent.
+  void GetHashAndBucket(StringPiece user_agent, GoogleString* hash,
+                        size_t* bucket_num) const;
+
+  SharedMemUserAgentCacheData::Bucket* GetBucket(size_t bucket_num);
+  // Attaches to every bucket's mutex once, so lookups needn't allocate.
+  void AttachMutexes();
+  size_t SegmentSize() const;
+
+  AbstractSharedMem* shm_runtime_;
+  GoogleString path_;
+  size_t num_buckets_;
+  size_t bucket_size_;
+  MessageHandler* handler_;
+  MD5Hasher hasher_;
+
+  scoped_ptr<AbstractSharedMemSegment> segment_;
+  // One per bucket, attached to segment_, so they must go first.
+  std::vector<AbstractMutex*> mutexes_;
+
+  Variable* hits_;
+  Variable* misses_;
+  Variable* inserts_;
+  Variable* evictions_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedMemUserAgentCache);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_USER_AGENT_CACHE_H_
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/sharedmem/shared_mem_user_agent_cache_test_base.h"
+
+#include <algorithm>
+
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/rolling_hash.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_test_base.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_user_agent_cache.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kPath[] = "shm_ua_cache";
+const int kEntries = 256;
+const char kChrome[] = "Mozilla/5.0 (X11; Linux x86_64) Chrome/47.0";
+const char kFirefox[] = "Mozilla/5.0 (X11; Linux x86_64) Firefox/43.0";
+
+}  // namespace
+
+SharedMemUserAgentCacheTestBase::SharedMemUserAgentCacheTestBase(
+    SharedMemTestEnv* test_env)
+    : test_env_(test_env),
+      shmem_runtime_(test_env->CreateSharedMemRuntime()),
+      thread_system_(Platform::CreateThreadSystem()),
+      handler_(thread_system_->NewMutex()),
+      stats_(thread_system_.get()) {
+  SharedMemUserAgentCache::InitStats(&stats_);
+}
+
+void SharedMemUserAgentCacheTestBase::SetUp() {
+  root_cache_.reset(CreateCache(kEntries));
+  EXPECT_TRUE(root_cache_->Initialize());
+}
+
+void SharedMemUserAgentCacheTestBase::TearDown() {
+  SharedMemUserAgentCache::GlobalCleanup(shmem_runtime_.get(), kPath,
+                                         &handler_);
+}
+
+bool SharedMemUserAgentCacheTestBase::CreateChild(TestMethod method) {
+  Function* callback =
+      new MemberFunction0<SharedMemUserAgentCacheTestBase>(method, this);
+  return test_env_->CreateChild(callback);
+}
+
+SharedMemUserAgentCache* SharedMemUserAgentCacheTestBase::CreateCache(
+    int entries) {
+  return new SharedMemUserAgentCache(shmem_runtime_.get(), kPath, entries,
+                                     &stats_, &handler_);
+}
+
+SharedMemUserAgentCache* SharedMemUserAgentCacheTestBase::AttachDefault() {
+  SharedMemUserAgentCache* cache = CreateCache(kEntries);
+  if (!cache->Attach()) {
+    delete cache;
+    cache = NULL;
+  }
+  return cache;
+}
+
+void SharedMemUserAgentCacheTestBase::TestBasic() {
+  scoped_ptr<SharedMemUserAgentCache> cache(AttachDefault());
+  ASSERT_TRUE(cache.get() != NULL);
+  EXPECT_LE(kEntries, cache->capacity());
+
+  uint32 capabilities = 0;
+  EXPECT_FALSE(cache->Lookup(kChrome, &capabilities));
+  EXPECT_EQ(1, stats_.GetVariable(
+      SharedMemUserAgentCache::kUserAgentCacheMisses)->Get());
+
+  cache->Insert(kChrome, 0x1234);
+  cache->Insert("", 0x42);
+  EXPECT_TRUE(cache->Lookup(kChrome, &capabilities));
+  EXPECT_EQ(0x1234U, capabilities);
+  EXPECT_TRUE(cache->Lookup("", &capabilities));
+  EXPECT_EQ(0x42U, capabilities);
+  EXPECT_FALSE(cache->Lookup(kFirefox, &capabilities));
+
+  // Re-inserting overwrites in place rather than evicting.
+  cache->Insert(kChrome, 0x5678);
+  EXPECT_TRUE(cache->Lookup(kChrome, &capabilities));
+  EXPECT_EQ(0x5678U, capabilities);
+
+  EXPECT_EQ(3, stats_.GetVariable(
+      SharedMemUserAgentCache::kUserAgentCacheHits)->Get());
+  EXPECT_EQ(2, stats_.GetVariable(
+      SharedMemUserAgentCache::kUserAgentCacheMisses)->Get());
+  EXPECT_EQ(3, stats_.GetVariable(
+      SharedMemUserAgentCache::kUserAgentCacheInserts)->Get());
+  EXPECT_EQ(0, stats_.GetVariable(
+      SharedMemUserAgentCache::kUserAgentCacheEvictions)->Get());
+}
+
+void SharedMemUserAgentCacheTestBase::TestChild() {
+  scoped_ptr<SharedMemUserAgentCache> cache(AttachDefault());
+  ASSERT_TRUE(cache.get() != NULL);
+  cache->Insert(kChrome, 7);
+
+  CreateChild(&SharedMemUserAgentCacheTestBase::TestChildReadAndInsert);
+  test_env_->WaitForChildren();
+
+  // We should see what the child wrote.
+  uint32 capabilities = 0;
+  EXPECT_TRUE(cache->Lookup(kFirefox, &capabilities));
+  EXPECT_EQ(9U, capabilities);
+}
+
+void SharedMemUserAgentCacheTestBase::TestChildReadAndInsert() {
+  scoped_ptr<SharedMemUserAgentCache> cache(AttachDefault());
+  if (cache.get() == NULL) {
+    test_env_->ChildFailed();
+  }
+  uint32 capabilities = 0;
+  if (!cache->Lookup(kChrome, &capabilities) || (capabilities != 7)) {
+    test_env_->ChildFailed();
+  }
+  cache->Insert(kFirefox, 9);
+}
+
+void SharedMemUserAgentCacheTestBase::TestLruEviction() {
+  // Use a separate, tiny, table so all user-agents land in the same bucket.
+  const char kSmallPath[] = "shm_ua_cache_small";
+  SharedMemUserAgentCache small_cache(shmem_runtime_.get(), kSmallPath, 1,
+                                      &stats_, &handler_);
+  ASSERT_TRUE(small_cache.Initialize());
+  int capacity = small_cache.capacity();
+  ASSERT_LT(1, capacity);
+
+  for (int i = 0; i < capacity; ++i) {
+    small_cache.Insert(StrCat("ua", IntegerToString(i)), i);
+  }
+
+  // Touch ua0, making ua1 the least-recently used entry.
+  uint32 capabilities = 0;
+  EXPECT_TRUE(small_cache.Lookup("ua0", &capabilities));
+  EXPECT_EQ(0U, capabilities);
+
+  small_cache.Insert("new", 100);
+  EXPECT_EQ(1, stats_.GetVariable(
+      SharedMemUserAgentCache::kUserAgentCacheEvictions)->Get());
+  EXPECT_TRUE(small_cache.Lookup("new", &capabilities));
+  EXPECT_EQ(100U, capabilities);
+  EXPECT_TRUE(small_cache.Lookup("ua0", &capabilities));
+  EXPECT_FALSE(small_cache.Lookup("ua1", &capabilities));
+  for (int i = 2; i < capacity; ++i) {
+    EXPECT_TRUE(small_cache.Lookup(StrCat("ua", IntegerToString(i)),
+                                   &capabilities));
+    EXPECT_EQ(static_cast<uint32>(i), capabilities);
+  }
+
+  SharedMemUserAgentCache::GlobalCleanup(shmem_runtime_.get(), kSmallPath,
+                                         &handler_);
+}
+
+void SharedMemUserAgentCacheTestBase::TestNoWeakHashCollisions() {
+  scoped_ptr<SharedMemUserAgentCache> cache(AttachDefault());
+  ASSERT_TRUE(cache.get() != NULL);
+
+  // RollingHash rotates each character's hash by its distance from the end,
+  // so swapping two characters 64 apart leaves it unchanged.  A client can
+  // make such a user-agent from a popular one; it must not get its entry.
+  GoogleString browser = StrCat("Mozilla/5.0 (X11; Linux x86_64) ",
+                                GoogleString(64, 'x'), " Chrome/47.0");
+  GoogleString crafted = browser;
+  std::swap(crafted[0], crafted[64]);
+  ASSERT_NE(browser, crafted);
+  ASSERT_EQ(RollingHash(browser.data(), 0, browser.size()),
+            RollingHash(crafted.data(), 0, crafted.size()));
+
+  cache->Insert(crafted, 0xbad);
+  uint32 capabilities = 0;
+  EXPECT_FALSE(cache->Lookup(browser, &capabilities));
+  cache->Insert(browser, 0x600d);
+  EXPECT_TRUE(cache->Lookup(browser, &capabilities));
+  EXPECT_EQ(0x600dU, capabilities);
+  EXPECT_TRUE(cache->Lookup(crafted, &capabilities));
+  EXPECT_EQ(0xbadU, capabilities);
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_USER_AGENT_CACHE_TEST_BASE_H_
+#define PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_USER_AGENT_CACHE_TEST_BASE_H_
+
+#include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/mock_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_test_base.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_user_agent_cache.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+
+namespace net_instaweb {
+
+class SharedMemUserAgentCacheTestBase : public testing::Test {
+ protected:
+  typedef void (SharedMemUserAgentCacheTestBase::*TestMethod)();
+
+  explicit SharedMemUserAgentCacheTestBase(SharedMemTestEnv* test_env);
+  virtual void SetUp();
+  virtual void TearDown();
+
+  void TestBasic();
+  void TestChild();
+  void TestLruEviction();
+  void TestNoWeakHashCollisions();
+
+ private:
+  bool CreateChild(TestMethod method);
+
+  SharedMemUserAgentCache* CreateCache(int entries);
+  SharedMemUserAgentCache* AttachDefault();
+
+  void TestChildReadAndInsert();
+
+  scoped_ptr<SharedMemTestEnv> test_env_;
+  scoped_ptr<AbstractSharedMem> shmem_runtime_;
+  scoped_ptr<ThreadSystem> thread_system_;
+  MockMessageHandler handler_;
+  SimpleStats stats_;
+  scoped_ptr<SharedMemUserAgentCache> root_cache_;  // used for init only.
+
+  DISALLOW_COPY_AND_ASSIGN(SharedMemUserAgentCacheTestBase);
+};
+
+template<typename ConcreteTestEnv>
+class SharedMemUserAgentCacheTestTemplate
+    : public SharedMemUserAgentCacheTestBase {
+ public:
+  SharedMemUserAgentCacheTestTemplate()
+      : SharedMemUserAgentCacheTestBase(new ConcreteTestEnv) {
+  }
+};
+
+TYPED_TEST_CASE_P(SharedMemUserAgentCacheTestTemplate);
+
+TYPED_TEST_P(SharedMemUserAgentCacheTestTemplate, TestBasic) {
+  SharedMemUserAgentCacheTestBase::TestBasic();
+}
+
+TYPED_TEST_P(SharedMemUserAgentCacheTestTemplate, TestChild) {
+  SharedMemUserAgentCacheTestBase::TestChild();
+}
+
+TYPED_TEST_P(SharedMemUserAgentCacheTestTemplate, TestLruEviction) {
+  SharedMemUserAgentCacheTestBase::TestLruEviction();
+}
+
+TYPED_TEST_P(SharedMemUserAgentCacheTestTemplate, TestNoWeakHashCollisions) {
+  SharedMemUserAgentCacheTestBase::TestNoWeakHashCollisions();
+}
+
+REGISTER_TYPED_TEST_CASE_P(SharedMemUserAgentCacheTestTemplate, TestBasic,
+                           TestChild, TestLruEviction,
+                           TestNoWeakHashCollisions);
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_USER_AGENT_CACHE_TEST_BASE_H_
@@ -31,7 +31,8 @@
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread.h"
 #include "pagespeed/kernel/base/thread_system.h"
-#include "pagespeed/kernel/util/threadsafe_lock_manager.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/thread/scheduler.h"
 
 namespace {
 
@@ -52,7 +53,7 @@ namespace net_instaweb {
 LockManagerSpammer::LockManagerSpammer(Scheduler* scheduler,
                                        ThreadSystem::ThreadFlags flags,
                                        const StringVector& lock_names,
-                                       ThreadSafeLockManager* lock_manager,
+                                       NamedLockManager* lock_manager,
                                        bool expecting_denials,
                                        bool delay_unlocks,
                                        int index,
@@ -108,9 +109,9 @@ void LockManagerSpammer::RunTests(int num_threads,
                                   int num_names,
                                   bool expecting_denials,
                                   bool delay_unlocks,
-                                  ThreadSafeLockManager* lock_manager,
+                                  NamedLockManager* lock_manager,
                                   Scheduler* scheduler,
-                                  MockTimer* timer) {
+                                  Timer* timer) {
   std::vector<LockManagerSpammer*> spammers(num_threads);
   CountDown pending_threads(scheduler, num_threads);
 
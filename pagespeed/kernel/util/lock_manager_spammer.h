@@ -23,15 +23,14 @@
 #include <vector>
 
 #include "pagespeed/kernel/base/basictypes.h"
-#include "pagespeed/kernel/base/mock_timer.h"
 #include "pagespeed/kernel/base/named_lock_manager.h"
 #include "pagespeed/kernel/base/thread.h"
 #include "pagespeed/kernel/base/thread_system.h"
-#include "pagespeed/kernel/thread/mock_scheduler.h"
+#include "pagespeed/kernel/thread/scheduler.h"
 
 namespace net_instaweb {
 
-class ThreadSafeLockManager;
+class Timer;
 
 // Test helper class for blasting a lock-manager with concurrent lock/unlock
 // requests.
@@ -45,8 +44,8 @@ class LockManagerSpammer : public ThreadSystem::Thread {
   // unlocked in the loop.
   static void RunTests(int num_threads, int num_iters, int num_names,
                        bool expecting_denials, bool delay_unlocks,
-                       ThreadSafeLockManager* lock_manager,
-                       Scheduler* scheduler, MockTimer* timer);
+                       NamedLockManager* lock_manager,
+                       Scheduler* scheduler, Timer* timer);
 
   // Called when a lock is granted/denied.
   void Granted(NamedLock* lock);
@@ -75,7 +74,7 @@ class LockManagerSpammer : public ThreadSystem::Thread {
   LockManagerSpammer(Scheduler* scheduler,
                      ThreadSystem::ThreadFlags flags,
                      const StringVector& lock_names,
-                     ThreadSafeLockManager* lock_manager,
+                     NamedLockManager* lock_manager,
                      bool expecting_denials,
                      bool delay_unlocks,
                      int index,
@@ -85,7 +84,7 @@ class LockManagerSpammer : public ThreadSystem::Thread {
 
   Scheduler* scheduler_;
   const StringVector& lock_names_;
-  ThreadSafeLockManager* lock_manager_;
+  NamedLockManager* lock_manager_;
   bool expecting_denials_;
   bool delay_unlocks_;
   int index_;
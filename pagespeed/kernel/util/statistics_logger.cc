@@ -17,13 +17,16 @@
 
 #include "pagespeed/kernel/util/statistics_logger.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <set>
 #include <utility>                      // for pair
 #include <vector>
 
+#include "base/logging.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/escaping.h"
@@ -36,6 +39,7 @@
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/base/writer.h"
 #include "pagespeed/kernel/html/html_keywords.h"
+#include "pagespeed/kernel/util/statistics_time_series.h"
 
 namespace net_instaweb {
 
@@ -125,6 +129,13 @@ const char* const kGraphsVars[] = {
   "cache_extensions", "cache_batcher_dropped_gets", "cache_flush_count",
 };
 
+GoogleString JsonVarName(StringPiece var_name) {
+  GoogleString html_name, json_name;
+  HtmlKeywords::Escape(var_name, &html_name);
+  EscapeToJsStringLiteral(html_name, true /* add_quotes*/, &json_name);
+  return json_name;
+}
+
 }  // namespace
 
 StatisticsLogger::StatisticsLogger(
@@ -160,6 +171,18 @@ void StatisticsLogger::Init() {
   }
 }
 
+bool StatisticsLogger::InitTimeSeries(AbstractSharedMem* shm_runtime,
+                                      const GoogleString& segment_name,
+                                      bool parent) {
+  time_series_.reset(new StatisticsTimeSeries(
+      shm_runtime, segment_name, variables_to_log_.size(), message_handler_));
+  bool ok = parent ? time_series_->Initialize() : time_series_->Attach();
+  if (!ok) {
+    time_series_.reset(NULL);
+  }
+  return ok;
+}
+
 void StatisticsLogger::InitStatsForTest() {
   // List of statistics to log.
   for (int i = 0, n = arraysize(kConsoleVars); i < n; ++i) {
@@ -212,6 +235,9 @@ void StatisticsLogger::UpdateAndDumpIfRequired() {
                                   "Error opening statistics log file %s.",
                                   logfile_name_.c_str());
       }
+      if (time_series_.get() != NULL) {
+        AppendToTimeSeries(current_time_ms);
+      }
       // Update timestamp regardless of file write so we don't hit the same
       // error many times in a row.
       last_dump_timestamp_->SetLockHeld(current_time_ms);
@@ -238,6 +264,24 @@ void StatisticsLogger::DumpConsoleVarsToWriter(
   writer->Flush(message_handler_);
 }
 
+void StatisticsLogger::AppendToTimeSeries(int64 current_time_ms) {
+  if (static_cast<size_t>(time_series_->num_columns()) !=
+      variables_to_log_.size()) {
+    LOG(DFATAL) << "Logged variables changed after InitTimeSeries";
+    return;
+  }
+  std::vector<int64> values;
+  values.reserve(variables_to_log_.size());
+  for (VariableMap::const_iterator iter = variables_to_log_.begin();
+       iter != variables_to_log_.end(); ++iter) {
+    VariableOrCounter var_or_counter = iter->second;
+    values.push_back((var_or_counter.first != NULL)
+                     ? var_or_counter.first->Get()
+                     : var_or_counter.second->Get());
+  }
+  time_series_->Append(current_time_ms, &values[0]);
+}
+
 void StatisticsLogger::TrimLogfileIfNeeded() {
   int64 size_bytes;
   if (file_system_->Size(logfile_name_, &size_bytes, message_handler_) &&
@@ -254,26 +298,130 @@ void StatisticsLogger::DumpJSON(
     bool dump_for_graphs, const StringSet& var_titles,
     int64 start_time, int64 end_time, int64 granularity_ms,
     Writer* writer, MessageHandler* message_handler) const {
+  StringSet graphs_vars;
+  if (dump_for_graphs) {
+    graphs_vars.insert(kGraphsVars, kGraphsVars + arraysize(kGraphsVars));
+  }
+  const StringSet& titles = dump_for_graphs ? graphs_vars : var_titles;
+
+  std::vector<int64> history_timestamps;
+  std::vector<int64> history_values;
+  int64 history_start_ms = 0;
+  bool have_history =
+      (time_series_.get() != NULL) &&
+      ReadTimeSeries(titles, start_time, end_time, granularity_ms,
+                     &history_start_ms, &history_timestamps, &history_values);
+
+  // The shared-memory history starts empty on every restart and only reaches
+  // back so far, so whatever is requested from before its oldest row comes
+  // from the logfile.
+  VarMap parsed_var_data;
+  std::vector<int64> list_of_timestamps;
+  if (!have_history || (start_time < history_start_ms)) {
+    int64 logfile_end_time = have_history
+        ? std::min(end_time, history_start_ms - 1) : end_time;
+    if (!ReadLogfile(dump_for_graphs, var_titles, start_time,
+                     logfile_end_time, granularity_ms, &list_of_timestamps,
+                     &parsed_var_data, message_handler) &&
+        !have_history) {
+      // If logfile_name_ represents a file that doesn't exist, OpenInputFile
+      // logged an error.  Return an empty json object.
+      writer->Write("{}", message_handler);
+      return;
+    }
+  }
+
+  if (have_history) {
+    // Keep to the requested granularity across the seam with the logfile.
+    size_t first_row = 0;
+    if (!list_of_timestamps.empty()) {
+      while ((first_row < history_timestamps.size()) &&
+             (history_timestamps[first_row] <
+              list_of_timestamps.back() + granularity_ms)) {
+        ++first_row;
+      }
+    }
+    size_t num_rows = history_timestamps.size();
+    list_of_timestamps.insert(list_of_timestamps.end(),
+                              history_timestamps.begin() + first_row,
+                              history_timestamps.end());
+    int c = 0;
+    for (StringSet::const_iterator iter = titles.begin();
+         iter != titles.end(); ++iter, ++c) {
+      VariableInfo* info = &parsed_var_data[*iter];
+      // Variables that were not in the logfile's part of the range still
+      // need a placeholder for each of its timestamps.
+      info->resize(list_of_timestamps.size() - (num_rows - first_row), "0");
+      for (size_t r = first_row; r < num_rows; ++r) {
+        info->push_back(Integer64ToString(history_values[c * num_rows + r]));
+      }
+    }
+  }
+  PrintJSON(list_of_timestamps, parsed_var_data, writer, message_handler);
+}
+
+bool StatisticsLogger::ReadLogfile(
+    bool dump_for_graphs, const StringSet& var_titles, int64 start_time,
+    int64 end_time, int64 granularity_ms, std::vector<int64>* timestamps,
+    VarMap* var_data, MessageHandler* message_handler) const {
   FileSystem::InputFile* log_file =
       file_system_->OpenInputFile(logfile_name_.c_str(), message_handler);
   if (log_file == NULL) {
-    // If logfile_name_ represents a file that doesn't exist, OpenInputFile
-    // logged an error and log_file will be null.  Return an empty json object.
-    writer->Write("{}", message_handler);
-    return;
+    return false;
   }
-  VarMap parsed_var_data;
-  std::vector<int64> list_of_timestamps;
   StatisticsLogfileReader reader(log_file, start_time, end_time,
                                  granularity_ms, message_handler);
   if (dump_for_graphs) {
-    ParseDataForGraphs(&reader, &list_of_timestamps, &parsed_var_data);
+    ParseDataForGraphs(&reader, timestamps, var_data);
   } else {
-    ParseDataFromReader(var_titles, &reader, &list_of_timestamps,
-                        &parsed_var_data);
+    ParseDataFromReader(var_titles, &reader, timestamps, var_data);
   }
-  PrintJSON(list_of_timestamps, parsed_var_data, writer, message_handler);
   file_system_->Close(log_file, message_handler);
+  return true;
+}
+
+bool StatisticsLogger::ReadTimeSeries(
+    const StringSet& var_titles, int64 start_time, int64 end_time,
+    int64 granularity_ms, int64* oldest_ms, std::vector<int64>* timestamps,
+    std::vector<int64>* values) const {
+  // Map each title to its column, or -1 for variables we don't log, which
+  // get zeros just like variables missing from the logfile.
+  std::vector<int> columns;
+  columns.reserve(var_titles.size());
+  for (StringSet::const_iterator iter = var_titles.begin();
+       iter != var_titles.end(); ++iter) {
+    VariableMap::const_iterator var = variables_to_log_.find(*iter);
+    columns.push_back((var == variables_to_log_.end())
+                      ? -1 : std::distance(variables_to_log_.begin(), var));
+  }
+
+  // Copy out what we need under the lock that serializes dumps; DumpJSON
+  // formats it after the lock is released.
+  AbstractMutex* mutex = last_dump_timestamp_->mutex();
+  if (mutex == NULL) {
+    return false;
+  }
+  ScopedMutex lock(mutex);
+  StatisticsTimeSeries::Selection selection;
+  if (!time_series_->Select(start_time, end_time, granularity_ms,
+                            &selection)) {
+    return false;
+  }
+  *oldest_ms = selection.oldest_ms;
+  const std::vector<int>& rows = selection.rows;
+  timestamps->reserve(rows.size());
+  for (size_t r = 0; r < rows.size(); ++r) {
+    timestamps->push_back(
+        time_series_->Timestamp(selection.resolution, rows[r]));
+  }
+  values->reserve(columns.size() * rows.size());
+  for (size_t c = 0; c < columns.size(); ++c) {
+    for (size_t r = 0; r < rows.size(); ++r) {
+      values->push_back((columns[c] < 0) ? 0 : time_series_->Value(
+          selection.resolution, rows[r], columns[c]));
+    }
+  }
+  return true;
 }
 
 void StatisticsLogger::ParseDataFromReader(
@@ -387,11 +535,7 @@ void StatisticsLogger::PrintVarDataAsJSON(
     if (iterator != parsed_var_data.begin()) {
       writer->Write(",", message_handler);
     }
-    GoogleString html_name, json_name;
-    HtmlKeywords::Escape(var_name, &html_name);
-    EscapeToJsStringLiteral(html_name, true /* add_quotes*/, &json_name);
-
-    writer->Write(json_name, message_handler);
+    writer->Write(JsonVarName(var_name), message_handler);
     writer->Write(": [", message_handler);
     for (size_t i = 0; i < info.size(); ++i) {
       writer->Write(info[i], message_handler);
@@ -25,15 +25,18 @@
 
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/file_system.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 
 namespace net_instaweb {
 
+class AbstractSharedMem;
 class MessageHandler;
 class MutexedScalar;
 class Statistics;
 class StatisticsLogfileReader;
+class StatisticsTimeSeries;
 class Timer;
 class UpDownCounter;
 class Variable;
@@ -53,6 +56,11 @@ class StatisticsLogger {
   // Variable data is a time series collected from with data points from
   // start_time to end_time. Granularity is the minimum time difference
   // between each successive data point.
+  //
+  // The data comes from the shared-memory history if InitTimeSeries
+  // succeeded and something has been recorded there.  The logfile supplies
+  // whatever part of the range is older than the history's oldest row, and
+  // everything when there is no history.
   void DumpJSON(bool dump_for_graphs, const StringSet& var_titles,
                 int64 start_time, int64 end_time, int64 granularity_ms,
                 Writer* writer, MessageHandler* message_handler) const;
@@ -71,6 +79,15 @@ class StatisticsLogger {
   // It is OK to call this multiple times (e.g. before & after a fork).
   void Init();
 
+  // Sets up a binary, columnar history of the logged variables in the shared
+  // memory segment segment_name, which every dump appends to and DumpJSON
+  // slices without parsing the logfile. Call after Init(), with parent = true
+  // in the root process and false in the children. Returns whether
+  // successful; on failure we keep serving from the logfile.
+  bool InitTimeSeries(AbstractSharedMem* shm_runtime,
+                      const GoogleString& segment_name, bool parent);
+  bool has_time_series() const { return time_series_.get() != NULL; }
+
  private:
   friend class StatisticsLoggerTest;
 
@@ -86,6 +103,24 @@ class StatisticsLogger {
   // Export statistics to a writer. Only export stats needed for console.
   // current_time_ms: The time at which the dump was triggered.
   void DumpConsoleVarsToWriter(int64 current_time_ms, Writer* writer);
+  // Records the current values of the logged variables in time_series_.
+  // Must be called with last_dump_timestamp_'s mutex held.
+  void AppendToTimeSeries(int64 current_time_ms);
+  // Reads the data for DumpJSON from the logfile.  Returns false if the
+  // logfile could not be opened.
+  bool ReadLogfile(bool dump_for_graphs, const StringSet& var_titles,
+                   int64 start_time, int64 end_time, int64 granularity_ms,
+                   std::vector<int64>* timestamps, VarMap* var_data,
+                   MessageHandler* message_handler) const;
+  // Reads the data for DumpJSON from time_series_: the selected timestamps,
+  // and then each title's values in order, one block of timestamps->size()
+  // values per title.  oldest_ms is set to the oldest timestamp the history
+  // still holds at the resolution used.  Returns false if nothing has been
+  // recorded there.
+  bool ReadTimeSeries(const StringSet& var_titles, int64 start_time,
+                      int64 end_time, int64 granularity_ms, int64* oldest_ms,
+                      std::vector<int64>* timestamps,
+                      std::vector<int64>* values) const;
   // Save the variables listed in var_titles to the map.
   void ParseDataFromReader(const StringSet& var_titles,
                            StatisticsLogfileReader* reader,
@@ -128,6 +163,9 @@ class StatisticsLogger {
   const int64 max_logfile_size_kb_;
   GoogleString logfile_name_;
   VariableMap variables_to_log_;
+  // Columns are the variables_to_log_, in map order. NULL unless
+  // InitTimeSeries was called.
+  scoped_ptr<StatisticsTimeSeries> time_series_;
 
   DISALLOW_COPY_AND_ASSIGN(StatisticsLogger);
 };
@@ -37,8 +37,10 @@
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/html/html_keywords.h"
+#include "pagespeed/kernel/sharedmem/inprocess_shared_mem.h"
 #include "pagespeed/kernel/util/platform.h"
 #include "pagespeed/kernel/util/simple_stats.h"
+#include "pagespeed/kernel/util/statistics_time_series.h"
 
 namespace net_instaweb {
 
@@ -405,6 +407,110 @@ TEST_F(StatisticsLoggerTest, FromStats) {
   }
 }
 
+// Once a shared-memory history is set up, DumpJSON is served from it rather
+// than from the logfile.
+TEST_F(StatisticsLoggerTest, TimeSeries) {
+  InProcessSharedMem shm(thread_system_.get());
+  ASSERT_TRUE(logger_.InitTimeSeries(&shm, "history", true));
+
+  // Nothing recorded yet, so we still read the logfile.
+  std::set<GoogleString> var_titles;
+  int64 start_time, end_time, granularity_ms;
+  CreateFakeLogfile(&var_titles, &start_time, &end_time, &granularity_ms);
+  GoogleString json_dump;
+  StringWriter writer(&json_dump);
+  logger_.DumpJSON(false, var_titles, start_time, end_time, granularity_ms,
+                   &writer, &handler_);
+  EXPECT_THAT(json_dump, ::testing::HasSubstr(
+      "\"num_flushes\": [300, 300, 300, 300]"));
+
+  var_titles.clear();
+  var_titles.insert("num_flushes");
+  var_titles.insert("foo");
+
+  int64 first_dump_ms = timer_.NowMs() + kLoggingIntervalMs;
+  for (int i = 0; i < 3; ++i) {
+    stats_.GetVariable("num_flushes")->Add(10);
+    timer_.AdvanceMs(kLoggingIntervalMs);
+    logger_.UpdateAndDumpIfRequired();
+  }
+  file_system_.RemoveFile(kStatsLogFile, &handler_);
+
+  json_dump.clear();
+  logger_.DumpJSON(false, var_titles, 0, timer_.NowMs(), 1, &writer,
+                   &handler_);
+  EXPECT_EQ(StrCat("{\"timestamps\": [", Integer64ToString(first_dump_ms),
+                   ", ",
+                   Integer64ToString(first_dump_ms + kLoggingIntervalMs),
+                   ", ",
+                   Integer64ToString(first_dump_ms + 2 * kLoggingIntervalMs),
+                   "],\"variables\": {"
+                   "\"foo\": [0, 0, 0],"
+                   "\"num_flushes\": [10, 20, 30]}}"),
+            json_dump);
+
+  GoogleString json_dump_graphs;
+  StringWriter writer_graphs(&json_dump_graphs);
+  logger_.DumpJSON(true, var_titles, 0, timer_.NowMs(), 1, &writer_graphs,
+                   &handler_);
+  Json::Value complete_json;
+  Json::Reader json_reader;
+  ASSERT_TRUE(json_reader.parse(json_dump_graphs.c_str(), complete_json))
+      << json_dump_graphs;
+  EXPECT_EQ(84, complete_json["variables"].size());
+  EXPECT_EQ(3, complete_json["timestamps"].size());
+
+  StatisticsTimeSeries::GlobalCleanup(&shm, "history", &handler_);
+}
+
+// The history starts empty on restart, so the part of a range from before
+// its oldest row is read from the logfile.
+TEST_F(StatisticsLoggerTest, TimeSeriesWithOlderLogfile) {
+  InProcessSharedMem shm(thread_system_.get());
+  ASSERT_TRUE(logger_.InitTimeSeries(&shm, "history", true));
+
+  std::set<GoogleString> var_titles;
+  int64 start_time, end_time, granularity_ms;
+  CreateFakeLogfile(&var_titles, &start_time, &end_time, &granularity_ms);
+  var_titles.clear();
+  var_titles.insert("num_flushes");
+
+  // The logfile ends where the history begins.  These dumps append to the
+  // logfile too, but the rows the history has are not read from it twice.
+  timer_.SetTimeMs(end_time);
+  stats_.GetVariable("num_flushes")->Add(310);
+  logger_.UpdateAndDumpIfRequired();
+  timer_.AdvanceMs(kLoggingIntervalMs);
+  stats_.GetVariable("num_flushes")->Add(10);
+  logger_.UpdateAndDumpIfRequired();
+
+  GoogleString json_dump;
+  StringWriter writer(&json_dump);
+  logger_.DumpJSON(false, var_titles, start_time, timer_.NowMs(),
+                   granularity_ms, &writer, &handler_);
+  GoogleString timestamps;
+  for (int64 time = start_time; time <= timer_.NowMs();
+       time += granularity_ms) {
+    StrAppend(&timestamps, (time == start_time) ? "" : ", ",
+              Integer64ToString(time));
+  }
+  EXPECT_EQ(StrCat("{\"timestamps\": [", timestamps, "],\"variables\": {"
+                   "\"num_flushes\": [300, 300, 300, 300, 310, 320]}}"),
+            json_dump);
+
+  // A range the history covers doesn't need the logfile.
+  file_system_.RemoveFile(kStatsLogFile, &handler_);
+  json_dump.clear();
+  logger_.DumpJSON(false, var_titles, end_time, timer_.NowMs(),
+                   granularity_ms, &writer, &handler_);
+  EXPECT_EQ(StrCat("{\"timestamps\": [", Integer64ToString(end_time), ", ",
+                   Integer64ToString(timer_.NowMs()),
+                   "],\"variables\": {\"num_flushes\": [310, 320]}}"),
+            json_dump);
+
+  StatisticsTimeSeries::GlobalCleanup(&shm, "history", &handler_);
+}
+
 TEST_F(StatisticsLoggerTest, LogfileTrimming) {
   const int64 kMaxLogfileSizeBytes = kMaxLogfileSizeKb * 1024;
 
@@ -0,0 +1,249 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pagespeed/kernel/util/statistics_time_series.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/timer.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Memory structure, repeated for each resolution:
+//
+//  rows_written (64-bit): total number of rows ever started in this ring.
+//  timestamps[capacity] (64-bit each)
+//  column 0 values[capacity] (64-bit each)
+//  ...
+//  column num_columns - 1 values[capacity]
+//
+// Row r of the ring lives at index r % capacity of every array, so once the
+// ring has wrapped the oldest row is at rows_written % capacity.
+const int kCapacity[StatisticsTimeSeries::kNumResolutions] = {
+  1200,     // kRaw: an hour at the default 3 second logging interval.
+  2 * 1440,  // kMinute: two days.
+  90 * 24,   // kHour: about three months.
+};
+
+// Width of the interval whose last sample a row represents; 0 means every
+// sample gets its own row.
+const int64 kIntervalMs[StatisticsTimeSeries::kNumResolutions] = {
+  0,
+  Timer::kMinuteMs,
+  Timer::kHourMs,
+};
+
+}  // namespace
+
+struct StatisticsTimeSeries::Ring {
+  int64 rows_written;
+  int64 data[1];
+};
+
+StatisticsTimeSeries::StatisticsTimeSeries(
+    AbstractSharedMem* shm_runtime, const GoogleString& path, int num_columns,
+    MessageHandler* handler)
+    : shm_runtime_(shm_runtime),
+      path_(path),
+      num_columns_(num_columns),
+      handler_(handler) {
+}
+
+StatisticsTimeSeries::~StatisticsTimeSeries() {
+}
+
+int StatisticsTimeSeries::Capacity(Resolution resolution) {
+  return kCapacity[resolution];
+}
+
+size_t StatisticsTimeSeries::RingSize(Resolution resolution) const {
+  return offsetof(Ring, data) +
+      sizeof(int64) * kCapacity[resolution] * (num_columns_ + 1);
+}
+
+size_t StatisticsTimeSeries::SegmentSize() const {
+  size_t total = 0;
+  for (int r = 0; r < kNumResolutions; ++r) {
+    total += RingSize(static_cast<Resolution>(r));
+  }
+  return total;
+}
+
+bool StatisticsTimeSeries::Initialize() {
+  // CreateSegment zeroes the memory, so every ring starts out empty.
+  segment_.reset(shm_runtime_->CreateSegment(path_, SegmentSize(), handler_));
+  if (segment_.get() == NULL) {
+    handler_->MessageS(
+        kError, "Unable to create memory segment for statistics history.");
+    return false;
+  }
+  return true;
+}
+
+bool StatisticsTimeSeries::Attach() {
+  segment_.reset(shm_runtime_->AttachToSegment(path_, SegmentSize(),
+                                               handler_));
+  if (segment_.get() == NULL) {
+    handler_->MessageS(
+        kWarning, "Unable to attach to statistics history SHM segment");
+    return false;
+  }
+  return true;
+}
+
+void StatisticsTimeSeries::GlobalCleanup(AbstractSharedMem* shm_runtime,
+                                         const GoogleString& path,
+                                         MessageHandler* message_handler) {
+  shm_runtime->DestroySegment(path, message_handler);
+}
+
+StatisticsTimeSeries::Ring* StatisticsTimeSeries::GetRing(
+    Resolution resolution) const {
+  size_t offset = 0;
+  for (int r = 0; r < resolution; ++r) {
+    offset += RingSize(static_cast<Resolution>(r));
+  }
+  return reinterpret_cast<Ring*>(
+      const_cast<char*>(segment_->Base() + offset));
+}
+
+// Column -1 is the timestamps.
+int64* StatisticsTimeSeries::Column(Resolution resolution, int column) const {
+  return GetRing(resolution)->data + (column + 1) * kCapacity[resolution];
+}
+
+int64 StatisticsTimeSeries::Timestamp(Resolution resolution, int row) const {
+  DCHECK_LE(0, row);
+  DCHECK_GT(kCapacity[resolution], row);
+  return Column(resolution, -1)[row];
+}
+
+int64 StatisticsTimeSeries::Value(Resolution resolution, int row,
+                                  int column) const {
+  DCHECK_LE(0, row);
+  DCHECK_GT(kCapacity[resolution], row);
+  DCHECK_LE(0, column);
+  DCHECK_GT(num_columns_, column);
+  return Column(resolution, column)[row];
+}
+
+void StatisticsTimeSeries::Append(int64 timestamp_ms, const int64* values) {
+  if (segment_.get() == NULL) {
+    return;
+  }
+  Ring* raw = GetRing(kRaw);
+  if ((raw->rows_written > 0) &&
+      (timestamp_ms <
+       Timestamp(kRaw, (raw->rows_written - 1) % kCapacity[kRaw]))) {
+    return;
+  }
+  for (int r = 0; r < kNumResolutions; ++r) {
+    AppendToRing(static_cast<Resolution>(r), timestamp_ms, values);
+  }
+}
+
+void StatisticsTimeSeries::AppendToRing(Resolution resolution,
+                                        int64 timestamp_ms,
+                                        const int64* values) {
+  Ring* ring = GetRing(resolution);
+  const int capacity = kCapacity[resolution];
+  const int64 interval_ms = kIntervalMs[resolution];
+  int64* timestamps = Column(resolution, -1);
+
+  // A rollup row is overwritten until the clock moves into the next interval,
+  // so it always holds the latest sample of its interval.
+  int row;
+  if ((interval_ms != 0) && (ring->rows_written > 0) &&
+      (timestamps[(ring->rows_written - 1) % capacity] / interval_ms ==
+       timestamp_ms / interval_ms)) {
+    row = (ring->rows_written - 1) % capacity;
+  } else {
+    row = ring->rows_written % capacity;
+    ++ring->rows_written;
+  }
+  timestamps[row] = timestamp_ms;
+  for (int c = 0; c < num_columns_; ++c) {
+    Column(resolution, c)[row] = values[c];
+  }
+}
+
+bool StatisticsTimeSeries::Select(int64 start_ms, int64 end_ms,
+                                  int64 granularity_ms,
+                                  Selection* selection) const {
+  selection->rows.clear();
+  if ((segment_.get() == NULL) || (GetRing(kRaw)->rows_written == 0)) {
+    return false;
+  }
+
+  // Use the finest resolution that still covers start_ms. A ring that has
+  // not wrapped yet holds everything since startup, so it covers as much as
+  // any other. Failing that, use the one with the longest history.
+  Resolution resolution = static_cast<Resolution>(kNumResolutions - 1);
+  for (int r = kNumResolutions - 2; r >= kRaw; --r) {
+    const Ring* ring = GetRing(static_cast<Resolution>(r));
+    int capacity = kCapacity[r];
+    if ((ring->rows_written <= capacity) ||
+        (Timestamp(static_cast<Resolution>(r),
+                   ring->rows_written % capacity) <= start_ms)) {
+      resolution = static_cast<Resolution>(r);
+    }
+  }
+  selection->resolution = resolution;
+
+  const Ring* ring = GetRing(resolution);
+  const int capacity = kCapacity[resolution];
+  const int64* timestamps = Column(resolution, -1);
+  int num_rows = std::min<int64>(ring->rows_written, capacity);
+  int oldest = (ring->rows_written <= capacity)
+      ? 0 : ring->rows_written % capacity;
+  selection->oldest_ms = timestamps[oldest];
+
+  // Binary search, in ring order, for the first row at or after start_ms.
+  int low = 0;
+  int high = num_rows;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (timestamps[(oldest + mid) % capacity] < start_ms) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  int64 last_selected = 0;
+  for (int i = low; i < num_rows; ++i) {
+    int row = (oldest + i) % capacity;
+    int64 timestamp = timestamps[row];
+    if (timestamp > end_ms) {
+      break;
+    }
+    if (selection->rows.empty() ||
+        (timestamp >= last_selected + granularity_ms)) {
+      selection->rows.push_back(row);
+      last_selected = timestamp;
+    }
+  }
+  return true;
+}
+
+}  // namespace net_instaweb
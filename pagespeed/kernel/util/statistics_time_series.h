@@ -0,0 +1,133 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PAGESPEED_KERNEL_UTIL_STATISTICS_TIME_SERIES_H_
+#define PAGESPEED_KERNEL_UTIL_STATISTICS_TIME_SERIES_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+
+namespace net_instaweb {
+
+class AbstractSharedMem;
+class AbstractSharedMemSegment;
+class MessageHandler;
+
+// Fixed-record, columnar history of a fixed set of int64 statistics, kept in
+// a shared-memory segment so that every process sees the samples recorded by
+// whichever process happened to do the periodic statistics dump.
+//
+// Samples are stored at three resolutions, each in its own ring of rows:
+//   kRaw:    every sample passed to Append.
+//   kMinute: the last sample seen in each wall-clock minute.
+//   kHour:   the last sample seen in each wall-clock hour.
+// Since almost everything we log is a monotonic counter, keeping the last
+// sample of an interval loses nothing but resolution, and lets long time
+// ranges be served from a handful of rows.
+//
+// Each ring stores its timestamps and every column contiguously, so reading a
+// range is a binary search on the timestamps followed by indexed loads; no
+// parsing is involved.
+//
+// This class does no locking of its own: callers must serialize Append
+// against other Appends and against readers (StatisticsLogger uses the
+// cross-process mutex guarding its last dump timestamp for this).
+class StatisticsTimeSeries {
+ public:
+  enum Resolution {
+    kRaw,
+    kMinute,
+    kHour,
+    kNumResolutions
+  };
+
+  // A set of rows selected from one resolution by Select. Rows are indices
+  // into the ring and stay meaningful only until the next Append.
+  struct Selection {
+    Selection() : resolution(kRaw), oldest_ms(0) {}
+
+    Resolution resolution;
+    std::vector<int> rows;
+    // Timestamp of the oldest row still held at this resolution; anything
+    // before it has been overwritten, or predates the segment.
+    int64 oldest_ms;
+  };
+
+  // Creates a series with num_columns values per sample. You must call
+  // Initialize() in the root process and Attach() in child processes before
+  // anything is recorded. 'path' names the shared memory segment.
+  StatisticsTimeSeries(AbstractSharedMem* shm_runtime, const GoogleString& path,
+                       int num_columns, MessageHandler* handler);
+  ~StatisticsTimeSeries();
+
+  // Sets up the segment in the root process. Returns whether successful.
+  bool Initialize();
+
+  // Connects to already initialized state from a child process.
+  // Returns whether successful.
+  bool Attach();
+
+  // This should be called from the root process as it is about to exit,
+  // with the same path as was passed to the constructor.
+  static void GlobalCleanup(AbstractSharedMem* shm_runtime,
+                            const GoogleString& path,
+                            MessageHandler* message_handler);
+
+  // Whether Initialize() or Attach() succeeded.
+  bool initialized() const { return segment_.get() != NULL; }
+
+  int num_columns() const { return num_columns_; }
+
+  // Records a sample of num_columns() values. Samples must be appended in
+  // non-decreasing timestamp order; out-of-order ones are dropped.
+  void Append(int64 timestamp_ms, const int64* values);
+
+  // Picks the rows with timestamps in [start_ms, end_ms] that are at least
+  // granularity_ms apart, from the finest resolution whose history reaches
+  // back to start_ms. Returns false if nothing has been recorded.
+  bool Select(int64 start_ms, int64 end_ms, int64 granularity_ms,
+              Selection* selection) const;
+
+  int64 Timestamp(Resolution resolution, int row) const;
+  int64 Value(Resolution resolution, int row, int column) const;
+
+  // Number of rows each resolution keeps before wrapping.
+  static int Capacity(Resolution resolution);
+
+ private:
+  struct Ring;
+
+  size_t SegmentSize() const;
+  size_t RingSize(Resolution resolution) const;
+  Ring* GetRing(Resolution resolution) const;
+  int64* Column(Resolution resolution, int column) const;
+  void AppendToRing(Resolution resolution, int64 timestamp_ms,
+                    const int64* values);
+
+  AbstractSharedMem* shm_runtime_;
+  GoogleString path_;
+  const int num_columns_;
+  MessageHandler* handler_;
+  scoped_ptr<AbstractSharedMemSegment> segment_;
+
+  DISALLOW_COPY_AND_ASSIGN(StatisticsTimeSeries);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_UTIL_STATISTICS_TIME_SERIES_H_
@@ -0,0 +1,142 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pagespeed/kernel/util/statistics_time_series.h"
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/mock_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/sharedmem/inprocess_shared_mem.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kSegmentName[] = "statistics_history";
+const int kNumColumns = 2;
+const int64 kStartMs = 1000 * Timer::kDayMs;
+
+class StatisticsTimeSeriesTest : public ::testing::Test {
+ protected:
+  typedef StatisticsTimeSeries::Selection Selection;
+
+  StatisticsTimeSeriesTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        handler_(thread_system_->NewMutex()),
+        shm_(thread_system_.get()),
+        series_(&shm_, kSegmentName, kNumColumns, &handler_) {
+  }
+
+  virtual void SetUp() {
+    ASSERT_TRUE(series_.Initialize());
+  }
+
+  virtual void TearDown() {
+    StatisticsTimeSeries::GlobalCleanup(&shm_, kSegmentName, &handler_);
+  }
+
+  // Appends a sample whose first column is 'value' and second is its double.
+  void Append(int64 timestamp_ms, int64 value) {
+    int64 values[kNumColumns] = { value, 2 * value };
+    series_.Append(timestamp_ms, values);
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  MockMessageHandler handler_;
+  InProcessSharedMem shm_;
+  StatisticsTimeSeries series_;
+};
+
+TEST_F(StatisticsTimeSeriesTest, Empty) {
+  Selection selection;
+  EXPECT_FALSE(series_.Select(0, kStartMs, 1, &selection));
+  EXPECT_TRUE(selection.rows.empty());
+}
+
+TEST_F(StatisticsTimeSeriesTest, SliceAndGranularity) {
+  for (int i = 0; i < 10; ++i) {
+    Append(kStartMs + i * Timer::kSecondMs, i);
+  }
+
+  Selection selection;
+  ASSERT_TRUE(series_.Select(kStartMs + 2 * Timer::kSecondMs,
+                             kStartMs + 7 * Timer::kSecondMs,
+                             2 * Timer::kSecondMs, &selection));
+  EXPECT_EQ(StatisticsTimeSeries::kRaw, selection.resolution);
+  ASSERT_EQ(3, selection.rows.size());
+  EXPECT_EQ(kStartMs + 2 * Timer::kSecondMs,
+            series_.Timestamp(selection.resolution, selection.rows[0]));
+  EXPECT_EQ(4, series_.Value(selection.resolution, selection.rows[1], 0));
+  EXPECT_EQ(12, series_.Value(selection.resolution, selection.rows[2], 1));
+
+  // Out-of-order samples are dropped.
+  Append(kStartMs, 100);
+  ASSERT_TRUE(series_.Select(0, kStartMs, 1, &selection));
+  ASSERT_EQ(1, selection.rows.size());
+  EXPECT_EQ(0, series_.Value(selection.resolution, selection.rows[0], 0));
+}
+
+TEST_F(StatisticsTimeSeriesTest, RollupsServeLongRanges) {
+  // Log every 30 seconds for a day, which wraps the raw ring but not the
+  // minute one.
+  const int64 kIntervalMs = 30 * Timer::kSecondMs;
+  const int kSamples = Timer::kDayMs / kIntervalMs;
+  ASSERT_LT(StatisticsTimeSeries::Capacity(StatisticsTimeSeries::kRaw),
+            kSamples);
+  for (int i = 0; i < kSamples; ++i) {
+    Append(kStartMs + i * kIntervalMs, i);
+  }
+  const int64 kEndMs = kStartMs + (kSamples - 1) * kIntervalMs;
+
+  // The last few minutes come from the raw samples.
+  Selection selection;
+  ASSERT_TRUE(series_.Select(kEndMs - 2 * Timer::kMinuteMs, kEndMs, 1,
+                             &selection));
+  EXPECT_EQ(StatisticsTimeSeries::kRaw, selection.resolution);
+  EXPECT_EQ(5, selection.rows.size());
+
+  // The whole day needs the minute rollup, which keeps the last sample of
+  // each minute.
+  ASSERT_TRUE(series_.Select(kStartMs, kEndMs, 1, &selection));
+  EXPECT_EQ(StatisticsTimeSeries::kMinute, selection.resolution);
+  ASSERT_EQ(kSamples / 2, selection.rows.size());
+  EXPECT_EQ(kStartMs + kIntervalMs,
+            series_.Timestamp(selection.resolution, selection.rows[0]));
+  EXPECT_EQ(1, series_.Value(selection.resolution, selection.rows[0], 0));
+  EXPECT_EQ(kSamples - 1,
+            series_.Value(selection.resolution, selection.rows.back(), 0));
+
+  // Asking for coarser points just skips rows.
+  ASSERT_TRUE(series_.Select(kStartMs, kEndMs, Timer::kHourMs, &selection));
+  EXPECT_EQ(24, selection.rows.size());
+}
+
+TEST_F(StatisticsTimeSeriesTest, ChildSeesParentSamples) {
+  Append(kStartMs, 42);
+
+  StatisticsTimeSeries child(&shm_, kSegmentName, kNumColumns, &handler_);
+  ASSERT_TRUE(child.Attach());
+  Selection selection;
+  ASSERT_TRUE(child.Select(0, kStartMs, 1, &selection));
+  ASSERT_EQ(1, selection.rows.size());
+  EXPECT_EQ(84, child.Value(selection.resolution, selection.rows[0], 1));
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -20,10 +20,13 @@
 
 #include <algorithm>
 #include <utility>
+#include <vector>
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/callback.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
 #include "pagespeed/kernel/base/proto_util.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/shared_string.h"
@@ -35,8 +38,18 @@
 
 namespace net_instaweb {
 
+namespace {
+
+// The full length of an MD5 hash; interned values must not collide.
+const int kInternedValueHashChars = 22;
+
+}  // namespace
+
 // Property cache key prefixes.
 const char CachePropertyStore::kPagePropertyCacheKeyPrefix[] = "prop_page/";
+const char CachePropertyStore::kInternedValueKeyPrefix[] = "interned/";
+
+const int64 CachePropertyStore::kDefaultInternedValueMemoryBytes = 1 << 20;
 
 CachePropertyStore::CachePropertyStore(const GoogleString& cache_key_prefix,
                                        CacheInterface* cache,
@@ -47,7 +60,12 @@ CachePropertyStore::CachePropertyStore(const GoogleString& cache_key_prefix,
       default_cache_(cache),
       timer_(timer),
       stats_(stats),
-      thread_system_(thread_system) {
+      thread_system_(thread_system),
+      min_interned_value_bytes_(0),
+      hasher_(kInternedValueHashChars),
+      interned_values_mutex_(thread_system->NewMutex()),
+      interned_values_(kDefaultInternedValueMemoryBytes,
+                       &interned_value_helper_) {
 }
 
 CachePropertyStore::~CachePropertyStore() {
@@ -135,58 +153,151 @@ class CachePropertyStoreCacheCallback : public CacheInterface::Callback {
  public:
   CachePropertyStoreCacheCallback(
       const PropertyCache::Cohort* cohort,
+      CachePropertyStore* property_store,
+      CacheInterface* cache,
       CachePropertyStoreGetCallback* property_store_callback,
       CachePropertyStoreCallbackCollector* callback_collector)
       : cohort_(cohort),
+        property_store_(property_store),
+        cache_(cache),
         property_store_callback_(property_store_callback),
         callback_collector_(callback_collector) {
   }
   virtual ~CachePropertyStoreCacheCallback() {}
 
   virtual void Done(CacheInterface::KeyState state) {
-    bool valid = false;
     if (state == CacheInterface::kAvailable) {
       StringPiece value_string = value()->Value();
       ArrayInputStream input(value_string.data(), value_string.size());
-      PropertyCacheValues values;
-      if (values.ParseFromZeroCopyStream(&input)) {
-        int64 min_write_timestamp_ms = kint64max;
-        // The values in a cohort could have different write_timestamp_ms
-        // values, since it is populated in UpdateValue.  But since all values
-        // in a cohort are written (and read) together we need to treat either
-        // all as valid or none as valid.  Hence we look at the oldest write
-        // timestamp to make this decision.
-        for (int i = 0; i < values.value_size(); ++i) {
-          min_write_timestamp_ms = std::min(
-              min_write_timestamp_ms, values.value(i).write_timestamp_ms());
-        }
-        // Return valid for empty cohort, and if IsCacheValid returns true for
-        // Value with oldest timestamp.
-        if (values.value_size() == 0) {
-          valid = true;
-        } else {
-          for (int i = 0; i < values.value_size(); ++i) {
-            const PropertyValueProtobuf& pcache_value = values.value(i);
-            valid = property_store_callback_->
-                AddPropertyValueProtobufToPropertyPage(
-                    cohort_, pcache_value, min_write_timestamp_ms);
-          }
-        }
+      if (values_.ParseFromZeroCopyStream(&input)) {
+        // Interned values must be fetched before the page can use them.
+        property_store_->ResolveInternedValues(
+            cache_, &values_,
+            NewCallback(this,
+                        &CachePropertyStoreCacheCallback::ValuesResolved));
+        return;
       }
     }
+    Finish(state, false);
+  }
+
+ private:
+  void ValuesResolved(bool resolved) {
+    if (!resolved) {
+      // Some interned value has been evicted, so this cohort entry is
+      // useless; treat it as a miss so it gets rewritten.
+      Finish(CacheInterface::kNotFound, false);
+      return;
+    }
+    bool valid = false;
+    int64 min_write_timestamp_ms = kint64max;
+    // The values in a cohort could have different write_timestamp_ms
+    // values, since it is populated in UpdateValue.  But since all values
+    // in a cohort are written (and read) together we need to treat either
+    // all as valid or none as valid.  Hence we look at the oldest write
+    // timestamp to make this decision.
+    for (int i = 0; i < values_.value_size(); ++i) {
+      min_write_timestamp_ms = std::min(
+          min_write_timestamp_ms, values_.value(i).write_timestamp_ms());
+    }
+    // Return valid for empty cohort, and if IsCacheValid returns true for
+    // Value with oldest timestamp.
+    if (values_.value_size() == 0) {
+      valid = true;
+    } else {
+      for (int i = 0; i < values_.value_size(); ++i) {
+        const PropertyValueProtobuf& pcache_value = values_.value(i);
+        valid = property_store_callback_->
+            AddPropertyValueProtobufToPropertyPage(
+                cohort_, pcache_value, min_write_timestamp_ms);
+      }
+    }
+    Finish(CacheInterface::kAvailable, valid);
+  }
+
+  void Finish(CacheInterface::KeyState state, bool valid) {
     property_store_callback_->SetStateInPropertyPage(cohort_, state, valid);
     callback_collector_->Done(valid);
     delete this;
   }
 
- private:
   const PropertyCache::Cohort* cohort_;
+  CachePropertyStore* property_store_;
+  CacheInterface* cache_;
   CachePropertyStoreGetCallback* property_store_callback_;
   CachePropertyStoreCallbackCollector* callback_collector_;
+  PropertyCacheValues values_;
 
   DISALLOW_COPY_AND_ASSIGN(CachePropertyStoreCacheCallback);
 };
 
+// Tracks the cache lookups of the interned values of one cohort entry.
+// When they are all complete, done is called with whether all were found.
+class InternedValueCollector {
+ public:
+  InternedValueCollector(int num_pending,
+                         AbstractMutex* mutex,
+                         PropertyStore::BoolCallback* done)
+      : pending_(num_pending),
+        success_(true),
+        mutex_(mutex),
+        done_(done) {
+  }
+
+  void Done(bool success) {
+    {
+      ScopedMutex lock(mutex_.get());
+      success_ &= success;
+      --pending_;
+      if (pending_ > 0) {
+        return;
+      }
+    }
+    done_->Run(success_);
+    delete this;
+  }
+
+ private:
+  int pending_;
+  bool success_;
+  scoped_ptr<AbstractMutex> mutex_;
+  PropertyStore::BoolCallback* done_;
+
+  DISALLOW_COPY_AND_ASSIGN(InternedValueCollector);
+};
+
+// Receives one interned value from the cache and fills in its body.
+class InternedValueCacheCallback : public CacheInterface::Callback {
+ public:
+  InternedValueCacheCallback(CachePropertyStore* property_store,
+                             PropertyValueProtobuf* pcache_value,
+                             InternedValueCollector* collector)
+      : property_store_(property_store),
+        pcache_value_(pcache_value),
+        collector_(collector) {
+  }
+  virtual ~InternedValueCacheCallback() {}
+
+  virtual void Done(CacheInterface::KeyState state) {
+    bool found = (state == CacheInterface::kAvailable);
+    if (found) {
+      property_store_->RememberInternedValue(pcache_value_->body_hash(),
+                                             *value());
+      value()->Value().CopyToString(pcache_value_->mutable_body());
+      pcache_value_->clear_body_hash();
+    }
+    collector_->Done(found);
+    delete this;
+  }
+
+ private:
+  CachePropertyStore* property_store_;
+  PropertyValueProtobuf* pcache_value_;
+  InternedValueCollector* collector_;
+
+  DISALLOW_COPY_AND_ASSIGN(InternedValueCacheCallback);
+};
+
 }  // namespace
 
 GoogleString CachePropertyStore::CacheKey(
@@ -238,7 +349,8 @@ void CachePropertyStore::Get(
     cohort_itr->second->Get(
         cache_key,
         new CachePropertyStoreCacheCallback(
-            cohort, property_store_get_callback, collector));
+            cohort, this, cohort_itr->second, property_store_get_callback,
+            collector));
   }
 }
 
@@ -248,11 +360,18 @@ void CachePropertyStore::Put(const GoogleString& url,
                              const PropertyCache::Cohort* cohort,
                              const PropertyCacheValues* values,
                              BoolCallback* done) {
+  CohortCacheMap::iterator cohort_itr = cohort_cache_map_.find(cohort->name());
+  CHECK(cohort_itr != cohort_cache_map_.end());
+  scoped_ptr<PropertyCacheValues> interned_values;
+  if (min_interned_value_bytes_ > 0) {
+    interned_values.reset(InternValues(*values, cohort_itr->second));
+    if (interned_values.get() != NULL) {
+      values = interned_values.get();
+    }
+  }
   GoogleString value;
   StringOutputStream sstream(&value);
   values->SerializeToZeroCopyStream(&sstream);
-  CohortCacheMap::iterator cohort_itr = cohort_cache_map_.find(cohort->name());
-  CHECK(cohort_itr != cohort_cache_map_.end());
   const GoogleString cache_key = CacheKey(
       url, options_signature_hash, cache_key_suffix, cohort);
   cohort_itr->second->PutSwappingString(cache_key, &value);
@@ -261,6 +380,87 @@ void CachePropertyStore::Put(const GoogleString& url,
   }
 }
 
+GoogleString CachePropertyStore::InternedValueKey(
+    const StringPiece& body_hash) const {
+  return StrCat(cache_key_prefix_, kInternedValueKeyPrefix, body_hash);
+}
+
+PropertyCacheValues* CachePropertyStore::InternValues(
+    const PropertyCacheValues& values, CacheInterface* cache) {
+  PropertyCacheValues* interned_values = NULL;
+  for (int i = 0; i < values.value_size(); ++i) {
+    const PropertyValueProtobuf& pcache_value = values.value(i);
+    if (static_cast<int64>(pcache_value.body().size()) <
+        min_interned_value_bytes_) {
+      continue;
+    }
+    if (interned_values == NULL) {
+      interned_values = new PropertyCacheValues(values);
+    }
+    GoogleString body_hash = hasher_.Hash(pcache_value.body());
+    // Write the body every time, even if we have seen it recently: the cache
+    // may have evicted it since, and other processes reading it have no way
+    // of telling us so.  Interning saves cache space, not write bandwidth.
+    SharedString body;
+    if (!LookupInternedValue(body_hash, &body)) {
+      body.Assign(pcache_value.body());
+      RememberInternedValue(body_hash, body);
+    }
+    cache->Put(InternedValueKey(body_hash), &body);
+    PropertyValueProtobuf* interned_value = interned_values->mutable_value(i);
+    interned_value->clear_body();
+    interned_value->set_body_hash(body_hash);
+  }
+  return interned_values;
+}
+
+void CachePropertyStore::ResolveInternedValues(CacheInterface* cache,
+                                               PropertyCacheValues* values,
+                                               BoolCallback* done) {
+  std::vector<PropertyValueProtobuf*> to_fetch;
+  for (int i = 0; i < values->value_size(); ++i) {
+    PropertyValueProtobuf* pcache_value = values->mutable_value(i);
+    if (!pcache_value->has_body_hash()) {
+      continue;
+    }
+    SharedString body;
+    if (LookupInternedValue(pcache_value->body_hash(), &body)) {
+      body.Value().CopyToString(pcache_value->mutable_body());
+      pcache_value->clear_body_hash();
+    } else {
+      to_fetch.push_back(pcache_value);
+    }
+  }
+  if (to_fetch.empty()) {
+    done->Run(true);
+    return;
+  }
+  InternedValueCollector* collector = new InternedValueCollector(
+      to_fetch.size(), thread_system_->NewMutex(), done);
+  for (int i = 0, n = to_fetch.size(); i < n; ++i) {
+    cache->Get(InternedValueKey(to_fetch[i]->body_hash()),
+               new InternedValueCacheCallback(this, to_fetch[i], collector));
+  }
+}
+
+bool CachePropertyStore::LookupInternedValue(const GoogleString& body_hash,
+                                             SharedString* body) {
+  ScopedMutex lock(interned_values_mutex_.get());
+  SharedString* found = interned_values_.GetFreshen(body_hash);
+  if (found == NULL) {
+    return false;
+  }
+  *body = *found;
+  return true;
+}
+
+void CachePropertyStore::RememberInternedValue(const GoogleString& body_hash,
+                                               const SharedString& body) {
+  SharedString shared_body(body);
+  ScopedMutex lock(interned_values_mutex_.get());
+  interned_values_.Put(body_hash, &shared_body);
+}
+
 void CachePropertyStore::AddCohort(const GoogleString& cohort) {
   AddCohortWithCache(cohort, default_cache_);
 }
@@ -25,18 +25,24 @@
 #ifndef PAGESPEED_OPT_HTTP_CACHE_PROPERTY_STORE_H_
 #define PAGESPEED_OPT_HTTP_CACHE_PROPERTY_STORE_H_
 
+#include <cstddef>
 #include <map>
 
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/cache/lru_cache_base.h"
 #include "pagespeed/opt/http/abstract_property_store_get_callback.h"
 #include "pagespeed/opt/http/property_cache.h"
 #include "pagespeed/opt/http/property_store.h"
 
 namespace net_instaweb {
 
+class AbstractMutex;
 class PropertyCacheValues;
 class Statistics;
 class ThreadSystem;
@@ -46,6 +52,11 @@ class CachePropertyStore : public PropertyStore {
  public:
   // Property cache key prefixes.
   static const char kPagePropertyCacheKeyPrefix[];
+  // Appended to the store's key prefix for entries holding interned values.
+  static const char kInternedValueKeyPrefix[];
+
+  // Number of bytes of recently used interned values kept in memory.
+  static const int64 kDefaultInternedValueMemoryBytes;
 
   // Does not take the ownership of cache, timer and stats object.
   // L2-only caches should be used for CachePropertyStore.  We cannot use the L1
@@ -97,12 +108,66 @@ class CachePropertyStore : public PropertyStore {
 
   virtual GoogleString Name() const;
 
+  // Property values whose body is at least this many bytes are interned: the
+  // body is written once to a cache entry keyed by its content hash, and the
+  // cohort entry for each page just refers to it by hash.  This greatly
+  // reduces the cache space used by values that are identical across many
+  // pages, such as those of template-generated sites.  The body is written
+  // again on every Put, so an evicted body comes back with the next write
+  // from any process.  0 (the default) disables interning, and nothing is
+  // written in the new format unless it is turned on.  Entries written
+  // either way can always be read by this version, but versions from before
+  // interning read interned values as empty, so the cache must be flushed
+  // before rolling back to one of them.
+  void set_min_interned_value_bytes(int64 x) { min_interned_value_bytes_ = x; }
+  int64 min_interned_value_bytes() const { return min_interned_value_bytes_; }
+
+  // Gets the key of the cache entry holding the interned body with the given
+  // content hash.
+  GoogleString InternedValueKey(const StringPiece& body_hash) const;
+
+  // Fills in the body of every value in *values that was interned, looking in
+  // the in-memory table of recently used interned values first, and then in
+  // cache.  Calls done->Run(true) once all of them are filled in, or
+  // done->Run(false) if any of them could not be found.  *values must stay
+  // alive until done is called.
+  void ResolveInternedValues(CacheInterface* cache,
+                             PropertyCacheValues* values,
+                             BoolCallback* done);
+
+  // Records body in the in-memory table of recently used interned values.
+  void RememberInternedValue(const GoogleString& body_hash,
+                             const SharedString& body);
+
   static GoogleString FormatName2(StringPiece cohort_name1,
                                   StringPiece cohort_cache1,
                                   StringPiece cohort_name2,
                                   StringPiece cohort_cache2);
 
  private:
+  struct InternedValueHelper {
+    size_t size(const SharedString& body) const { return body.size(); }
+    bool Equal(const SharedString& a, const SharedString& b) const {
+      return a.Value() == b.Value();
+    }
+    void EvictNotify(const SharedString& body) {}
+    bool ShouldReplace(const SharedString& old_body,
+                       const SharedString& new_body) const {
+      return true;
+    }
+  };
+  typedef LRUCacheBase<SharedString, InternedValueHelper> InternedValueTable;
+
+  // Returns a copy of values with the body of every value at least
+  // min_interned_value_bytes_ long replaced by its hash, writing those bodies
+  // to cache as needed, or NULL if none of the values is that long.
+  PropertyCacheValues* InternValues(const PropertyCacheValues& values,
+                                    CacheInterface* cache);
+
+  // Looks up body_hash in the in-memory table of recently used interned
+  // values, returning whether it was found.
+  bool LookupInternedValue(const GoogleString& body_hash, SharedString* body);
+
   GoogleString cache_key_prefix_;
   typedef std::map<GoogleString, CacheInterface*> CohortCacheMap;
   CohortCacheMap cohort_cache_map_;
@@ -110,6 +175,13 @@ class CachePropertyStore : public PropertyStore {
   Timer* timer_;
   Statistics* stats_;
   ThreadSystem* thread_system_;
+
+  int64 min_interned_value_bytes_;
+  MD5Hasher hasher_;
+  scoped_ptr<AbstractMutex> interned_values_mutex_;
+  InternedValueHelper interned_value_helper_;
+  InternedValueTable interned_values_;  // Guarded by interned_values_mutex_.
+
   DISALLOW_COPY_AND_ASSIGN(CachePropertyStore);
 };
 
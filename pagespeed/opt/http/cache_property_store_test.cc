@@ -28,6 +28,8 @@
 #include "pagespeed/kernel/base/mock_timer.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/cache/lru_cache.h"
 #include "pagespeed/kernel/util/platform.h"
@@ -40,15 +42,19 @@ namespace net_instaweb {
 
 namespace {
 
-const size_t kMaxCacheSize = 200;
+const size_t kMaxCacheSize = 1000;
 const char kCohortName1[] = "cohort1";
 const char kCohortName2[] = "cohort2";
 const char kUrl[] = "www.test.com/sample.html";
+const char kUrl2[] = "www.test.com/other.html";
 const char kParsableContent[] =
     "value { name: 'prop1' value: 'value1' }";
 const char kNonParsableContent[] = "random";
 const char kOptionsSignatureHash[] = "hash";
 const char kCacheKeySuffix[] = "CacheKeySuffix";
+const char kPropertyName[] = "prop1";
+const char kLargeValue[] = "a value that is shared by many pages";
+const char kSmallValue[] = "small";
 
 }  // namespace
 
@@ -96,8 +102,12 @@ class CachePropertyStoreTest : public testing::Test {
   }
 
   bool ExecuteGet(PropertyPage* page) {
+    return ExecuteGetFromStore(&cache_property_store_, page);
+  }
+
+  bool ExecuteGetFromStore(CachePropertyStore* store, PropertyPage* page) {
     AbstractPropertyStoreGetCallback* callback = NULL;
-    cache_property_store_.Get(
+    store->Get(
         kUrl,
         kOptionsSignatureHash,
         kCacheKeySuffix,
@@ -109,6 +119,26 @@ class CachePropertyStoreTest : public testing::Test {
     return cache_lookup_status_;
   }
 
+  void PutValue(const char* url, StringPiece body) {
+    PropertyCacheValues values;
+    PropertyValueProtobuf* value = values.add_value();
+    value->set_name(kPropertyName);
+    value->set_body(body.data(), body.size());
+    value->set_write_timestamp_ms(timer_.NowMs());
+    cache_property_store_.Put(
+        url,
+        kOptionsSignatureHash,
+        kCacheKeySuffix,
+        cohort_,
+        &values,
+        NULL);
+  }
+
+  GoogleString ReadValue(PropertyPage* page) {
+    PropertyValue* value = page->GetProperty(cohort_, kPropertyName);
+    return value->has_value() ? value->value().as_string() : "";
+  }
+
  protected:
   LRUCache lru_cache_;
   scoped_ptr<ThreadSystem> thread_system_;
@@ -299,4 +329,82 @@ TEST_F(CachePropertyStoreTest, TestPutHandlesNonNullCallback) {
   EXPECT_EQ(1, num_callback_with_true_called_);
 }
 
+TEST_F(CachePropertyStoreTest, InternedValueSharedAcrossPages) {
+  cache_property_store_.set_min_interned_value_bytes(
+      STATIC_STRLEN(kLargeValue));
+  lru_cache_.ClearStats();
+  PutValue(kUrl, kLargeValue);
+  PutValue(kUrl2, kLargeValue);
+  // The value is written along with the entry for each of the two pages;
+  // the second time, the cache already has it.
+  EXPECT_EQ(3, lru_cache_.num_inserts());
+  EXPECT_EQ(1, lru_cache_.num_identical_reinserts());
+
+  EXPECT_TRUE(ExecuteGet(page_.get()));
+  EXPECT_EQ(CacheInterface::kAvailable, page_->GetCacheState(cohort_));
+  EXPECT_EQ(kLargeValue, ReadValue(page_.get()));
+  // The interned value was found in memory.
+  EXPECT_EQ(1, lru_cache_.num_hits());
+}
+
+TEST_F(CachePropertyStoreTest, SmallValuesNotInterned) {
+  cache_property_store_.set_min_interned_value_bytes(
+      STATIC_STRLEN(kLargeValue));
+  lru_cache_.ClearStats();
+  PutValue(kUrl, kSmallValue);
+  EXPECT_EQ(1, lru_cache_.num_inserts());
+  EXPECT_TRUE(ExecuteGet(page_.get()));
+  EXPECT_EQ(kSmallValue, ReadValue(page_.get()));
+}
+
+TEST_F(CachePropertyStoreTest, InternedValueReadByAnotherStore) {
+  // A second store sharing the same cache stands in for another process,
+  // which has not seen the interned value and so must fetch it.
+  cache_property_store_.set_min_interned_value_bytes(1);
+  PutValue(kUrl, kLargeValue);
+  CachePropertyStore other_store(
+      "test/", &lru_cache_, &timer_, &stats_, thread_system_.get());
+  other_store.AddCohort(kCohortName1);
+  lru_cache_.ClearStats();
+  EXPECT_TRUE(ExecuteGetFromStore(&other_store, page_.get()));
+  EXPECT_EQ(CacheInterface::kAvailable, page_->GetCacheState(cohort_));
+  EXPECT_EQ(kLargeValue, ReadValue(page_.get()));
+  EXPECT_EQ(2, lru_cache_.num_hits());
+}
+
+TEST_F(CachePropertyStoreTest, EvictedInternedValueIsMiss) {
+  cache_property_store_.set_min_interned_value_bytes(1);
+  PutValue(kUrl, kLargeValue);
+  lru_cache_.DeleteWithPrefixForTesting(
+      cache_property_store_.InternedValueKey(""));
+  CachePropertyStore other_store(
+      "test/", &lru_cache_, &timer_, &stats_, thread_system_.get());
+  other_store.AddCohort(kCohortName1);
+  EXPECT_FALSE(ExecuteGetFromStore(&other_store, page_.get()));
+  EXPECT_EQ(CacheInterface::kNotFound, page_->GetCacheState(cohort_));
+}
+
+TEST_F(CachePropertyStoreTest, EvictedInternedValueWrittenAgain) {
+  // The store still remembers the value, but the next write puts it back in
+  // the cache for the benefit of every other store.
+  cache_property_store_.set_min_interned_value_bytes(1);
+  PutValue(kUrl, kLargeValue);
+  lru_cache_.DeleteWithPrefixForTesting(
+      cache_property_store_.InternedValueKey(""));
+  PutValue(kUrl2, kLargeValue);
+  CachePropertyStore other_store(
+      "test/", &lru_cache_, &timer_, &stats_, thread_system_.get());
+  other_store.AddCohort(kCohortName1);
+  EXPECT_TRUE(ExecuteGetFromStore(&other_store, page_.get()));
+  EXPECT_EQ(CacheInterface::kAvailable, page_->GetCacheState(cohort_));
+  EXPECT_EQ(kLargeValue, ReadValue(page_.get()));
+}
+
+TEST_F(CachePropertyStoreTest, ReadsValuesWrittenWithoutInterning) {
+  PutValue(kUrl, kLargeValue);
+  cache_property_store_.set_min_interned_value_bytes(1);
+  EXPECT_TRUE(ExecuteGet(page_.get()));
+  EXPECT_EQ(kLargeValue, ReadValue(page_.get()));
+}
+
 }  // namespace net_instaweb
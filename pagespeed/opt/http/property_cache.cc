@@ -217,6 +217,10 @@ void PropertyPage::Read(const PropertyCache::CohortVector& cohort_list) {
   DCHECK(!cohort_list.empty());
   DCHECK(property_store_callback_ == NULL);
   SetupCohorts(cohort_list);
+  if (request_context_.get() != NULL) {
+    request_context_->StartTraceSpan("pcache", "PropertyPage::Read",
+                                     &read_span_);
+  }
   property_cache_->property_store()->Get(
       url_,
       options_signature_hash_,
@@ -100,6 +100,7 @@
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/trace_span_ring.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/opt/http/request_context.h"
 
@@ -448,6 +449,7 @@ class PropertyPage : public AbstractPropertyPage {
 
   void CallDone(bool success) {
     was_read_ = true;
+    read_span_.End();
     Done(success);
   }
 
@@ -480,6 +482,7 @@ class PropertyPage : public AbstractPropertyPage {
   // PropertyPage.
   AbstractPropertyStoreGetCallback* property_store_callback_;
   PageType page_type_;
+  ScopedTraceSpan read_span_;
 
   DISALLOW_COPY_AND_ASSIGN(PropertyPage);
 };
@@ -22,6 +22,7 @@
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/request_trace.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/trace_span_ring.h"
 #include "pagespeed/kernel/http/http_options.h"
 #include "pagespeed/opt/logging/log_record.h"
 
@@ -37,6 +38,8 @@ RequestContext::RequestContext(const HttpOptions& options,
       accepts_webp_(false),
       split_request_type_(SPLIT_FULL),
       request_id_(0),
+      trace_spans_(NULL),
+      trace_id_(0),
       options_set_(true),
       options_(options) {
 }
@@ -49,6 +52,8 @@ RequestContext::RequestContext(AbstractMutex* logging_mutex, Timer* timer)
       accepts_webp_(false),
       split_request_type_(SPLIT_FULL),
       request_id_(0),
+      trace_spans_(NULL),
+      trace_id_(0),
       options_set_(false),
       // Note: We use default here, just in case, even though we expect
       // set_options to be called
@@ -65,6 +70,9 @@ RequestContext::RequestContext(const HttpOptions& options,
       using_spdy_(false),
       accepts_webp_(false),
       split_request_type_(SPLIT_FULL),
+      request_id_(0),
+      trace_spans_(NULL),
+      trace_id_(0),
       options_set_(true),
       options_(options) {
 }
@@ -100,6 +108,16 @@ void RequestContext::set_root_trace_context(RequestTrace* x) {
   root_trace_context_.reset(x);
 }
 
+void RequestContext::set_trace_spans(TraceSpanRing* ring) {
+  trace_spans_ = ring;
+  trace_id_ = (ring == NULL) ? 0 : ring->NewTraceId();
+}
+
+void RequestContext::StartTraceSpan(const char* category, const char* name,
+                                    ScopedTraceSpan* span) const {
+  span->Start(trace_spans_, trace_id_, category, name);
+}
+
 AbstractLogRecord* RequestContext::log_record() {
   DCHECK(log_record_.get() != NULL);
   return log_record_.get();
@@ -36,8 +36,10 @@ class AbstractLogRecord;
 class AbstractMutex;
 class RequestContext;
 class RequestTrace;
+class ScopedTraceSpan;
 class ThreadSystem;
 class Timer;
+class TraceSpanRing;
 
 typedef RefCountedPtr<RequestContext> RequestContextPtr;
 
@@ -164,6 +166,18 @@ class RequestContext : public RefCounted<RequestContext> {
     request_id_ = x;
   }
 
+  // Structured span tracing.  Once set_trace_spans has been given a ring,
+  // StartTraceSpan times spans of this request into it, all under a trace id
+  // of their own; otherwise StartTraceSpan leaves the span inactive, which
+  // costs next to nothing.  Call set_trace_spans before the context is shared
+  // with other threads.  Does not take ownership of the ring.
+  void set_trace_spans(TraceSpanRing* ring);
+  TraceSpanRing* trace_spans() const { return trace_spans_; }
+  int64 trace_id() const { return trace_id_; }
+  // category and name must be string literals.
+  void StartTraceSpan(const char* category, const char* name,
+                      ScopedTraceSpan* span) const;
+
   const GoogleString& sticky_query_parameters_token() const {
     return sticky_query_parameters_token_;
   }
@@ -256,6 +270,9 @@ class RequestContext : public RefCounted<RequestContext> {
   SplitRequestType split_request_type_;
   int64 request_id_;
 
+  TraceSpanRing* trace_spans_;
+  int64 trace_id_;
+
   // The token specified by query parameter or header that must match the
   // configured value for options to be converted to cookies.
   GoogleString sticky_query_parameters_token_;
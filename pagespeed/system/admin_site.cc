@@ -17,6 +17,7 @@
 
 #include "pagespeed/system/admin_site.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <memory>
 #include <set>
@@ -34,12 +35,16 @@
 #include "net/instaweb/util/public/property_store.h"
 #include "pagespeed/kernel/base/cache_interface.h"
 #include "pagespeed/kernel/base/callback.h"
+#include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/sampling_profiler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/base/trace_span_ring.h"
 #include "pagespeed/kernel/cache/purge_context.h"
 #include "pagespeed/kernel/html/html_keywords.h"
 #include "pagespeed/kernel/http/content_type.h"
@@ -48,6 +53,7 @@
 #include "pagespeed/kernel/http/query_params.h"
 #include "pagespeed/kernel/http/request_headers.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/thread/scheduler.h"
 #include "pagespeed/kernel/util/statistics_logger.h"
 
 namespace net_instaweb {
@@ -71,6 +77,13 @@ extern const char* JS_statistics_js_opt;
 
 namespace {
 
+// Sampling profiles taken via /pagespeed_admin/profile run for 'seconds'
+// (default kProfileDefaultSeconds) at 100 samples per CPU-second.
+const int kProfileDefaultSeconds = 10;
+const int kProfileMaxSeconds = 60;
+const int64 kProfileIntervalUs = 10 * Timer::kMsUs;
+const int kProfileMaxSamples = 20000;
+
 struct Tab {
   const char* label;
   const char* title;
@@ -79,6 +92,43 @@ struct Tab {
   const char* space;            // html for inter-link spacing.
 };
 
+// Stops a profile started by ProfileHandler when its alarm fires, and sends
+// the report.
+class ProfileFinisher : public Function {
+ public:
+  // Takes ownership of profiler.
+  ProfileFinisher(SamplingProfiler* profiler, AsyncFetch* fetch,
+                  MessageHandler* handler)
+      : profiler_(profiler),
+        fetch_(fetch),
+        handler_(handler) {
+  }
+
+ protected:
+  virtual void Run() {
+    profiler_->Stop();
+    fetch_->response_headers()->SetStatusAndReason(HttpStatus::kOK);
+    fetch_->response_headers()->Add(HttpAttributes::kContentType,
+                                    "text/plain");
+    profiler_->WriteCollapsedStacks(fetch_, handler_);
+    fetch_->Done(true);
+  }
+
+  // The scheduler is shutting down.
+  virtual void Cancel() {
+    profiler_->Stop();
+    fetch_->response_headers()->SetStatusAndReason(HttpStatus::kUnavailable);
+    fetch_->Done(false);
+  }
+
+ private:
+  scoped_ptr<SamplingProfiler> profiler_;
+  AsyncFetch* fetch_;
+  MessageHandler* handler_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProfileFinisher);
+};
+
 const char kShortBreak[] = " ";
 const char kLongBreak[] = " &nbsp;&nbsp; ";
 
@@ -265,6 +315,49 @@ void AdminSite::StatisticsJsonHandler(AsyncFetch* fetch, Statistics* stats) {
   fetch->Done(true);
 }
 
+void AdminSite::TraceHandler(AsyncFetch* fetch, ServerContext* server_context) {
+  TraceSpanRing* trace_spans = server_context->trace_spans();
+  if (trace_spans == NULL) {
+    fetch->response_headers()->SetStatusAndReason(HttpStatus::kNotFound);
+    fetch->response_headers()->Add(HttpAttributes::kContentType, "text/plain");
+    fetch->Write("TraceSpanBufferSize must be set to record trace spans.",
+                 message_handler_);
+  } else {
+    fetch->response_headers()->SetStatusAndReason(HttpStatus::kOK);
+    fetch->response_headers()->Add(HttpAttributes::kContentType,
+                                   kContentTypeJson.mime_type());
+    trace_spans->WriteChromeTraceJson(fetch, message_handler_);
+  }
+  fetch->Done(true);
+}
+
+void AdminSite::ProfileHandler(const QueryParams& query_params,
+                               AsyncFetch* fetch, Scheduler* scheduler) {
+  int seconds = kProfileDefaultSeconds;
+  GoogleString value;
+  int requested_seconds;
+  if (query_params.Lookup1Unescaped("seconds", &value) &&
+      StringToInt(value, &requested_seconds)) {
+    seconds = std::max(1, std::min(requested_seconds, kProfileMaxSeconds));
+  }
+
+  scoped_ptr<SamplingProfiler> profiler(
+      new SamplingProfiler(kProfileMaxSamples));
+  if (!profiler->Start(kProfileIntervalUs, message_handler_)) {
+    fetch->response_headers()->SetStatusAndReason(HttpStatus::kConflict);
+    fetch->response_headers()->Add(HttpAttributes::kContentType, "text/plain");
+    fetch->Write("Unable to start profiling; see the message history.",
+                 message_handler_);
+    fetch->Done(true);
+    return;
+  }
+  // The timer samples every thread while the profile runs, so there's no
+  // need to tie up the request thread; the alarm completes the fetch.
+  scheduler->AddAlarmAtUs(
+      scheduler->timer()->NowUs() + seconds * Timer::kSecondUs,
+      new ProfileFinisher(profiler.release(), fetch, message_handler_));
+}
+
 void AdminSite::StatisticsHandler(const RewriteOptions& options,
                                   AdminSource source, AsyncFetch* fetch,
                                   Statistics* stats) {
@@ -775,6 +868,10 @@ void AdminSite::AdminPage(
                   page_property_cache, server_context);
     } else if (leaf == "histograms") {
       PrintHistograms(kPageSpeedAdmin, fetch, stats);
+    } else if (leaf == "trace") {
+      TraceHandler(fetch, server_context);
+    } else if (leaf == "profile") {
+      ProfileHandler(query_params, fetch, server_context->scheduler());
     } else {
       fetch->response_headers()->SetStatusAndReason(HttpStatus::kNotFound);
       fetch->response_headers()->Add(HttpAttributes::kContentType, "text/html");
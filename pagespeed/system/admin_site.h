@@ -31,6 +31,7 @@ class MessageHandler;
 class PropertyCache;
 class QueryParams;
 class RewriteOptions;
+class Scheduler;
 class ServerContext;
 class StaticAssetManager;
 class Statistics;
@@ -126,6 +127,18 @@ class AdminSite {
   // in JSON format.
   void StatisticsJsonHandler(AsyncFetch* fetch, Statistics* stats);
 
+  // Responds to 'fetch' with the trace spans recorded by this process, in
+  // the Chrome trace-event JSON format, so they can be loaded into
+  // chrome://tracing.  Responds 404 if TraceSpanBufferSize is 0.
+  void TraceHandler(AsyncFetch* fetch, ServerContext* server_context);
+
+  // Samples the stacks of every thread in this process for ?seconds=N
+  // (default 10, at most 60) and responds with them as collapsed stacks,
+  // aggregated by thread pool and running filter.  Returns right away; an
+  // alarm on scheduler stops the profile and completes the fetch.
+  void ProfileHandler(const QueryParams& query_params, AsyncFetch* fetch,
+                      Scheduler* scheduler);
+
   // Display various charts on graphs page.
   // TODO(xqyin): Integrate this into console page.
   void GraphsHandler(const RewriteOptions& options, AdminSource source,
@@ -19,6 +19,8 @@
 
 #include "pagespeed/system/admin_site.h"
 
+#include <ctime>
+
 #include "net/instaweb/http/public/async_fetch.h"
 #include "net/instaweb/rewriter/public/custom_rewrite_test_base.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
@@ -31,9 +33,15 @@
 #include "pagespeed/kernel/base/gtest.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/mock_message_handler.h"
+#include "pagespeed/kernel/base/sampling_profiler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/http/http_names.h"
+#include "pagespeed/kernel/http/query_params.h"
+#include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/thread/mock_scheduler.h"
 #include "pagespeed/kernel/util/platform.h"
 
 namespace net_instaweb {
@@ -54,6 +62,18 @@ class SystemServerContextNoProxyHtml : public SystemServerContext {
   DISALLOW_COPY_AND_ASSIGN(SystemServerContextNoProxyHtml);
 };
 
+// Spins until the process has used at least cpu_ms of CPU time, so the
+// profiler has something to sample.
+void BurnCpu(int64 cpu_ms) {
+  clock_t end = clock() + cpu_ms * CLOCKS_PER_SEC / Timer::kSecondMs;
+  volatile int64 sink = 0;
+  while (clock() < end) {
+    for (int i = 0; i < 10000; ++i) {
+      sink += i;
+    }
+  }
+}
+
 class AdminSiteTest : public CustomRewriteTestBase<SystemRewriteOptions> {
  protected:
   AdminSiteTest()
@@ -113,6 +133,41 @@ TEST_F(AdminSiteTest, ColorMessagesInHistoryPage) {
       buffer, ::testing::HasSubstr(StringPrintf(kColorTemplate, "brown")));
   EXPECT_THAT(buffer, ::testing::HasSubstr("style=\"margin:0;\""));
 }
+
+TEST_F(AdminSiteTest, ProfileHandler) {
+  QueryParams query_params;
+  query_params.ParseFromUntrustedString("seconds=1");
+  GoogleString buffer;
+  StringAsyncFetch fetch(rewrite_driver()->request_context(), &buffer);
+  admin_site_->ProfileHandler(query_params, &fetch, mock_scheduler());
+
+  // The profile runs in the background until its alarm fires.
+  EXPECT_FALSE(fetch.done());
+  {
+    SamplingProfiler::ScopedLabel label("admin_site_test");
+    BurnCpu(200);
+  }
+  AdvanceTimeMs(Timer::kSecondMs - 1);
+  EXPECT_FALSE(fetch.done());
+  AdvanceTimeMs(1);
+  ASSERT_TRUE(fetch.done());
+  EXPECT_TRUE(fetch.success());
+  EXPECT_EQ(HttpStatus::kOK, fetch.response_headers()->status_code());
+  EXPECT_THAT(buffer, ::testing::HasSubstr(";admin_site_test"));
+
+  // Only one profile can run at a time.
+  SamplingProfiler running_profile(1);
+  ASSERT_TRUE(running_profile.Start(Timer::kSecondUs, message_handler()));
+  GoogleString conflict_buffer;
+  StringAsyncFetch conflict_fetch(rewrite_driver()->request_context(),
+                                  &conflict_buffer);
+  admin_site_->ProfileHandler(query_params, &conflict_fetch, mock_scheduler());
+  running_profile.Stop();
+  EXPECT_TRUE(conflict_fetch.done());
+  EXPECT_EQ(HttpStatus::kConflict,
+            conflict_fetch.response_headers()->status_code());
+}
+
 // TODO(xqyin): Add unit tests for other methods in AdminSite.
 
 }  // namespace
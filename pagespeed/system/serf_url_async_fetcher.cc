@@ -41,6 +41,7 @@
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/pool.h"
 #include "pagespeed/kernel/base/pool_element.h"
+#include "pagespeed/kernel/base/sampling_profiler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -819,6 +820,7 @@ class SerfThreadedFetcher : public SerfUrlAsyncFetcher {
                                             void* context) {
     SerfThreadedFetcher* stc = static_cast<SerfThreadedFetcher*>(context);
     CHECK_EQ(thread_id, stc->thread_id_);
+    SamplingProfiler::SetCurrentThreadName("serf");
     stc->SerfThread();
     return NULL;
   }
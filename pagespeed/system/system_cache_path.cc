@@ -98,6 +98,9 @@ SystemCachePath::SystemCachePath(const StringPiece& path,
     shared_mem_lock_manager_.reset(new SharedMemLockManager(
         shm_runtime, LockManagerSegmentName(),
         factory->scheduler(), factory->hasher(), factory->message_handler()));
+    // Servers run on a real clock, so waiters can sleep in the kernel and be
+    // woken by Unlock rather than polling.
+    shared_mem_lock_manager_->set_use_wakeups(true);
     lock_manager_ = shared_mem_lock_manager_.get();
   } else {
     FallBackToFileBasedLocking();
@@ -50,6 +50,7 @@
 #include "pagespeed/kernel/cache/write_through_cache.h"
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/thread/slow_worker.h"
+#include "pagespeed/opt/http/cache_property_store.h"
 
 namespace net_instaweb {
 
@@ -197,10 +198,14 @@ SystemCaches::MemcachedInterfaces SystemCaches::GetMemcached(
 
     CacheBatcher* batcher = new CacheBatcher(
         memcached.async, factory_->thread_system()->NewMutex(),
-        factory_->statistics());
+        factory_->timer(), factory_->statistics());
     factory_->TakeOwnership(batcher);
     if (num_threads != 0) {
       batcher->set_max_parallel_lookups(num_threads);
+      // Adapting only makes sense when lookups run on the memcached
+      // threads.  Without them the batcher sits on a blocking cache, and
+      // lowering its parallelism would just serialize the request threads.
+      batcher->set_adaptive(config->memcached_adaptive_batching());
     }
     memcached.async = batcher;
 
@@ -509,6 +514,12 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
   DCHECK(property_store_cache->IsBlocking());
   server_context->MakePagePropertyCache(
       server_context->CreatePropertyStore(property_store_cache));
+  CachePropertyStore* cache_property_store =
+      server_context->cache_property_store();
+  if (cache_property_store != NULL) {
+    cache_property_store->set_min_interned_value_bytes(
+        config->property_cache_intern_min_bytes());
+  }
   server_context->set_metadata_cache(metadata_cache);
   SetupPcacheCohorts(server_context, enable_property_cache);
   SystemServerContext* system_server_context =
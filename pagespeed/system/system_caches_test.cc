@@ -412,7 +412,8 @@ class SystemCachesTest : public CustomRewriteTestBase<SystemRewriteOptions> {
   }
 
   void TestBasicMemCacheAndNoLru(int num_threads_specified,
-                                 int num_threads_expected) {
+                                 int num_threads_expected,
+                                 bool adaptive) {
     if (MemCachedServerSpec().empty()) {
       return;
     }
@@ -422,6 +423,7 @@ class SystemCachesTest : public CustomRewriteTestBase<SystemRewriteOptions> {
     options_->set_lru_cache_kb_per_process(0);
     options_->set_memcached_servers(MemCachedServerSpec());
     options_->set_memcached_threads(num_threads_specified);
+    options_->set_memcached_adaptive_batching(adaptive);
     options_->set_default_shared_memory_cache_kb(0);
     PrepareWithConfig(options_.get());
 
@@ -434,7 +436,10 @@ class SystemCachesTest : public CustomRewriteTestBase<SystemRewriteOptions> {
                                 AprMemCache::FormatName()),
                           1, 1000);
     } else {
-      mem_cache = Batcher(AsyncMemCacheWithStats(), num_threads_expected, 1000);
+      // Adaptive batching only applies when lookups go to memcached threads.
+      mem_cache = CacheBatcher::FormatName(AsyncMemCacheWithStats(),
+                                           num_threads_expected, 1000,
+                                           adaptive);
     }
 
     EXPECT_STREQ(
@@ -452,6 +457,12 @@ class SystemCachesTest : public CustomRewriteTestBase<SystemRewriteOptions> {
     EXPECT_STREQ(
         Fallback(BlockingMemCacheWithStats(), FileCacheWithStats()),
         server_context->filesystem_metadata_cache()->Name());
+
+    // The property cache stays blocking however many threads memcached has.
+    EXPECT_STREQ(
+        Pcache(Compressed(Fallback(BlockingMemCacheWithStats(),
+                                   FileCacheWithStats()))),
+        server_context->page_property_cache()->property_store()->Name());
   }
 
   // Wrapper functions to format expected cache descriptor strings with
@@ -470,7 +481,7 @@ class SystemCachesTest : public CustomRewriteTestBase<SystemRewriteOptions> {
   }
 
   GoogleString Batcher(StringPiece cache, int parallel, int max) {
-    return CacheBatcher::FormatName(cache, parallel, max);
+    return CacheBatcher::FormatName(cache, parallel, max, false);
   }
 
   GoogleString Stats(StringPiece prefix, StringPiece cache) {
@@ -729,15 +740,23 @@ TEST_F(SystemCachesTest, BasicMemCachedAndLru) {
 }
 
 TEST_F(SystemCachesTest, BasicMemCachedAndNoLru_0_Threads) {
-  TestBasicMemCacheAndNoLru(0, 0);
+  TestBasicMemCacheAndNoLru(0, 0, false);
 }
 
 TEST_F(SystemCachesTest, BasicMemCachedAndNoLru_1_Thread) {
-  TestBasicMemCacheAndNoLru(1, 1);
+  TestBasicMemCacheAndNoLru(1, 1, false);
 }
 
 TEST_F(SystemCachesTest, BasicMemCachedAndNoLru_2_Threads) {
-  TestBasicMemCacheAndNoLru(2, 1);  // Clamp to 1.
+  TestBasicMemCacheAndNoLru(2, 1, false);  // Clamp to 1.
+}
+
+TEST_F(SystemCachesTest, BasicMemCachedAdaptive_0_Threads) {
+  TestBasicMemCacheAndNoLru(0, 0, true);
+}
+
+TEST_F(SystemCachesTest, BasicMemCachedAdaptive_1_Thread) {
+  TestBasicMemCacheAndNoLru(1, 1, true);
 }
 
 TEST_F(SystemCachesTest, BasicMemCachedLruShm) {
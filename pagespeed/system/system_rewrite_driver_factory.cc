@@ -56,6 +56,7 @@
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/sharedmem/shared_circular_buffer.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_statistics.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_user_agent_cache.h"
 #include "pagespeed/kernel/thread/pthread_shared_mem.h"
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/util/input_file_nonce_generator.h"
@@ -77,10 +78,13 @@ const char kNumExpensiveRewriteThreads[] = "NumExpensiveRewriteThreads";
 const char kForceCaching[] = "ForceCaching";
 const char kListOutstandingUrlsOnError[] = "ListOutstandingUrlsOnError";
 const char kMessageBufferSize[] = "MessageBufferSize";
+const char kUserAgentCacheEntries[] = "UserAgentCacheEntries";
 const char kTrackOriginalContentLength[] = "TrackOriginalContentLength";
 const char kCreateSharedMemoryMetadataCache[] =
     "CreateSharedMemoryMetadataCache";
 
+const char kUserAgentCacheSegment[] = "UserAgentCache";
+
 }  // namespace
 
 SystemRewriteDriverFactory::SystemRewriteDriverFactory(
@@ -93,6 +97,7 @@ SystemRewriteDriverFactory::SystemRewriteDriverFactory(
       is_root_process_(true),
       hostname_identifier_(StrCat(hostname, ":", IntegerToString(port))),
       message_buffer_size_(0),
+      user_agent_cache_entries_(0),
       track_original_content_length_(false),
       list_outstanding_urls_on_error_(false),
       static_asset_prefix_("/pagespeed_static/"),
@@ -127,6 +132,9 @@ void SystemRewriteDriverFactory::Init() {
 }
 
 SystemRewriteDriverFactory::~SystemRewriteDriverFactory() {
+  if (user_agent_cache_.get() != NULL) {
+    user_agent_matcher()->set_capability_cache(NULL);
+  }
   shared_mem_statistics_.reset(NULL);
 }
 
@@ -178,6 +186,9 @@ SharedMemStatistics* SystemRewriteDriverFactory::
   bool init_ok = stats->Init(true, message_handler());
   if (local && init_ok) {
     local_shm_stats_segment_names_.push_back(stats->SegmentName());
+    if (stats->has_history_segment()) {
+      local_shm_stats_segment_names_.push_back(stats->HistorySegmentName());
+    }
   }
   return stats;
 }
@@ -194,6 +205,7 @@ void SystemRewriteDriverFactory::InitStats(Statistics* statistics) {
   PropertyCache::InitCohortStats(RewriteDriver::kDomCohort, statistics);
   InPlaceResourceRecorder::InitStats(statistics);
   RateController::InitStats(statistics);
+  SharedMemUserAgentCache::InitStats(statistics);
 
   statistics->AddVariable(kShutdownCount);
 }
@@ -237,6 +249,7 @@ QueuedWorkerPool* SystemRewriteDriverFactory::CreateWorkerPool(
 
 void SystemRewriteDriverFactory::ParentOrChildInit() {
   SharedCircularBufferInit(is_root_process_);
+  UserAgentCacheInit(is_root_process_);
 }
 
 void SystemRewriteDriverFactory::RootInit() {
@@ -318,6 +331,22 @@ void SystemRewriteDriverFactory::SharedCircularBufferInit(bool is_root) {
   }
 }
 
+void SystemRewriteDriverFactory::UserAgentCacheInit(bool is_root) {
+  if (shared_mem_runtime() == NULL || user_agent_cache_entries_ <= 0) {
+    return;
+  }
+  user_agent_matcher()->set_capability_cache(NULL);
+  user_agent_cache_.reset(new SharedMemUserAgentCache(
+      shared_mem_runtime(),
+      StrCat(filename_prefix(), kUserAgentCacheSegment),
+      user_agent_cache_entries_, statistics(), message_handler()));
+  bool ok = is_root ? user_agent_cache_->Initialize()
+                    : user_agent_cache_->Attach();
+  if (ok) {
+    user_agent_matcher()->set_capability_cache(user_agent_cache_.get());
+  }
+}
+
 RewriteOptions::OptionSettingResult
 SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
                                                StringPiece arg,
@@ -337,6 +366,7 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
   } else if (StringCaseEqual(option, kForceCaching) ||
              StringCaseEqual(option, kListOutstandingUrlsOnError) ||
              StringCaseEqual(option, kMessageBufferSize) ||
+             StringCaseEqual(option, kUserAgentCacheEntries) ||
              StringCaseEqual(option, kTrackOriginalContentLength)) {
     if (!process_scope) {
       // msg is only printed to the user on error, so warnings must be logged.
@@ -384,6 +414,7 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
   // Values of 0 have special meanings:
   //   Num(Expensive)RewriteThreads: autodetect (see AutoDetectThreadCounts())
   //   MessageBufferSize: disable the message buffer
+  //   UserAgentCacheEntries: disable the user-agent capability cache
   int int_value = 0;
   RewriteOptions::OptionSettingResult parsed_as_int =
       RewriteOptions::ParseFromString(arg, &int_value) ?
@@ -397,6 +428,9 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
   } else if (StringCaseEqual(option, kMessageBufferSize)) {
     set_message_buffer_size(int_value);
     return parsed_as_int;
+  } else if (StringCaseEqual(option, kUserAgentCacheEntries)) {
+    set_user_agent_cache_entries(int_value);
+    return parsed_as_int;
   }
 
   LOG(FATAL) << "Unknown options should have been handled in scope checking.";
@@ -523,6 +557,12 @@ void SystemRewriteDriverFactory::ShutDown() {
     if (shared_circular_buffer_ != NULL) {
       shared_circular_buffer_->GlobalCleanup(&handler);
     }
+
+    if (user_agent_cache_.get() != NULL) {
+      SharedMemUserAgentCache::GlobalCleanup(
+          shared_mem_runtime_.get(),
+          StrCat(filename_prefix(), kUserAgentCacheSegment), &handler);
+    }
   }
 }
 
@@ -41,6 +41,7 @@ class QueuedWorkerPool;
 class ServerContext;
 class SharedCircularBuffer;
 class SharedMemStatistics;
+class SharedMemUserAgentCache;
 class StaticAssetManager;
 class Statistics;
 class SystemCaches;
@@ -137,6 +138,11 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   // root (ie. parent) process.
   void SharedCircularBufferInit(bool is_root);
 
+  // Initialize the SharedMemUserAgentCache and hook it up to the
+  // UserAgentMatcher, if user_agent_cache_entries_ is non-zero. is_root is
+  // true if this is invoked from root (ie. parent) process.
+  void UserAgentCacheInit(bool is_root);
+
   // Most options are parsed by and applied to the RewriteOptions via
   // ParseAndSetOptionFromNameN, but process-scope options need to be set on the
   // rewrite driver factory.
@@ -184,6 +190,12 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
     message_buffer_size_ = x;
   }
 
+  // Number of user-agents whose capabilities are cached in shared memory
+  // by UserAgentMatcher; 0 (the default) disables the cache.
+  void set_user_agent_cache_entries(int x) {
+    user_agent_cache_entries_ = x;
+  }
+
   // Finds a fetcher for the settings in this config, sharing with
   // existing fetchers if possible, otherwise making a new one (and
   // its required thread).
@@ -329,6 +341,7 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   StringVector local_shm_stats_segment_names_;
   scoped_ptr<AbstractSharedMem> shared_mem_runtime_;
   scoped_ptr<SharedCircularBuffer> shared_circular_buffer_;
+  scoped_ptr<SharedMemUserAgentCache> user_agent_cache_;
 
   bool statistics_frozen_;
   bool is_root_process_;
@@ -342,6 +355,9 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   // /pagespeed_messages (or /mod_pagespeed_messages, /ngx_pagespeed_messages)
   int message_buffer_size_;
 
+  // Number of entries in user_agent_cache_, 0 to disable it.
+  int user_agent_cache_entries_;
+
   // Manages all our caches & lock managers.
   scoped_ptr<SystemCaches> caches_;
 
@@ -30,6 +30,9 @@ namespace {
 const int64 kDefaultCacheFlushIntervalSec = 5;
 
 const char kFetchHttps[] = "FetchHttps";
+const char kPropertyCacheInternMinBytes[] = "PropertyCacheInternMinBytes";
+const char kMemcachedAdaptiveBatching[] = "MemcachedAdaptiveBatching";
+const char kTraceSpanBufferSize[] = "TraceSpanBufferSize";
 
 }  // namespace
 
@@ -92,6 +95,13 @@ void SystemRewriteOptions::AddProperties() {
                     RewriteOptions::kMemcachedTimeoutUs,
                     "Maximum time in microseconds to allow for memcached "
                         "transactions", true);
+  AddSystemProperty(false,
+                    &SystemRewriteOptions::memcached_adaptive_batching_, "amab",
+                    kMemcachedAdaptiveBatching,
+                    "Tune the number of parallel memcached lookups and the "
+                        "number of keys batched into each from the observed "
+                        "lookup latency.  Ignored if MemcachedThreads is 0",
+                    true);
   AddSystemProperty(50 * Timer::kMsUs,  // 50 ms
                     &SystemRewriteOptions::slow_file_latency_threshold_us_,
                     "asflt", "SlowFileLatencyUs",
@@ -162,6 +172,19 @@ void SystemRewriteOptions::AddProperties() {
                     "acfpi", RewriteOptions::kCacheFlushPollIntervalSec,
                     "Number of seconds to wait between polling for cache-flush "
                         "requests", true);
+  AddSystemProperty(0,
+                    &SystemRewriteOptions::property_cache_intern_min_bytes_,
+                    "apcim", kPropertyCacheInternMinBytes,
+                    "Store property cache values of at least this many bytes "
+                    "once, shared by all pages with the same value, rather "
+                    "than once per page.  0 to disable.  Versions without "
+                    "this option read such values as empty, so flush the "
+                    "cache before downgrading.", true);
+  AddSystemProperty(0, &SystemRewriteOptions::trace_span_buffer_size_,
+                    "atsb", kTraceSpanBufferSize,
+                    "Number of per-request timing spans each process keeps "
+                    "for the admin trace page, rounded up to a power of two.  "
+                    "0 to disable.", true);
   AddSystemProperty(true,
                     &SystemRewriteOptions::compress_metadata_cache_,
                     "cc", RewriteOptions::kCompressMetadataCache,
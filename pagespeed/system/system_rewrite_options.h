@@ -101,6 +101,18 @@ class SystemRewriteOptions : public RewriteOptions {
   void set_use_shared_mem_locking(bool x) {
     set_option(x, &use_shared_mem_locking_);
   }
+  int64 property_cache_intern_min_bytes() const {
+    return property_cache_intern_min_bytes_.value();
+  }
+  void set_property_cache_intern_min_bytes(int64 x) {
+    set_option(x, &property_cache_intern_min_bytes_);
+  }
+  int trace_span_buffer_size() const {
+    return trace_span_buffer_size_.value();
+  }
+  void set_trace_span_buffer_size(int x) {
+    set_option(x, &trace_span_buffer_size_);
+  }
   bool compress_metadata_cache() const {
     return compress_metadata_cache_.value();
   }
@@ -163,6 +175,12 @@ class SystemRewriteOptions : public RewriteOptions {
   void set_memcached_timeout_us(int x) {
     set_option(x, &memcached_timeout_us_);
   }
+  bool memcached_adaptive_batching() const {
+    return memcached_adaptive_batching_.value();
+  }
+  void set_memcached_adaptive_batching(bool x) {
+    set_option(x, &memcached_adaptive_batching_);
+  }
   int64 slow_file_latency_threshold_us() const {
     return slow_file_latency_threshold_us_.value();
   }
@@ -434,6 +452,7 @@ class SystemRewriteOptions : public RewriteOptions {
 
   Option<int> memcached_threads_;
   Option<int> memcached_timeout_us_;
+  Option<bool> memcached_adaptive_batching_;
 
   Option<int64> slow_file_latency_threshold_us_;
   Option<int64> file_cache_clean_inode_limit_;
@@ -450,6 +469,8 @@ class SystemRewriteOptions : public RewriteOptions {
   Option<int64> ipro_max_response_bytes_;
   Option<int64> ipro_max_concurrent_recordings_;
   Option<int64> default_shared_memory_cache_kb_;
+  Option<int64> property_cache_intern_min_bytes_;
+  Option<int> trace_span_buffer_size_;
   Option<GoogleString> purge_method_;
 
   StaticAssetCDNOptions static_assets_to_cdn_;
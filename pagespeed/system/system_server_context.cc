@@ -39,6 +39,7 @@
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/base/trace_span_ring.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_statistics.h"
 
 namespace net_instaweb {
@@ -285,6 +286,12 @@ void SystemServerContext::ChildInit(SystemRewriteDriverFactory* factory) {
         thread_system()->NewRWLock());
     factory->InitServerContext(this);
 
+    int trace_span_buffer_size =
+        global_system_rewrite_options()->trace_span_buffer_size();
+    if (trace_span_buffer_size > 0) {
+      set_trace_spans(new TraceSpanRing(trace_span_buffer_size, timer()));
+    }
+
     html_rewrite_time_us_histogram_ = statistics()->GetHistogram(
         kHtmlRewriteTimeUsHistogram);
     html_rewrite_time_us_histogram_->SetMaxValue(2 * Timer::kSecondUs);